@@ -38,6 +38,8 @@
       'sources': [
         'leveldb/db/builder.cc',
         'leveldb/db/builder.h',
+        'leveldb/db/column_family.cc',
+        'leveldb/db/column_family.h',
         'leveldb/db/db_impl.cc',
         'leveldb/db/db_impl.h',
         'leveldb/db/db_iter.cc',
@@ -53,9 +55,15 @@
         'leveldb/db/log_writer.h',
         'leveldb/db/memtable.cc',
         'leveldb/db/memtable.h',
+        'leveldb/db/memtablerep.cc',
+        'leveldb/db/merge_helper.cc',
+        'leveldb/db/merge_helper.h',
+        'leveldb/db/range_del.cc',
+        'leveldb/db/range_del.h',
         'leveldb/db/repair.cc',
         'leveldb/db/skiplist.h',
         'leveldb/db/snapshot.h',
+        'leveldb/db/sst_file_writer.cc',
         'leveldb/db/table_cache.cc',
         'leveldb/db/table_cache.h',
         'leveldb/db/version_edit.cc',
@@ -67,13 +75,21 @@
         'leveldb/helpers/memenv/memenv.cc',
         'leveldb/helpers/memenv/memenv.h',
         'leveldb/include/leveldb/cache.h',
+        'leveldb/include/leveldb/compaction_filter.h',
         'leveldb/include/leveldb/comparator.h',
+        'leveldb/include/leveldb/compressor.h',
         'leveldb/include/leveldb/db.h',
         'leveldb/include/leveldb/env.h',
         'leveldb/include/leveldb/filter_policy.h',
         'leveldb/include/leveldb/iterator.h',
+        'leveldb/include/leveldb/memtablerep.h',
+        'leveldb/include/leveldb/merge_operator.h',
         'leveldb/include/leveldb/options.h',
+        'leveldb/include/leveldb/perf_context.h',
+        'leveldb/include/leveldb/rate_limiter.h',
         'leveldb/include/leveldb/slice.h',
+        'leveldb/include/leveldb/slice_transform.h',
+        'leveldb/include/leveldb/sst_file_writer.h',
         'leveldb/include/leveldb/status.h',
         'leveldb/include/leveldb/table.h',
         'leveldb/include/leveldb/table_builder.h',
@@ -85,6 +101,8 @@
         'leveldb/table/block.h',
         'leveldb/table/block_builder.cc',
         'leveldb/table/block_builder.h',
+        'leveldb/table/block_hash_index.cc',
+        'leveldb/table/block_hash_index.h',
         'leveldb/table/filter_block.cc',
         'leveldb/table/filter_block.h',
         'leveldb/table/format.cc',
@@ -93,6 +111,8 @@
         'leveldb/table/iterator_wrapper.h',
         'leveldb/table/merger.cc',
         'leveldb/table/merger.h',
+        'leveldb/table/readahead_file.cc',
+        'leveldb/table/readahead_file.h',
         'leveldb/table/table.cc',
         'leveldb/table/table_builder.cc',
         'leveldb/table/two_level_iterator.cc',
@@ -103,7 +123,9 @@
         'leveldb/util/cache.cc',
         'leveldb/util/coding.cc',
         'leveldb/util/coding.h',
+        'leveldb/util/compaction_filter.cc',
         'leveldb/util/comparator.cc',
+        'leveldb/util/compressor.cc',
         'leveldb/util/crc32c.cc',
         'leveldb/util/crc32c.h',
         'leveldb/util/env.cc',
@@ -111,11 +133,19 @@
         'leveldb/util/filter_policy.cc',
         'leveldb/util/hash.cc',
         'leveldb/util/hash.h',
+        'leveldb/util/histogram.cc',
+        'leveldb/util/histogram.h',
         'leveldb/util/logging.cc',
         'leveldb/util/logging.h',
+        'leveldb/util/merge_operator.cc',
         'leveldb/util/mutexlock.h',
         'leveldb/util/options.cc',
+        'leveldb/util/perf_context.cc',
+        'leveldb/util/perf_context_imp.h',
         'leveldb/util/random.h',
+        'leveldb/util/rate_limiter.cc',
+        'leveldb/util/rate_limiter.h',
+        'leveldb/util/slice_transform.cc',
         'leveldb/util/status.cc',
       ],
     },
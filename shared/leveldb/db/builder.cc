@@ -4,6 +4,7 @@
 
 #include "db/builder.h"
 
+#include <algorithm>
 #include "db/filename.h"
 #include "db/dbformat.h"
 #include "db/table_cache.h"
@@ -11,9 +12,21 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
+Options TableOptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  const std::vector<CompressionType>& per_level =
+      options.compression_per_level;
+  if (!per_level.empty()) {
+    const size_t i = std::min(static_cast<size_t>(level), per_level.size() - 1);
+    result.compression = per_level[i];
+  }
+  return result;
+}
+
 Status BuildTable(const std::string& dbname,
                   Env* env,
                   const Options& options,
@@ -22,6 +35,7 @@ Status BuildTable(const std::string& dbname,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->range_dels.clear();
   iter->SeekToFirst();
 
   std::string fname = TableFileName(dbname, meta->number);
@@ -31,12 +45,25 @@ Status BuildTable(const std::string& dbname,
     if (!s.ok()) {
       return s;
     }
+    if (options.rate_limiter != NULL) {
+      file = NewRateLimitedWritableFile(file, options.rate_limiter,
+                                        Env::kHighPriority);
+    }
 
     TableBuilder* builder = new TableBuilder(options, file);
     meta->smallest.DecodeFrom(iter->key());
+    meta->largest_seqno = 0;
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
+      const SequenceNumber seq = ExtractSequenceNumber(key);
+      if (seq > meta->largest_seqno) {
+        meta->largest_seqno = seq;
+      }
+      if (ExtractValueType(key) == kTypeRangeDeletion) {
+        meta->range_dels.push_back(
+            RangeTombstone(ExtractUserKey(key), iter->value(), seq));
+      }
       builder->Add(key, iter->value());
     }
 
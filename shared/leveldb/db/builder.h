@@ -17,9 +17,14 @@ class Iterator;
 class TableCache;
 class VersionEdit;
 
+// Return a copy of "options" for building the tables of "level", i.e.,
+// with the compression that options.compression_per_level asks for.
+extern Options TableOptionsForLevel(const Options& options, int level);
+
 // Build a Table file from the contents of *iter.  The generated file
 // will be named according to meta->number.  On success, the rest of
-// *meta will be filled with metadata about the generated table.
+// *meta will be filled with metadata about the generated table,
+// including its largest sequence number.
 // If no data is present in *iter, meta->file_size will be set to
 // zero, and no Table file will be produced.
 extern Status BuildTable(const std::string& dbname,
@@ -13,6 +13,8 @@
 #include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 #include "leveldb/write_batch.h"
 
@@ -28,10 +30,14 @@ using leveldb::kMajorVersion;
 using leveldb::kMinorVersion;
 using leveldb::Logger;
 using leveldb::NewBloomFilterPolicy;
+using leveldb::NewClockCache;
 using leveldb::NewLRUCache;
+using leveldb::NewRateLimiter;
 using leveldb::Options;
+using leveldb::PerfLevel;
 using leveldb::RandomAccessFile;
 using leveldb::Range;
+using leveldb::RateLimiter;
 using leveldb::ReadOptions;
 using leveldb::SequentialFile;
 using leveldb::Slice;
@@ -51,6 +57,7 @@ struct leveldb_readoptions_t  { ReadOptions       rep; };
 struct leveldb_writeoptions_t { WriteOptions      rep; };
 struct leveldb_options_t      { Options           rep; };
 struct leveldb_cache_t        { Cache*            rep; };
+struct leveldb_ratelimiter_t  { RateLimiter*      rep; };
 struct leveldb_seqfile_t      { SequentialFile*   rep; };
 struct leveldb_randomfile_t   { RandomAccessFile* rep; };
 struct leveldb_writablefile_t { WritableFile*     rep; };
@@ -215,6 +222,37 @@ char* leveldb_get(
   return result;
 }
 
+void leveldb_multiget(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    size_t num_keys,
+    const char* const* keys_list,
+    const size_t* keys_list_sizes,
+    char** values_list,
+    size_t* values_list_sizes,
+    char** errs) {
+  std::vector<Slice> keys(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    keys[i] = Slice(keys_list[i], keys_list_sizes[i]);
+  }
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db->rep->MultiGet(options->rep, keys, &values, &statuses);
+  for (size_t i = 0; i < num_keys; i++) {
+    errs[i] = NULL;
+    if (statuses[i].ok()) {
+      values_list[i] = CopyString(values[i]);
+      values_list_sizes[i] = values[i].size();
+    } else {
+      values_list[i] = NULL;
+      values_list_sizes[i] = 0;
+      if (!statuses[i].IsNotFound()) {
+        errs[i] = strdup(statuses[i].ToString().c_str());
+      }
+    }
+  }
+}
+
 leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db,
     const leveldb_readoptions_t* options) {
@@ -438,6 +476,11 @@ void leveldb_options_set_cache(leveldb_options_t* opt, leveldb_cache_t* c) {
   opt->rep.block_cache = c->rep;
 }
 
+void leveldb_options_set_rate_limiter(leveldb_options_t* opt,
+                                      leveldb_ratelimiter_t* limiter) {
+  opt->rep.rate_limiter = (limiter != NULL) ? limiter->rep : NULL;
+}
+
 void leveldb_options_set_block_size(leveldb_options_t* opt, size_t s) {
   opt->rep.block_size = s;
 }
@@ -450,6 +493,21 @@ void leveldb_options_set_compression(leveldb_options_t* opt, int t) {
   opt->rep.compression = static_cast<CompressionType>(t);
 }
 
+void leveldb_options_set_compression_per_level(leveldb_options_t* opt,
+                                               const int* level_values,
+                                               size_t num_levels) {
+  opt->rep.compression_per_level.clear();
+  for (size_t i = 0; i < num_levels; i++) {
+    opt->rep.compression_per_level.push_back(
+        static_cast<CompressionType>(level_values[i]));
+  }
+}
+
+void leveldb_options_set_compression_dict_bytes(leveldb_options_t* opt,
+                                                size_t n) {
+  opt->rep.compression_dict_bytes = n;
+}
+
 leveldb_comparator_t* leveldb_comparator_create(
     void* state,
     void (*destructor)(void*),
@@ -563,11 +621,28 @@ leveldb_cache_t* leveldb_cache_create_lru(size_t capacity) {
   return c;
 }
 
+leveldb_cache_t* leveldb_cache_create_clock(size_t capacity) {
+  leveldb_cache_t* c = new leveldb_cache_t;
+  c->rep = NewClockCache(capacity);
+  return c;
+}
+
 void leveldb_cache_destroy(leveldb_cache_t* cache) {
   delete cache->rep;
   delete cache;
 }
 
+leveldb_ratelimiter_t* leveldb_ratelimiter_create(uint64_t bytes_per_second) {
+  leveldb_ratelimiter_t* limiter = new leveldb_ratelimiter_t;
+  limiter->rep = NewRateLimiter(bytes_per_second);
+  return limiter;
+}
+
+void leveldb_ratelimiter_destroy(leveldb_ratelimiter_t* limiter) {
+  delete limiter->rep;
+  delete limiter;
+}
+
 leveldb_env_t* leveldb_create_default_env() {
   leveldb_env_t* result = new leveldb_env_t;
   result->rep = Env::Default();
@@ -580,6 +655,18 @@ void leveldb_env_destroy(leveldb_env_t* env) {
   delete env;
 }
 
+void leveldb_set_perf_level(int level) {
+  leveldb::SetPerfLevel(static_cast<PerfLevel>(level));
+}
+
+void leveldb_perf_context_reset() {
+  leveldb::GetPerfContext()->Reset();
+}
+
+char* leveldb_perf_context_report() {
+  return strdup(leveldb::GetPerfContext()->ToString().c_str());
+}
+
 void leveldb_free(void* ptr) {
   free(ptr);
 }
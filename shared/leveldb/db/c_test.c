@@ -158,6 +158,7 @@ int main(int argc, char** argv) {
   leveldb_t* db;
   leveldb_comparator_t* cmp;
   leveldb_cache_t* cache;
+  leveldb_ratelimiter_t* limiter;
   leveldb_env_t* env;
   leveldb_options_t* options;
   leveldb_readoptions_t* roptions;
@@ -177,11 +178,13 @@ int main(int argc, char** argv) {
   cmp = leveldb_comparator_create(NULL, CmpDestroy, CmpCompare, CmpName);
   env = leveldb_create_default_env();
   cache = leveldb_cache_create_lru(100000);
+  limiter = leveldb_ratelimiter_create(100 << 20);
 
   options = leveldb_options_create();
   leveldb_options_set_comparator(options, cmp);
   leveldb_options_set_error_if_exists(options, 1);
   leveldb_options_set_cache(options, cache);
+  leveldb_options_set_rate_limiter(options, limiter);
   leveldb_options_set_env(options, env);
   leveldb_options_set_info_log(options, NULL);
   leveldb_options_set_write_buffer_size(options, 100000);
@@ -190,6 +193,11 @@ int main(int argc, char** argv) {
   leveldb_options_set_block_size(options, 1024);
   leveldb_options_set_block_restart_interval(options, 8);
   leveldb_options_set_compression(options, leveldb_no_compression);
+  {
+    const int levels[] = { leveldb_no_compression, leveldb_zlib_compression };
+    leveldb_options_set_compression_per_level(options, levels, 2);
+  }
+  leveldb_options_set_compression_dict_bytes(options, 1024);
 
   roptions = leveldb_readoptions_create();
   leveldb_readoptions_set_verify_checksums(roptions, 1);
@@ -245,6 +253,23 @@ int main(int argc, char** argv) {
     CheckGet(db, roptions, "foo", "hello");
     CheckGet(db, roptions, "bar", NULL);
     CheckGet(db, roptions, "box", "c");
+    {
+      const char* keys[3] = { "box", "bar", "foo" };
+      size_t key_sizes[3] = { 3, 3, 3 };
+      char* vals[3];
+      size_t val_sizes[3];
+      char* errs[3];
+      leveldb_multiget(db, roptions, 3, keys, key_sizes, vals, val_sizes,
+                       errs);
+      CheckNoError(errs[0]);
+      CheckNoError(errs[1]);
+      CheckNoError(errs[2]);
+      CheckEqual("c", vals[0], val_sizes[0]);
+      CheckEqual(NULL, vals[1], val_sizes[1]);
+      CheckEqual("hello", vals[2], val_sizes[2]);
+      Free(&vals[0]);
+      Free(&vals[2]);
+    }
     int pos = 0;
     leveldb_writebatch_iterate(wb, &pos, CheckPut, CheckDel);
     CheckCondition(pos == 3);
@@ -304,6 +329,24 @@ int main(int argc, char** argv) {
     prop = leveldb_property_value(db, "leveldb.stats");
     CheckCondition(prop != NULL);
     Free(&prop);
+    prop = leveldb_property_value(db, "leveldb.latency.get");
+    CheckCondition(prop != NULL);
+    Free(&prop);
+  }
+
+  StartPhase("perf_context");
+  {
+    char* report;
+    leveldb_set_perf_level(leveldb_perf_enable_time);
+    leveldb_perf_context_reset();
+    report = leveldb_perf_context_report();
+    CheckCondition(strcmp(report, "") == 0);
+    Free(&report);
+    CheckGet(db, roptions, "foo", "hello");
+    report = leveldb_perf_context_report();
+    CheckCondition(strstr(report, "get_from_") != NULL);
+    Free(&report);
+    leveldb_set_perf_level(leveldb_perf_enable_count);
   }
 
   StartPhase("snapshot");
@@ -382,6 +425,7 @@ int main(int argc, char** argv) {
   leveldb_readoptions_destroy(roptions);
   leveldb_writeoptions_destroy(woptions);
   leveldb_cache_destroy(cache);
+  leveldb_ratelimiter_destroy(limiter);
   leveldb_comparator_destroy(cmp);
   leveldb_env_destroy(env);
 
@@ -0,0 +1,68 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/column_family.h"
+
+#include "db/memtable.h"
+#include "db/table_cache.h"
+
+namespace leveldb {
+
+ColumnFamilyData::ColumnFamilyData(const Options* options,
+                                   TableCache* table_cache,
+                                   const InternalKeyComparator& icmp)
+    : id_(0),
+      name_(kDefaultColumnFamilyName),
+      icmp_(icmp),
+      ipolicy_(NULL, NULL),
+      options_(options),
+      table_cache_(table_cache),
+      owns_table_cache_(false),
+      mem_(NULL),
+      imm_(NULL),
+      dummy_versions_(this),
+      current_(NULL),
+      log_number_(0),
+      dropped_(false) {
+}
+
+ColumnFamilyData::ColumnFamilyData(uint32_t id, const std::string& name,
+                                   const Options& options,
+                                   TableCache* table_cache)
+    : id_(id),
+      name_(name),
+      icmp_(options.comparator),
+      ipolicy_(options.filter_policy, options.prefix_extractor),
+      owned_options_(options),
+      options_(&owned_options_),
+      table_cache_(NULL),
+      owns_table_cache_(false),
+      mem_(NULL),
+      imm_(NULL),
+      dummy_versions_(this),
+      current_(NULL),
+      log_number_(0),
+      dropped_(false) {
+  owned_options_.comparator = &icmp_;
+  owned_options_.filter_policy =
+      (options.filter_policy != NULL) ? &ipolicy_ : NULL;
+  if (table_cache != NULL) {
+    table_cache_ = new TableCache(table_cache, options_);
+    owns_table_cache_ = true;
+  }
+}
+
+ColumnFamilyData::~ColumnFamilyData() {
+  assert(current_ == NULL);
+  assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
+  if (mem_ != NULL) mem_->Unref();
+  if (imm_ != NULL) imm_->Unref();
+  if (owns_table_cache_) {
+    delete table_cache_;
+  }
+}
+
+ColumnFamilyHandleImpl::~ColumnFamilyHandleImpl() { }
+
+}  // namespace leveldb
@@ -0,0 +1,118 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A column family is a key space of a database with its own comparator,
+// table options, memtables and table files.  The column families of a
+// database share its log, its manifest, its file and sequence numbers
+// and its background threads.
+//
+// ColumnFamilyData requires external synchronization (the DB mutex) for
+// everything that is not constant after construction.
+
+#ifndef STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+#define STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+
+#include <string>
+#include "db/dbformat.h"
+#include "db/version_set.h"
+#include "leveldb/db.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class MemTable;
+class TableCache;
+
+class ColumnFamilyData {
+ public:
+  uint32_t id() const { return id_; }
+  const std::string& name() const { return name_; }
+
+  // The options that tables of this family are built and read with.
+  // options().comparator == &internal_comparator().
+  const Options& options() const { return *options_; }
+  const InternalKeyComparator& internal_comparator() const { return icmp_; }
+  const Comparator* user_comparator() const {
+    return icmp_.user_comparator();
+  }
+  TableCache* table_cache() const { return table_cache_; }
+
+  // Return the current version, or NULL once the family is dropped.
+  Version* current() const { return current_; }
+
+  bool IsDropped() const { return dropped_; }
+
+  // Entries of this family in logs older than this one are all in its
+  // table files.
+  uint64_t log_number() const { return log_number_; }
+
+  // The memtable that writes go to, and the one being flushed (if any).
+  // The family releases a reference to each when it is destroyed.
+  MemTable* mem() const { return mem_; }
+  MemTable* imm() const { return imm_; }
+  void SetMemTable(MemTable* mem) { mem_ = mem; }
+  void SetImmutableMemTable(MemTable* imm) { imm_ = imm; }
+
+ private:
+  friend class Version;
+  friend class VersionSet;
+
+  // The default column family, whose options and table cache belong to
+  // the caller.
+  ColumnFamilyData(const Options* options, TableCache* table_cache,
+                   const InternalKeyComparator& icmp);
+
+  // The column family "name".  "options" are sanitized options that
+  // hold the user comparator and filter policy of the family.  Tables
+  // are kept in the cache of "table_cache", unless it is NULL.
+  ColumnFamilyData(uint32_t id, const std::string& name,
+                   const Options& options, TableCache* table_cache);
+
+  ~ColumnFamilyData();
+
+  const uint32_t id_;
+  const std::string name_;
+  const InternalKeyComparator icmp_;
+  const InternalFilterPolicy ipolicy_;
+  Options owned_options_;
+  const Options* options_;
+  TableCache* table_cache_;
+  bool owns_table_cache_;
+
+  MemTable* mem_;
+  MemTable* imm_;
+
+  Version dummy_versions_;  // Head of circular doubly-linked list of versions.
+  Version* current_;        // == dummy_versions_.prev_
+
+  // Per-level key at which the next compaction at that level should start.
+  // Either an empty string, or a valid InternalKey.
+  std::string compact_pointer_[config::kNumLevels];
+
+  uint64_t log_number_;
+  bool dropped_;
+
+  // No copying allowed
+  ColumnFamilyData(const ColumnFamilyData&);
+  void operator=(const ColumnFamilyData&);
+};
+
+// The ColumnFamilyHandle that DBImpl hands out.
+class ColumnFamilyHandleImpl : public ColumnFamilyHandle {
+ public:
+  explicit ColumnFamilyHandleImpl(ColumnFamilyData* cfd) : cfd_(cfd) { }
+  virtual ~ColumnFamilyHandleImpl();
+
+  virtual const std::string& GetName() const { return cfd_->name(); }
+  virtual uint32_t GetID() const { return cfd_->id(); }
+
+  ColumnFamilyData* cfd() const { return cfd_; }
+
+ private:
+  ColumnFamilyData* const cfd_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
@@ -0,0 +1,360 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "leveldb/db.h"
+#include "db/db_impl.h"
+#include "leveldb/comparator.h"
+#include "leveldb/sst_file_writer.h"
+#include "leveldb/write_batch.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+namespace {
+// Orders keys from last to first.
+class ReverseComparator : public Comparator {
+ public:
+  virtual const char* Name() const { return "test.ReverseComparator"; }
+  virtual int Compare(const Slice& a, const Slice& b) const {
+    return -BytewiseComparator()->Compare(a, b);
+  }
+  virtual void FindShortestSeparator(std::string* start,
+                                     const Slice& limit) const { }
+  virtual void FindShortSuccessor(std::string* key) const { }
+};
+}  // namespace
+
+class ColumnFamilyTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  DB* db_;
+  std::vector<ColumnFamilyHandle*> handles_;
+  ReverseComparator reverse_;
+
+  ColumnFamilyTest() : db_(NULL) {
+    dbname_ = test::TmpDir() + "/column_family_test";
+    DestroyDB(dbname_, Options());
+    options_.create_if_missing = true;
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  ~ColumnFamilyTest() {
+    Close();
+    DestroyDB(dbname_, Options());
+  }
+
+  void Close() {
+    for (size_t i = 0; i < handles_.size(); i++) {
+      delete handles_[i];
+    }
+    handles_.clear();
+    delete db_;
+    db_ = NULL;
+  }
+
+  // Return descriptors of the default family and the families "names".
+  std::vector<ColumnFamilyDescriptor> Descriptors(
+      const std::vector<std::string>& names) {
+    std::vector<ColumnFamilyDescriptor> families;
+    families.push_back(ColumnFamilyDescriptor());
+    for (size_t i = 0; i < names.size(); i++) {
+      Options options;
+      if (names[i] == "reverse") {
+        options.comparator = &reverse_;
+      }
+      families.push_back(ColumnFamilyDescriptor(names[i], options));
+    }
+    return families;
+  }
+
+  // Open the DB with the default family and the families "names".
+  Status TryOpen(const std::vector<std::string>& names) {
+    Close();
+    return DB::Open(options_, dbname_, Descriptors(names), &handles_, &db_);
+  }
+
+  void Create(const std::string& name) {
+    Options options;
+    if (name == "reverse") {
+      options.comparator = &reverse_;
+    }
+    ColumnFamilyHandle* handle;
+    ASSERT_OK(db_->CreateColumnFamily(options, name, &handle));
+    handles_.push_back(handle);
+  }
+
+  std::string Get(ColumnFamilyHandle* cf, const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), cf, k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  std::string Contents(ColumnFamilyHandle* cf) {
+    std::string result;
+    Iterator* iter = db_->NewIterator(ReadOptions(), cf);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result.append(iter->key().ToString());
+      result.append("=");
+      result.append(iter->value().ToString());
+      result.append(" ");
+    }
+    delete iter;
+    return result;
+  }
+
+  std::vector<std::string> List() {
+    std::vector<std::string> names;
+    ASSERT_OK(DB::ListColumnFamilies(options_, dbname_, &names));
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+};
+
+TEST(ColumnFamilyTest, CreateAndReopen) {
+  Create("one");
+  Create("two");
+  ColumnFamilyHandle* one = handles_[0];
+  ColumnFamilyHandle* two = handles_[1];
+  ASSERT_EQ("one", one->GetName());
+  ASSERT_EQ(kDefaultColumnFamilyName, db_->DefaultColumnFamily()->GetName());
+
+  ASSERT_OK(db_->Put(WriteOptions(), "k", "default"));
+  ASSERT_OK(db_->Put(WriteOptions(), one, "k", "one"));
+  ASSERT_OK(db_->Put(WriteOptions(), two, "k", "two"));
+  ASSERT_OK(db_->Put(WriteOptions(), two, "only-in-two", "x"));
+  ASSERT_EQ("default", Get(db_->DefaultColumnFamily(), "k"));
+  ASSERT_EQ("one", Get(one, "k"));
+  ASSERT_EQ("two", Get(two, "k"));
+  ASSERT_EQ("NOT_FOUND", Get(one, "only-in-two"));
+  ASSERT_OK(db_->Delete(WriteOptions(), one, "k"));
+  ASSERT_EQ("NOT_FOUND", Get(one, "k"));
+  ASSERT_EQ("two", Get(two, "k"));
+
+  std::vector<std::string> names = List();
+  ASSERT_EQ(3, names.size());
+  ASSERT_EQ("default", names[0]);
+  ASSERT_EQ("one", names[1]);
+  ASSERT_EQ("two", names[2]);
+
+  // The log is replayed into each family
+  std::vector<std::string> open;
+  open.push_back("one");
+  open.push_back("two");
+  ASSERT_OK(TryOpen(open));
+  ASSERT_EQ(3, handles_.size());
+  ASSERT_EQ("default", Get(handles_[0], "k"));
+  ASSERT_EQ("NOT_FOUND", Get(handles_[1], "k"));
+  ASSERT_EQ("two", Get(handles_[2], "k"));
+
+  // And so are the tables
+  ASSERT_OK(reinterpret_cast<DBImpl*>(db_)->TEST_CompactMemTable());
+  ASSERT_OK(TryOpen(open));
+  ASSERT_EQ("default", Get(handles_[0], "k"));
+  ASSERT_EQ("two", Get(handles_[2], "k"));
+  ASSERT_EQ("k=two only-in-two=x ", Contents(handles_[2]));
+}
+
+TEST(ColumnFamilyTest, OpenMustNameEveryFamily) {
+  Create("one");
+  std::vector<std::string> open;
+  ASSERT_TRUE(!TryOpen(open).ok());
+  open.push_back("one");
+  open.push_back("missing");
+  ASSERT_TRUE(!TryOpen(open).ok());
+  open.pop_back();
+  ASSERT_OK(TryOpen(open));
+
+  // Open() without column families cannot open the DB either
+  Close();
+  ASSERT_TRUE(!DB::Open(options_, dbname_, &db_).ok());
+}
+
+TEST(ColumnFamilyTest, AtomicBatch) {
+  Create("one");
+  WriteBatch batch;
+  batch.Put("a", "default");
+  batch.Put(handles_[0], "a", "one");
+  batch.Delete(handles_[0], "b");
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "b", "old"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("default", Get(db_->DefaultColumnFamily(), "a"));
+  ASSERT_EQ("one", Get(handles_[0], "a"));
+  ASSERT_EQ("NOT_FOUND", Get(handles_[0], "b"));
+
+  // A snapshot covers every family
+  ReadOptions options;
+  options.snapshot = snapshot;
+  std::string value;
+  ASSERT_TRUE(db_->Get(options, handles_[0], "a", &value).IsNotFound());
+  ASSERT_OK(db_->Get(options, handles_[0], "b", &value));
+  ASSERT_EQ("old", value);
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(ColumnFamilyTest, SeparateComparator) {
+  Create("reverse");
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "a", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "c", "3"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "b", "2"));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "2"));
+  ASSERT_EQ("c=3 b=2 a=1 ", Contents(handles_[0]));
+  ASSERT_EQ("a=1 b=2 ", Contents(db_->DefaultColumnFamily()));
+
+  std::vector<std::string> open;
+  open.push_back("reverse");
+  ASSERT_OK(TryOpen(open));
+  ASSERT_OK(reinterpret_cast<DBImpl*>(db_)->TEST_CompactMemTable());
+  db_->CompactRange(handles_[1], NULL, NULL);
+  ASSERT_EQ("c=3 b=2 a=1 ", Contents(handles_[1]));
+  ASSERT_EQ("2", Get(handles_[1], "b"));
+}
+
+TEST(ColumnFamilyTest, Drop) {
+  Create("one");
+  Create("two");
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "k", "one"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[1], "k", "two"));
+  ASSERT_OK(reinterpret_cast<DBImpl*>(db_)->TEST_CompactMemTable());
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "l", "one"));
+
+  ASSERT_TRUE(!db_->DropColumnFamily(db_->DefaultColumnFamily()).ok());
+  ASSERT_OK(db_->DropColumnFamily(handles_[0]));
+  ASSERT_TRUE(!db_->DropColumnFamily(handles_[0]).ok());
+  ASSERT_TRUE(!db_->Get(ReadOptions(), handles_[0], "k", NULL).ok());
+  ASSERT_TRUE(!db_->Put(WriteOptions(), handles_[0], "k", "v").ok());
+  Iterator* iter = db_->NewIterator(ReadOptions(), handles_[0]);
+  ASSERT_TRUE(!iter->status().ok());
+  delete iter;
+  ASSERT_EQ("two", Get(handles_[1], "k"));
+
+  std::vector<std::string> names = List();
+  ASSERT_EQ(2, names.size());
+  ASSERT_EQ("two", names[1]);
+
+  // The log still holds entries of the dropped family
+  std::vector<std::string> open;
+  open.push_back("two");
+  ASSERT_OK(TryOpen(open));
+  ASSERT_EQ("two", Get(handles_[1], "k"));
+
+  // A new family with the old name starts out empty
+  Create("one");
+  ASSERT_EQ("NOT_FOUND", Get(handles_[2], "k"));
+  ASSERT_EQ("NOT_FOUND", Get(handles_[2], "l"));
+  ASSERT_TRUE(handles_[2]->GetID() > handles_[1]->GetID());
+}
+
+TEST(ColumnFamilyTest, MultiGetAndIngest) {
+  Create("reverse");
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "b", "2"));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "default"));
+
+  // The file is sorted by the family's comparator
+  const std::string fname = test::TmpDir() + "/column_family_test.sst";
+  Options options;
+  options.comparator = &reverse_;
+  SstFileWriter writer(options);
+  ASSERT_OK(writer.Open(fname));
+  ASSERT_OK(writer.Put("d", "4"));
+  ASSERT_OK(writer.Put("c", "3"));
+  ASSERT_OK(writer.Finish());
+  ASSERT_OK(db_->IngestExternalFile(IngestExternalFileOptions(), handles_[0],
+                                    fname));
+  ASSERT_EQ("d=4 c=3 b=2 ", Contents(handles_[0]));
+  ASSERT_EQ("a=default ", Contents(db_->DefaultColumnFamily()));
+
+  std::vector<Slice> keys;
+  keys.push_back("a");
+  keys.push_back("c");
+  keys.push_back("b");
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), handles_[0], keys, &values, &statuses);
+  ASSERT_EQ(3, values.size());
+  ASSERT_TRUE(statuses[0].IsNotFound());
+  ASSERT_OK(statuses[1]);
+  ASSERT_EQ("3", values[1]);
+  ASSERT_OK(statuses[2]);
+  ASSERT_EQ("2", values[2]);
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  ASSERT_OK(statuses[0]);
+  ASSERT_EQ("default", values[0]);
+  ASSERT_TRUE(statuses[1].IsNotFound());
+
+  std::vector<std::string> open;
+  open.push_back("reverse");
+  ASSERT_OK(TryOpen(open));
+  ASSERT_EQ("d=4 c=3 b=2 ", Contents(handles_[1]));
+
+  ASSERT_OK(db_->DropColumnFamily(handles_[1]));
+  db_->MultiGet(ReadOptions(), handles_[1], keys, &values, &statuses);
+  ASSERT_TRUE(!statuses[1].ok() && !statuses[1].IsNotFound());
+  ASSERT_TRUE(!db_->IngestExternalFile(IngestExternalFileOptions(),
+                                       handles_[1], fname).ok());
+  Env::Default()->DeleteFile(fname);
+}
+
+TEST(ColumnFamilyTest, Repair) {
+  Create("one");
+  Create("reverse");
+  ASSERT_OK(db_->Put(WriteOptions(), "k", "default"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "k", "one"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[1], "a", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[1], "c", "3"));
+  ASSERT_OK(reinterpret_cast<DBImpl*>(db_)->TEST_CompactMemTable());
+  // These are only in the log
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "l", "one"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[1], "b", "2"));
+  ASSERT_OK(db_->Delete(WriteOptions(), handles_[1], "c"));
+  Close();
+
+  // The options of every family are needed
+  std::vector<std::string> names;
+  names.push_back("one");
+  Status s = RepairDB(dbname_, options_);
+  ASSERT_EQ(0, s.ToString().find("Invalid argument: "));
+  s = RepairDB(dbname_, options_, Descriptors(names));
+  ASSERT_EQ(0, s.ToString().find("Invalid argument: reverse"));
+
+  // Each family gets back its own tables and log entries
+  names.push_back("reverse");
+  ASSERT_OK(RepairDB(dbname_, options_, Descriptors(names)));
+  ASSERT_OK(TryOpen(names));
+  ASSERT_EQ("k=default ", Contents(handles_[0]));
+  ASSERT_EQ("k=one l=one ", Contents(handles_[1]));
+  ASSERT_EQ("b=2 a=1 ", Contents(handles_[2]));
+  ASSERT_EQ("NOT_FOUND", Get(handles_[2], "k"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[2], "d", "4"));
+  ASSERT_EQ("d=4 b=2 a=1 ", Contents(handles_[2]));
+  Close();
+
+  // The family of a table cannot be told without a descriptor
+  std::vector<std::string> files;
+  ASSERT_OK(Env::Default()->GetChildren(dbname_, &files));
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i].compare(0, 8, "MANIFEST") == 0) {
+      ASSERT_OK(Env::Default()->DeleteFile(dbname_ + "/" + files[i]));
+    }
+  }
+  s = RepairDB(dbname_, options_, Descriptors(names));
+  ASSERT_EQ(0, s.ToString().find("Not implemented: "));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
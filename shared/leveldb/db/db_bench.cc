@@ -5,13 +5,24 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <vector>
 #include "db/db_impl.h"
+#include "db/filename.h"
+#include "db/memtable.h"
 #include "db/version_set.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/table.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -27,18 +38,34 @@
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      updaterandom  -- add one to N counters in random order, reading
+//                       each with Get() and writing it back with Put()
+//      mergerandom   -- add one to N counters in random order with Merge()
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, 100 keys per
+//                       MultiGet() call
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
+//      filterprobe   -- build a filter over N keys with --filter_policy and
+//                       probe it with R keys, half of which are absent
+//      memtablefill  -- insert N entries into a memtable, one thread at a time
+//      memtablefillconcurrent -- insert N entries into a memtable, with all
+//                       threads inserting at once
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      ratelimiter -- Print the I/O requested from --rate_limit
+//      writestalls -- Print how long writes were delayed and stopped
+//      writeamp    -- Print the bytes written to tables per byte written
+//                     to the DB
+//      compressionstats -- Print the on-disk and uncompressed size of each
+//                       level and the time to scan it
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -76,9 +103,60 @@ static int FLAGS_value_size = 100;
 // their original size after compression
 static double FLAGS_compression_ratio = 0.5;
 
+// Compression of the tables: "none", "snappy" or "zlib"
+static const char* FLAGS_compression_type = "snappy";
+
+// Comma-separated compression of each level, e.g. "none,none,snappy,zlib"
+// (see Options::compression_per_level).  Empty means that all levels
+// use --compression_type.
+static const char* FLAGS_compression_per_level = "";
+
+// Bytes of compression dictionary per table (see
+// Options::compression_dict_bytes).  Zero disables dictionaries.
+static int FLAGS_compression_dict_bytes = 0;
+
+// Bytes per second of flush and compaction I/O (see
+// Options::rate_limiter).  Zero means no limit.
+static int FLAGS_rate_limit = 0;
+
+// Access table files with O_DIRECT, and allocate space for logs this
+// many bytes at a time (see PosixEnvOptions)
+static bool FLAGS_use_direct_writes = false;
+static bool FLAGS_use_direct_reads = false;
+static int FLAGS_log_preallocation_bytes = 0;
+
+// Number of obsolete logs to keep and write new logs over (see
+// Options::recycle_log_file_num)
+static int FLAGS_recycle_log_file_num = 0;
+
 // Print histogram of operation timings
 static bool FLAGS_histogram = false;
 
+// If non-zero, print percentiles of the latencies of the operations that
+// each thread finished in every period of this many seconds, to show how
+// latency evolves as compactions fall behind.
+static int FLAGS_latency_interval = 0;
+
+// Number of level-0 files at which writes are slowed down and stopped
+static int FLAGS_level0_slowdown_writes_trigger = 0;
+static int FLAGS_level0_stop_writes_trigger = 0;
+
+// Bytes per second at which writes are admitted once they are slowed down
+static int FLAGS_delayed_write_rate = 0;
+
+// Compaction style: "level" or "universal"
+static const char* FLAGS_compaction_style = "level";
+
+// Settings of the universal compaction style (see
+// Options::universal_size_ratio; initialized to default values by "main")
+static int FLAGS_universal_size_ratio = 0;
+static int FLAGS_universal_min_merge_width = 0;
+static int FLAGS_universal_max_merge_width = 0;
+static int FLAGS_universal_max_size_amplification_percent = 0;
+
+// Report how much the heap grew per op, as reported by mallinfo()
+static bool FLAGS_alloc_stats = false;
+
 // Number of bytes to buffer in memtable before compacting
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
@@ -87,6 +165,13 @@ static int FLAGS_write_buffer_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Block cache implementation: "lru" or "clock"
+static const char* FLAGS_cache_type = "lru";
+
+// The block cache is split into 2^cache_numshardbits shards.
+// Negative means use default settings.
+static int FLAGS_cache_numshardbits = -1;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -94,6 +179,25 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Filter policy used with --bloom_bits: "bloom" or "blocked"
+static const char* FLAGS_filter_policy = "bloom";
+
+// Filter layout: "block", "full" or "partitioned"
+static const char* FLAGS_filter_type = "block";
+
+// If true, data blocks get a hash index for point lookups
+static bool FLAGS_data_block_hash_index = false;
+
+// Bytes that iterators read ahead (0 disables readahead)
+static int FLAGS_readahead_size = 0;
+
+// Memtable representation: "skiplist", "vector" or "hashskiplist"
+static const char* FLAGS_memtablerep = "skiplist";
+
+// Number of leading key bytes that "hashskiplist" hashes on.  Keys are
+// 16-digit numbers below --num, so 12 puts 10000 keys per prefix.
+static int FLAGS_memtable_prefix_length = 12;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -106,6 +210,23 @@ namespace leveldb {
 
 namespace {
 
+// Bytes of heap in use by the whole process, or -1 if the C library
+// does not tell.  Called for --alloc_stats only, before and after the
+// benchmark threads run.
+int64_t HeapBytesInUse() {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return static_cast<int64_t>(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+  struct mallinfo info = mallinfo();
+  return static_cast<int64_t>(static_cast<unsigned int>(info.uordblks)) +
+         static_cast<unsigned int>(info.hblkhd);
+#else
+  return -1;
+#endif
+}
+
 // Helper for quickly generating random data.
 class RandomGenerator {
  private:
@@ -150,6 +271,25 @@ static Slice TrimSpace(Slice s) {
   return Slice(s.data() + start, limit - start);
 }
 
+// Env configured by --use_direct_writes, --use_direct_reads and
+// --log_preallocation_bytes.
+static Env* BenchmarkEnv() {
+  static Env* env = NULL;
+  if (env == NULL) {
+    if (FLAGS_use_direct_writes || FLAGS_use_direct_reads ||
+        FLAGS_log_preallocation_bytes > 0) {
+      PosixEnvOptions env_options;
+      env_options.use_direct_writes = FLAGS_use_direct_writes;
+      env_options.use_direct_reads = FLAGS_use_direct_reads;
+      env_options.log_preallocation_bytes = FLAGS_log_preallocation_bytes;
+      env = NewPosixEnv(env_options);
+    } else {
+      env = Env::Default();
+    }
+  }
+  return env;
+}
+
 static void AppendWithSpace(std::string* str, Slice msg) {
   if (msg.empty()) return;
   if (!str->empty()) {
@@ -167,7 +307,11 @@ class Stats {
   int next_report_;
   int64_t bytes_;
   double last_op_finish_;
+  bool has_heap_growth_;
+  int64_t heap_growth_;        // May be negative
   Histogram hist_;
+  double interval_start_;
+  Histogram interval_hist_;   // Latencies since interval_start_
   std::string message_;
 
  public:
@@ -175,14 +319,18 @@ class Stats {
 
   void Start() {
     next_report_ = 100;
-    last_op_finish_ = start_;
     hist_.Clear();
+    interval_hist_.Clear();
     done_ = 0;
     bytes_ = 0;
     seconds_ = 0;
     start_ = Env::Default()->NowMicros();
     finish_ = start_;
+    last_op_finish_ = start_;
+    interval_start_ = start_;
     message_.clear();
+    has_heap_growth_ = false;
+    heap_growth_ = 0;
   }
 
   void Merge(const Stats& other) {
@@ -202,18 +350,33 @@ class Stats {
     seconds_ = (finish_ - start_) * 1e-6;
   }
 
+  // Record that the heap of the process grew by "bytes" while the
+  // benchmark threads ran.
+  void SetHeapGrowth(int64_t bytes) {
+    has_heap_growth_ = true;
+    heap_growth_ = bytes;
+  }
+
   void AddMessage(Slice msg) {
     AppendWithSpace(&message_, msg);
   }
 
   void FinishedSingleOp() {
-    if (FLAGS_histogram) {
+    if (FLAGS_histogram || FLAGS_latency_interval > 0) {
       double now = Env::Default()->NowMicros();
       double micros = now - last_op_finish_;
-      hist_.Add(micros);
-      if (micros > 20000) {
-        fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
-        fflush(stderr);
+      if (FLAGS_histogram) {
+        hist_.Add(micros);
+        if (micros > 20000) {
+          fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
+          fflush(stderr);
+        }
+      }
+      if (FLAGS_latency_interval > 0) {
+        interval_hist_.Add(micros);
+        if (now - interval_start_ >= FLAGS_latency_interval * 1e6) {
+          ReportInterval(now);
+        }
       }
       last_op_finish_ = now;
     }
@@ -232,6 +395,21 @@ class Stats {
     }
   }
 
+  void ReportInterval(double now) {
+    fprintf(stdout,
+            "%7.1f s: %9.0f ops/sec; micros/op P50: %.1f P99: %.1f "
+            "P99.9: %.1f Max: %.0f\n",
+            (now - start_) * 1e-6,
+            interval_hist_.Count() / ((now - interval_start_) * 1e-6),
+            interval_hist_.Median(),
+            interval_hist_.Percentile(99),
+            interval_hist_.Percentile(99.9),
+            interval_hist_.Max());
+    fflush(stdout);
+    interval_hist_.Clear();
+    interval_start_ = now;
+  }
+
   void AddBytes(int64_t n) {
     bytes_ += n;
   }
@@ -252,6 +430,16 @@ class Stats {
       extra = rate;
     }
     AppendWithSpace(&extra, message_);
+    if (FLAGS_alloc_stats) {
+      char heap[100];
+      if (!has_heap_growth_) {
+        snprintf(heap, sizeof(heap), "(heap size unknown)");
+      } else {
+        snprintf(heap, sizeof(heap), "%.1f heap bytes/op",
+                 static_cast<double>(heap_growth_) / done_);
+      }
+      AppendWithSpace(&extra, heap);
+    }
 
     fprintf(stdout, "%-12s : %11.3f micros/op;%s%s\n",
             name.ToString().c_str(),
@@ -297,12 +485,55 @@ struct ThreadState {
   }
 };
 
+// Merge operator for counters stored as fixed64 numbers: each operand
+// is an amount to add.
+class CounterAddOperator : public MergeOperator {
+ public:
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::deque<std::string>& operands,
+                         std::string* new_value,
+                         Logger* logger) const {
+    uint64_t sum = Decode(existing_value);
+    for (size_t i = 0; i < operands.size(); i++) {
+      const Slice operand(operands[i]);
+      sum += Decode(&operand);
+    }
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value,
+                            Logger* logger) const {
+    new_value->clear();
+    PutFixed64(new_value, Decode(&left_operand) + Decode(&right_operand));
+    return true;
+  }
+
+  virtual const char* Name() const { return "leveldb.CounterAddOperator"; }
+
+ private:
+  static uint64_t Decode(const Slice* value) {
+    if (value == NULL || value->size() < sizeof(uint64_t)) {
+      return 0;
+    }
+    return DecodeFixed64(value->data());
+  }
+};
+
 }  // namespace
 
 class Benchmark {
  private:
   Cache* cache_;
+  RateLimiter* rate_limiter_;
   const FilterPolicy* filter_policy_;
+  const MemTableRepFactory* memtable_factory_;
+  CounterAddOperator counter_add_operator_;
   DB* db_;
   int num_;
   int value_size_;
@@ -310,6 +541,8 @@ class Benchmark {
   WriteOptions write_options_;
   int reads_;
   int heap_counter_;
+  MemTable* memtable_;       // Shared by the threads of memtablefill*
+  port::Mutex memtable_mu_;  // Serializes memtablefill
 
   void PrintHeader() {
     const int kKeySize = 16;
@@ -319,6 +552,8 @@ class Benchmark {
             FLAGS_value_size,
             static_cast<int>(FLAGS_value_size * FLAGS_compression_ratio + 0.5));
     fprintf(stdout, "Entries:    %d\n", num_);
+    fprintf(stdout, "MemTable:   %s\n", memtable_factory_->Name());
+    fprintf(stdout, "BlockCache: %s\n", FLAGS_cache_type);
     fprintf(stdout, "RawSize:    %.1f MB (estimated)\n",
             ((static_cast<int64_t>(kKeySize + FLAGS_value_size) * num_)
              / 1048576.0));
@@ -329,6 +564,46 @@ class Benchmark {
     fprintf(stdout, "------------------------------------------------\n");
   }
 
+  static const FilterPolicy* NewFilterPolicy() {
+    if (FLAGS_bloom_bits < 0) {
+      return NULL;
+    } else if (strcmp(FLAGS_filter_policy, "blocked") == 0) {
+      return NewBlockedBloomFilterPolicy(FLAGS_bloom_bits);
+    } else if (strcmp(FLAGS_filter_policy, "bloom") != 0) {
+      fprintf(stderr, "unknown filter_policy '%s'\n", FLAGS_filter_policy);
+      exit(1);
+    }
+    return NewBloomFilterPolicy(FLAGS_bloom_bits);
+  }
+
+  static Cache* NewBlockCache() {
+    // Leave the default cache alone unless asked otherwise
+    const bool clock = (strcmp(FLAGS_cache_type, "clock") == 0);
+    if (!clock && strcmp(FLAGS_cache_type, "lru") != 0) {
+      fprintf(stderr, "unknown cache_type '%s'\n", FLAGS_cache_type);
+      exit(1);
+    }
+    if (FLAGS_cache_size < 0 && !clock && FLAGS_cache_numshardbits < 0) {
+      return NULL;
+    }
+    const size_t capacity =
+        (FLAGS_cache_size >= 0) ? FLAGS_cache_size : 8 << 20;
+    return clock ? NewClockCache(capacity, FLAGS_cache_numshardbits)
+                 : NewLRUCache(capacity, FLAGS_cache_numshardbits);
+  }
+
+  static const MemTableRepFactory* NewMemTableRepFactory() {
+    if (strcmp(FLAGS_memtablerep, "vector") == 0) {
+      return NewVectorRepFactory(0);
+    } else if (strcmp(FLAGS_memtablerep, "hashskiplist") == 0) {
+      return NewHashSkipListRepFactory(FLAGS_memtable_prefix_length, 50000);
+    } else if (strcmp(FLAGS_memtablerep, "skiplist") != 0) {
+      fprintf(stderr, "unknown memtablerep '%s'\n", FLAGS_memtablerep);
+      exit(1);
+    }
+    return NewSkipListRepFactory();
+  }
+
   void PrintWarnings() {
 #if defined(__GNUC__) && !defined(__OPTIMIZE__)
     fprintf(stdout,
@@ -387,16 +662,18 @@ class Benchmark {
 
  public:
   Benchmark()
-  : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
-    filter_policy_(FLAGS_bloom_bits >= 0
-                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                   : NULL),
+  : cache_(NewBlockCache()),
+    rate_limiter_(FLAGS_rate_limit > 0 ? NewRateLimiter(FLAGS_rate_limit)
+                                       : NULL),
+    filter_policy_(NewFilterPolicy()),
+    memtable_factory_(NewMemTableRepFactory()),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
     entries_per_batch_(1),
     reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-    heap_counter_(0) {
+    heap_counter_(0),
+    memtable_(NULL) {
     std::vector<std::string> files;
     Env::Default()->GetChildren(FLAGS_db, &files);
     for (int i = 0; i < files.size(); i++) {
@@ -412,7 +689,9 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete rate_limiter_;
     delete filter_policy_;
+    delete memtable_factory_;
   }
 
   void Run() {
@@ -440,6 +719,7 @@ class Benchmark {
 
       void (Benchmark::*method)(ThreadState*) = NULL;
       bool fresh_db = false;
+      bool fresh_memtable = false;
       int num_threads = FLAGS_threads;
 
       if (name == Slice("fillseq")) {
@@ -471,6 +751,9 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        entries_per_batch_ = 100;
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -484,6 +767,10 @@ class Benchmark {
         method = &Benchmark::DeleteSeq;
       } else if (name == Slice("deleterandom")) {
         method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("updaterandom")) {
+        method = &Benchmark::UpdateRandom;
+      } else if (name == Slice("mergerandom")) {
+        method = &Benchmark::MergeRandom;
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
@@ -493,6 +780,14 @@ class Benchmark {
         method = &Benchmark::Crc32c;
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
+      } else if (name == Slice("filterprobe")) {
+        method = &Benchmark::FilterProbe;
+      } else if (name == Slice("memtablefill")) {
+        fresh_memtable = true;
+        method = &Benchmark::MemTableFill;
+      } else if (name == Slice("memtablefillconcurrent")) {
+        fresh_memtable = true;
+        method = &Benchmark::MemTableFillConcurrently;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -503,6 +798,14 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("ratelimiter")) {
+        PrintStats("leveldb.rate-limiter");
+      } else if (name == Slice("writestalls")) {
+        PrintStats("leveldb.write-stalls");
+      } else if (name == Slice("writeamp")) {
+        PrintStats("leveldb.write-amplification");
+      } else if (name == Slice("compressionstats")) {
+        CompressionStats();
       } else {
         if (name != Slice()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -522,9 +825,20 @@ class Benchmark {
         }
       }
 
+      if (fresh_memtable) {
+        memtable_ = new MemTable(InternalKeyComparator(BytewiseComparator()),
+                                 memtable_factory_);
+        memtable_->Ref();
+      }
+
       if (method != NULL) {
         RunBenchmark(num_threads, name, method);
       }
+
+      if (memtable_ != NULL) {
+        memtable_->Unref();
+        memtable_ = NULL;
+      }
     }
   }
 
@@ -587,6 +901,10 @@ class Benchmark {
       shared.cv.Wait();
     }
 
+    int64_t heap_start = -1;
+    if (FLAGS_alloc_stats) {
+      heap_start = HeapBytesInUse();
+    }
     shared.start = true;
     shared.cv.SignalAll();
     while (shared.num_done < n) {
@@ -597,6 +915,9 @@ class Benchmark {
     for (int i = 1; i < n; i++) {
       arg[0].thread->stats.Merge(arg[i].thread->stats);
     }
+    if (heap_start >= 0) {
+      arg[0].thread->stats.SetHeapGrowth(HeapBytesInUse() - heap_start);
+    }
     arg[0].thread->stats.Report(name);
 
     for (int i = 0; i < n; i++) {
@@ -640,6 +961,87 @@ class Benchmark {
     if (ptr == NULL) exit(1); // Disable unused variable warning.
   }
 
+  void FilterProbe(ThreadState* thread) {
+    if (filter_policy_ == NULL) {
+      thread->stats.AddMessage("(use --bloom_bits to pick a filter)");
+      return;
+    }
+
+    // Keys k and k+num_ are probed; only the former are in the filter.
+    std::vector<std::string> keys(2 * num_);
+    std::vector<Slice> present(num_);
+    for (int i = 0; i < 2 * num_; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      keys[i] = key;
+      if (i < num_) {
+        present[i] = keys[i];
+      }
+    }
+    std::string filter;
+    filter_policy_->CreateFilter(&present[0], num_, &filter);
+
+    // Do not count building the filter
+    thread->stats.Start();
+    int matched = 0;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Next() % (2 * num_);
+      if (filter_policy_->KeyMayMatch(keys[k], filter)) {
+        matched++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%s, %d bytes, %d of %d matched)",
+             filter_policy_->Name(), static_cast<int>(filter.size()),
+             matched, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void MemTableFill(ThreadState* thread) {
+    DoMemTableFill(thread, false);
+  }
+
+  void MemTableFillConcurrently(ThreadState* thread) {
+    DoMemTableFill(thread, true);
+  }
+
+  // The threads split num_ inserts between them.  Without "concurrent"
+  // they take turns under a mutex, which is how DB writes used to reach
+  // the memtable.
+  void DoMemTableFill(ThreadState* thread, bool concurrent) {
+    const int threads = thread->shared->total;
+    const int n = num_ / threads;
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d ops per thread)", n);
+    thread->stats.AddMessage(msg);
+    if (concurrent && !memtable_factory_->IsInsertConcurrentlySupported()) {
+      thread->stats.AddMessage("(no concurrent inserts; using a mutex)");
+      concurrent = false;
+    }
+
+    RandomGenerator gen;
+    int64_t bytes = 0;
+    for (int i = 0; i < n; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      // Distinct sequence numbers keep the internal keys unique
+      const SequenceNumber seq =
+          static_cast<SequenceNumber>(i) * threads + thread->tid + 1;
+      Slice value = gen.Generate(value_size_);
+      if (concurrent) {
+        memtable_->AddConcurrently(seq, kTypeValue, key, value);
+      } else {
+        MutexLock l(&memtable_mu_);
+        memtable_->Add(seq, kTypeValue, key, value);
+      }
+      bytes += value_size_ + strlen(key);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -690,11 +1092,52 @@ class Benchmark {
   void Open() {
     assert(db_ == NULL);
     Options options;
+    options.env = BenchmarkEnv();
     options.create_if_missing = !FLAGS_use_existing_db;
+    options.merge_operator = &counter_add_operator_;
     options.block_cache = cache_;
+    options.rate_limiter = rate_limiter_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.recycle_log_file_num = FLAGS_recycle_log_file_num;
+    options.level0_slowdown_writes_trigger =
+        FLAGS_level0_slowdown_writes_trigger;
+    options.level0_stop_writes_trigger = FLAGS_level0_stop_writes_trigger;
+    options.delayed_write_rate = FLAGS_delayed_write_rate;
+    if (strcmp(FLAGS_compaction_style, "universal") == 0) {
+      options.compaction_style = kCompactionStyleUniversal;
+    } else if (strcmp(FLAGS_compaction_style, "level") != 0) {
+      fprintf(stderr, "unknown compaction_style '%s'\n",
+              FLAGS_compaction_style);
+      exit(1);
+    }
+    options.universal_size_ratio = FLAGS_universal_size_ratio;
+    options.universal_min_merge_width = FLAGS_universal_min_merge_width;
+    options.universal_max_merge_width = FLAGS_universal_max_merge_width;
+    options.universal_max_size_amplification_percent =
+        FLAGS_universal_max_size_amplification_percent;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    if (strcmp(FLAGS_filter_type, "full") == 0) {
+      options.filter_type = kFullFilter;
+    } else if (strcmp(FLAGS_filter_type, "partitioned") == 0) {
+      options.filter_type = kPartitionedFilter;
+    } else if (strcmp(FLAGS_filter_type, "block") != 0) {
+      fprintf(stderr, "unknown filter_type '%s'\n", FLAGS_filter_type);
+      exit(1);
+    }
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    options.memtable_factory = memtable_factory_;
+    options.compression = StringToCompressionType(FLAGS_compression_type);
+    Slice per_level = FLAGS_compression_per_level;
+    while (!per_level.empty()) {
+      const char* comma = strchr(per_level.data(), ',');
+      const size_t n = (comma != NULL) ? comma - per_level.data()
+                                       : per_level.size();
+      options.compression_per_level.push_back(
+          StringToCompressionType(std::string(per_level.data(), n).c_str()));
+      per_level.remove_prefix(comma != NULL ? n + 1 : n);
+    }
+    options.compression_dict_bytes = FLAGS_compression_dict_bytes;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -740,8 +1183,14 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  ReadOptions IteratorOptions() const {
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    return options;
+  }
+
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    Iterator* iter = db_->NewIterator(IteratorOptions());
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -754,7 +1203,7 @@ class Benchmark {
   }
 
   void ReadReverse(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    Iterator* iter = db_->NewIterator(IteratorOptions());
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
@@ -784,6 +1233,34 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> key_data(entries_per_batch_);
+    std::vector<Slice> keys(entries_per_batch_);
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    for (int i = 0; i < reads_; i += entries_per_batch_) {
+      for (int j = 0; j < entries_per_batch_; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(key, sizeof(key), "%016d", k);
+        key_data[j] = key;
+        keys[j] = key_data[j];
+      }
+      db_->MultiGet(options, keys, &values, &statuses);
+      for (int j = 0; j < entries_per_batch_; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -810,7 +1287,7 @@ class Benchmark {
   }
 
   void SeekRandom(ThreadState* thread) {
-    ReadOptions options;
+    ReadOptions options = IteratorOptions();
     std::string value;
     int found = 0;
     for (int i = 0; i < reads_; i++) {
@@ -857,6 +1334,46 @@ class Benchmark {
     DoDelete(thread, false);
   }
 
+  void UpdateRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    std::string counter;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      uint64_t count = 0;
+      if (db_->Get(options, key, &value).ok() &&
+          value.size() >= sizeof(uint64_t)) {
+        count = DecodeFixed64(value.data());
+      }
+      counter.clear();
+      PutFixed64(&counter, count + 1);
+      Status s = db_->Put(write_options_, key, counter);
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
+  void MergeRandom(ThreadState* thread) {
+    std::string one;
+    PutFixed64(&one, 1);
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      Status s = db_->Merge(write_options_, key, one);
+      if (!s.ok()) {
+        fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
   void ReadWhileWriting(ThreadState* thread) {
     if (thread->tid > 0) {
       ReadRandom(thread);
@@ -891,6 +1408,118 @@ class Benchmark {
     db_->CompactRange(NULL, NULL);
   }
 
+  static CompressionType StringToCompressionType(const char* name) {
+    if (strcmp(name, "none") == 0) {
+      return kNoCompression;
+    } else if (strcmp(name, "snappy") == 0) {
+      return kSnappyCompression;
+    } else if (strcmp(name, "zlib") == 0) {
+      return kZlibCompression;
+    }
+    fprintf(stderr, "unknown compression type '%s'\n", name);
+    exit(1);
+  }
+
+  // For each level, print how much space its tables take on disk
+  // against the size of the entries they hold, and the time a scan of
+  // them takes once they are in memory, i.e., the CPU cost of reading
+  // (and decompressing) them.  The last line relates the size of the
+  // whole database to the size of its live entries.
+  void CompressionStats() {
+    std::string sstables;
+    if (!db_->GetProperty("leveldb.sstables", &sstables)) {
+      fprintf(stdout, "\n(failed)\n");
+      return;
+    }
+    // The property lists the files of each level as
+    //   --- level 1 ---
+    //    17:123['a' .. 'd']
+    std::vector<std::vector<std::pair<uint64_t, uint64_t> > > files;
+    Slice input = sstables;
+    while (!input.empty()) {
+      const char* eol = strchr(input.data(), '\n');
+      const size_t n = (eol != NULL) ? eol - input.data() + 1 : input.size();
+      const std::string line(input.data(), n);
+      input.remove_prefix(n);
+      int level;
+      unsigned long long number, size;
+      if (sscanf(line.c_str(), "--- level %d ---", &level) == 1) {
+        files.resize(level + 1);
+      } else if (!files.empty() &&
+                 sscanf(line.c_str(), " %llu:%llu[", &number, &size) == 2) {
+        files.back().push_back(std::make_pair(number, size));
+      }
+    }
+
+    Env* env = Env::Default();
+    InternalKeyComparator icmp(BytewiseComparator());
+    Options options;
+    options.comparator = &icmp;
+    uint64_t total_disk = 0;
+    fprintf(stdout, "\n");
+    for (size_t level = 0; level < files.size(); level++) {
+      if (files[level].empty()) {
+        continue;
+      }
+      uint64_t disk = 0;
+      uint64_t raw = 0;
+      uint64_t micros = 0;
+      for (size_t f = 0; f < files[level].size(); f++) {
+        const uint64_t size = files[level][f].second;
+        RandomAccessFile* file;
+        Table* table;
+        Status s = env->NewRandomAccessFile(
+            TableFileName(FLAGS_db, files[level][f].first), &file);
+        if (s.ok()) {
+          s = Table::Open(options, file, size, &table);
+          if (!s.ok()) {
+            delete file;
+          }
+        }
+        if (!s.ok()) {
+          fprintf(stderr, "open error: %s\n", s.ToString().c_str());
+          exit(1);
+        }
+        // The first scan brings the file into memory, the second one
+        // is timed.
+        for (int pass = 0; pass < 2; pass++) {
+          const uint64_t start = env->NowMicros();
+          uint64_t bytes = 0;
+          Iterator* iter = table->NewIterator(ReadOptions());
+          for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            bytes += iter->key().size() + iter->value().size();
+          }
+          delete iter;
+          if (pass == 1) {
+            micros += env->NowMicros() - start;
+            raw += bytes;
+          }
+        }
+        delete table;
+        delete file;
+        disk += size;
+      }
+      total_disk += disk;
+      fprintf(stdout, "level %d: %5d files %10.1f MB on disk %10.1f MB "
+              "uncompressed (%.2fx) %10.1f micros/MB scanned\n",
+              static_cast<int>(level), static_cast<int>(files[level].size()),
+              disk / 1048576.0, raw / 1048576.0,
+              raw > 0 ? static_cast<double>(disk) / raw : 0.0,
+              raw > 0 ? micros / (raw / 1048576.0) : 0.0);
+    }
+
+    uint64_t live = 0;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      live += iter->key().size() + iter->value().size();
+    }
+    delete iter;
+    fprintf(stdout, "all levels: %10.1f MB on disk %10.1f MB live "
+            "(space amplification %.2f)\n",
+            total_disk / 1048576.0, live / 1048576.0,
+            live > 0 ? static_cast<double>(total_disk) / live : 0.0);
+  }
+
   void PrintStats(const char* key) {
     std::string stats;
     if (!db_->GetProperty(key, &stats)) {
@@ -926,6 +1555,18 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_level0_slowdown_writes_trigger =
+      leveldb::Options().level0_slowdown_writes_trigger;
+  FLAGS_level0_stop_writes_trigger =
+      leveldb::Options().level0_stop_writes_trigger;
+  FLAGS_delayed_write_rate = leveldb::Options().delayed_write_rate;
+  FLAGS_universal_size_ratio = leveldb::Options().universal_size_ratio;
+  FLAGS_universal_min_merge_width =
+      leveldb::Options().universal_min_merge_width;
+  FLAGS_universal_max_merge_width =
+      leveldb::Options().universal_max_merge_width;
+  FLAGS_universal_max_size_amplification_percent =
+      leveldb::Options().universal_max_size_amplification_percent;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -939,6 +1580,32 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_histogram = n;
+    } else if (sscanf(argv[i], "--use_direct_writes=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_writes = n;
+    } else if (sscanf(argv[i], "--use_direct_reads=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_reads = n;
+    } else if (sscanf(argv[i], "--log_preallocation_bytes=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_log_preallocation_bytes = n;
+    } else if (sscanf(argv[i], "--recycle_log_file_num=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_recycle_log_file_num = n;
+    } else if (sscanf(argv[i], "--latency_interval=%d%c", &n, &junk) == 1) {
+      FLAGS_latency_interval = n;
+    } else if (sscanf(argv[i], "--level0_slowdown_writes_trigger=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_level0_slowdown_writes_trigger = n;
+    } else if (sscanf(argv[i], "--level0_stop_writes_trigger=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_level0_stop_writes_trigger = n;
+    } else if (sscanf(argv[i], "--delayed_write_rate=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_delayed_write_rate = n;
+    } else if (sscanf(argv[i], "--alloc_stats=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_alloc_stats = n;
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
@@ -954,10 +1621,54 @@ int main(int argc, char** argv) {
       FLAGS_write_buffer_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+      FLAGS_cache_type = argv[i] + 13;
+    } else if (sscanf(argv[i], "--cache_numshardbits=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_cache_numshardbits = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strncmp(argv[i], "--filter_policy=", 16) == 0) {
+      FLAGS_filter_policy = argv[i] + 16;
+    } else if (strncmp(argv[i], "--filter_type=", 14) == 0) {
+      FLAGS_filter_type = argv[i] + 14;
+    } else if (strncmp(argv[i], "--compaction_style=", 19) == 0) {
+      FLAGS_compaction_style = argv[i] + 19;
+    } else if (sscanf(argv[i], "--universal_size_ratio=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_size_ratio = n;
+    } else if (sscanf(argv[i], "--universal_min_merge_width=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_min_merge_width = n;
+    } else if (sscanf(argv[i], "--universal_max_merge_width=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_max_merge_width = n;
+    } else if (sscanf(argv[i],
+                      "--universal_max_size_amplification_percent=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_max_size_amplification_percent = n;
+    } else if (strncmp(argv[i], "--compression_type=", 19) == 0) {
+      FLAGS_compression_type = argv[i] + 19;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0) {
+      FLAGS_compression_per_level = argv[i] + 24;
+    } else if (sscanf(argv[i], "--compression_dict_bytes=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_compression_dict_bytes = n;
+    } else if (sscanf(argv[i], "--rate_limit=%d%c", &n, &junk) == 1) {
+      FLAGS_rate_limit = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1) {
+      FLAGS_readahead_size = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (strncmp(argv[i], "--memtablerep=", 14) == 0) {
+      FLAGS_memtablerep = argv[i] + 14;
+    } else if (sscanf(argv[i], "--memtable_prefix_length=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_memtable_prefix_length = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
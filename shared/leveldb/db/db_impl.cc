@@ -5,21 +5,26 @@
 #include "db/db_impl.h"
 
 #include <algorithm>
+#include <deque>
 #include <set>
 #include <string>
 #include <stdint.h>
 #include <stdio.h>
 #include <vector>
 #include "db/builder.h"
+#include "db/column_family.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
+#include "leveldb/compressor.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -32,20 +37,46 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Delayed writes are never admitted at less than this fraction of
+// Options::delayed_write_rate; the stop thresholds bound how far writers
+// can get ahead of compactions.
+static const double kMinDelayedWriteRateFraction = 1.0 / 16;
+
+// A delayed writer sleeps once it has run this far ahead of its rate.
+static const uint64_t kMinWriteDelayMicros = 1000;
+
+// How often the periodic compaction timer checks the ages of files.
+// Ages are kept in whole seconds.
+static const uint64_t kPeriodicCompactionCheckMicros = 1000000;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  WriteGroup* group;  // Set once the batch has been logged
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  explicit Writer(port::Mutex* mu) : group(NULL), cv(mu) { }
+};
+
+// Writers whose batches went out in one log record.  A group lives from
+// the log write until all of its batches are in "mems" and its sequence
+// numbers have been published.
+struct DBImpl::WriteGroup {
+  std::vector<Writer*> writers;   // writers[0] is the leader
+  std::vector<MemTable*> mems;    // Memtable of each column family, by id
+  SequenceNumber last_sequence;
+  bool concurrent;                // Does each writer insert its own batch?
+  int pending;                    // Inserts that have not finished yet
+  Status status;
 };
 
 struct DBImpl::CompactionState {
@@ -57,11 +88,18 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // No snapshot sees entries with sequence numbers above latest_snapshot
+  // (zero if there are no snapshots), so the compaction filter may
+  // delete or change them.
+  SequenceNumber latest_snapshot;
+
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    SequenceNumber largest_seqno;
+    std::vector<RangeTombstone> range_dels;
   };
   std::vector<Output> outputs;
 
@@ -81,6 +119,20 @@ struct DBImpl::CompactionState {
   }
 };
 
+// A key range of a compaction that is merged by a single thread
+struct DBImpl::Subcompaction {
+  DBImpl* db;
+  Compaction* inputs;       // Compaction whose inputs are read
+  CompactionState* state;   // Receives the output for [*begin,*end)
+  const Slice* begin;       // NULL means beginning of key range
+  const Slice* end;         // NULL means end of key range
+  Status status;
+  int64_t imm_micros;       // Micros spent doing imm_ compactions
+  bool started;             // Claimed by a thread; guarded by mutex_
+  bool done;                // Guarded by mutex_
+  int refs;                 // DoCompactionWork() and scheduled calls
+};
+
 // Fix user-supplied options to be reasonable
 template <class T,class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -90,13 +142,39 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        RateLimiter* ilimiter,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
+  if (src.rate_limiter != NULL && ilimiter != NULL) {
+    result.rate_limiter = ilimiter;
+  }
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.max_background_compactions, 1,                  64);
+  ClipToRange(&result.max_subcompactions, 1,                          64);
+  ClipToRange(&result.universal_size_ratio, 0,                        1000);
+  ClipToRange(&result.universal_min_merge_width, 2,                   1000);
+  ClipToRange(&result.universal_max_merge_width, 0,                   1000);
+  ClipToRange(&result.universal_max_size_amplification_percent, 0, 1 << 20);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              config::kL0_CompactionTrigger, 1 << 20);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger + 1, 1 << 20);
+  if (result.hard_pending_compaction_bytes_limit != 0 &&
+      result.hard_pending_compaction_bytes_limit <
+      result.soft_pending_compaction_bytes_limit) {
+    result.hard_pending_compaction_bytes_limit =
+        result.soft_pending_compaction_bytes_limit;
+  }
+  ClipToRange(&result.delayed_write_rate,
+              static_cast<uint64_t>(1) << 10, static_cast<uint64_t>(1) << 40);
+  if (result.memtable_factory != NULL &&
+      !result.memtable_factory->IsInsertConcurrentlySupported()) {
+    result.allow_concurrent_memtable_write = false;
+  }
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -113,30 +191,119 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+Options SanitizeColumnFamilyOptions(const Options& db_options,
+                                   const Options& src) {
+  Options result = db_options;
+  result.comparator = src.comparator;
+  result.merge_operator = src.merge_operator;
+  result.compaction_filter = src.compaction_filter;
+  result.filter_policy = src.filter_policy;
+  result.filter_type = src.filter_type;
+  result.filter_partition_keys = src.filter_partition_keys;
+  result.prefix_extractor = src.prefix_extractor;
+  result.write_buffer_size = src.write_buffer_size;
+  result.block_size = src.block_size;
+  result.block_restart_interval = src.block_restart_interval;
+  result.data_block_hash_index = src.data_block_hash_index;
+  result.compression = src.compression;
+  result.compression_per_level = src.compression_per_level;
+  result.compression_dict_bytes = src.compression_dict_bytes;
+  result.compaction_style = src.compaction_style;
+  result.universal_size_ratio = src.universal_size_ratio;
+  result.universal_min_merge_width = src.universal_min_merge_width;
+  result.universal_max_merge_width = src.universal_max_merge_width;
+  result.universal_max_size_amplification_percent =
+      src.universal_max_size_amplification_percent;
+  result.periodic_compaction_seconds = src.periodic_compaction_seconds;
+  ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
+  ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.universal_size_ratio, 0,                        1000);
+  ClipToRange(&result.universal_min_merge_width, 2,                   1000);
+  ClipToRange(&result.universal_max_merge_width, 0,                   1000);
+  ClipToRange(&result.universal_max_size_amplification_percent, 0, 1 << 20);
+  return result;
+}
+
+// Return OK if there is a compressor for every compression that
+// "options" asks for, and if a dictionary is asked for, at least one
+// of them can use it.
+static Status CheckCompression(const Options& options) {
+  std::vector<CompressionType> types = options.compression_per_level;
+  types.push_back(options.compression);
+  bool dictionary_used = false;
+  for (size_t i = 0; i < types.size(); i++) {
+    const Compressor* compressor = GetCompressor(types[i]);
+    if (types[i] != kNoCompression && compressor == NULL) {
+      char buf[50];
+      snprintf(buf, sizeof(buf), "%d", static_cast<int>(types[i]));
+      return Status::InvalidArgument("unknown compression type", buf);
+    }
+    // "compression" is not used if there are per-level compressions
+    const bool used = (options.compression_per_level.empty() ||
+                       i + 1 < types.size());
+    if (used && compressor != NULL && compressor->SupportsDictionary()) {
+      dictionary_used = true;
+    }
+  }
+  if (options.compression_dict_bytes > 0 && !dictionary_used) {
+    return Status::InvalidArgument(
+        "compression_dict_bytes is set, but no compression in use "
+        "supports dictionaries");
+  }
+  return Status::OK();
+}
+
+// Returns true iff "mem" holds no entries.
+static bool MemTableIsEmpty(MemTable* mem) {
+  Iterator* iter = mem->NewIterator();
+  iter->SeekToFirst();
+  const bool empty = !iter->Valid();
+  delete iter;
+  return empty;
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
+      rate_limiter_(raw_options.rate_limiter, raw_options.env),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_, &rate_limiter_,
+                               raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
       db_lock_(NULL),
       shutting_down_(NULL),
       bg_cv_(&mutex_),
-      mem_(new MemTable(internal_comparator_)),
-      imm_(NULL),
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
+      first_log_number_(0),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      bg_compaction_scheduled_(false),
+      bg_compaction_scheduled_(0),
+      bg_flush_scheduled_(false),
+      bg_subcompactions_scheduled_(0),
+      periodic_timer_running_(false),
+      running_compactions_(0),
+      flushing_imm_(false),
+      logging_manifest_(false),
+      compactions_paused_(false),
       manual_compaction_(NULL),
-      consecutive_compaction_errors_(0) {
-  mem_->Ref();
+      consecutive_compaction_errors_(0),
+      delayed_write_until_(0),
+      delayed_writes_(0),
+      write_delay_micros_(0),
+      stopped_writes_(0),
+      write_stop_micros_(0),
+      bytes_ingested_(0),
+      bytes_flushed_(0) {
   has_imm_.Release_Store(NULL);
+  get_latency_.Clear();
+  multiget_latency_.Clear();
+  write_latency_.Clear();
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
@@ -144,13 +311,21 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
+  ColumnFamilyData* default_cfd = versions_->default_column_family();
+  default_cfd->SetMemTable(NewMemTable(default_cfd));
+  default_cf_handle_ = new ColumnFamilyHandleImpl(default_cfd);
+
+  env_->SetBackgroundThreads(options_.max_background_compactions,
+                             Env::kLowPriority);
 }
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  bg_cv_.SignalAll();  // Wake up the periodic compaction timer
+  while (bg_compaction_scheduled_ > 0 || bg_flush_scheduled_ ||
+         bg_subcompactions_scheduled_ > 0 || periodic_timer_running_) {
     bg_cv_.Wait();
   }
   mutex_.Unlock();
@@ -159,9 +334,10 @@ DBImpl::~DBImpl() {
     env_->UnlockFile(db_lock_);
   }
 
+  // Column families release their memtables, and must go before the
+  // table cache that holds their tables.
+  delete default_cf_handle_;
   delete versions_;
-  if (mem_ != NULL) mem_->Unref();
-  if (imm_ != NULL) imm_->Unref();
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -175,6 +351,13 @@ DBImpl::~DBImpl() {
   }
 }
 
+MemTable* DBImpl::NewMemTable(ColumnFamilyData* cfd) {
+  MemTable* mem = new MemTable(cfd->internal_comparator(),
+                               options_.memtable_factory);
+  mem->Ref();
+  return mem;
+}
+
 Status DBImpl::NewDB() {
   VersionEdit new_db;
   new_db.SetComparatorName(user_comparator()->Name());
@@ -232,6 +415,17 @@ void DBImpl::DeleteObsoleteFiles() {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
                   (number == versions_->PrevLogNumber()));
+          if (!keep && first_log_number_ != 0 &&
+              number >= first_log_number_) {
+            if (std::find(recycled_logs_.begin(), recycled_logs_.end(),
+                          number) != recycled_logs_.end()) {
+              keep = true;
+            } else if (recycled_logs_.size() <
+                       options_.recycle_log_file_num) {
+              recycled_logs_.push_back(number);
+              keep = true;
+            }
+          }
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -266,7 +460,9 @@ void DBImpl::DeleteObsoleteFiles() {
   }
 }
 
-Status DBImpl::Recover(VersionEdit* edit) {
+Status DBImpl::Recover(
+    const std::map<std::string, Options>& column_families,
+    std::map<uint32_t, VersionEdit>* edits) {
   mutex_.AssertHeld();
 
   // Ignore error from CreateDir since the creation of the DB is
@@ -296,8 +492,16 @@ Status DBImpl::Recover(VersionEdit* edit) {
     }
   }
 
-  s = versions_->Recover();
+  s = versions_->Recover(column_families);
   if (s.ok()) {
+    const std::vector<ColumnFamilyData*>& families =
+        versions_->column_families();
+    for (size_t i = 0; i < families.size(); i++) {
+      if (families[i]->mem() == NULL) {
+        families[i]->SetMemTable(NewMemTable(families[i]));
+      }
+    }
+
     SequenceNumber max_sequence(0);
 
     // Recover from all newer log files than the ones named in the
@@ -307,6 +511,9 @@ Status DBImpl::Recover(VersionEdit* edit) {
     // Note that PrevLogNumber() is no longer used, but we pay
     // attention to it in case we are recovering a database
     // produced by an older version of leveldb.
+    //
+    // LogNumber() is the oldest log of any column family; entries of a
+    // family in logs older than its own log number are skipped.
     const uint64_t min_log = versions_->LogNumber();
     const uint64_t prev_log = versions_->PrevLogNumber();
     std::vector<std::string> filenames;
@@ -336,7 +543,7 @@ Status DBImpl::Recover(VersionEdit* edit) {
     // Recover in the order in which the logs were generated
     std::sort(logs.begin(), logs.end());
     for (size_t i = 0; i < logs.size(); i++) {
-      s = RecoverLogFile(logs[i], edit, &max_sequence);
+      s = RecoverLogFile(logs[i], edits, &max_sequence);
 
       // The previous incarnation may not have written any MANIFEST
       // records after allocating this log number.  So we manually
@@ -355,7 +562,7 @@ Status DBImpl::Recover(VersionEdit* edit) {
 }
 
 Status DBImpl::RecoverLogFile(uint64_t log_number,
-                              VersionEdit* edit,
+                              std::map<uint32_t, VersionEdit>* edits,
                               SequenceNumber* max_sequence) {
   struct LogReporter : public log::Reader::Reporter {
     Env* env;
@@ -392,15 +599,31 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
   log::Reader reader(file, &reporter, true/*checksum*/,
-                     0/*initial_offset*/);
+                     0/*initial_offset*/, log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long) log_number);
 
-  // Read all the records and add to a memtable
+  // Give each column family whose entries in this log are not all in
+  // its tables a memtable, indexed by id.  Entries of other families
+  // are skipped.
+  const std::vector<ColumnFamilyData*>& families =
+      versions_->column_families();
+  std::vector<MemTable*> mems;
+  for (size_t i = 0; i < families.size(); i++) {
+    ColumnFamilyData* cfd = families[i];
+    if (cfd->id() >= mems.size()) {
+      mems.resize(cfd->id() + 1, NULL);
+    }
+    if (log_number >= cfd->log_number() ||
+        log_number == versions_->PrevLogNumber()) {
+      mems[cfd->id()] = NewMemTable(cfd);
+    }
+  }
+
+  // Read all the records and add to the memtables
   std::string scratch;
   Slice record;
   WriteBatch batch;
-  MemTable* mem = NULL;
   while (reader.ReadRecord(&record, &scratch) &&
          status.ok()) {
     if (record.size() < 12) {
@@ -410,11 +633,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
     }
     WriteBatchInternal::SetContents(&batch, record);
 
-    if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
-      mem->Ref();
-    }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
+    status = WriteBatchInternal::InsertInto(&batch, mems);
     MaybeIgnoreError(&status);
     if (!status.ok()) {
       break;
@@ -426,36 +645,56 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
       *max_sequence = last_seq;
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      status = WriteLevel0Table(mem, edit, NULL);
-      if (!status.ok()) {
-        // Reflect errors immediately so that conditions like full
-        // file-systems cause the DB::Open() to fail.
-        break;
+    for (size_t i = 0; status.ok() && i < families.size(); i++) {
+      ColumnFamilyData* cfd = families[i];
+      MemTable*& mem = mems[cfd->id()];
+      if (mem != NULL &&
+          mem->ApproximateMemoryUsage() > cfd->options().write_buffer_size) {
+        uint64_t number;
+        status = WriteLevel0Table(cfd, mem, &(*edits)[cfd->id()], NULL,
+                                  &number);
+        pending_outputs_.erase(number);
+        mem->Unref();
+        mem = NewMemTable(cfd);
       }
-      mem->Unref();
-      mem = NULL;
+    }
+    if (!status.ok()) {
+      // Reflect errors immediately so that conditions like full
+      // file-systems cause the DB::Open() to fail.
+      break;
     }
   }
 
-  if (status.ok() && mem != NULL) {
-    status = WriteLevel0Table(mem, edit, NULL);
-    // Reflect errors immediately so that conditions like full
-    // file-systems cause the DB::Open() to fail.
+  for (size_t i = 0; status.ok() && i < families.size(); i++) {
+    ColumnFamilyData* cfd = families[i];
+    MemTable* mem = mems[cfd->id()];
+    if (mem != NULL && !MemTableIsEmpty(mem)) {
+      uint64_t number;
+      status = WriteLevel0Table(cfd, mem, &(*edits)[cfd->id()], NULL,
+                                &number);
+      pending_outputs_.erase(number);
+      // Reflect errors immediately so that conditions like full
+      // file-systems cause the DB::Open() to fail.
+    }
   }
 
-  if (mem != NULL) mem->Unref();
+  for (size_t i = 0; i < mems.size(); i++) {
+    if (mems[i] != NULL) mems[i]->Unref();
+  }
   delete file;
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                                VersionEdit* edit, Version* base,
+                                uint64_t* number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
+  meta.creation_time = start_micros / 1000000;
   pending_outputs_.insert(meta.number);
+  *number = meta.number;
   Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
@@ -463,7 +702,8 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, TableOptionsForLevel(cfd->options(), 0),
+                   cfd->table_cache(), iter, &meta);
     mutex_.Lock();
   }
 
@@ -472,8 +712,6 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
-
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -481,58 +719,106 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != NULL) {
+    // Only push the table past level-0 if no compaction ran while it was
+    // being built and none is running now: a running compaction may be
+    // about to add files that overlap it to the levels we would pick.
+    if (base != NULL && base == cfd->current() &&
+        running_compactions_ == 0) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
   stats_[level].Add(stats);
+  bytes_flushed_ += meta.file_size;
   return s;
 }
 
 Status DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != NULL);
+  assert(has_imm_.NoBarrier_Load() != NULL);
+  assert(!flushing_imm_);
+  flushing_imm_ = true;
+
+  // The memtables of all column families are switched together, so
+  // every family's earlier logs are no longer needed once they are all
+  // saved.  Families are committed one at a time; after an error, the
+  // ones that are done are skipped when the flush is retried.
+  const uint64_t log_number = logfile_number_;
+  const std::vector<ColumnFamilyData*> families =
+      versions_->column_families();
+  Status s;
+  for (size_t i = 0; s.ok() && i < families.size(); i++) {
+    ColumnFamilyData* cfd = families[i];
+    MemTable* imm = cfd->imm();
+    if (imm == NULL && cfd->log_number() >= log_number) {
+      continue;
+    }
+
+    // Save the contents of the memtable as a new Table
+    VersionEdit edit;
+    edit.SetColumnFamily(cfd->id());
+    uint64_t number = 0;
+    if (imm != NULL && !MemTableIsEmpty(imm)) {
+      Version* base = cfd->current();
+      base->Ref();
+      s = WriteLevel0Table(cfd, imm, &edit, base, &number);
+      base->Unref();
+    }
 
-  // Save the contents of the memtable as a new Table
-  VersionEdit edit;
-  Version* base = versions_->current();
-  base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
-  base->Unref();
+    if (s.ok() && shutting_down_.Acquire_Load()) {
+      s = Status::IOError("Deleting DB during memtable compaction");
+    }
+
+    // Replace immutable memtable with the generated Table
+    if (s.ok()) {
+      edit.SetPrevLogNumber(0);
+      edit.SetLogNumber(log_number);  // Earlier logs no longer needed
+      s = LogAndApply(&edit);
+    }
+    if (number != 0) {
+      pending_outputs_.erase(number);
+    }
 
-  if (s.ok() && shutting_down_.Acquire_Load()) {
-    s = Status::IOError("Deleting DB during memtable compaction");
+    if (s.ok() && imm != NULL) {
+      imm->Unref();
+      cfd->SetImmutableMemTable(NULL);
+    }
   }
 
-  // Replace immutable memtable with the generated Table
   if (s.ok()) {
-    edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // The new tables may hold range deletions that empty older ones
+    s = DeleteFilesInDeletedRanges();
   }
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = NULL;
     has_imm_.Release_Store(NULL);
     DeleteObsoleteFiles();
   }
 
+  flushing_imm_ = false;
   return s;
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
+  CompactRange(default_cf_handle_, begin, end);
+}
+
+void DBImpl::CompactRange(ColumnFamilyHandle* column_family,
+                          const Slice* begin, const Slice* end) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
   int max_level_with_files = 1;
   {
     MutexLock l(&mutex_);
-    Version* base = versions_->current();
+    if (cfd->IsDropped()) {
+      return;
+    }
+    Version* base = cfd->current();
     for (int level = 1; level < config::kNumLevels; level++) {
       if (base->OverlapInLevel(level, begin, end)) {
         max_level_with_files = level;
@@ -541,17 +827,23 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
   TEST_CompactMemTable(); // TODO(sanjay): Skip if memtable does not overlap
   for (int level = 0; level < max_level_with_files; level++) {
-    TEST_CompactRange(level, begin, end);
+    ManualCompact(cfd, level, begin, end);
   }
 }
 
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
+  ManualCompact(versions_->default_column_family(), level, begin, end);
+}
+
+void DBImpl::ManualCompact(ColumnFamilyData* cfd, int level,
+                           const Slice* begin, const Slice* end) {
   assert(level >= 0);
   assert(level + 1 < config::kNumLevels);
 
   InternalKey begin_storage, end_storage;
 
   ManualCompaction manual;
+  manual.cfd = cfd;
   manual.level = level;
   manual.done = false;
   if (begin == NULL) {
@@ -586,41 +878,104 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != NULL && bg_error_.ok()) {
+    while (has_imm_.NoBarrier_Load() != NULL && bg_error_.ok()) {
       bg_cv_.Wait();
     }
-    if (imm_ != NULL) {
+    if (has_imm_.NoBarrier_Load() != NULL) {
       s = bg_error_;
     }
   }
   return s;
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (logging_manifest_) {
+    bg_cv_.Wait();
+  }
+  logging_manifest_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  logging_manifest_ = false;
+  bg_cv_.SignalAll();
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.Acquire_Load()) {
+  if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
-  } else if (imm_ == NULL &&
-             manual_compaction_ == NULL &&
+    return;
+  }
+  if (has_imm_.NoBarrier_Load() != NULL && !bg_flush_scheduled_) {
+    bg_flush_scheduled_ = true;
+    env_->ScheduleWithPriority(&DBImpl::BGFlushWork, this,
+                               Env::kHighPriority);
+  }
+  if (bg_compaction_scheduled_ >= options_.max_background_compactions) {
+    // Already scheduled as many as allowed
+  } else if (manual_compaction_ == NULL &&
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    bg_compaction_scheduled_ = true;
+    // A job that manages to pick a compaction calls us again, so more
+    // jobs are added only while there is work for them.
+    bg_compaction_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
   }
 }
 
+void DBImpl::MaybeStartPeriodicCompactionTimer() {
+  mutex_.AssertHeld();
+  if (periodic_timer_running_ || shutting_down_.Acquire_Load()) {
+    return;
+  }
+  const std::vector<ColumnFamilyData*>& families =
+      versions_->column_families();
+  for (size_t i = 0; i < families.size(); i++) {
+    if (families[i]->options().periodic_compaction_seconds != 0) {
+      periodic_timer_running_ = true;
+      env_->StartThread(&DBImpl::PeriodicCompactionTimer, this);
+      return;
+    }
+  }
+}
+
+void DBImpl::PeriodicCompactionTimer(void* db) {
+  reinterpret_cast<DBImpl*>(db)->RunPeriodicCompactionTimer();
+}
+
+void DBImpl::RunPeriodicCompactionTimer() {
+  // Files come due without any other event, so look for due files
+  // every kPeriodicCompactionCheckMicros even if the DB is idle.  The
+  // other signals of bg_cv_ wake us up early; they are ignored.
+  MutexLock l(&mutex_);
+  uint64_t next_check = 0;
+  while (!shutting_down_.Acquire_Load()) {
+    const uint64_t now = env_->NowMicros();
+    if (now >= next_check) {
+      MaybeScheduleCompaction();
+      next_check = now + kPeriodicCompactionCheckMicros;
+    }
+    bg_cv_.TimedWait(std::min(next_check - now,
+                              kPeriodicCompactionCheckMicros));
+  }
+  periodic_timer_running_ = false;
+  bg_cv_.SignalAll();
+}
+
 void DBImpl::BGWork(void* db) {
-  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+  reinterpret_cast<DBImpl*>(db)->BackgroundCall(false);
 }
 
-void DBImpl::BackgroundCall() {
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundCall(true);
+}
+
+void DBImpl::BackgroundCall(bool flush) {
   MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
+  bool idle = false;
   if (!shutting_down_.Acquire_Load()) {
-    Status s = BackgroundCompaction();
+    Status s = flush ? BackgroundFlush() : BackgroundCompaction(&idle);
     if (s.ok()) {
       // Success
       consecutive_compaction_errors_ = 0;
@@ -645,30 +1000,94 @@ void DBImpl::BackgroundCall() {
     }
   }
 
-  bg_compaction_scheduled_ = false;
+  if (flush) {
+    assert(bg_flush_scheduled_);
+    bg_flush_scheduled_ = false;
+  } else {
+    assert(bg_compaction_scheduled_ > 0);
+    bg_compaction_scheduled_--;
+  }
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A job that found
+  // nothing to do leaves this to the compactions that kept it idle;
+  // otherwise it would keep rescheduling itself until they finish.
+  if (!idle) {
+    MaybeScheduleCompaction();
+  }
   bg_cv_.SignalAll();
 }
 
-Status DBImpl::BackgroundCompaction() {
+Status DBImpl::BackgroundFlush() {
+  mutex_.AssertHeld();
+  if (has_imm_.NoBarrier_Load() == NULL || flushing_imm_) {
+    // Already handled by a compaction thread
+    return Status::OK();
+  }
+  Status s = CompactMemTable();
+  RecordBackgroundError(s);
+  return s;
+}
+
+void DBImpl::RecordBackgroundError(const Status& s) {
+  mutex_.AssertHeld();
+  if (s.ok()) {
+    // Done
+  } else if (shutting_down_.Acquire_Load()) {
+    // Ignore compaction errors found during shutting down
+  } else {
+    Log(options_.info_log,
+        "Compaction error: %s", s.ToString().c_str());
+    if (options_.paranoid_checks && bg_error_.ok()) {
+      bg_error_ = s;
+    }
+  }
+}
+
+Status DBImpl::BackgroundCompaction(bool* idle) {
   mutex_.AssertHeld();
 
-  if (imm_ != NULL) {
-    return CompactMemTable();
+  // Let an in-progress manifest write finish first: a memtable flush
+  // that is installing a table past level-0 relies on no compaction
+  // picking inputs before its edit has been applied.
+  while (logging_manifest_) {
+    bg_cv_.Wait();
+  }
+  if (compactions_paused_) {
+    // We are rescheduled once compactions are allowed again
+    *idle = true;
+    return Status::OK();
+  }
+
+  // Released snapshots may let range deletions empty more files
+  Status status = DeleteFilesInDeletedRanges();
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+    return status;
   }
 
   Compaction* c;
   bool is_manual = (manual_compaction_ != NULL);
   InternalKey manual_end;
   if (is_manual) {
+    if (running_compactions_ > 0) {
+      // Manual compactions run alone; wait for the others to finish
+      *idle = true;
+      return Status::OK();
+    }
     ManualCompaction* m = manual_compaction_;
-    c = versions_->CompactRange(m->level, m->begin, m->end);
+    if (m->cfd->IsDropped()) {
+      c = NULL;
+    } else {
+      c = versions_->CompactRange(m->cfd, m->level, m->begin, m->end);
+    }
     m->done = (c == NULL);
     if (c != NULL) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
+      if (c->output_level() == c->level()) {
+        // A merge of level-0 runs takes in the whole level at once
+        m->done = true;
+      }
     }
     Log(options_.info_log,
         "Manual compaction at level-%d from %s .. %s; will stop at %s\n",
@@ -678,47 +1097,47 @@ Status DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == NULL) {
+      *idle = true;
+      return Status::OK();
+    }
   }
 
-  Status status;
   if (c == NULL) {
     // Nothing to do
-  } else if (!is_manual && c->IsTrivialMove()) {
-    // Move file to next level
-    assert(c->num_input_files(0) == 1);
-    FileMetaData* f = c->input(0, 0);
-    c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
-    VersionSet::LevelSummaryStorage tmp;
-    Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number),
-        c->level() + 1,
-        static_cast<unsigned long long>(f->file_size),
-        status.ToString().c_str(),
-        versions_->LevelSummary(&tmp));
-  } else {
-    CompactionState* compact = new CompactionState(c);
-    status = DoCompactionWork(compact);
-    CleanupCompaction(compact);
-    c->ReleaseInputs();
-    DeleteObsoleteFiles();
-  }
-  delete c;
-
-  if (status.ok()) {
-    // Done
-  } else if (shutting_down_.Acquire_Load()) {
-    // Ignore compaction errors found during shutting down
   } else {
-    Log(options_.info_log,
-        "Compaction error: %s", status.ToString().c_str());
-    if (options_.paranoid_checks && bg_error_.ok()) {
-      bg_error_ = status;
+    running_compactions_++;
+    if (!is_manual) {
+      // Let another thread look for more work while we are busy
+      MaybeScheduleCompaction();
+    }
+    if (!is_manual && c->IsTrivialMove()) {
+      // Move file to next level
+      assert(c->num_input_files(0) == 1);
+      FileMetaData* f = c->input(0, 0);
+      c->edit()->DeleteFile(c->level(), f->number);
+      c->edit()->AddFile(c->level() + 1, *f);
+      status = LogAndApply(c->edit());
+      VersionSet::LevelSummaryStorage tmp;
+      Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
+          static_cast<unsigned long long>(f->number),
+          c->level() + 1,
+          static_cast<unsigned long long>(f->file_size),
+          status.ToString().c_str(),
+          versions_->LevelSummary(c->column_family(), &tmp));
+    } else {
+      CompactionState* compact = new CompactionState(c);
+      status = DoCompactionWork(compact);
+      CleanupCompaction(compact);
+      c->ReleaseInputs();
+      DeleteObsoleteFiles();
     }
+    delete c;
+    running_compactions_--;
   }
 
+  RecordBackgroundError(status);
+
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
     if (!status.ok()) {
@@ -735,6 +1154,52 @@ Status DBImpl::BackgroundCompaction() {
   return status;
 }
 
+Status DBImpl::DeleteFilesInDeletedRanges() {
+  mutex_.AssertHeld();
+  const SequenceNumber smallest_snapshot = snapshots_.empty() ?
+      versions_->LastSequence() : snapshots_.oldest()->number_;
+  const std::vector<ColumnFamilyData*> families =
+      versions_->column_families();
+  bool deleted = false;
+  Status s;
+  for (size_t i = 0; s.ok() && i < families.size(); i++) {
+    ColumnFamilyData* cfd = families[i];
+    std::vector< std::pair<int, FileMetaData*> > files;
+    cfd->current()->GetFilesInDeletedRanges(smallest_snapshot, &files);
+    if (files.empty()) {
+      continue;
+    }
+
+    // Claim the files so that no compaction picks them while the edit
+    // is being written.  "base" keeps them alive until they are released.
+    Version* base = cfd->current();
+    base->Ref();
+    VersionEdit edit;
+    edit.SetColumnFamily(cfd->id());
+    uint64_t bytes = 0;
+    for (size_t f = 0; f < files.size(); f++) {
+      edit.DeleteFile(files[f].first, files[f].second->number);
+      files[f].second->being_compacted = true;
+      bytes += files[f].second->file_size;
+    }
+    s = LogAndApply(&edit);
+    for (size_t f = 0; f < files.size(); f++) {
+      files[f].second->being_compacted = false;
+    }
+    base->Unref();
+    Log(options_.info_log,
+        "Deleted %d files (%llu bytes) emptied by range deletions: %s",
+        static_cast<int>(files.size()),
+        static_cast<unsigned long long>(bytes),
+        s.ToString().c_str());
+    deleted = deleted || s.ok();
+  }
+  if (deleted) {
+    DeleteObsoleteFiles();
+  }
+  return s;
+}
+
 void DBImpl::CleanupCompaction(CompactionState* compact) {
   mutex_.AssertHeld();
   if (compact->builder != NULL) {
@@ -764,6 +1229,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.largest_seqno = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -772,7 +1238,14 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    if (options_.rate_limiter != NULL) {
+      compact->outfile = NewRateLimitedWritableFile(
+          compact->outfile, options_.rate_limiter, Env::kLowPriority);
+    }
+    const Compaction* c = compact->compaction;
+    compact->builder = new TableBuilder(
+        TableOptionsForLevel(c->column_family()->options(), c->output_level()),
+        compact->outfile);
   }
   return s;
 }
@@ -812,9 +1285,11 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
-    Iterator* iter = table_cache_->NewIterator(ReadOptions(),
-                                               output_number,
-                                               current_bytes);
+    TableCache* table_cache =
+        compact->compaction->column_family()->table_cache();
+    Iterator* iter = table_cache->NewIterator(ReadOptions(),
+                                              output_number,
+                                              current_bytes);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -840,19 +1315,25 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
+  const uint64_t now = env_->NowMicros() / 1000000;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(
-        level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
-  }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    f.largest_seqno = out.largest_seqno;
+    f.range_dels = out.range_dels;
+    f.creation_time = now;
+    compact->compaction->edit()->AddFile(level, f);
+  }
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0),
@@ -860,20 +1341,190 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       compact->compaction->num_input_files(1),
       compact->compaction->level() + 1);
 
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  assert(compact->compaction->column_family()->current()->NumFiles(
+      compact->compaction->level()) > 0);
   assert(compact->builder == NULL);
   assert(compact->outfile == NULL);
   if (snapshots_.empty()) {
     compact->smallest_snapshot = versions_->LastSequence();
+    compact->latest_snapshot = 0;
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
+    compact->latest_snapshot = snapshots_.newest()->number_;
+  }
+
+  // Split the key range so that each piece can be merged by its own
+  // thread.  The first piece is merged directly into *compact; the
+  // others get their own outputs, which are appended to
+  // compact->outputs in key order once they are done.
+  std::vector<Slice> boundaries;
+  compact->compaction->GetSplitPoints(options_.max_subcompactions,
+                                      &boundaries);
+  std::vector<Subcompaction*> subs(boundaries.size() + 1);
+  for (size_t i = 0; i < subs.size(); i++) {
+    Subcompaction* sub = new Subcompaction;
+    subs[i] = sub;
+    sub->db = this;
+    sub->inputs = compact->compaction;
+    if (i == 0) {
+      sub->state = compact;
+    } else {
+      sub->state = new CompactionState(
+          compact->compaction->NewSubcompaction());
+      sub->state->smallest_snapshot = compact->smallest_snapshot;
+      sub->state->latest_snapshot = compact->latest_snapshot;
+    }
+    sub->begin = (i == 0) ? NULL : &boundaries[i - 1];
+    sub->end = (i + 1 == subs.size()) ? NULL : &boundaries[i];
+    sub->imm_micros = 0;
+    sub->started = false;
+    sub->done = false;
+    sub->refs = 1;
+  }
+  if (subs.size() > 1) {
+    Log(options_.info_log, "Compaction split into %d subcompactions",
+        static_cast<int>(subs.size()));
+  }
+
+  // Offer the other pieces to the low priority thread pool, then merge
+  // every piece that no pool thread has started, so that a busy pool
+  // only makes the compaction run with fewer threads.
+  for (size_t i = 1; i < subs.size(); i++) {
+    subs[i]->refs++;
+    bg_subcompactions_scheduled_++;
+    env_->Schedule(&DBImpl::BGSubcompactionWork, subs[i]);
+  }
+  int64_t imm_micros = 0;  // Spent by this thread, within start_micros
+  for (size_t i = 0; i < subs.size(); i++) {
+    Subcompaction* sub = subs[i];
+    if (!sub->started) {
+      sub->started = true;
+      // Release mutex while we're actually doing the compaction work
+      mutex_.Unlock();
+      DoSubcompactionWork(sub);
+      mutex_.Lock();
+      sub->done = true;
+      imm_micros += sub->imm_micros;
+    }
   }
 
-  // Release mutex while we're actually doing the compaction work
-  mutex_.Unlock();
+  Status status;
+  for (size_t i = 0; i < subs.size(); i++) {
+    Subcompaction* sub = subs[i];
+    while (!sub->done) {
+      bg_cv_.Wait();
+    }
+    if (status.ok()) {
+      status = sub->status;
+    }
+    if (i > 0) {
+      CompactionState* state = sub->state;
+      if (state->builder != NULL) {
+        // Abandoned because of an error or a shutdown
+        state->builder->Abandon();
+        delete state->builder;
+      }
+      delete state->outfile;
+      compact->outputs.insert(compact->outputs.end(),
+                              state->outputs.begin(), state->outputs.end());
+      compact->total_bytes += state->total_bytes;
+      delete state->compaction;
+      delete state;
+    }
+    if (--sub->refs == 0) {
+      delete sub;
+    }
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+  stats_[compact->compaction->output_level()].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s",
+      versions_->LevelSummary(compact->compaction->column_family(), &tmp));
+  return status;
+}
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
+Status DBImpl::AddCompactionOutput(CompactionState* compact, Iterator* input,
+                                   const Slice& key, const Slice& value) {
+  // Open output file if necessary
+  if (compact->builder == NULL) {
+    Status s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  if (key.size() >= 8) {
+    const SequenceNumber seq = ExtractSequenceNumber(key);
+    if (seq > compact->current_output()->largest_seqno) {
+      compact->current_output()->largest_seqno = seq;
+    }
+    if (ExtractValueType(key) == kTypeRangeDeletion) {
+      compact->current_output()->range_dels.push_back(
+          RangeTombstone(ExtractUserKey(key), value, seq));
+    }
+  }
+  compact->builder->Add(key, value);
+
+  // Close output file if it is big enough
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    return FinishCompactionOutputFile(compact, input);
+  }
+  return Status::OK();
+}
+
+void DBImpl::BGSubcompactionWork(void* arg) {
+  Subcompaction* sub = reinterpret_cast<Subcompaction*>(arg);
+  DBImpl* db = sub->db;
+  MutexLock l(&db->mutex_);
+  if (!sub->started) {
+    sub->started = true;
+    db->mutex_.Unlock();
+    db->DoSubcompactionWork(sub);
+    db->mutex_.Lock();
+    sub->done = true;
+  }
+  if (--sub->refs == 0) {
+    delete sub;  // DoCompactionWork() merged it itself
+  }
+  db->bg_subcompactions_scheduled_--;
+  db->bg_cv_.SignalAll();
+}
+
+void DBImpl::DoSubcompactionWork(Subcompaction* sub) {
+  CompactionState* compact = sub->state;
+  const Comparator* ucmp = sub->inputs->column_family()->user_comparator();
+  const MergeOperator* merge_operator =
+      sub->inputs->column_family()->options().merge_operator;
+  const CompactionFilter* compaction_filter =
+      sub->inputs->column_family()->options().compaction_filter;
+  const RangeDelMap* range_dels = sub->inputs->range_dels();
+  std::vector<std::string> merge_keys, merge_values;
+  std::string filtered_key, filtered_value;
+  Iterator* input = versions_->MakeInputIterator(sub->inputs);
+  if (sub->begin != NULL) {
+    InternalKey start(*sub->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
@@ -884,15 +1535,20 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     if (has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
+      if (has_imm_.NoBarrier_Load() != NULL && !flushing_imm_) {
         CompactMemTable();
         bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      sub->imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
+    if (sub->end != NULL && key.size() >= 8 &&
+        ucmp->Compare(ExtractUserKey(key), *sub->end) >= 0) {
+      // Rest of the range belongs to the next subcompaction
+      break;
+    }
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != NULL) {
       status = FinishCompactionOutputFile(compact, input);
@@ -903,6 +1559,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool merge = false;
+    bool filtered = false;
+    SequenceNumber covering = 0;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -910,17 +1569,32 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key,
-                                     Slice(current_user_key)) != 0) {
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
       }
 
-      if (last_sequence_for_key <= compact->smallest_snapshot) {
+      if (range_dels != NULL) {
+        covering = range_dels->MaxCoveringSequence(
+            ikey.user_key, compact->smallest_snapshot);
+      }
+
+      if (ikey.type == kTypeRangeDeletion) {
+        // Newer entries for its first key do not hide the rest of the
+        // range.  Once every snapshot sees it, it is obsolete when no
+        // other file holds keys of the range: this compaction drops the
+        // entries that it deletes by rule (B) below.
+        drop = (ikey.sequence <= compact->smallest_snapshot &&
+                sub->inputs->IsRangeDeletionObsolete(ikey.user_key,
+                                                     input->value()));
+      } else if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
+      } else if (ikey.sequence < covering) {
+        // Deleted by a range deletion that every snapshot sees
+        drop = true;    // (B)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
                  compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
@@ -932,6 +1606,35 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (ikey.type == kTypeMerge && merge_operator != NULL &&
+                 ikey.sequence <= compact->smallest_snapshot) {
+        // Every snapshot sees this merge operand together with all the
+        // older entries for the key, so they can be folded into one.
+        merge = true;
+      } else if (ikey.type == kTypeValue && compaction_filter != NULL &&
+                 ikey.sequence > compact->latest_snapshot) {
+        bool value_changed = false;
+        filtered_value.clear();
+        if (compaction_filter->Filter(compact->compaction->level(),
+                                      ikey.user_key, input->value(),
+                                      &filtered_value, &value_changed)) {
+          if (ikey.sequence <= compact->smallest_snapshot &&
+              compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+            // Nothing older for the key to hide, as for deletions above
+            drop = true;
+          } else {
+            // Keep hiding the older entries for the key
+            filtered_key.clear();
+            AppendInternalKey(&filtered_key,
+                              ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                kTypeDeletion));
+            filtered_value.clear();
+            filtered = true;
+          }
+        } else if (value_changed) {
+          filtered_key = key.ToString();
+          filtered = true;
+        }
       }
 
       last_sequence_for_key = ikey.sequence;
@@ -946,27 +1649,33 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
+    if (merge) {
+      // Moves "input" past the entries it folds.  Those it leaves for
+      // the key are older than ikey and dropped by rule (A).
+      status = CompactMergeOperands(
+          ucmp, merge_operator, options_.info_log, input,
+          compact->compaction->IsBaseLevelForKey(ikey.user_key), covering,
+          &merge_keys, &merge_values);
+      for (size_t i = 0; status.ok() && i < merge_keys.size(); i++) {
+        status = AddCompactionOutput(compact, input, merge_keys[i],
+                                     merge_values[i]);
       }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+      if (!status.ok()) {
+        break;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      continue;
+    }
+
+    if (filtered) {
+      status = AddCompactionOutput(compact, input, filtered_key,
+                                   filtered_value);
+      if (!status.ok()) {
+        break;
+      }
+    } else if (!drop) {
+      status = AddCompactionOutput(compact, input, key, input->value());
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -983,29 +1692,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     status = input->status();
   }
   delete input;
-  input = NULL;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
+  sub->status = status;
 }
 
 namespace {
@@ -1028,29 +1715,44 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 }  // namespace
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      ColumnFamilyData* cfd,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
-  IterState* cleanup = new IterState;
+                                      uint32_t* seed,
+                                      std::vector<RangeTombstone>* range_dels,
+                                      const bool* prefix_seek) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
+  if (cfd->IsDropped()) {
+    mutex_.Unlock();
+    return NewErrorIterator(
+        Status::InvalidArgument("column family was dropped"));
+  }
 
   // Collect together all needed child iterators
+  IterState* cleanup = new IterState;
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != NULL) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  list.push_back(cfd->mem()->NewIterator());
+  cfd->mem()->Ref();
+  if (cfd->imm() != NULL) {
+    list.push_back(cfd->imm()->NewIterator());
+    cfd->imm()->Ref();
+  }
+  cfd->current()->AddIterators(options, &list, prefix_seek);
+  if (range_dels != NULL) {
+    cfd->mem()->AddRangeTombstones(range_dels);
+    if (cfd->imm() != NULL) {
+      cfd->imm()->AddRangeTombstones(range_dels);
+    }
+    cfd->current()->AddRangeTombstones(range_dels);
   }
-  versions_->current()->AddIterators(options, &list);
   Iterator* internal_iter =
-      NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
+      NewMergingIterator(&cfd->internal_comparator(), &list[0], list.size());
+  cfd->current()->Ref();
 
   cleanup->mu = &mutex_;
-  cleanup->mem = mem_;
-  cleanup->imm = imm_;
-  cleanup->version = versions_->current();
+  cleanup->mem = cfd->mem();
+  cleanup->imm = cfd->imm();
+  cleanup->version = cfd->current();
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
 
   *seed = ++seed_;
@@ -1061,7 +1763,8 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
-  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
+  return NewInternalIterator(ReadOptions(), versions_->default_column_family(),
+                             &ignored, &ignored_seed, NULL, NULL);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1069,11 +1772,60 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
-Status DBImpl::Get(const ReadOptions& options,
-                   const Slice& key,
-                   std::string* value) {
-  Status s;
-  MutexLock l(&mutex_);
+namespace {
+// Adds the time since "start_micros" to *hist when it goes out of scope.
+// REQUIRES: the mutex that guards *hist is held at that point.
+class LatencyRecorder {
+ public:
+  LatencyRecorder(Env* env, uint64_t start_micros, Histogram* hist)
+      : env_(env), start_micros_(start_micros), hist_(hist) { }
+  ~LatencyRecorder() {
+    if (hist_ != NULL) {
+      hist_->Add(env_->NowMicros() - start_micros_);
+    }
+  }
+
+ private:
+  Env* const env_;
+  const uint64_t start_micros_;
+  Histogram* const hist_;
+};
+}  // namespace
+
+// Applies the merge operands found by a lookup of "key" to the result
+// of the lookup: the value in *value if "s" is OK, or no value if "s" is
+// NotFound.  Other errors are returned as they are.
+static Status MergeOperands(const Options& options, const Slice& key,
+                            const Status& s,
+                            const std::deque<std::string>& operands,
+                            std::string* value) {
+  if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  }
+  Slice existing(*value);
+  return ApplyMergeOperands(options.merge_operator, key,
+                            s.ok() ? &existing : NULL, operands, value,
+                            options.info_log);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   const Slice& key,
+                   std::string* value) {
+  return Get(options, default_cf_handle_, key, value);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   ColumnFamilyHandle* column_family,
+                   const Slice& key,
+                   std::string* value) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  Status s;
+  const uint64_t start_micros = env_->NowMicros();
+  PerfTimer mutex_timer(env_, &perf_context.db_mutex_wait_time);
+  MutexLock l(&mutex_);
+  mutex_timer.Stop();
+  LatencyRecorder latency(env_, start_micros, &get_latency_);
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
@@ -1081,9 +1833,12 @@ Status DBImpl::Get(const ReadOptions& options,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
+  if (cfd->IsDropped()) {
+    return Status::InvalidArgument("column family was dropped");
+  }
+  MemTable* mem = cfd->mem();
+  MemTable* imm = cfd->imm();
+  Version* current = cfd->current();
   mem->Ref();
   if (imm != NULL) imm->Ref();
   current->Ref();
@@ -1096,14 +1851,20 @@ Status DBImpl::Get(const ReadOptions& options,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
+    std::deque<std::string> operands;
+    SequenceNumber covering = 0;
+    if (mem->Get(lkey, value, &s, &operands, &covering)) {
+      PERF_COUNTER_ADD(get_from_memtable_count, 1);
+    } else if (imm != NULL &&
+               imm->Get(lkey, value, &s, &operands, &covering)) {
+      PERF_COUNTER_ADD(get_from_memtable_count, 1);
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, covering, value, &operands, &stats);
       have_stat_update = true;
     }
+    if (!operands.empty()) {
+      s = MergeOperands(cfd->options(), key, s, operands, value);
+    }
     mutex_.Lock();
   }
 
@@ -1116,21 +1877,172 @@ Status DBImpl::Get(const ReadOptions& options,
   return s;
 }
 
+namespace {
+// Orders indexes into a vector of user keys by key.
+struct KeyIndexLess {
+  const Comparator* ucmp;
+  const std::vector<Slice>* keys;
+  bool operator()(size_t a, size_t b) const {
+    return ucmp->Compare((*keys)[a], (*keys)[b]) < 0;
+  }
+};
+}  // namespace
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  MultiGet(options, default_cf_handle_, keys, values, statuses);
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      ColumnFamilyHandle* column_family,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  const size_t n = keys.size();
+  values->resize(n);
+  statuses->resize(n);
+  const uint64_t start_micros = env_->NowMicros();
+  PerfTimer mutex_timer(env_, &perf_context.db_mutex_wait_time);
+  MutexLock l(&mutex_);
+  mutex_timer.Stop();
+  LatencyRecorder latency(env_, start_micros, &multiget_latency_);
+  if (cfd->IsDropped()) {
+    for (size_t i = 0; i < n; i++) {
+      (*values)[i].clear();
+      (*statuses)[i] = Status::InvalidArgument("column family was dropped");
+    }
+    return;
+  }
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = cfd->mem();
+  MemTable* imm = cfd->imm();
+  Version* current = cfd->current();
+  mem->Ref();
+  if (imm != NULL) imm->Ref();
+  current->Ref();
+
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    // Visit the keys in order, so that keys that live in the same table
+    // file or block are looked up together.
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    KeyIndexLess less;
+    less.ucmp = cfd->user_comparator();
+    less.keys = &keys;
+    std::stable_sort(order.begin(), order.end(), less);
+
+    std::vector<LookupKey*> lkeys(n);
+    std::vector<std::deque<std::string> > operands(n);
+    std::vector<SequenceNumber> coverings(n, 0);
+    std::vector<const LookupKey*> table_keys;
+    std::vector<SequenceNumber> table_coverings;
+    std::vector<std::string*> table_values;
+    std::vector<std::deque<std::string>*> table_operands;
+    std::vector<size_t> table_index;
+    for (size_t o = 0; o < n; o++) {
+      const size_t i = order[o];
+      std::string* value = &(*values)[i];
+      Status* s = &(*statuses)[i];
+      value->clear();
+      *s = Status::OK();
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      if (mem->Get(*lkeys[i], value, s, &operands[i], &coverings[i])) {
+        PERF_COUNTER_ADD(get_from_memtable_count, 1);
+      } else if (imm != NULL &&
+                 imm->Get(*lkeys[i], value, s, &operands[i], &coverings[i])) {
+        PERF_COUNTER_ADD(get_from_memtable_count, 1);
+      } else {
+        table_keys.push_back(lkeys[i]);
+        table_coverings.push_back(coverings[i]);
+        table_values.push_back(value);
+        table_operands.push_back(&operands[i]);
+        table_index.push_back(i);
+      }
+    }
+    if (!table_keys.empty()) {
+      std::vector<Status> table_statuses(table_keys.size());
+      stats.resize(table_keys.size());
+      current->MultiGet(options, &table_keys[0], table_keys.size(),
+                        &table_coverings[0], &table_values[0],
+                        &table_operands[0], &table_statuses[0], &stats[0]);
+      for (size_t t = 0; t < table_index.size(); t++) {
+        (*statuses)[table_index[t]] = table_statuses[t];
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (!operands[i].empty()) {
+        (*statuses)[i] = MergeOperands(cfd->options(), keys[i],
+                                       (*statuses)[i], operands[i],
+                                       &(*values)[i]);
+      }
+      delete lkeys[i];
+    }
+    mutex_.Lock();
+  }
+
+  bool need_compaction = false;
+  for (size_t i = 0; i < stats.size(); i++) {
+    if (current->UpdateStats(stats[i])) {
+      need_compaction = true;
+    }
+  }
+  if (need_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != NULL) imm->Unref();
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  return NewIterator(options, default_cf_handle_);
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  std::vector<RangeTombstone> tombstones;
+  bool* prefix_seek = NULL;
+  if (options.prefix_same_as_start &&
+      cfd->options().prefix_extractor != NULL) {
+    prefix_seek = new bool(false);
+  }
+  Iterator* iter = NewInternalIterator(options, cfd, &latest_snapshot, &seed,
+                                       &tombstones, prefix_seek);
+  RangeDelMap* range_dels = NULL;
+  if (!tombstones.empty()) {
+    range_dels = new RangeDelMap(cfd->user_comparator(), tombstones);
+  }
   return NewDBIterator(
-      this, user_comparator(), iter,
+      this, cfd, options, cfd->user_comparator(), iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
-      seed);
+      seed, range_dels, prefix_seek);
 }
 
-void DBImpl::RecordReadSample(Slice key) {
+void DBImpl::RecordReadSample(ColumnFamilyData* cfd, Slice key) {
   MutexLock l(&mutex_);
-  if (versions_->current()->RecordReadSample(key)) {
+  if (!cfd->IsDropped() && cfd->current()->RecordReadSample(key)) {
     MaybeScheduleCompaction();
   }
 }
@@ -1154,48 +2066,174 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Put(const WriteOptions& o, ColumnFamilyHandle* column_family,
+                   const Slice& key, const Slice& val) {
+  Status s = CheckNotDropped(column_family);
+  if (!s.ok()) {
+    return s;
+  }
+  return DB::Put(o, column_family, key, val);
+}
+
+Status DBImpl::Delete(const WriteOptions& options,
+                      ColumnFamilyHandle* column_family, const Slice& key) {
+  Status s = CheckNotDropped(column_family);
+  if (!s.ok()) {
+    return s;
+  }
+  return DB::Delete(options, column_family, key);
+}
+
+Status DBImpl::Merge(const WriteOptions& o, const Slice& key,
+                     const Slice& val) {
+  return Merge(o, default_cf_handle_, key, val);
+}
+
+Status DBImpl::Merge(const WriteOptions& o, ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& val) {
+  Status s = CheckNotDropped(column_family);
+  if (!s.ok()) {
+    return s;
+  }
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  if (cfd->options().merge_operator == NULL) {
+    return Status::InvalidArgument("column family has no merge operator");
+  }
+  return DB::Merge(o, column_family, key, val);
+}
+
+Status DBImpl::DeleteRange(const WriteOptions& o, const Slice& begin_key,
+                           const Slice& end_key) {
+  return DeleteRange(o, default_cf_handle_, begin_key, end_key);
+}
+
+Status DBImpl::DeleteRange(const WriteOptions& o,
+                           ColumnFamilyHandle* column_family,
+                           const Slice& begin_key, const Slice& end_key) {
+  Status s = CheckNotDropped(column_family);
+  if (!s.ok()) {
+    return s;
+  }
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  if (cfd->user_comparator()->Compare(begin_key, end_key) >= 0) {
+    return s;  // Nothing to delete
+  }
+  return DB::DeleteRange(o, column_family, begin_key, end_key);
+}
+
+Status DBImpl::CheckNotDropped(ColumnFamilyHandle* column_family) {
+  MutexLock l(&mutex_);
+  if (reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd()
+          ->IsDropped()) {
+    return Status::InvalidArgument("column family was dropped");
+  }
+  return Status::OK();
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   Writer w(&mutex_);
   w.batch = my_batch;
   w.sync = options.sync;
   w.done = false;
 
+  const uint64_t start_micros = env_->NowMicros();
+  PerfTimer mutex_timer(env_, &perf_context.db_mutex_wait_time);
   MutexLock l(&mutex_);
+  mutex_timer.Stop();
+  // NULL batches are compaction requests; leave them out.
+  LatencyRecorder latency(env_, start_micros,
+                          my_batch != NULL ? &write_latency_ : NULL);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  // Unless writes are pipelined, the next leader waits until the
+  // previous group has finished its memtable inserts.
+  while (!w.done && w.group == NULL &&
+         (&w != writers_.front() ||
+          (!options_.enable_pipelined_write && !memtable_groups_.empty()))) {
     w.cv.Wait();
   }
   if (w.done) {
     return w.status;
   }
+  if (w.group != NULL) {
+    // The leader logged our batch; it is our turn to insert it
+    return ApplyWriteGroup(&w);
+  }
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(my_batch == NULL);
-  uint64_t last_sequence = versions_->LastSequence();
+  uint64_t last_sequence = memtable_groups_.empty()
+      ? versions_->LastSequence()
+      : memtable_groups_.back()->last_sequence;
   Writer* last_writer = &w;
   if (status.ok() && my_batch != NULL) {  // NULL batch is for compactions
     WriteBatch* updates = BuildBatchGroup(&last_writer);
-    WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+    // May temporarily unlock and sleep if writes are being slowed down.
+    DelayWrite(WriteBatchInternal::ByteSize(updates));
+    bytes_ingested_ += WriteBatchInternal::ByteSize(updates);
+    SequenceNumber seq = last_sequence + 1;
+    WriteBatchInternal::SetSequence(updates, seq);
     last_sequence += WriteBatchInternal::Count(updates);
 
-    // Add to log and apply to memtable.  We can release the lock
-    // during this phase since &w is currently responsible for logging
-    // and protects against concurrent loggers and concurrent writes
-    // into mem_.
+    // Add to log.  We can release the lock during this phase since &w
+    // is currently responsible for logging and protects against
+    // concurrent loggers.
     {
       mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+      {
+        PerfTimer timer(env_, &perf_context.wal_write_time);
+        status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+      }
       if (status.ok() && options.sync) {
+        PerfTimer timer(env_, &perf_context.wal_sync_time);
         status = logfile_->Sync();
       }
-      if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(updates, mem_);
-      }
       mutex_.Lock();
     }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
-    versions_->SetLastSequence(last_sequence);
+    // Hand the group over to the memtable stage and let the next
+    // leader in.
+    WriteGroup* group = new WriteGroup;
+    const std::vector<ColumnFamilyData*>& families =
+        versions_->column_families();
+    for (size_t i = 0; i < families.size(); i++) {
+      const uint32_t id = families[i]->id();
+      if (group->mems.size() <= id) {
+        group->mems.resize(id + 1, NULL);
+      }
+      group->mems[id] = families[i]->mem();
+    }
+    group->last_sequence = last_sequence;
+    group->concurrent = status.ok() && options_.allow_concurrent_memtable_write;
+    group->status = status;
+    while (true) {
+      Writer* ready = writers_.front();
+      writers_.pop_front();
+      ready->group = group;
+      group->writers.push_back(ready);
+      if (ready->batch != NULL) {
+        WriteBatchInternal::SetSequence(ready->batch, seq);
+        seq += WriteBatchInternal::Count(ready->batch);
+      }
+      if (ready == last_writer) break;
+    }
+    if (!status.ok()) {
+      group->pending = 0;
+    } else if (group->concurrent) {
+      group->pending = group->writers.size();
+      for (size_t i = 1; i < group->writers.size(); i++) {
+        group->writers[i]->cv.Signal();
+      }
+    } else {
+      group->pending = 1;
+    }
+    memtable_groups_.push_back(group);
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+    return ApplyWriteGroup(&w);
   }
 
   while (true) {
@@ -1217,6 +2255,77 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   return status;
 }
 
+// REQUIRES: w->group has been logged
+Status DBImpl::ApplyWriteGroup(Writer* w) {
+  mutex_.AssertHeld();
+  WriteGroup* group = w->group;
+  if (group->concurrent) {
+    if (w->batch != NULL) {
+      mutex_.Unlock();
+      Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch,
+                                                            group->mems);
+      mutex_.Lock();
+      if (!s.ok() && group->status.ok()) {
+        group->status = s;
+      }
+    }
+    group->pending--;
+  } else if (w == group->writers[0] && group->pending > 0) {
+    // The skiplist takes one serial inserter at a time, so wait for the
+    // earlier groups to finish.
+    while (memtable_groups_.front() != group) {
+      w->cv.Wait();
+    }
+    mutex_.Unlock();
+    Status s;
+    for (size_t i = 0; i < group->writers.size() && s.ok(); i++) {
+      if (group->writers[i]->batch != NULL) {
+        s = WriteBatchInternal::InsertInto(group->writers[i]->batch,
+                                           group->mems);
+      }
+    }
+    mutex_.Lock();
+    group->status = s;
+    group->pending = 0;
+  }
+
+  if (group->pending == 0) {
+    PublishWriteGroups();
+  }
+  while (!w->done) {
+    w->cv.Wait();
+  }
+  return w->status;
+}
+
+// Make the writes of finished groups visible, in sequence order.
+void DBImpl::PublishWriteGroups() {
+  mutex_.AssertHeld();
+  while (!memtable_groups_.empty() && memtable_groups_.front()->pending == 0) {
+    WriteGroup* group = memtable_groups_.front();
+    memtable_groups_.pop_front();
+    versions_->SetLastSequence(group->last_sequence);
+    for (size_t i = 0; i < group->writers.size(); i++) {
+      Writer* ready = group->writers[i];
+      ready->status = group->status;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+    delete group;
+  }
+
+  if (memtable_groups_.empty()) {
+    // MakeRoomForWrite() and the next leader wait for the memtable
+    // inserts to drain.
+    bg_cv_.SignalAll();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+  } else {
+    memtable_groups_.front()->writers[0]->cv.Signal();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-NULL batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1244,6 +2353,10 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Do not include a sync write into a batch handled by a non-sync write.
       break;
     }
+    if (w->batch == NULL) {
+      // Compaction requests and file ingestion need to lead the queue.
+      break;
+    }
 
     if (w->batch != NULL) {
       size += WriteBatchInternal::ByteSize(w->batch);
@@ -1271,45 +2384,41 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (
-        allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
-    } else if (!force &&
-               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
+    } else if (!force && !MemTablesFull()) {
       // There is room in current memtable
       break;
-    } else if (imm_ != NULL) {
+    } else if (has_imm_.NoBarrier_Load() != NULL) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      PerfTimer timer(env_, &perf_context.write_stall_time);
       bg_cv_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    } else if (versions_->MaxLevel0Files() >=
+               options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      WaitForCompactions();
+    } else if (options_.hard_pending_compaction_bytes_limit != 0 &&
+               versions_->EstimatedCompactionDebt() >=
+               options_.hard_pending_compaction_bytes_limit) {
+      // Compactions have fallen too far behind.
+      Log(options_.info_log, "Too much pending compaction; waiting...\n");
+      WaitForCompactions();
+    } else if (!memtable_groups_.empty()) {
+      // Earlier write groups are still being inserted into the memtables.
       bg_cv_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = NULL;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      s = NewLogFile(new_log_number, &lfile);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1319,11 +2428,19 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       delete logfile_;
       logfile_ = lfile;
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.Release_Store(imm_);
-      mem_ = new MemTable(internal_comparator_);
-      mem_->Ref();
+      log_ = new log::Writer(lfile, new_log_number,
+                             options_.recycle_log_file_num > 0);
+      // All column families share the log, so they all switch to new
+      // memtables with it.
+      const std::vector<ColumnFamilyData*>& families =
+          versions_->column_families();
+      for (size_t i = 0; i < families.size(); i++) {
+        ColumnFamilyData* cfd = families[i];
+        cfd->mem()->MarkReadOnly();
+        cfd->SetImmutableMemTable(cfd->mem());
+        cfd->SetMemTable(NewMemTable(cfd));
+      }
+      has_imm_.Release_Store(this);
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1331,7 +2448,417 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+Status DBImpl::NewLogFile(uint64_t number, WritableFile** file) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(dbname_, number);
+  if (recycled_logs_.empty()) {
+    return env_->NewWritableFile(fname, file);
+  }
+  const uint64_t old_number = recycled_logs_.front();
+  recycled_logs_.pop_front();
+  Log(options_.info_log, "Reusing log #%llu as #%llu\n",
+      static_cast<unsigned long long>(old_number),
+      static_cast<unsigned long long>(number));
+  return env_->ReuseWritableFile(fname, LogFileName(dbname_, old_number),
+                                 file);
+}
+
+// Has the memtable of some column family outgrown its write buffer?
+bool DBImpl::MemTablesFull() {
+  mutex_.AssertHeld();
+  const std::vector<ColumnFamilyData*>& families =
+      versions_->column_families();
+  for (size_t i = 0; i < families.size(); i++) {
+    ColumnFamilyData* cfd = families[i];
+    if (cfd->mem()->ApproximateMemoryUsage() >
+        cfd->options().write_buffer_size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void DBImpl::WaitForCompactions() {
+  mutex_.AssertHeld();
+  PerfTimer timer(env_, &perf_context.write_stall_time);
+  const uint64_t start_micros = env_->NowMicros();
+  bg_cv_.Wait();
+  stopped_writes_++;
+  write_stop_micros_ += env_->NowMicros() - start_micros;
+}
+
+double DBImpl::DelayedWriteRate() {
+  mutex_.AssertHeld();
+  // How far each slowdown threshold has been overrun, as a fraction of
+  // the distance to the matching stop threshold.
+  double pressure = -1;
+  const int level0_files = versions_->MaxLevel0Files();
+  if (level0_files >= options_.level0_slowdown_writes_trigger) {
+    pressure = static_cast<double>(
+        level0_files - options_.level0_slowdown_writes_trigger) /
+        (options_.level0_stop_writes_trigger -
+         options_.level0_slowdown_writes_trigger);
+  }
+  const uint64_t debt = versions_->EstimatedCompactionDebt();
+  const uint64_t soft_limit = options_.soft_pending_compaction_bytes_limit;
+  const uint64_t hard_limit = options_.hard_pending_compaction_bytes_limit;
+  if (soft_limit != 0 && debt >= soft_limit) {
+    double debt_pressure = 0;
+    if (hard_limit > soft_limit) {
+      debt_pressure = static_cast<double>(debt - soft_limit) /
+          (hard_limit - soft_limit);
+    }
+    pressure = std::max(pressure, debt_pressure);
+  }
+  if (pressure < 0) {
+    return 0;
+  }
+  return options_.delayed_write_rate *
+      std::max(1 - pressure, kMinDelayedWriteRateFraction);
+}
+
+void DBImpl::DelayWrite(size_t bytes) {
+  mutex_.AssertHeld();
+  const double rate = DelayedWriteRate();
+  if (rate == 0) {
+    return;
+  }
+
+  // Admit the bytes at "rate".  Time spent below the rate is not banked
+  // for later bursts, and the writer only sleeps once it is at least
+  // kMinWriteDelayMicros ahead, so that small writes are not each
+  // paying for a sleep that the OS cannot time accurately anyway.
+  const uint64_t now = env_->NowMicros();
+  if (delayed_write_until_ < now) {
+    delayed_write_until_ = now;
+  }
+  delayed_write_until_ += static_cast<uint64_t>(bytes * 1e6 / rate);
+  const uint64_t delay = delayed_write_until_ - now;
+  if (delay >= kMinWriteDelayMicros) {
+    PerfTimer timer(env_, &perf_context.write_stall_time);
+    mutex_.Unlock();
+    env_->SleepForMicroseconds(static_cast<int>(delay));
+    mutex_.Lock();
+    delayed_writes_++;
+    write_delay_micros_ += delay;
+  }
+}
+
+namespace {
+// Store in *smallest and *largest the first and last keys of the table
+// file "fname" written by an SstFileWriter, and its size in *file_size.
+Status ReadExternalFileRange(const Options& options, const std::string& fname,
+                             uint64_t* file_size,
+                             InternalKey* smallest, InternalKey* largest) {
+  Env* env = options.env;
+  Status s = env->GetFileSize(fname, file_size);
+  RandomAccessFile* file = NULL;
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(fname, &file);
+  }
+  Table* table = NULL;
+  if (s.ok()) {
+    s = Table::Open(options, file, *file_size, &table);
+  }
+  if (s.ok()) {
+    ReadOptions read_options;
+    read_options.verify_checksums = true;
+    read_options.fill_cache = false;
+    Iterator* iter = table->NewIterator(read_options);
+    ParsedInternalKey first, last;
+    bool found = false;
+    iter->SeekToFirst();
+    if (iter->Valid() && ParseInternalKey(iter->key(), &first) &&
+        first.sequence == 0) {
+      smallest->DecodeFrom(iter->key());
+      iter->SeekToLast();
+      if (iter->Valid() && ParseInternalKey(iter->key(), &last) &&
+          last.sequence == 0) {
+        largest->DecodeFrom(iter->key());
+        found = true;
+      }
+    }
+    if (!iter->status().ok()) {
+      s = iter->status();
+    } else if (!found) {
+      s = Status::InvalidArgument(fname, "not a file built by SstFileWriter");
+    }
+    delete iter;
+  }
+  delete table;
+  delete file;
+  return s;
+}
+
+Status CopyFile(Env* env, const std::string& src, const std::string& dst) {
+  SequentialFile* in = NULL;
+  WritableFile* out = NULL;
+  Status s = env->NewSequentialFile(src, &in);
+  if (s.ok()) {
+    s = env->NewWritableFile(dst, &out);
+  }
+  if (s.ok()) {
+    const size_t kBufferSize = 1 << 20;
+    char* buffer = new char[kBufferSize];
+    while (s.ok()) {
+      Slice chunk;
+      s = in->Read(kBufferSize, &chunk, buffer);
+      if (!s.ok() || chunk.empty()) {
+        break;
+      }
+      s = out->Append(chunk);
+    }
+    delete[] buffer;
+    if (s.ok()) {
+      s = out->Sync();
+    }
+    if (s.ok()) {
+      s = out->Close();
+    }
+  }
+  delete out;
+  delete in;
+  return s;
+}
+
+// Returns true iff "mem" holds an entry in [smallest,largest].
+bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                      const Slice& smallest, const Slice& largest) {
+  InternalKey start(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+  Iterator* iter = mem->NewIterator();
+  iter->Seek(start.Encode());
+  const bool overlaps =
+      iter->Valid() && ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  return overlaps;
+}
+}  // namespace
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions& options,
+                                  const std::string& fname) {
+  return IngestExternalFile(options, default_cf_handle_, fname);
+}
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions& options,
+                                  ColumnFamilyHandle* column_family,
+                                  const std::string& fname) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  Status s = CheckNotDropped(column_family);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Check the file and find its key range before taking any locks.
+  FileMetaData meta;
+  s = ReadExternalFileRange(cfd->options(), fname, &meta.file_size,
+                            &meta.smallest, &meta.largest);
+  if (!s.ok()) {
+    return s;
+  }
+  const std::string smallest_user_key = meta.smallest.user_key().ToString();
+  const std::string largest_user_key = meta.largest.user_key().ToString();
+
+  {
+    MutexLock l(&mutex_);
+    meta.number = versions_->NewFileNumber();
+    pending_outputs_.insert(meta.number);
+  }
+  const std::string dst = TableFileName(dbname_, meta.number);
+  if (options.move_files) {
+    s = env_->RenameFile(fname, dst);
+  } else {
+    s = CopyFile(env_, fname, dst);
+  }
+  if (!s.ok()) {
+    MutexLock l(&mutex_);
+    pending_outputs_.erase(meta.number);
+    return s;
+  }
+
+  // Hold off other writers, and so memtable switches, while the file is
+  // being added.
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.done = false;
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_groups_.empty()) {
+    bg_cv_.Wait();
+  }
+  if (cfd->IsDropped()) {
+    s = Status::InvalidArgument("column family was dropped");
+  }
+
+  // Memtable entries in the file's range are older than the file's, but
+  // reads look in the memtable first, so flush them out.
+  if (s.ok() && MemTableOverlaps(cfd->mem(), cfd->user_comparator(),
+                       smallest_user_key, largest_user_key)) {
+    s = MakeRoomForWrite(true /* force switch */);
+  }
+  while (s.ok() && has_imm_.NoBarrier_Load() != NULL && bg_error_.ok()) {
+    bg_cv_.Wait();
+  }
+  if (s.ok()) {
+    s = bg_error_;
+  }
+
+  // Running compactions may write files that span the file's range into
+  // the levels we would pick, so pick once they are done, and keep new
+  // ones from starting until the file is in place.
+  compactions_paused_ = true;
+  while (s.ok() && running_compactions_ > 0) {
+    bg_cv_.Wait();
+  }
+
+  if (s.ok()) {
+    const SequenceNumber seq = versions_->LastSequence() + 1;
+    versions_->SetLastSequence(seq);
+    meta.global_seqno = seq;
+    meta.largest_seqno = seq;
+    meta.creation_time = env_->NowMicros() / 1000000;
+    meta.smallest = InternalKey(smallest_user_key, seq,
+                                ExtractValueType(meta.smallest.Encode()));
+    meta.largest = InternalKey(largest_user_key, seq,
+                               ExtractValueType(meta.largest.Encode()));
+    const int level = cfd->current()->PickLevelForIngestedFile(
+        smallest_user_key, largest_user_key);
+    VersionEdit edit;
+    edit.SetColumnFamily(cfd->id());
+    edit.AddFile(level, meta);
+    s = LogAndApply(&edit);
+    if (s.ok()) {
+      bytes_ingested_ += meta.file_size;
+    }
+    Log(options_.info_log, "Ingested %s as #%llu at level-%d: %s",
+        fname.c_str(), static_cast<unsigned long long>(meta.number), level,
+        s.ToString().c_str());
+  }
+  compactions_paused_ = false;
+  MaybeScheduleCompaction();
+
+  pending_outputs_.erase(meta.number);
+  if (!s.ok()) {
+    if (options.move_files) {
+      env_->RenameFile(dst, fname);
+    } else {
+      env_->DeleteFile(dst);
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
+Status DBImpl::CreateColumnFamily(const Options& options,
+                                  const std::string& name,
+                                  ColumnFamilyHandle** handle) {
+  *handle = NULL;
+  Status s = CheckCompression(options);
+  if (!s.ok()) {
+    return s;
+  }
+
+  MutexLock l(&mutex_);
+  while (logging_manifest_) {
+    bg_cv_.Wait();
+  }
+  if (versions_->GetColumnFamily(name) != NULL) {
+    return Status::InvalidArgument(name, "column family already exists");
+  }
+  logging_manifest_ = true;
+  ColumnFamilyData* cfd;
+  s = versions_->CreateColumnFamily(name,
+                                    SanitizeColumnFamilyOptions(options_,
+                                                                options),
+                                    logfile_number_, &mutex_, &cfd);
+  logging_manifest_ = false;
+  bg_cv_.SignalAll();
+  if (s.ok()) {
+    cfd->SetMemTable(NewMemTable(cfd));
+    *handle = new ColumnFamilyHandleImpl(cfd);
+    Log(options_.info_log, "Created column family %s (id %u)",
+        name.c_str(), static_cast<unsigned int>(cfd->id()));
+    MaybeStartPeriodicCompactionTimer();
+  }
+  return s;
+}
+
+Status DBImpl::DropColumnFamily(ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  if (cfd->id() == 0) {
+    return Status::InvalidArgument("cannot drop the default column family");
+  }
+
+  // Hold off other writers, so that no write group refers to the
+  // family's memtable, and wait for the background work that reads it.
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.done = false;
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_groups_.empty()) {
+    bg_cv_.Wait();
+  }
+  compactions_paused_ = true;
+  while (bg_error_.ok() &&
+         (has_imm_.NoBarrier_Load() != NULL || running_compactions_ > 0 ||
+          logging_manifest_)) {
+    bg_cv_.Wait();
+  }
+
+  Status s = bg_error_;
+  if (s.ok() && cfd->IsDropped()) {
+    s = Status::InvalidArgument("column family was dropped");
+  }
+  if (s.ok()) {
+    logging_manifest_ = true;
+    s = versions_->DropColumnFamily(cfd, &mutex_);
+    logging_manifest_ = false;
+    bg_cv_.SignalAll();
+  }
+  if (s.ok()) {
+    assert(cfd->imm() == NULL);
+    cfd->mem()->Unref();
+    cfd->SetMemTable(NULL);
+    Log(options_.info_log, "Dropped column family %s (id %u)",
+        cfd->name().c_str(), static_cast<unsigned int>(cfd->id()));
+    DeleteObsoleteFiles();
+  }
+  compactions_paused_ = false;
+  MaybeScheduleCompaction();
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
+ColumnFamilyHandle* DBImpl::DefaultColumnFamily() const {
+  return default_cf_handle_;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
+  return GetProperty(default_cf_handle_, property, value);
+}
+
+bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
+                         const Slice& property, std::string* value) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
   value->clear();
 
   MutexLock l(&mutex_);
@@ -1340,7 +2867,9 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   if (!in.starts_with(prefix)) return false;
   in.remove_prefix(prefix.size());
 
-  if (in.starts_with("num-files-at-level")) {
+  if (cfd->IsDropped()) {
+    return false;
+  } else if (in.starts_with("num-files-at-level")) {
     in.remove_prefix(strlen("num-files-at-level"));
     uint64_t level;
     bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
@@ -1349,7 +2878,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     } else {
       char buf[100];
       snprintf(buf, sizeof(buf), "%d",
-               versions_->NumLevelFiles(static_cast<int>(level)));
+               cfd->current()->NumFiles(static_cast<int>(level)));
       *value = buf;
       return true;
     }
@@ -1362,14 +2891,14 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
              );
     value->append(buf);
     for (int level = 0; level < config::kNumLevels; level++) {
-      int files = versions_->NumLevelFiles(level);
+      int files = cfd->current()->NumFiles(level);
       if (stats_[level].micros > 0 || files > 0) {
         snprintf(
             buf, sizeof(buf),
             "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
             level,
             files,
-            versions_->NumLevelBytes(level) / 1048576.0,
+            cfd->current()->NumLevelBytes(level) / 1048576.0,
             stats_[level].micros / 1e6,
             stats_[level].bytes_read / 1048576.0,
             stats_[level].bytes_written / 1048576.0);
@@ -1378,7 +2907,70 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     }
     return true;
   } else if (in == "sstables") {
-    *value = versions_->current()->DebugString();
+    *value = cfd->current()->DebugString();
+    return true;
+  } else if (in == "latency.get") {
+    *value = get_latency_.ToString();
+    return true;
+  } else if (in == "latency.multiget") {
+    *value = multiget_latency_.ToString();
+    return true;
+  } else if (in == "latency.write") {
+    *value = write_latency_.ToString();
+    return true;
+  } else if (in == "perf-context") {
+    *value = perf_context.ToString();
+    return true;
+  } else if (in == "write-stalls") {
+    char buf[300];
+    snprintf(buf, sizeof(buf),
+             "Compaction debt(MB): %.1f\n"
+             "Write rate limit(MB/s): %.1f\n"
+             "                Count Time(sec)\n"
+             "Delayed    %10llu %9.3f\n"
+             "Stopped    %10llu %9.3f\n",
+             versions_->EstimatedCompactionDebt() / 1048576.0,
+             DelayedWriteRate() / 1048576.0,
+             static_cast<unsigned long long>(delayed_writes_),
+             write_delay_micros_ / 1e6,
+             static_cast<unsigned long long>(stopped_writes_),
+             write_stop_micros_ / 1e6);
+    *value = buf;
+    return true;
+  } else if (in == "write-amplification") {
+    uint64_t written = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      written += stats_[level].bytes_written;
+    }
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Ingested(MB): %.1f\n"
+             "Flushed(MB): %.1f\n"
+             "Compacted(MB): %.1f\n"
+             "Write amplification: %.2f\n",
+             bytes_ingested_ / 1048576.0,
+             bytes_flushed_ / 1048576.0,
+             (written - bytes_flushed_) / 1048576.0,
+             (bytes_ingested_ > 0) ?
+             static_cast<double>(written) / bytes_ingested_ : 0.0);
+    *value = buf;
+    return true;
+  } else if (in == "rate-limiter") {
+    if (options_.rate_limiter == NULL) {
+      return false;
+    }
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Rate limit: %.1f MB/s\n"
+             "            Bytes(MB) Throttled(sec)\n"
+             "Flush       %9.1f %14.3f\n"
+             "Compaction  %9.1f %14.3f\n",
+             rate_limiter_.GetBytesPerSecond() / 1048576.0,
+             rate_limiter_.Bytes(Env::kHighPriority) / 1048576.0,
+             rate_limiter_.WaitMicros(Env::kHighPriority) / 1e6,
+             rate_limiter_.Bytes(Env::kLowPriority) / 1048576.0,
+             rate_limiter_.WaitMicros(Env::kLowPriority) / 1e6);
+    *value = buf;
     return true;
   }
 
@@ -1392,8 +2984,8 @@ void DBImpl::GetApproximateSizes(
   Version* v;
   {
     MutexLock l(&mutex_);
-    versions_->current()->Ref();
-    v = versions_->current();
+    v = versions_->default_column_family()->current();
+    v->Ref();
   }
 
   for (int i = 0; i < n; i++) {
@@ -1425,31 +3017,175 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Put(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Delete(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                  const Slice& key) {
+  WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                 const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin_key,
+                       const Slice& end_key) {
+  WriteBatch batch;
+  batch.DeleteRange(begin_key, end_key);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt,
+                       ColumnFamilyHandle* column_family,
+                       const Slice& begin_key, const Slice& end_key) {
+  WriteBatch batch;
+  batch.DeleteRange(column_family, begin_key, end_key);
+  return Write(opt, &batch);
+}
+
+void DB::MultiGet(const ReadOptions& options,
+                  const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  MultiGet(options, DefaultColumnFamily(), keys, values, statuses);
+}
+
+void DB::MultiGet(const ReadOptions& options,
+                  ColumnFamilyHandle* column_family,
+                  const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  ReadOptions snapshot_options = options;
+  if (options.snapshot == NULL) {
+    snapshot_options.snapshot = GetSnapshot();
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*values)[i].clear();
+    (*statuses)[i] = Get(snapshot_options, column_family, keys[i],
+                         &(*values)[i]);
+  }
+  if (options.snapshot == NULL) {
+    ReleaseSnapshot(snapshot_options.snapshot);
+  }
+}
+
+Status DB::IngestExternalFile(const IngestExternalFileOptions& options,
+                              const std::string& fname) {
+  return IngestExternalFile(options, DefaultColumnFamily(), fname);
+}
+
+Status DB::IngestExternalFile(const IngestExternalFileOptions& options,
+                              ColumnFamilyHandle* column_family,
+                              const std::string& fname) {
+  return Status::NotSupported("IngestExternalFile", fname);
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
                 DB** dbptr) {
+  std::vector<ColumnFamilyDescriptor> column_families;
+  column_families.push_back(
+      ColumnFamilyDescriptor(kDefaultColumnFamilyName, options));
+  std::vector<ColumnFamilyHandle*> handles;
+  Status s = DB::Open(options, dbname, column_families, &handles, dbptr);
+  if (s.ok()) {
+    assert(handles.size() == 1);
+    delete handles[0];
+  }
+  return s;
+}
+
+Status DB::Open(const Options& options, const std::string& dbname,
+                const std::vector<ColumnFamilyDescriptor>& column_families,
+                std::vector<ColumnFamilyHandle*>* handles,
+                DB** dbptr) {
   *dbptr = NULL;
+  handles->clear();
+
+  // The default column family's options are the DB's.
+  Options db_options = options;
+  for (size_t i = 0; i < column_families.size(); i++) {
+    if (column_families[i].name == kDefaultColumnFamilyName) {
+      db_options = SanitizeColumnFamilyOptions(options,
+                                               column_families[i].options);
+    }
+  }
+  Status s = CheckCompression(db_options);
+  for (size_t i = 0; s.ok() && i < column_families.size(); i++) {
+    s = CheckCompression(column_families[i].options);
+  }
+  if (!s.ok()) {
+    return s;
+  }
 
-  DBImpl* impl = new DBImpl(options, dbname);
+  DBImpl* impl = new DBImpl(db_options, dbname);
   impl->mutex_.Lock();
-  VersionEdit edit;
-  Status s = impl->Recover(&edit); // Handles create_if_missing, error_if_exists
+  std::map<std::string, Options> cf_options;
+  for (size_t i = 0; i < column_families.size(); i++) {
+    const ColumnFamilyDescriptor& cf = column_families[i];
+    if (cf.name != kDefaultColumnFamilyName) {
+      cf_options[cf.name] = SanitizeColumnFamilyOptions(impl->options_,
+                                                        cf.options);
+    }
+  }
+  std::map<uint32_t, VersionEdit> edits;
+  // Handles create_if_missing, error_if_exists
+  s = impl->Recover(cf_options, &edits);
+  for (size_t i = 0; s.ok() && i < column_families.size(); i++) {
+    const std::string& name = column_families[i].name;
+    if (impl->versions_->GetColumnFamily(name) == NULL) {
+      s = Status::InvalidArgument(name, "column family does not exist");
+    }
+  }
   if (s.ok()) {
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    s = impl->NewLogFile(new_log_number, &lfile);
     if (s.ok()) {
-      edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
-      s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+      impl->first_log_number_ = new_log_number;
+      impl->log_ = new log::Writer(lfile, new_log_number,
+                                   impl->options_.recycle_log_file_num > 0);
+      const std::vector<ColumnFamilyData*> families =
+          impl->versions_->column_families();
+      for (size_t i = 0; s.ok() && i < families.size(); i++) {
+        VersionEdit* edit = &edits[families[i]->id()];
+        edit->SetColumnFamily(families[i]->id());
+        edit->SetLogNumber(new_log_number);
+        s = impl->versions_->LogAndApply(edit, &impl->mutex_);
+      }
     }
     if (s.ok()) {
       impl->DeleteObsoleteFiles();
       impl->MaybeScheduleCompaction();
+      impl->MaybeStartPeriodicCompactionTimer();
+    }
+  }
+  if (s.ok()) {
+    for (size_t i = 0; i < column_families.size(); i++) {
+      handles->push_back(new ColumnFamilyHandleImpl(
+          impl->versions_->GetColumnFamily(column_families[i].name)));
     }
   }
   impl->mutex_.Unlock();
@@ -1461,6 +3197,16 @@ Status DB::Open(const Options& options, const std::string& dbname,
   return s;
 }
 
+Status DB::ListColumnFamilies(const Options& options, const std::string& name,
+                              std::vector<std::string>* column_families) {
+  return VersionSet::ListColumnFamilies(options.env, name, column_families);
+}
+
+const char kDefaultColumnFamilyName[] = "default";
+
+ColumnFamilyHandle::~ColumnFamilyHandle() {
+}
+
 Snapshot::~Snapshot() {
 }
 
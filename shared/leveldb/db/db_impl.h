@@ -6,17 +6,23 @@
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
 #include <deque>
+#include <map>
 #include <set>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
+#include "db/range_del.h"
 #include "db/snapshot.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/histogram.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
+class ColumnFamilyData;
+class ColumnFamilyHandleImpl;
 class MemTable;
 class TableCache;
 class Version;
@@ -31,10 +37,57 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
+  virtual Status DeleteRange(const WriteOptions&, const Slice& begin_key,
+                             const Slice& end_key);
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle);
+  virtual Status DropColumnFamily(ColumnFamilyHandle* column_family);
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const;
+  virtual Status Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key,
+                     const Slice& value);
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const Slice& key);
+  virtual Status Merge(const WriteOptions& options,
+                       ColumnFamilyHandle* column_family,
+                       const Slice& key,
+                       const Slice& value);
+  virtual Status DeleteRange(const WriteOptions& options,
+                             ColumnFamilyHandle* column_family,
+                             const Slice& begin_key,
+                             const Slice& end_key);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, std::string* value);
+  virtual void MultiGet(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    ColumnFamilyHandle* column_family,
+                                    const std::string& fname);
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family);
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value);
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    const std::string& fname);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
@@ -44,7 +97,8 @@ class DBImpl : public DB {
 
   // Extra methods (for testing) that are not in the public DB interface
 
-  // Compact any files in the named level that overlap [*begin,*end]
+  // Compact any files of the default column family in the named level
+  // that overlap [*begin,*end]
   void TEST_CompactRange(int level, const Slice* begin, const Slice* end);
 
   // Force current memtable contents to be compacted.
@@ -59,26 +113,41 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
-  // Record a sample of bytes read at the specified internal key.
-  // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.
-  void RecordReadSample(Slice key);
+  // Record a sample of bytes read at the specified internal key of the
+  // column family "cfd".  Samples are taken approximately once every
+  // config::kReadBytesPeriod bytes.
+  void RecordReadSample(ColumnFamilyData* cfd, Slice key);
 
  private:
   friend class DB;
   struct CompactionState;
+  struct Subcompaction;
   struct Writer;
+  struct WriteGroup;
 
+  // Also appends the range deletions of the data that the iterator
+  // reads to *range_dels, if that is not NULL.  "prefix_seek" is as for
+  // Version::AddIterators().
   Iterator* NewInternalIterator(const ReadOptions&,
+                                ColumnFamilyData* cfd,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                std::vector<RangeTombstone>* range_dels,
+                                const bool* prefix_seek);
+
+  // Return a new, referenced memtable for the column family "cfd".
+  MemTable* NewMemTable(ColumnFamilyData* cfd);
 
   Status NewDB();
 
-  // Recover the descriptor from persistent storage.  May do a significant
-  // amount of work to recover recently logged updates.  Any changes to
-  // be made to the descriptor are added to *edit.
-  Status Recover(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Recover the descriptor from persistent storage, opening the column
+  // families named in "column_families" with the options they map to.
+  // May do a significant amount of work to recover recently logged
+  // updates.  Any changes to be made to the descriptor of a column
+  // family are added to (*edits)[id].
+  Status Recover(const std::map<std::string, Options>& column_families,
+                 std::map<uint32_t, VersionEdit>* edits)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void MaybeIgnoreError(Status* s) const;
 
@@ -91,28 +160,79 @@ class DBImpl : public DB {
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status RecoverLogFile(uint64_t log_number,
-                        VersionEdit* edit,
+                        std::map<uint32_t, VersionEdit>* edits,
                         SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Write "mem" of the column family "cfd" to a new table and record it
+  // in *edit.  The file number of the table is stored in *number and
+  // stays in pending_outputs_ until the caller removes it after applying
+  // *edit.
+  Status WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                          VersionEdit* edit, Version* base, uint64_t* number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  Status CheckNotDropped(ColumnFamilyHandle* column_family);
+
+  void ManualCompact(ColumnFamilyData* cfd, int level,
+                     const Slice* begin, const Slice* end);
+
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Create the file of log "number", reusing an obsolete log file if
+  // one was kept for that.
+  Status NewLogFile(uint64_t number, WritableFile** file)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool MemTablesFull() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void WaitForCompactions() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  double DelayedWriteRate() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DelayWrite(size_t bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer);
 
+  // Insert w's share of its logged write group into the memtable and
+  // wait until the group has been published.
+  Status ApplyWriteGroup(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void PublishWriteGroups() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Apply *edit via versions_->LogAndApply(), waiting for any other
+  // thread that is in the middle of doing the same.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Start the thread that wakes up compactions of files past their
+  // Options::periodic_compaction_seconds, if some column family needs
+  // it and it is not running yet.
+  void MaybeStartPeriodicCompactionTimer() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void PeriodicCompactionTimer(void* db);
+  void RunPeriodicCompactionTimer();
+
   static void BGWork(void* db);
-  void BackgroundCall();
-  Status BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlushWork(void* db);
+  void BackgroundCall(bool flush);
+  Status BackgroundFlush() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status BackgroundCompaction(bool* idle) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RecordBackgroundError(const Status& s) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Delete the files of every column family whose entries are all
+  // deleted by range deletions that every snapshot sees, without
+  // reading them.
+  Status DeleteFilesInDeletedRanges() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGSubcompactionWork(void* arg);
+  void DoSubcompactionWork(Subcompaction* sub);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Add "key" and "value" to the output of "compact", which reads from
+  // "input", opening and finishing output files as needed.
+  Status AddCompactionOutput(CompactionState* compact, Iterator* input,
+                             const Slice& key, const Slice& value);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -120,6 +240,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  CountingRateLimiter rate_limiter_;  // Wraps the user's rate_limiter
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   bool owns_cache_;
@@ -135,29 +256,66 @@ class DBImpl : public DB {
   port::Mutex mutex_;
   port::AtomicPointer shutting_down_;
   port::CondVar bg_cv_;          // Signalled when background work finishes
-  MemTable* mem_;
-  MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  ColumnFamilyHandleImpl* default_cf_handle_;
+  // Non-NULL iff some column family has a memtable being compacted
+  port::AtomicPointer has_imm_;
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
+
+  // Obsolete logs kept to be reused by new logs (at most
+  // options_.recycle_log_file_num), oldest first.  Only logs numbered at
+  // least first_log_number_, the first log this DB wrote, are kept: older
+  // ones may not be in the recyclable format.
+  std::deque<uint64_t> recycled_logs_;
+  uint64_t first_log_number_;
   uint32_t seed_;                // For sampling.
 
   // Queue of writers.
   std::deque<Writer*> writers_;
   WriteBatch* tmp_batch_;
 
+  // Logged write groups whose memtable inserts are not all published,
+  // in sequence order.
+  std::deque<WriteGroup*> memtable_groups_;
+
   SnapshotList snapshots_;
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_;
 
-  // Has a background compaction been scheduled or is running?
-  bool bg_compaction_scheduled_;
+  // Number of compaction jobs scheduled on (or running in) the low
+  // priority thread pool.  At most options_.max_background_compactions.
+  int bg_compaction_scheduled_;
+
+  // Has a memtable flush been scheduled on the high priority thread pool?
+  bool bg_flush_scheduled_;
+
+  // Number of BGSubcompactionWork() calls scheduled on (or running in)
+  // the low priority thread pool.
+  int bg_subcompactions_scheduled_;
+
+  // Is the PeriodicCompactionTimer() thread running?
+  bool periodic_timer_running_;
+
+  // Number of compactions that have claimed their inputs and not yet
+  // released them.
+  int running_compactions_;
+
+  // Is CompactMemTable() writing out the immutable memtables?
+  bool flushing_imm_;
+
+  // Is some thread inside versions_->LogAndApply()?
+  bool logging_manifest_;
+
+  // Is IngestExternalFile() or DropColumnFamily() waiting for compactions
+  // to finish?  No new compactions start meanwhile.
+  bool compactions_paused_;
 
   // Information for a manual compaction
   struct ManualCompaction {
+    ColumnFamilyData* cfd;
     int level;
     bool done;
     const InternalKey* begin;   // NULL means beginning of key range
@@ -189,6 +347,26 @@ class DBImpl : public DB {
   };
   CompactionStats stats_[config::kNumLevels];
 
+  // Latencies of the calls to Get(), MultiGet() and Write(), in
+  // microseconds.
+  Histogram get_latency_;
+  Histogram multiget_latency_;
+  Histogram write_latency_;
+
+  // Write throttling state.  Delayed writes are admitted at
+  // DelayedWriteRate(); delayed_write_until_ is the time at which the
+  // bytes admitted so far have been paid for.
+  uint64_t delayed_write_until_;
+  uint64_t delayed_writes_;       // Writes that were slept for
+  uint64_t write_delay_micros_;   // Time spent in those sleeps
+  uint64_t stopped_writes_;       // Times writes were stopped
+  uint64_t write_stop_micros_;    // Time writes spent stopped
+
+  // Bytes of updates written to the log and of ingested files, and the
+  // part of the bytes in stats_ that was written by memtable flushes.
+  uint64_t bytes_ingested_;
+  uint64_t bytes_flushed_;
+
   // No copying allowed
   DBImpl(const DBImpl&);
   void operator=(const DBImpl&);
@@ -199,12 +377,20 @@ class DBImpl : public DB {
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
+// it is not equal to src.info_log.  If "ilimiter" is non-NULL, it
+// replaces a non-NULL src.rate_limiter and should pass requests on to
+// it.
 extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
                                const InternalFilterPolicy* ipolicy,
+                               RateLimiter* ilimiter,
                                const Options& src);
 
+// Return "db_options" with the fields that describe the key space of a
+// column family (see ColumnFamilyDescriptor) taken from "src".
+extern Options SanitizeColumnFamilyOptions(const Options& db_options,
+                                           const Options& src);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_IMPL_H_
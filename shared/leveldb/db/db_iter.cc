@@ -5,10 +5,14 @@
 #include "db/db_iter.h"
 
 #include "db/filename.h"
+#include "db/column_family.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -40,7 +44,9 @@ class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), or,
+  //     if that entry is a merge operand, just past the entries that
+  //     were merged into saved_key_, saved_value_
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction {
@@ -48,28 +54,41 @@ class DBIter: public Iterator {
     kReverse
   };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, ColumnFamilyData* cfd, const ReadOptions& options,
+         const Comparator* cmp, Iterator* iter, SequenceNumber s,
+         uint32_t seed, RangeDelMap* range_dels, bool* prefix_seek)
       : db_(db),
+        cfd_(cfd),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        upper_bound_(options.iterate_upper_bound),
+        prefix_extractor_(options.prefix_same_as_start
+                          ? cfd->options().prefix_extractor : NULL),
+        range_dels_(range_dels),
+        prefix_seek_(prefix_seek),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        has_prefix_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
   virtual ~DBIter() {
     delete iter_;
+    delete range_dels_;
+    delete prefix_seek_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ?
+        iter_->value() : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -89,6 +108,10 @@ class DBIter: public Iterator {
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
+  bool PastRange(const Slice& user_key) const;
+  bool InDeletedRange(const ParsedInternalKey& ikey) const;
+  void MergeValuesNewToOld();
+  bool ApplyOperands(const Slice* existing_value);
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -109,15 +132,30 @@ class DBIter: public Iterator {
   }
 
   DBImpl* db_;
+  ColumnFamilyData* const cfd_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const Slice* const upper_bound_;  // ReadOptions::iterate_upper_bound
+  // The column family's prefix_extractor if the iterator was created
+  // with ReadOptions::prefix_same_as_start, else NULL
+  const SliceTransform* const prefix_extractor_;
+  const RangeDelMap* const range_dels_;  // NULL if there are none
+  // Lets the table filters of iter_ rule out the positions of a Seek()
+  // within a prefix; every other positioning of iter_ is exact.  NULL if
+  // iter_ has no such filters.
+  bool* const prefix_seek_;
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
+  std::deque<std::string> operands_;  // Merge operands, oldest first
   Direction direction_;
   bool valid_;
+  bool merged_;               // Forward, and saved_key_,saved_value_ hold
+                              // the result of merge operands
+  bool has_prefix_;           // Forward scans stop at the end of prefix_
+  std::string prefix_;        // Prefix of the target of the last Seek()
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -133,7 +171,7 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   bytes_counter_ -= n;
   while (bytes_counter_ < 0) {
     bytes_counter_ += RandomPeriod();
-    db_->RecordReadSample(k);
+    db_->RecordReadSample(cfd_, k);
   }
   if (!ParseInternalKey(k, ikey)) {
     status_ = Status::Corruption("corrupted internal key in DBIter");
@@ -143,9 +181,50 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   }
 }
 
+// Returns true if forward scans should stop at the entries for
+// "user_key": they are at or past upper_bound_, or past the keys that
+// have prefix_.
+inline bool DBIter::PastRange(const Slice& user_key) const {
+  if (upper_bound_ != NULL &&
+      user_comparator_->Compare(user_key, *upper_bound_) >= 0) {
+    return true;
+  }
+  if (has_prefix_) {
+    return (!prefix_extractor_->InDomain(user_key) ||
+            prefix_extractor_->Transform(user_key) != Slice(prefix_));
+  }
+  return false;
+}
+
+// Returns true if "ikey" is a range deletion, which deletes its own key,
+// or older than a range deletion that covers it.  Either way the entry
+// acts as a deletion.
+inline bool DBIter::InDeletedRange(const ParsedInternalKey& ikey) const {
+  if (ikey.type == kTypeRangeDeletion) {
+    return true;
+  }
+  return (range_dels_ != NULL &&
+          ikey.sequence <
+          range_dels_->MaxCoveringSequence(ikey.user_key, sequence_));
+}
+
 void DBIter::Next() {
   assert(valid_);
 
+  if (merged_) {
+    // iter_ is already past the operands of this->key(), and saved_key_
+    // holds the key to skip.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
+    }
+    FindNextUserEntry(true, &saved_key_);
+    return;
+  }
+
   if (direction_ == kReverse) {  // Switch directions?
     direction_ = kForward;
     // iter_ is pointing just before the entries for this->key(),
@@ -175,9 +254,15 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+    if (!ParseKey(&ikey)) {
+      // Skip the corrupted entry
+    } else if (PastRange(ikey.user_key)) {
+      // Do not read on through the entries, live or not, out of range
+      break;
+    } else if (ikey.sequence <= sequence_) {
+      switch (InDeletedRange(ikey) ? kTypeDeletion : ikey.type) {
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
@@ -193,6 +278,18 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            // The newest visible entry for the key is an operand:
+            // merge it with the older entries.
+            SaveKey(ikey.user_key, &saved_key_);
+            MergeValuesNewToOld();
+            return;
+          }
+          break;
       }
     }
     iter_->Next();
@@ -201,16 +298,68 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeValuesNewToOld() {
+  assert(iter_->Valid());
+  assert(direction_ == kForward);
+  operands_.clear();
+  ParsedInternalKey ikey;
+  bool has_value = false;
+  for (; iter_->Valid(); iter_->Next()) {
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    const ValueType type = InDeletedRange(ikey) ? kTypeDeletion : ikey.type;
+    if (type == kTypeMerge) {
+      operands_.push_front(iter_->value().ToString());
+    } else {
+      // A value or deletion, which the operands apply to
+      if (type == kTypeValue) {
+        Slice raw_value = iter_->value();
+        saved_value_.assign(raw_value.data(), raw_value.size());
+        has_value = true;
+      }
+      iter_->Next();
+      break;
+    }
+  }
+  Slice existing(saved_value_);
+  merged_ = true;
+  valid_ = ApplyOperands(has_value ? &existing : NULL);
+}
+
+// Stores in saved_value_ the result of applying operands_ to
+// "existing_value".  On failure, records the error in status_ and
+// returns false.
+bool DBIter::ApplyOperands(const Slice* existing_value) {
+  Status s = ApplyMergeOperands(cfd_->options().merge_operator, saved_key_,
+                                existing_value, operands_, &saved_value_,
+                                cfd_->options().info_log);
+  operands_.clear();
+  if (!s.ok()) {
+    status_ = s;
+    return false;
+  }
+  return true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // iter_ is pointing at the current entry, or past the merged entries
+    // of saved_key_.  Scan backwards until the key changes so we can use
+    // the normal reverse scanning code.
+    if (merged_) {
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
-      iter_->Prev();
       if (!iter_->Valid()) {
         valid_ = false;
         saved_key_.clear();
@@ -221,6 +370,7 @@ void DBIter::Prev() {
                                     saved_key_) < 0) {
         break;
       }
+      iter_->Prev();
     }
     direction_ = kReverse;
   }
@@ -232,6 +382,8 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  bool has_value = false;  // Does saved_value_ hold a value for saved_key_?
+  operands_.clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -241,10 +393,16 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        value_type = InDeletedRange(ikey) ? kTypeDeletion : ikey.type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          operands_.clear();
+          has_value = false;
+        } else if (value_type == kTypeMerge) {
+          // Newer than the entries seen so far for this key
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          operands_.push_back(iter_->value().ToString());
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
@@ -253,6 +411,8 @@ void DBIter::FindPrevUserEntry() {
           }
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
+          operands_.clear();  // Older than the value
+          has_value = true;
         }
       }
       iter_->Prev();
@@ -265,6 +425,9 @@ void DBIter::FindPrevUserEntry() {
     saved_key_.clear();
     ClearSavedValue();
     direction_ = kForward;
+  } else if (!operands_.empty()) {
+    Slice existing(saved_value_);
+    valid_ = ApplyOperands(has_value ? &existing : NULL);
   } else {
     valid_ = true;
   }
@@ -272,11 +435,24 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
+  has_prefix_ = (prefix_extractor_ != NULL &&
+                 prefix_extractor_->InDomain(target));
+  if (has_prefix_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(
       &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+  if (prefix_seek_ != NULL) {
+    *prefix_seek_ = has_prefix_;
+    iter_->Seek(saved_key_);
+    *prefix_seek_ = false;
+  } else {
+    iter_->Seek(saved_key_);
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -286,6 +462,8 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
+  has_prefix_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -297,8 +475,24 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
+  has_prefix_ = false;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ == NULL) {
+    iter_->SeekToLast();
+  } else {
+    // Position iter_ at the last entry before the bound
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*upper_bound_,
+                                                     kMaxSequenceNumber,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  }
   FindPrevUserEntry();
 }
 
@@ -306,11 +500,16 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(
     DBImpl* db,
+    ColumnFamilyData* cfd,
+    const ReadOptions& options,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+    uint32_t seed,
+    RangeDelMap* range_dels,
+    bool* prefix_seek) {
+  return new DBIter(db, cfd, options, user_key_comparator, internal_iter,
+                    sequence, seed, range_dels, prefix_seek);
 }
 
 }  // namespace leveldb
@@ -11,17 +11,30 @@
 
 namespace leveldb {
 
+class ColumnFamilyData;
 class DBImpl;
+class RangeDelMap;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Read samples are recorded against the
+// column family "cfd".  The iterator honours options.prefix_same_as_start
+// and options.iterate_upper_bound.  It skips the entries deleted by the
+// range deletions of "*range_dels", which it takes ownership of; NULL
+// means that the entries hold no range deletions.  If not NULL,
+// "*prefix_seek" is the flag that "*internal_iter" was built with (see
+// Version::AddIterators()); the iterator takes ownership of it and sets
+// it only while seeking within a prefix.
 extern Iterator* NewDBIterator(
     DBImpl* db,
+    ColumnFamilyData* cfd,
+    const ReadOptions& options,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed);
+    uint32_t seed,
+    RangeDelMap* range_dels,
+    bool* prefix_seek);
 
 }  // namespace leveldb
 
@@ -9,7 +9,15 @@
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
+#include "leveldb/compressor.h"
 #include "leveldb/env.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -74,10 +82,14 @@ class SpecialEnv : public EnvWrapper {
 
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
+  AtomicCounter prefetch_counter_;
 
   AtomicCounter sleep_counter_;
   AtomicCounter sleep_time_counter_;
 
+  // Added to the time NowMicros() reports
+  AtomicCounter clock_offset_seconds_;
+
   explicit SpecialEnv(Env* base) : EnvWrapper(base) {
     delay_sstable_sync_.Release_Store(NULL);
     no_space_.Release_Store(NULL);
@@ -161,9 +173,12 @@ class SpecialEnv : public EnvWrapper {
      private:
       RandomAccessFile* target_;
       AtomicCounter* counter_;
+      AtomicCounter* prefetch_counter_;
      public:
-      CountingFile(RandomAccessFile* target, AtomicCounter* counter)
-          : target_(target), counter_(counter) {
+      CountingFile(RandomAccessFile* target, AtomicCounter* counter,
+                   AtomicCounter* prefetch_counter)
+          : target_(target), counter_(counter),
+            prefetch_counter_(prefetch_counter) {
       }
       virtual ~CountingFile() { delete target_; }
       virtual Status Read(uint64_t offset, size_t n, Slice* result,
@@ -171,11 +186,18 @@ class SpecialEnv : public EnvWrapper {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      virtual Status Prefetch(uint64_t offset, size_t n) const {
+        prefetch_counter_->Increment();
+        return target_->Prefetch(offset, n);
+      }
+      virtual bool ServesFromMemory() const {
+        return target_->ServesFromMemory();
+      }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
-      *r = new CountingFile(*r, &random_read_counter_);
+      *r = new CountingFile(*r, &random_read_counter_, &prefetch_counter_);
     }
     return s;
   }
@@ -185,17 +207,32 @@ class SpecialEnv : public EnvWrapper {
     sleep_time_counter_.IncrementBy(micros);
   }
 
+  virtual uint64_t NowMicros() {
+    return target()->NowMicros() +
+        static_cast<uint64_t>(clock_offset_seconds_.Read()) * 1000000;
+  }
+
 };
 
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  const MemTableRepFactory* vector_rep_factory_;
+  const MemTableRepFactory* hash_rep_factory_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
     kDefault,
     kFilter,
+    kFilterFull,
+    kFilterPartitioned,
     kUncompressed,
+    kDataBlockHashIndex,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kVectorMemTable,
+    kHashSkipListMemTable,
+    kUniversalCompaction,
     kEnd
   };
   int option_config_;
@@ -210,6 +247,8 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    vector_rep_factory_ = NewVectorRepFactory(0);
+    hash_rep_factory_ = NewHashSkipListRepFactory(4, 1000);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -221,12 +260,24 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete vector_rep_factory_;
+    delete hash_rep_factory_;
   }
 
+  // Configurations that tests of the placement of files in levels skip
+  enum OptionSkip {
+    kSkipNone = 0,
+    kSkipUniversalCompaction = 1
+  };
+
   // Switch to a fresh database with the next option configuration to
   // test.  Return false if there are no more configurations to test.
-  bool ChangeOptions() {
+  bool ChangeOptions(int skip = kSkipNone) {
     option_config_++;
+    if (option_config_ == kUniversalCompaction &&
+        (skip & kSkipUniversalCompaction)) {
+      option_config_++;
+    }
     if (option_config_ >= kEnd) {
       return false;
     } else {
@@ -242,9 +293,38 @@ class DBTest {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kFilterFull:
+        options.filter_policy = filter_policy_;
+        options.filter_type = kFullFilter;
+        break;
+      case kFilterPartitioned:
+        options.filter_policy = filter_policy_;
+        options.filter_type = kPartitionedFilter;
+        options.filter_partition_keys = 100;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        options.block_restart_interval = 4;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.enable_pipelined_write = true;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kVectorMemTable:
+        options.memtable_factory = vector_rep_factory_;
+        break;
+      case kHashSkipListMemTable:
+        options.memtable_factory = hash_rep_factory_;
+        break;
+      case kUniversalCompaction:
+        options.compaction_style = kCompactionStyleUniversal;
+        break;
       default:
         break;
     }
@@ -307,6 +387,25 @@ class DBTest {
     return result;
   }
 
+  // Like Get() for each of keys, but with a single MultiGet() call.
+  std::vector<std::string> MultiGet(const std::vector<std::string>& keys,
+                                    const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (statuses[i].IsNotFound()) {
+        values[i] = "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        values[i] = statuses[i].ToString();
+      }
+    }
+    return values;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -363,6 +462,12 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeRangeDeletion:
+              result += "DELRANGE(" + iter->value().ToString() + ")";
+              break;
           }
         }
         iter->Next();
@@ -637,7 +742,7 @@ TEST(DBTest, GetEncountersEmptyLevel) {
     DelayMilliseconds(1000);
 
     ASSERT_EQ(NumTableFilesAtLevel(0), 0);
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipUniversalCompaction));
 }
 
 TEST(DBTest, IterEmpty) {
@@ -943,6 +1048,50 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST(DBTest, RecycleLogFiles) {
+  Options options = CurrentOptions();
+  options.recycle_log_file_num = 2;
+  options.paranoid_checks = true;
+  Reopen(&options);
+
+  // Logs holding records of the same sizes, each written over an older one
+  for (int i = 0; i < 5; i++) {
+    for (int k = 0; k < 10; k++) {
+      ASSERT_OK(Put(Key(k), std::string(1000, 'a' + i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  // Leave no trace of the keys in the tables
+  for (int k = 0; k < 10; k++) {
+    ASSERT_OK(Delete(Key(k)));
+  }
+  db_->CompactRange(NULL, NULL);
+  // The record lines up with the first one the file holds from its
+  // previous use, so the second of those follows it intact.
+  ASSERT_OK(Put(Key(0), std::string(1000, 'z')));
+
+  // The obsolete log is kept for the next one
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  int logs = 0;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+      logs++;
+    }
+  }
+  ASSERT_EQ(2, logs);
+
+  // Recovery stops at the end of the current log, without reporting the
+  // rest of the file as corrupted or replaying the records there
+  Reopen(&options);
+  ASSERT_EQ(std::string(1000, 'z'), Get(Key(0)));
+  for (int k = 1; k < 10; k++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(k)));
+  }
+}
+
 TEST(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;        // Large write buffer
@@ -976,8 +1125,8 @@ TEST(DBTest, RepeatedWritesToSameKey) {
   Reopen(&options);
 
   // We must have at most one file per level except for level-0,
-  // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  // which may have up to level0_stop_writes_trigger files.
+  const int kMaxFiles = config::kNumLevels + options.level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -988,6 +1137,83 @@ TEST(DBTest, RepeatedWritesToSameKey) {
   }
 }
 
+TEST(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Overwrite and delete random keys so that the compactions running in
+  // parallel have real merging to do.
+  Random rnd(301);
+  const int kNumKeys = 2000;
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < 20000; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    if (rnd.OneIn(10)) {
+      ASSERT_OK(Delete(Key(k)));
+      values[k].clear();
+    } else {
+      values[k] = RandomString(&rnd, 100 + rnd.Uniform(400));
+      ASSERT_OK(Put(Key(k), values[k]));
+    }
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < kNumKeys; k++) {
+      ASSERT_EQ(values[k].empty() ? "NOT_FOUND" : values[k], Get(Key(k)));
+    }
+    Reopen(&options);
+  }
+  ASSERT_LE(NumTableFilesAtLevel(0), options.level0_stop_writes_trigger);
+}
+
+TEST(DBTest, Subcompactions) {
+  // With a single background thread the compacting thread merges all
+  // of the pieces itself; with more, the pool merges some of them.
+  for (int threads = 1; threads <= 4; threads += 3) {
+    Options options = CurrentOptions();
+    options.max_subcompactions = 4;
+    options.max_background_compactions = threads;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // Build level-0 files that start at different keys and overlap their
+    // neighbours, so that compacting them all splits at file boundaries.
+    // (Reopening moves updates to level-0.)
+    Random rnd(301);
+    const int kNumKeys = 1000;
+    std::vector<std::string> values(kNumKeys);
+    for (int file = 0; file < 3; file++) {
+      for (int i = file * 300; i < file * 300 + 400; i++) {
+        values[i] = RandomString(&rnd, 1000);
+        ASSERT_OK(Put(Key(i), values[i]));
+      }
+      Reopen(&options);
+    }
+    ASSERT_EQ(NumTableFilesAtLevel(0), 3);
+
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+    ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+    ASSERT_GT(NumTableFilesAtLevel(1), 1);
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+
+    // The level-1 files must not overlap each other
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(Key(count), iter->key().ToString());
+      count++;
+    }
+    delete iter;
+    ASSERT_EQ(kNumKeys, count);
+    Reopen(&options);
+    ASSERT_EQ(values[650], Get(Key(650)));
+  }
+}
+
 TEST(DBTest, SparseMerge) {
   Options options = CurrentOptions();
   options.compression = kNoCompression;
@@ -1086,7 +1312,7 @@ TEST(DBTest, ApproximateSizes) {
       ASSERT_EQ(NumTableFilesAtLevel(0), 0);
       ASSERT_GT(NumTableFilesAtLevel(1), 0);
     }
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipUniversalCompaction));
 }
 
 TEST(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
@@ -1206,7 +1432,7 @@ TEST(DBTest, HiddenValuesAreRemoved) {
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny ]");
 
     ASSERT_TRUE(Between(Size("", "pastfoo"), 0, 1000));
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipUniversalCompaction));
 }
 
 TEST(DBTest, DeletionMarkers1) {
@@ -1302,7 +1528,7 @@ TEST(DBTest, OverlapInLevel0) {
     dbfull()->TEST_CompactMemTable();
     ASSERT_EQ("3", FilesPerLevel());
     ASSERT_EQ("NOT_FOUND", Get("600"));
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipUniversalCompaction));
 }
 
 TEST(DBTest, L0_CompactionBug_Issue44_a) {
@@ -1460,6 +1686,95 @@ TEST(DBTest, ManualCompaction) {
   ASSERT_EQ("0,0,1", FilesPerLevel());
 }
 
+TEST(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleUniversal;
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values(100, "NOT_FOUND");
+  for (int i = 0; i < 2000; i++) {
+    const int k = rnd.Uniform(values.size());
+    values[k] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(k), values[k]));
+  }
+  for (int i = 0; i < 100 &&
+           NumTableFilesAtLevel(0) >= config::kL0_CompactionTrigger; i++) {
+    DelayMilliseconds(100);
+  }
+  ASSERT_LT(NumTableFilesAtLevel(0), config::kL0_CompactionTrigger);
+  ASSERT_EQ(NumTableFilesAtLevel(0), TotalTableFiles());
+  for (size_t k = 0; k < values.size(); k++) {
+    ASSERT_EQ(values[k], Get(Key(k)));
+  }
+
+  std::string amp;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-amplification", &amp));
+  ASSERT_TRUE(amp.find("Write amplification: ") != std::string::npos);
+
+  Reopen(&options);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("1", FilesPerLevel());
+  for (size_t k = 0; k < values.size(); k++) {
+    ASSERT_EQ(values[k], Get(Key(k)));
+  }
+}
+
+TEST(DBTest, UniversalCompactionOfOlderRuns) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleUniversal;
+  options.compression = kNoCompression;
+  Reopen(&options);
+  const std::string value(1000, 'x');
+
+  // Oldest and largest run
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), value));
+  }
+  ASSERT_OK(Put("d", "dv"));
+  ASSERT_OK(Put("e", "ev"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // Two runs of the same size, which are merged with each other but
+  // not with the newest, tiny run
+  for (int i = 100; i < 130; i++) {
+    ASSERT_OK(Put(Key(i), value));
+  }
+  ASSERT_OK(Put("k", "old"));
+  ASSERT_OK(Delete("e"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 100; i < 130; i++) {
+    ASSERT_OK(Put(Key(i), value));
+  }
+  ASSERT_OK(Put("k", "mid"));
+  ASSERT_OK(Delete("d"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("k", "new"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(0) > 3; i++) {
+    DelayMilliseconds(100);
+  }
+  ASSERT_EQ("3", FilesPerLevel());
+
+  // The merged run is newer than the oldest run only, and keeps the
+  // deletions of entries that the oldest run holds.
+  for (int run = 0; run < 2; run++) {
+    ASSERT_EQ("new", Get("k"));
+    ASSERT_EQ("NOT_FOUND", Get("d"));
+    ASSERT_EQ("NOT_FOUND", Get("e"));
+    ASSERT_EQ(AllEntriesFor("k"), "[ new, mid ]");
+    Reopen(&options);
+  }
+
+  // Merging all runs drops the deletions
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ(AllEntriesFor("d"), "[ ]");
+  ASSERT_EQ("new", Get("k"));
+}
+
 TEST(DBTest, DBOpen_Options) {
   std::string dbname = test::TmpDir() + "/db_options_test";
   DestroyDB(dbname, Options());
@@ -1690,132 +2005,1670 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
-// Multi-threaded test:
-namespace {
-
-static const int kNumThreads = 4;
-static const int kTestSeconds = 10;
-static const int kNumKeys = 1000;
+TEST(DBTest, BloomFilterFormats) {
+  const FilterType kTypes[] = { kFullFilter, kPartitionedFilter };
+  for (int t = 0; t < 2; t++) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(1 << 20);
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.filter_type = kTypes[t];
+    options.filter_partition_keys = 1000;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
 
-struct MTState {
-  DBTest* test;
-  port::AtomicPointer stop;
-  port::AtomicPointer counter[kNumThreads];
-  port::AtomicPointer thread_done[kNumThreads];
-};
+    // Populate multiple layers
+    const int N = 10000;
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    for (int i = 0; i < N; i += 100) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
 
-struct MTThread {
-  MTState* state;
-  int id;
-};
+    // Prevent auto compactions triggered by seeks
+    env_->delay_sstable_sync_.Release_Store(env_);
 
-static void MTThreadBody(void* arg) {
-  MTThread* t = reinterpret_cast<MTThread*>(arg);
-  int id = t->id;
-  DB* db = t->state->test->db_;
-  uintptr_t counter = 0;
-  fprintf(stderr, "... starting thread %d\n", id);
-  Random rnd(1000 + id);
-  std::string value;
-  char valbuf[1500];
-  while (t->state->stop.Acquire_Load() == NULL) {
-    t->state->counter[id].Release_Store(reinterpret_cast<void*>(counter));
+    // Data blocks are read from the file every time, and so are filter
+    // partitions: each lookup reads one partition of each table it
+    // looks at.
+    ReadOptions ropts;
+    ropts.fill_cache = false;
+    const int kPartitionReads = (t == 1) ? 2*N : 0;
+    std::string value;
 
-    int key = rnd.Uniform(kNumKeys);
-    char keybuf[20];
-    snprintf(keybuf, sizeof(keybuf), "%016d", key);
+    // Lookup present keys.  Should rarely read from small sstable.
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(db_->Get(ropts, Key(i), &value));
+      ASSERT_EQ(Key(i), value);
+    }
+    int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "type %d: %d present => %d reads\n", t, N, reads);
+    ASSERT_GE(reads, N);
+    ASSERT_LE(reads, N + 2*N/100 + kPartitionReads);
 
-    if (rnd.OneIn(2)) {
-      // Write values of the form <key, my id, counter>.
-      // We add some padding for force compactions.
-      snprintf(valbuf, sizeof(valbuf), "%d.%d.%-1000d",
-               key, id, static_cast<int>(counter));
-      ASSERT_OK(db->Put(WriteOptions(), Slice(keybuf), Slice(valbuf)));
-    } else {
-      // Read a value and verify that it matches the pattern written above.
-      Status s = db->Get(ReadOptions(), Slice(keybuf), &value);
-      if (s.IsNotFound()) {
-        // Key has not yet been written
-      } else {
-        // Check that the writer thread counter is >= the counter in the value
-        ASSERT_OK(s);
-        int k, w, c;
-        ASSERT_EQ(3, sscanf(value.c_str(), "%d.%d.%d", &k, &w, &c)) << value;
-        ASSERT_EQ(k, key);
-        ASSERT_GE(w, 0);
-        ASSERT_LT(w, kNumThreads);
-        ASSERT_LE(c, reinterpret_cast<uintptr_t>(
-            t->state->counter[w].Acquire_Load()));
+    // Lookup missing keys.  Should rarely read from either sstable.
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_TRUE(db_->Get(ropts, Key(i) + ".missing", &value).IsNotFound());
+    }
+    reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "type %d: %d missing => %d reads\n", t, N, reads);
+    ASSERT_LE(reads, 3*N/100 + kPartitionReads);
+
+    // With fill_cache, partitions stay in the cache after their first
+    // use, which costs at most one read per partition.
+    ropts.fill_cache = true;
+    for (int pass = 0; pass < 2; pass++) {
+      env_->random_read_counter_.Reset();
+      for (int i = 0; i < N; i++) {
+        ASSERT_TRUE(db_->Get(ropts, Key(i) + ".missing", &value)
+                    .IsNotFound());
       }
+      reads = env_->random_read_counter_.Read();
+      fprintf(stderr, "type %d: %d missing, pass %d => %d reads\n",
+              t, N, pass, reads);
+      ASSERT_LE(reads, 3*N/100 + ((pass == 0 && t == 1) ? 2*N/1000 + 2 : 0));
     }
-    counter++;
+
+    env_->delay_sstable_sync_.Release_Store(NULL);
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
   }
-  t->state->thread_done[id].Release_Store(t);
-  fprintf(stderr, "... stopping thread %d after %d ops\n", id, int(counter));
 }
 
-}  // namespace
-
-TEST(DBTest, MultiThreaded) {
-  do {
-    // Initialize state
-    MTState mt;
-    mt.test = this;
-    mt.stop.Release_Store(0);
-    for (int id = 0; id < kNumThreads; id++) {
-      mt.counter[id].Release_Store(0);
-      mt.thread_done[id].Release_Store(0);
-    }
-
-    // Start threads
-    MTThread thread[kNumThreads];
-    for (int id = 0; id < kNumThreads; id++) {
-      thread[id].state = &mt;
-      thread[id].id = id;
-      env_->StartThread(MTThreadBody, &thread[id]);
+TEST(DBTest, FilterTypeChange) {
+  // Tables written with one filter layout stay readable after the
+  // database is reopened with another.
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.filter_type = kBlockFilter;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  const FilterType kTypes[] = { kFullFilter, kPartitionedFilter, kBlockFilter };
+  for (int t = 0; t < 3; t++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(t * 100 + i), Key(i)));
     }
-
-    // Let them run for a while
-    DelayMilliseconds(kTestSeconds * 1000);
-
-    // Stop the threads and wait for them to finish
-    mt.stop.Release_Store(&mt);
-    for (int id = 0; id < kNumThreads; id++) {
-      while (mt.thread_done[id].Acquire_Load() == NULL) {
-        DelayMilliseconds(100);
-      }
+    dbfull()->TEST_CompactMemTable();
+    options.filter_type = kTypes[t];
+    Reopen(&options);
+    for (int i = 0; i < 100 * (t + 1); i++) {
+      ASSERT_EQ(Key(i % 100), Get(Key(i)));
     }
-  } while (ChangeOptions());
+    ASSERT_EQ("NOT_FOUND", Get("missing"));
+  }
+  Close();
+  delete options.filter_policy;
 }
 
-namespace {
-typedef std::map<std::string, std::string> KVMap;
+// Return the keys that "iter" yields from its position on.
+static std::string ScanKeys(Iterator* iter) {
+  std::string result;
+  for (; iter->Valid(); iter->Next()) {
+    result.append(iter->key().ToString());
+    result.append(",");
+  }
+  return result;
 }
 
-class ModelDB: public DB {
- public:
-  class ModelSnapshot : public Snapshot {
-   public:
-    KVMap map_;
-  };
-
-  explicit ModelDB(const Options& options): options_(options) { }
-  ~ModelDB() { }
-  virtual Status Put(const WriteOptions& o, const Slice& k, const Slice& v) {
-    return DB::Put(o, k, v);
-  }
-  virtual Status Delete(const WriteOptions& o, const Slice& key) {
-    return DB::Delete(o, key);
-  }
-  virtual Status Get(const ReadOptions& options,
-                     const Slice& key, std::string* value) {
-    assert(false);      // Not implemented
-    return Status::NotFound(key);
+TEST(DBTest, PrefixSameAsStart) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.filter_type = kFullFilter;
+  options.prefix_extractor = NewFixedPrefixTransform(3);
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  const char* kPrefixes[] = { "aaa", "bbb", "ccc" };
+  for (int p = 0; p < 3; p++) {
+    ASSERT_OK(Put(std::string(kPrefixes[p]) + "1", "v"));
+    ASSERT_OK(Put(std::string(kPrefixes[p]) + "2", "v"));
+    dbfull()->TEST_CompactMemTable();
   }
-  virtual Iterator* NewIterator(const ReadOptions& options) {
-    if (options.snapshot == NULL) {
-      KVMap* saved = new KVMap;
-      *saved = map_;
+  ASSERT_OK(Put("bbb3", "v"));
+  ASSERT_OK(Delete("bbb2"));
+  ASSERT_OK(Put("bb", "v"));  // Too short to have a prefix
+
+  PerfContext* perf = GetPerfContext();
+  ReadOptions ropts;
+  ropts.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(ropts);
+  iter->Seek("bbb");
+  ASSERT_EQ("bbb1,bbb3,", ScanKeys(iter));
+  iter->Seek("aaa2");
+  ASSERT_EQ("aaa2,", ScanKeys(iter));
+
+  // The table of "ccc" is not read for a prefix that it lacks
+  perf->Reset();
+  iter->Seek("bbc");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  ASSERT_EQ(1, perf->bloom_useful_count);
+  ASSERT_EQ(0, perf->block_read_count);
+
+  // Seeks to keys without a prefix are not limited
+  iter->Seek("b");
+  ASSERT_EQ("bb,bbb1,bbb3,ccc1,ccc2,", ScanKeys(iter));
+  iter->SeekToFirst();
+  ASSERT_EQ("aaa1,aaa2,bb,bbb1,bbb3,ccc1,ccc2,", ScanKeys(iter));
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // SeekToLast() finds the last key before an upper bound, whatever its
+  // prefix, although the tables of "aaa" and "ccc" lack that of the bound
+  Slice bound("bbb2");
+  ropts.iterate_upper_bound = &bound;
+  iter = db_->NewIterator(ropts);
+  iter->SeekToLast();
+  ASSERT_EQ("bbb1->v", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("bb->v", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("aaa2->v", IterStatus(iter));
+  delete iter;
+  bound = "bbc";
+  iter = db_->NewIterator(ropts);
+  iter->SeekToLast();
+  ASSERT_EQ("bbb3->v", IterStatus(iter));
+  iter->Seek("bbb");
+  ASSERT_EQ("bbb1,bbb3,", ScanKeys(iter));
+  ASSERT_OK(iter->status());
+  delete iter;
+  ropts.iterate_upper_bound = NULL;
+
+  // Filters built with another prefix_extractor are not used: the one
+  // of "ccc" holds "ccc" but not "cc"
+  const SliceTransform* old_extractor = options.prefix_extractor;
+  options.prefix_extractor = NewFixedPrefixTransform(2);
+  Reopen(&options);
+  iter = db_->NewIterator(ropts);
+  iter->Seek("cc");
+  ASSERT_EQ("ccc1,ccc2,", ScanKeys(iter));
+  delete iter;
+
+  Close();
+  delete old_extractor;
+  delete options.prefix_extractor;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, IterateUpperBound) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put("a", "v"));
+  ASSERT_OK(Put("b", "v"));
+  ASSERT_OK(Put("c", "v"));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put("d" + Key(i), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Delete("d" + Key(i)));
+  }
+  ASSERT_OK(Put("e", "v"));
+
+  Slice bound("d");
+  ReadOptions ropts;
+  ropts.iterate_upper_bound = &bound;
+  Iterator* iter = db_->NewIterator(ropts);
+  iter->SeekToFirst();
+  ASSERT_EQ("a,b,c,", ScanKeys(iter));
+  iter->Seek("b");
+  ASSERT_EQ("b,c,", ScanKeys(iter));
+  iter->Seek("d");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->SeekToLast();
+  ASSERT_EQ("c->v", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("b->v", IterStatus(iter));
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // The deleted entries past the bound are not read
+  PerfContext* perf = GetPerfContext();
+  ropts.fill_cache = false;
+  bound = "c";
+  iter = db_->NewIterator(ropts);
+  perf->Reset();
+  iter->Seek("b");
+  ASSERT_EQ("b,", ScanKeys(iter));
+  ASSERT_EQ(1, perf->block_read_count);
+  delete iter;
+}
+
+TEST(DBTest, DataBlockHashIndex) {
+  // Lookups through the hash index find the same versions as the binary
+  // search, including old versions kept by snapshots, deletions, and
+  // keys whose versions span several restart intervals.
+  Options options = CurrentOptions();
+  options.data_block_hash_index = true;
+  options.block_restart_interval = 2;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  const int kRounds = 4;
+  const int kKeys = 200;
+  std::vector<const Snapshot*> snapshots;
+  for (int r = 0; r < kRounds; r++) {
+    for (int i = 0; i < kKeys; i++) {
+      if ((i + r) % 7 == 0) {
+        ASSERT_OK(Delete(Key(i)));
+      } else {
+        ASSERT_OK(Put(Key(i), Key(i + r)));
+      }
+    }
+    snapshots.push_back(db_->GetSnapshot());
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, TotalTableFiles());
+
+  for (int r = 0; r < kRounds; r++) {
+    for (int i = 0; i < kKeys; i++) {
+      const std::string expected =
+          ((i + r) % 7 == 0) ? "NOT_FOUND" : Key(i + r);
+      ASSERT_EQ(expected, Get(Key(i), snapshots[r]));
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + "x", snapshots[r]));
+    }
+    db_->ReleaseSnapshot(snapshots[r]);
+  }
+}
+
+TEST(DBTest, MultiGet) {
+  do {
+    Options options = CurrentOptions();
+    options.write_buffer_size = 100000;  // Small write buffer
+    Reopen(&options);
+
+    // Spread the versions of the keys over the memtable, level-0 files,
+    // and deeper levels.
+    const int kKeys = 300;
+    for (int i = 0; i < kKeys; i++) {
+      ASSERT_OK(Put(Key(i), "a" + Key(i)));
+    }
+    Compact(Key(0), Key(kKeys));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < kKeys; i += 3) {
+      ASSERT_OK(Put(Key(i), "b" + Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < kKeys; i += 5) {
+      ASSERT_OK(Delete(Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < kKeys; i += 7) {
+      ASSERT_OK(Put(Key(i), "c" + Key(i)));
+    }
+
+    // Unsorted keys with duplicates and missing keys
+    std::vector<std::string> keys;
+    for (int i = 0; i < kKeys + 10; i++) {
+      keys.push_back(Key((i * 37) % (kKeys + 10)));
+      if (i % 11 == 0) {
+        keys.push_back(Key(i) + "x");
+        keys.push_back(Key(i));
+      }
+    }
+    std::vector<std::string> values = MultiGet(keys);
+    std::vector<std::string> old_values = MultiGet(keys, snapshot);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), old_values.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(Get(keys[i]), values[i]);
+      ASSERT_EQ(Get(keys[i], snapshot), old_values[i]);
+    }
+    db_->ReleaseSnapshot(snapshot);
+
+    ASSERT_EQ(0, MultiGet(std::vector<std::string>()).size());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, MultiGetCoalescesReads) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  const int N = 1000;
+  std::vector<std::string> keys;
+  for (int i = 0; i < N; i++) {
+    keys.push_back(Key(i));
+    ASSERT_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  Compact("a", "z");
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(0)));
+
+  // Each Get() reads a block, but MultiGet() reads neighbouring blocks
+  // together.
+  env_->random_read_counter_.Reset();
+  std::vector<std::string> values = MultiGet(keys);
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d keys => %d reads\n", N, reads);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(100, 'v'), values[i]);
+  }
+  ASSERT_LE(reads, N / 100);
+
+  Close();
+  delete options.block_cache;
+}
+
+namespace {
+// Joins a key's value and operands with commas.
+class AppendOperator : public MergeOperator {
+ public:
+  explicit AppendOperator(bool allow_partial)
+      : allow_partial_(allow_partial) { }
+
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::deque<std::string>& operands,
+                         std::string* new_value,
+                         Logger* logger) const {
+    new_value->clear();
+    if (existing_value != NULL) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (size_t i = 0; i < operands.size(); i++) {
+      if (!new_value->empty()) {
+        new_value->push_back(',');
+      }
+      new_value->append(operands[i]);
+    }
+    return true;
+  }
+
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value,
+                            Logger* logger) const {
+    if (!allow_partial_) {
+      return false;
+    }
+    *new_value = left_operand.ToString() + "," + right_operand.ToString();
+    return true;
+  }
+
+  virtual const char* Name() const { return "leveldb.AppendOperator"; }
+
+ private:
+  const bool allow_partial_;
+};
+}  // namespace
+
+TEST(DBTest, Merge) {
+  AppendOperator append(true);
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.merge_operator = &append;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Put("a", "x"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "1"));
+    ASSERT_OK(Put("c", "y"));
+    ASSERT_OK(Delete("c"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "c", "3"));
+    ASSERT_EQ("x,1,2", Get("a"));
+    ASSERT_EQ("1", Get("b"));
+    ASSERT_EQ("3", Get("c"));
+
+    // Operands in the memtable apply to values in table files
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("x,1,2", Get("a"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "3"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "2"));
+    ASSERT_EQ("x,1,2,3", Get("a"));
+    ASSERT_EQ("1,2", Get("b"));
+    ASSERT_EQ("3", Get("c"));
+    ASSERT_EQ("NOT_FOUND", Get("d"));
+
+    std::vector<std::string> keys;
+    keys.push_back("c");
+    keys.push_back("a");
+    keys.push_back("d");
+    keys.push_back("b");
+    std::vector<std::string> values = MultiGet(keys);
+    ASSERT_EQ("3", values[0]);
+    ASSERT_EQ("x,1,2,3", values[1]);
+    ASSERT_EQ("NOT_FOUND", values[2]);
+    ASSERT_EQ("1,2", values[3]);
+
+    // Compactions replace the operands by their result
+    dbfull()->TEST_CompactMemTable();
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("[ x,1,2,3 ]", AllEntriesFor("a"));
+    ASSERT_EQ("[ 1,2 ]", AllEntriesFor("b"));
+    ASSERT_EQ("[ 3 ]", AllEntriesFor("c"));
+    ASSERT_EQ("(a->x,1,2,3)(b->1,2)(c->3)", Contents());
+
+    // The result survives a reopen
+    Reopen(&options);
+    ASSERT_EQ("x,1,2,3", Get("a"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, MergeWithSnapshot) {
+  AppendOperator append(true);
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &append;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "x"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+
+  // The operand that the snapshot does not see is kept apart
+  ASSERT_EQ("[ MERGE(2), x,1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("x,1", Get("a", snapshot));
+  ASSERT_EQ("x,1,2", Get("a"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_EQ("a->x,1,2", IterStatus(iter));
+  delete iter;
+  ReadOptions snapshot_options;
+  snapshot_options.snapshot = snapshot;
+  iter = db_->NewIterator(snapshot_options);
+  iter->SeekToFirst();
+  ASSERT_EQ("a->x,1", IterStatus(iter));
+  delete iter;
+
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+  ASSERT_EQ("[ x,1,2 ]", AllEntriesFor("a"));
+}
+
+TEST(DBTest, MergeIterator) {
+  AppendOperator append(true);
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.merge_operator = &append;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Put("a", "x"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "1"));
+    ASSERT_OK(Put("c", "y"));
+    ASSERT_OK(Put("e", "z"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "2"));
+    ASSERT_OK(Delete("c"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "c", "3"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "d", "4"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "e", "5"));
+    ASSERT_OK(Delete("e"));
+
+    ASSERT_EQ("(a->x,1)(b->1,2)(c->3)(d->4)", Contents());
+
+    // Change directions on merged entries
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek("b");
+    ASSERT_EQ("b->1,2", IterStatus(iter));
+    iter->Prev();
+    ASSERT_EQ("a->x,1", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("b->1,2", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("c->3", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("d->4", IterStatus(iter));
+    iter->Prev();
+    ASSERT_EQ("c->3", IterStatus(iter));
+    iter->Next();
+    iter->Next();
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+    iter->SeekToLast();
+    ASSERT_EQ("d->4", IterStatus(iter));
+    iter->Prev();
+    iter->Prev();
+    ASSERT_EQ("b->1,2", IterStatus(iter));
+    delete iter;
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, MergePartialInCompaction) {
+  for (int partial = 0; partial < 2; partial++) {
+    AppendOperator append(partial != 0);
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.merge_operator = &append;
+    DestroyAndReopen(&options);
+
+    // Leave the value in a level below those that are compacted
+    ASSERT_OK(Put("a", "x"));
+    ASSERT_OK(Put("z", "x"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("1,1,1", FilesPerLevel());
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+    ASSERT_EQ("0,1,1", FilesPerLevel());
+
+    if (partial) {
+      ASSERT_EQ("[ MERGE(1,2), x ]", AllEntriesFor("a"));
+    } else {
+      ASSERT_EQ("[ MERGE(2), MERGE(1), x ]", AllEntriesFor("a"));
+    }
+    ASSERT_EQ("x,1,2", Get("a"));
+
+    dbfull()->TEST_CompactRange(1, NULL, NULL);
+    ASSERT_EQ("[ x,1,2 ]", AllEntriesFor("a"));
+    ASSERT_EQ("x,1,2", Get("a"));
+  }
+}
+
+TEST(DBTest, MergeWithoutOperator) {
+  ASSERT_EQ(0, db_->Merge(WriteOptions(), "a", "1").ToString().find(
+                   "Invalid argument"));
+
+  // Operands that a database holds cannot be read without an operator
+  AppendOperator append(true);
+  Options options = CurrentOptions();
+  options.merge_operator = &append;
+  Reopen(&options);
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+  options.merge_operator = NULL;
+  Reopen(&options);
+  ASSERT_EQ(0, Get("a").find("Invalid argument"));
+}
+
+TEST(DBTest, DeleteRange) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(Put("e", "ve"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "e"));
+    ASSERT_OK(Put("c", "vc2"));
+
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("NOT_FOUND", Get("d"));
+      ASSERT_EQ("ve", Get("e"));
+      ASSERT_EQ("(a->va)(c->vc2)(e->ve)", Contents());
+      std::vector<std::string> keys;
+      for (char c = 'a'; c <= 'e'; c++) {
+        keys.push_back(std::string(1, c));
+      }
+      std::vector<std::string> values = MultiGet(keys);
+      for (size_t k = 0; k < keys.size(); k++) {
+        ASSERT_EQ(Get(keys[k]), values[k]);
+      }
+      if (i < 2) {
+        ASSERT_EQ("vb", Get("b", snapshot));
+        ASSERT_EQ("vd", Get("d", snapshot));
+      }
+      if (i == 0) {
+        dbfull()->TEST_CompactMemTable();
+      } else if (i == 1) {
+        db_->ReleaseSnapshot(snapshot);
+        Reopen();
+      }
+    }
+
+    // An empty range deletes nothing
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "e", "a"));
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "a"));
+    ASSERT_EQ("(a->va)(c->vc2)(e->ve)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteRangeManyInMemTable) {
+  // Overlapping range deletions added one at a time, with writes and a
+  // snapshot between them, are all applied by reads of the memtable.
+  const int kKeys = 200;
+  std::vector<std::string> expected(kKeys, "v");
+  for (int i = 0; i < kKeys; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  const Snapshot* snapshot = NULL;
+  std::vector<std::string> at_snapshot;
+  for (int r = 0; r < 37; r++) {
+    const int begin = (r * 53) % kKeys;
+    const int end = std::min(kKeys, begin + 1 + r % 11);
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(begin), Key(end)));
+    for (int i = begin; i < end; i++) {
+      expected[i] = "NOT_FOUND";
+    }
+    ASSERT_OK(Put(Key(begin + 1), "w"));
+    if (begin + 1 < kKeys) {
+      expected[begin + 1] = "w";
+    }
+    if (r == 20) {
+      snapshot = db_->GetSnapshot();
+      at_snapshot = expected;
+    }
+    for (int i = 0; i < kKeys; i++) {
+      ASSERT_EQ(expected[i], Get(Key(i)));
+    }
+  }
+  for (int i = 0; i < kKeys; i++) {
+    ASSERT_EQ(at_snapshot[i], Get(Key(i), snapshot));
+  }
+  db_->ReleaseSnapshot(snapshot);
+  Reopen();
+  for (int i = 0; i < kKeys; i++) {
+    ASSERT_EQ(expected[i], Get(Key(i)));
+  }
+}
+
+TEST(DBTest, DeleteRangeCompaction) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(Put("d", "vd"));
+  Compact("a", "d");
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+  ASSERT_OK(Put("c", "vc2"));
+  ASSERT_EQ("[ DELRANGE(d), vb ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ vc2, vc ]", AllEntriesFor("c"));
+
+  // Compactions drop the covered entries, and the tombstone itself
+  // once no older data remains below it
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ vc2 ]", AllEntriesFor("c"));
+  ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+  // A snapshot keeps both until it is released
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "b"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ DELRANGE(b), va ]", AllEntriesFor("a"));
+  ASSERT_EQ("va", Get("a", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("(c->vc2)(d->vd)", Contents());
+}
+
+TEST(DBTest, DeleteRangeDropsFiles) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("z", "vz"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+
+  // The file of the covered keys outlives a snapshot that sees them
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(0), Key(100)));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(3, TotalTableFiles());
+  ASSERT_EQ("v", Get(Key(50), snapshot));
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+
+  // Once the snapshot is gone the file is deleted without compacting it
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_OK(Put("y", "vy"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(3, TotalTableFiles());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(50)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(99)));
+  ASSERT_EQ("vz", Get("z"));
+  ASSERT_EQ("(y->vy)(z->vz)", Contents());
+}
+
+namespace {
+// Deletes the values "expired" and replaces the values "old" by "new".
+class ExpiryFilter : public CompactionFilter {
+ public:
+  virtual bool Filter(int level,
+                      const Slice& key,
+                      const Slice& existing_value,
+                      std::string* new_value,
+                      bool* value_changed) const {
+    if (existing_value == "expired") {
+      return true;
+    }
+    if (existing_value == "old") {
+      *new_value = "new";
+      *value_changed = true;
+    }
+    return false;
+  }
+
+  virtual const char* Name() const { return "leveldb.ExpiryFilter"; }
+};
+}  // namespace
+
+TEST(DBTest, CompactionFilter) {
+  ExpiryFilter filter;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_filter = &filter;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Put("z", "vz"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a", "expired"));
+  ASSERT_OK(Put("b", "old"));
+  ASSERT_OK(Put("c", "expired"));
+  dbfull()->TEST_CompactMemTable();
+
+  // Values are only filtered once a compaction reaches them
+  ASSERT_EQ("expired", Get("a"));
+  ASSERT_EQ("[ expired, va ]", AllEntriesFor("a"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ new ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("c"));
+  ASSERT_EQ("(b->new)(z->vz)", Contents());
+
+  // Values that a snapshot sees are left alone, and filtered values
+  // keep hiding the older ones that it sees
+  ASSERT_OK(Put("d", "expired"));
+  ASSERT_OK(Put("e", "ve"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("e", "expired"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ expired ]", AllEntriesFor("d"));
+  ASSERT_EQ("[ DEL, ve ]", AllEntriesFor("e"));
+  ASSERT_EQ("expired", Get("d", snapshot));
+  ASSERT_EQ("ve", Get("e", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(DBTest, PeriodicCompaction) {
+  ExpiryFilter filter;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.env = env_;
+  options.compaction_filter = &filter;
+  options.periodic_compaction_seconds = 3600;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "expired"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // No file is compacted before it is old enough
+  env_->clock_offset_seconds_.IncrementBy(1800);
+  ASSERT_OK(Put("c", "old"));
+  dbfull()->TEST_CompactMemTable();
+  DelayMilliseconds(100);
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+  ASSERT_EQ("[ expired ]", AllEntriesFor("b"));
+
+  // The next flush finds the first file due and compacts it by itself
+  env_->clock_offset_seconds_.IncrementBy(1800);
+  ASSERT_OK(Put("d", "vd"));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 100 && AllEntriesFor("b") != "[ ]"; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ old ]", AllEntriesFor("c"));
+  ASSERT_EQ(3, TotalTableFiles());
+  ASSERT_EQ("(a->va)(c->old)(d->vd)", Contents());
+
+  // Files written by a compaction start over
+  Reopen(&options);
+  env_->clock_offset_seconds_.IncrementBy(1800);
+  ASSERT_OK(Put("e", "ve"));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 100 && AllEntriesFor("c") != "[ new ]"; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("[ new ]", AllEntriesFor("c"));
+  ASSERT_EQ("[ va ]", AllEntriesFor("a"));
+  ASSERT_EQ("(a->va)(c->new)(d->vd)(e->ve)", Contents());
+}
+
+TEST(DBTest, PeriodicCompactionWithoutWrites) {
+  ExpiryFilter filter;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.env = env_;
+  options.compaction_filter = &filter;
+  options.periodic_compaction_seconds = 3600;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "expired"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // The timer finds the file due although nothing is written
+  env_->clock_offset_seconds_.IncrementBy(3600);
+  for (int i = 0; i < 500 && AllEntriesFor("b") != "[ ]"; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("(a->va)", Contents());
+}
+
+TEST(DBTest, PeriodicCompactionOfUnknownAge) {
+  ExpiryFilter filter;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.env = env_;
+  options.compaction_filter = &filter;
+  options.periodic_compaction_seconds = 3600;
+  DestroyAndReopen(&options);
+
+  const int kFiles = 4;
+  for (int i = 0; i < kFiles; i++) {
+    ASSERT_OK(Put(Key(i), "expired"));
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  // RepairDB does not know when the files were written
+  Close();
+  ASSERT_OK(RepairDB(dbname_, options));
+  Reopen(&options);
+
+  // They are not all due at once
+  ASSERT_OK(Put("x", "vx"));
+  dbfull()->TEST_CompactMemTable();
+  DelayMilliseconds(100);
+  for (int i = 0; i < kFiles; i++) {
+    ASSERT_EQ("[ expired ]", AllEntriesFor(Key(i)));
+  }
+
+  // But all of them are within a period, and keep their ages when the
+  // database is reopened
+  env_->clock_offset_seconds_.IncrementBy(1800);
+  Reopen(&options);
+  env_->clock_offset_seconds_.IncrementBy(1800);
+  ASSERT_OK(Put("y", "vy"));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 200 && Contents() != "(x->vx)(y->vy)"; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("(x->vx)(y->vy)", Contents());
+}
+
+TEST(DBTest, IteratorReadahead) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.block_size = 1024;
+  Reopen(&options);
+
+  const int N = 5000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  Compact("a", "z");
+  ASSERT_OK(Put(Key(N / 2), "new"));     // Memtable entries merge in
+  ASSERT_OK(Delete(Key(N / 3)));
+
+  ReadOptions plain_options;
+  ReadOptions readahead_options;
+  readahead_options.readahead_size = 256 * 1024;
+  env_->random_read_counter_.Reset();
+  Iterator* plain = db_->NewIterator(plain_options);
+  int plain_entries = 0;
+  for (plain->SeekToFirst(); plain->Valid(); plain->Next()) {
+    plain_entries++;
+  }
+  delete plain;
+  const int plain_reads = env_->random_read_counter_.Read();
+
+  env_->random_read_counter_.Reset();
+  env_->prefetch_counter_.Reset();
+  Iterator* iter = db_->NewIterator(readahead_options);
+  int i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+    if (i == N / 3) {
+      i++;  // Deleted
+    }
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    if (i == N / 2) {
+      ASSERT_EQ("new", iter->value().ToString());
+    } else {
+      ASSERT_EQ(Key(i) + std::string(100, 'v'), iter->value().ToString());
+    }
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  const int readahead_reads = env_->random_read_counter_.Read();
+  const int prefetches = env_->prefetch_counter_.Read();
+  fprintf(stderr, "%d entries => %d reads, %d with readahead (%d prefetches)\n",
+          plain_entries, plain_reads, readahead_reads, prefetches);
+  ASSERT_EQ(N, i);
+  ASSERT_EQ(N - 1, plain_entries);
+  if (prefetches == 0) {
+    ASSERT_LT(readahead_reads * 10, plain_reads);
+  } else {
+    // Reads of mmapped files need no I/O, so the iterator prefetches
+    // instead of reading ahead.
+    ASSERT_LT(prefetches * 10, plain_reads);
+  }
+
+  Close();
+  delete options.block_cache;
+}
+
+namespace {
+// Leaves blocks uncompressed but counts the blocks it is asked to
+// compress.
+class CountingCompressor : public Compressor {
+ public:
+  virtual CompressionType type() const {
+    return static_cast<CompressionType>(0x81);
+  }
+  virtual const char* Name() const { return "leveldb.CountingTest"; }
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    blocks_.Increment();
+    return false;
+  }
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    return false;
+  }
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    return false;
+  }
+  int blocks() const { return blocks_.Read(); }
+
+ private:
+  mutable AtomicCounter blocks_;
+};
+}  // namespace
+
+TEST(DBTest, CompressionPerLevel) {
+  // Registered compressors must stay live
+  static CountingCompressor compressor;
+  RegisterCompressor(&compressor);
+
+  Options options = CurrentOptions();
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(compressor.type());
+  Reopen(&options);
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("z", "vz"));
+
+  // Memtables are written with the compression of level 0
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(0, compressor.blocks());
+
+  // Compactions output to level 1 or deeper
+  int level = 0;
+  while (NumTableFilesAtLevel(level) == 0) {
+    level++;
+  }
+  dbfull()->TEST_CompactRange(level, NULL, NULL);
+  ASSERT_EQ(1, NumTableFilesAtLevel(level + 1));
+  ASSERT_GT(compressor.blocks(), 0);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vz", Get("z"));
+}
+
+TEST(DBTest, UnknownCompression) {
+  Options options = CurrentOptions();
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(
+      static_cast<CompressionType>(0xf0));
+  Status s = TryReopen(&options);
+  ASSERT_TRUE(!s.ok());
+  ASSERT_TRUE(s.ToString().find("unknown compression") != std::string::npos)
+      << s.ToString();
+}
+
+TEST(DBTest, CompressionDictionaryNeedsSupport) {
+  Options options = CurrentOptions();
+  options.compression = kSnappyCompression;
+  options.compression_dict_bytes = 4096;
+  Status s = TryReopen(&options);
+  ASSERT_TRUE(s.ToString().find("Invalid argument: ") == 0) << s.ToString();
+
+  // Only the compressions that are used count
+  options.compression = kZlibCompression;
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(kSnappyCompression);
+  s = TryReopen(&options);
+  ASSERT_TRUE(s.ToString().find("Invalid argument: ") == 0) << s.ToString();
+
+  options.compression_per_level.push_back(kZlibCompression);
+  ASSERT_OK(TryReopen(&options));
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_EQ("va", Get("a"));
+}
+
+namespace {
+// Grants every request at once but counts the bytes requested at each
+// priority.
+class GrantingRateLimiter : public RateLimiter {
+ public:
+  virtual void Request(size_t bytes, Env::Priority priority) {
+    bytes_[priority].IncrementBy(bytes);
+  }
+  virtual uint64_t GetBytesPerSecond() const { return 1 << 30; }
+  int bytes(Env::Priority priority) { return bytes_[priority].Read(); }
+
+ private:
+  AtomicCounter bytes_[2];
+};
+}  // namespace
+
+TEST(DBTest, RateLimiter) {
+  GrantingRateLimiter limiter;
+  Options options = CurrentOptions();
+  options.rate_limiter = &limiter;
+  Reopen(&options);
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.rate-limiter", &property));
+
+  // Flushes request at high priority
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), std::string(1000, 'a' + round)));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  const int flushed = limiter.bytes(Env::kHighPriority);
+  ASSERT_GE(flushed, 2 * 100 * 1000);
+  ASSERT_EQ(0, limiter.bytes(Env::kLowPriority));
+
+  // Compactions request both their reads and their writes at low
+  // priority.
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_GE(limiter.bytes(Env::kLowPriority), 3 * 100 * 1000);
+  ASSERT_EQ(flushed, limiter.bytes(Env::kHighPriority));
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.rate-limiter", &property));
+  ASSERT_TRUE(property.find("Compaction") != std::string::npos) << property;
+
+  // The database must not outlive the limiter.
+  options.rate_limiter = NULL;
+  Reopen(&options);
+  ASSERT_TRUE(!db_->GetProperty("leveldb.rate-limiter", &property));
+}
+
+namespace {
+// Holds compactions, which request their I/O at low priority, back
+// until Release() is called.  Flushes are let through.
+class CompactionBlockingRateLimiter : public RateLimiter {
+ public:
+  CompactionBlockingRateLimiter() : cv_(&mu_), blocked_(true) { }
+
+  virtual void Request(size_t bytes, Env::Priority priority) {
+    MutexLock l(&mu_);
+    while (blocked_ && priority == Env::kLowPriority) {
+      cv_.Wait();
+    }
+  }
+  virtual uint64_t GetBytesPerSecond() const { return 1 << 30; }
+
+  void Release() {
+    MutexLock l(&mu_);
+    blocked_ = false;
+    cv_.SignalAll();
+  }
+
+ private:
+  port::Mutex mu_;
+  port::CondVar cv_;
+  bool blocked_;
+};
+
+// Return the count on the line of the "leveldb.write-stalls" property
+// that starts with "kind".
+uint64_t WriteStalls(DB* db, const std::string& kind) {
+  std::string property;
+  ASSERT_TRUE(db->GetProperty("leveldb.write-stalls", &property));
+  const size_t pos = property.find("\n" + kind);
+  ASSERT_TRUE(pos != std::string::npos) << property;
+  unsigned long long count = 0;
+  ASSERT_EQ(1, sscanf(property.c_str() + pos + 1 + kind.size(), "%llu",
+                      &count)) << property;
+  return count;
+}
+}  // namespace
+
+TEST(DBTest, DelayedWrites) {
+  CompactionBlockingRateLimiter limiter;
+  Options options = CurrentOptions();
+  options.rate_limiter = &limiter;
+  options.level0_slowdown_writes_trigger = config::kL0_CompactionTrigger;
+  options.level0_stop_writes_trigger = 100;
+  options.delayed_write_rate = 100 << 10;
+  Reopen(&options);
+
+  // Pile up overlapping level-0 files that compactions cannot merge.
+  for (int i = 0; NumTableFilesAtLevel(0) < config::kL0_CompactionTrigger;
+       i++) {
+    ASSERT_LT(i, 100);
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("z", "vz"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(0, WriteStalls(db_, "Delayed"));
+
+  // Writes are slowed down to about delayed_write_rate but not stopped.
+  const uint64_t start = env_->NowMicros();
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'x')));
+  }
+  ASSERT_GE(env_->NowMicros() - start, 250000);
+  ASSERT_GT(WriteStalls(db_, "Delayed"), 0);
+  ASSERT_EQ(0, WriteStalls(db_, "Stopped"));
+
+  // Once compactions catch up, writes go through undelayed.
+  limiter.Release();
+  for (int i = 0; NumTableFilesAtLevel(0) >= config::kL0_CompactionTrigger;
+       i++) {
+    ASSERT_LT(i, 1000) << FilesPerLevel();
+    DelayMilliseconds(10);
+  }
+  const uint64_t delayed = WriteStalls(db_, "Delayed");
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'y')));
+  }
+  ASSERT_EQ(delayed, WriteStalls(db_, "Delayed"));
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(std::string(1000, 'y'), Get(Key(i)));
+  }
+
+  // The database must not outlive the limiter.
+  options.rate_limiter = NULL;
+  Reopen(&options);
+}
+
+static std::string IngestFileName() {
+  return test::TmpDir() + "/db_test_ingest.sst";
+}
+
+// Write Key(from) .. Key(to-1) with the given value to fname.
+static void WriteExternalFile(const Options& options, const std::string& fname,
+                              int from, int to, const std::string& value) {
+  SstFileWriter writer(options);
+  ASSERT_OK(writer.Open(fname));
+  for (int i = from; i < to; i++) {
+    ASSERT_OK(writer.Put(Key(i), value));
+  }
+  ASSERT_OK(writer.Finish());
+  ASSERT_EQ(to - from, writer.NumEntries());
+}
+
+static bool IsInvalidArgument(const Status& s) {
+  return s.ToString().find("Invalid argument") == 0;
+}
+
+TEST(DBTest, IngestExternalFile) {
+  do {
+    const std::string fname = IngestFileName();
+    WriteExternalFile(CurrentOptions(), fname, 0, 100, "v1");
+    ASSERT_OK(db_->IngestExternalFile(IngestExternalFileOptions(), fname));
+
+    // Nothing overlaps the file, so it goes straight to the last level.
+    ASSERT_EQ(1, TotalTableFiles());
+    ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+    ASSERT_TRUE(env_->FileExists(fname));
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ("v1", Get(Key(i)));
+    }
+    ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+
+    Reopen();
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ("v1", Get(Key(i)));
+    }
+    ASSERT_OK(env_->DeleteFile(fname));
+  } while (ChangeOptions(kSkipUniversalCompaction));
+}
+
+TEST(DBTest, IngestExternalFileOverwrites) {
+  do {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(Key(i), "old"));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 10; i < 20; i++) {
+      ASSERT_OK(Put(Key(i), "old"));
+    }
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    // Key(5) .. Key(15) get new values and Key(16) is deleted; the range
+    // overlaps both a table and the memtable.
+    const std::string fname = IngestFileName();
+    {
+      SstFileWriter writer(CurrentOptions());
+      ASSERT_OK(writer.Open(fname));
+      for (int i = 5; i < 16; i++) {
+        ASSERT_OK(writer.Put(Key(i), "new"));
+      }
+      ASSERT_OK(writer.Delete(Key(16)));
+      ASSERT_OK(writer.Finish());
+    }
+    ASSERT_OK(db_->IngestExternalFile(IngestExternalFileOptions(), fname));
+    ASSERT_OK(Put(Key(6), "newer"));
+
+    for (int pass = 0; pass < 3; pass++) {
+      for (int i = 0; i < 20; i++) {
+        std::string expected = "old";
+        if (i == 6) {
+          expected = "newer";
+        } else if (i == 16) {
+          expected = "NOT_FOUND";
+        } else if (i >= 5 && i < 16) {
+          expected = "new";
+        }
+        ASSERT_EQ(expected, Get(Key(i)));
+        if (snapshot != NULL) {
+          ASSERT_EQ("old", Get(Key(i), snapshot));
+        }
+      }
+      if (pass == 0) {
+        db_->ReleaseSnapshot(snapshot);
+        snapshot = NULL;
+        db_->CompactRange(NULL, NULL);
+      } else {
+        Reopen();
+      }
+    }
+    ASSERT_OK(env_->DeleteFile(fname));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, IngestExternalFileMove) {
+  const std::string fname = IngestFileName();
+  WriteExternalFile(CurrentOptions(), fname, 0, 10, "v1");
+  IngestExternalFileOptions ingest_options;
+  ingest_options.move_files = true;
+  ASSERT_OK(db_->IngestExternalFile(ingest_options, fname));
+  ASSERT_TRUE(!env_->FileExists(fname));
+  ASSERT_EQ("v1", Get(Key(0)));
+  ASSERT_EQ("v1", Get(Key(9)));
+
+  // A second file over the same keys lands above the first one.
+  WriteExternalFile(CurrentOptions(), fname, 5, 15, "v2");
+  ASSERT_OK(db_->IngestExternalFile(ingest_options, fname));
+  ASSERT_EQ(2, TotalTableFiles());
+  ASSERT_EQ("v1", Get(Key(4)));
+  ASSERT_EQ("v2", Get(Key(5)));
+  ASSERT_EQ("v2", Get(Key(14)));
+  Reopen();
+  ASSERT_EQ("v1", Get(Key(4)));
+  ASSERT_EQ("v2", Get(Key(9)));
+}
+
+TEST(DBTest, IngestExternalFileIntoDeletedRange) {
+  do {
+    // No memtable entry falls in the file's range, but a range deletion
+    // of the memtable covers it.  The file is newer than the deletion.
+    ASSERT_OK(Put(Key(0), "v0"));
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(1), Key(20)));
+    const std::string fname = IngestFileName();
+    WriteExternalFile(CurrentOptions(), fname, 5, 10, "new");
+    ASSERT_OK(db_->IngestExternalFile(IngestExternalFileOptions(), fname));
+
+    std::string expected = "(" + Key(0) + "->v0)";
+    for (int i = 5; i < 10; i++) {
+      expected += "(" + Key(i) + "->new)";
+    }
+    std::vector<std::string> keys;
+    for (int i = 0; i < 12; i++) {
+      keys.push_back(Key(i));
+    }
+    for (int pass = 0; pass < 3; pass++) {
+      ASSERT_EQ("v0", Get(Key(0)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(1)));
+      ASSERT_EQ("new", Get(Key(5)));
+      ASSERT_EQ("new", Get(Key(9)));
+      ASSERT_EQ(expected, Contents());
+      std::vector<std::string> values = MultiGet(keys);
+      for (size_t i = 0; i < keys.size(); i++) {
+        ASSERT_EQ(Get(keys[i]), values[i]);
+      }
+      if (pass == 0) {
+        dbfull()->TEST_CompactMemTable();
+      } else {
+        Reopen();
+      }
+    }
+    ASSERT_OK(env_->DeleteFile(fname));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, IngestExternalFileErrors) {
+  const std::string fname = IngestFileName();
+  {
+    SstFileWriter writer(CurrentOptions());
+    ASSERT_TRUE(!writer.Put("a", "v").ok());
+    ASSERT_OK(writer.Open(fname));
+    ASSERT_OK(writer.Put("b", "v"));
+    ASSERT_TRUE(IsInvalidArgument(writer.Put("a", "v")));
+    ASSERT_TRUE(IsInvalidArgument(writer.Put("b", "v")));
+    ASSERT_EQ(1, writer.NumEntries());
+  }
+  {
+    SstFileWriter writer(CurrentOptions());
+    ASSERT_OK(writer.Open(fname));
+    ASSERT_TRUE(IsInvalidArgument(writer.Finish()));
+  }
+  ASSERT_OK(env_->DeleteFile(fname));
+  ASSERT_TRUE(!db_->IngestExternalFile(IngestExternalFileOptions(),
+                                       fname).ok());
+
+  // Tables written by the database itself carry real sequence numbers.
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  std::string table;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+      table = dbname_ + "/" + filenames[i];
+    }
+  }
+  ASSERT_TRUE(!table.empty());
+  ASSERT_TRUE(IsInvalidArgument(
+      db_->IngestExternalFile(IngestExternalFileOptions(), table)));
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_OK(Put("bar", "v2"));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+}
+
+static uint64_t LevelHits(const PerfContext* perf) {
+  uint64_t hits = 0;
+  for (int level = 0; level < kPerfContextNumLevels; level++) {
+    hits += perf->get_from_level_count[level];
+  }
+  return hits;
+}
+
+TEST(DBTest, PerfContext) {
+  Options options = CurrentOptions();
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+  PerfContext* perf = GetPerfContext();
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("z", "vz"));
+  perf->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(1, perf->get_from_memtable_count);
+  ASSERT_EQ(0, LevelHits(perf));
+  ASSERT_EQ(0, perf->block_read_count);
+
+  dbfull()->TEST_CompactMemTable();
+  perf->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(0, perf->get_from_memtable_count);
+  ASSERT_EQ(1, LevelHits(perf));
+  ASSERT_EQ(1, perf->block_cache_miss_count);
+  ASSERT_EQ(1, perf->block_read_count);
+  ASSERT_GT(perf->block_read_byte, 0);
+
+  // The filter rules out the table without reading a block
+  perf->Reset();
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+  ASSERT_EQ(1, perf->bloom_useful_count);
+  ASSERT_EQ(0, perf->bloom_useless_count);
+  ASSERT_EQ(0, perf->block_read_count);
+
+  perf->Reset();
+  ASSERT_EQ("v1", MultiGet(std::vector<std::string>(1, "foo"))[0]);
+  ASSERT_EQ(1, LevelHits(perf));
+  ASSERT_EQ(1, perf->block_read_count);
+
+  // Nothing is counted when disabled
+  SetPerfLevel(kPerfDisable);
+  perf->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("", perf->ToString());
+
+  SetPerfLevel(kPerfEnableTime);
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_NE("", perf->ToString());
+  SetPerfLevel(kPerfEnableCount);
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, LatencyProperties) {
+  std::string prop;
+  ASSERT_TRUE(db_->GetProperty("leveldb.latency.get", &prop));
+  ASSERT_TRUE(prop.find("Count: 0 ") != std::string::npos) << prop;
+
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+    ASSERT_EQ("v", Get(Key(i)));
+  }
+  MultiGet(std::vector<std::string>(3, Key(0)));
+  ASSERT_TRUE(db_->GetProperty("leveldb.latency.get", &prop));
+  ASSERT_TRUE(prop.find("Count: 10 ") != std::string::npos) << prop;
+  ASSERT_TRUE(db_->GetProperty("leveldb.latency.multiget", &prop));
+  ASSERT_TRUE(prop.find("Count: 1 ") != std::string::npos) << prop;
+  ASSERT_TRUE(db_->GetProperty("leveldb.latency.write", &prop));
+  ASSERT_TRUE(prop.find("Count: 10 ") != std::string::npos) << prop;
+  ASSERT_TRUE(db_->GetProperty("leveldb.perf-context", &prop));
+}
+
+// Multi-threaded test:
+namespace {
+
+static const int kNumThreads = 4;
+static const int kTestSeconds = 10;
+static const int kNumKeys = 1000;
+
+struct MTState {
+  DBTest* test;
+  port::AtomicPointer stop;
+  port::AtomicPointer counter[kNumThreads];
+  port::AtomicPointer thread_done[kNumThreads];
+};
+
+struct MTThread {
+  MTState* state;
+  int id;
+};
+
+static void MTThreadBody(void* arg) {
+  MTThread* t = reinterpret_cast<MTThread*>(arg);
+  int id = t->id;
+  DB* db = t->state->test->db_;
+  uintptr_t counter = 0;
+  fprintf(stderr, "... starting thread %d\n", id);
+  Random rnd(1000 + id);
+  std::string value;
+  char valbuf[1500];
+  while (t->state->stop.Acquire_Load() == NULL) {
+    t->state->counter[id].Release_Store(reinterpret_cast<void*>(counter));
+
+    int key = rnd.Uniform(kNumKeys);
+    char keybuf[20];
+    snprintf(keybuf, sizeof(keybuf), "%016d", key);
+
+    if (rnd.OneIn(2)) {
+      // Write values of the form <key, my id, counter>.
+      // We add some padding for force compactions.
+      snprintf(valbuf, sizeof(valbuf), "%d.%d.%-1000d",
+               key, id, static_cast<int>(counter));
+      ASSERT_OK(db->Put(WriteOptions(), Slice(keybuf), Slice(valbuf)));
+    } else {
+      // Read a value and verify that it matches the pattern written above.
+      Status s = db->Get(ReadOptions(), Slice(keybuf), &value);
+      if (s.IsNotFound()) {
+        // Key has not yet been written
+      } else {
+        // Check that the writer thread counter is >= the counter in the value
+        ASSERT_OK(s);
+        int k, w, c;
+        ASSERT_EQ(3, sscanf(value.c_str(), "%d.%d.%d", &k, &w, &c)) << value;
+        ASSERT_EQ(k, key);
+        ASSERT_GE(w, 0);
+        ASSERT_LT(w, kNumThreads);
+        ASSERT_LE(c, reinterpret_cast<uintptr_t>(
+            t->state->counter[w].Acquire_Load()));
+      }
+    }
+    counter++;
+  }
+  t->state->thread_done[id].Release_Store(t);
+  fprintf(stderr, "... stopping thread %d after %d ops\n", id, int(counter));
+}
+
+}  // namespace
+
+TEST(DBTest, MultiThreaded) {
+  do {
+    // Initialize state
+    MTState mt;
+    mt.test = this;
+    mt.stop.Release_Store(0);
+    for (int id = 0; id < kNumThreads; id++) {
+      mt.counter[id].Release_Store(0);
+      mt.thread_done[id].Release_Store(0);
+    }
+
+    // Start threads
+    MTThread thread[kNumThreads];
+    for (int id = 0; id < kNumThreads; id++) {
+      thread[id].state = &mt;
+      thread[id].id = id;
+      env_->StartThread(MTThreadBody, &thread[id]);
+    }
+
+    // Let them run for a while
+    DelayMilliseconds(kTestSeconds * 1000);
+
+    // Stop the threads and wait for them to finish
+    mt.stop.Release_Store(&mt);
+    for (int id = 0; id < kNumThreads; id++) {
+      while (mt.thread_done[id].Acquire_Load() == NULL) {
+        DelayMilliseconds(100);
+      }
+    }
+  } while (ChangeOptions());
+}
+
+namespace {
+
+struct OverwriteThread {
+  DB* db;
+  int id;
+  port::AtomicPointer done;
+};
+
+static const int kNumOverwrites = 2000;
+
+static void OverwriteThreadBody(void* arg) {
+  OverwriteThread* t = reinterpret_cast<OverwriteThread*>(arg);
+  char key[20];
+  snprintf(key, sizeof(key), "%d", t->id);
+  for (int i = 0; i < kNumOverwrites; i++) {
+    char value[20];
+    snprintf(value, sizeof(value), "%d", i);
+    WriteBatch batch;
+    batch.Put(key, value);
+    batch.Put(std::string(key) + "." + value, value);
+    ASSERT_OK(t->db->Write(WriteOptions(), &batch));
+  }
+  t->done.Release_Store(t);
+}
+
+}  // namespace
+
+TEST(DBTest, ConcurrentWriters) {
+  // Each thread keeps overwriting its own key, so a write group that
+  // hands out the wrong sequence numbers leaves a stale final value.
+  do {
+    OverwriteThread thread[kNumThreads];
+    for (int id = 0; id < kNumThreads; id++) {
+      thread[id].db = db_;
+      thread[id].id = id;
+      thread[id].done.Release_Store(NULL);
+      env_->StartThread(OverwriteThreadBody, &thread[id]);
+    }
+    for (int id = 0; id < kNumThreads; id++) {
+      while (thread[id].done.Acquire_Load() == NULL) {
+        DelayMilliseconds(10);
+      }
+    }
+
+    char last[20];
+    snprintf(last, sizeof(last), "%d", kNumOverwrites - 1);
+    for (int pass = 0; pass < 2; pass++) {
+      for (int id = 0; id < kNumThreads; id++) {
+        char key[20];
+        snprintf(key, sizeof(key), "%d", id);
+        ASSERT_EQ(last, Get(key));
+        ASSERT_EQ(last, Get(std::string(key) + "." + last));
+      }
+      Reopen();
+    }
+  } while (ChangeOptions());
+}
+
+namespace {
+typedef std::map<std::string, std::string> KVMap;
+}
+
+class ModelDB: public DB {
+ public:
+  class ModelSnapshot : public Snapshot {
+   public:
+    KVMap map_;
+  };
+
+  explicit ModelDB(const Options& options): options_(options) { }
+  ~ModelDB() { }
+  virtual Status Put(const WriteOptions& o, const Slice& k, const Slice& v) {
+    return DB::Put(o, k, v);
+  }
+  virtual Status Delete(const WriteOptions& o, const Slice& key) {
+    return DB::Delete(o, key);
+  }
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, std::string* value) {
+    assert(false);      // Not implemented
+    return Status::NotFound(key);
+  }
+  virtual Iterator* NewIterator(const ReadOptions& options) {
+    if (options.snapshot == NULL) {
+      KVMap* saved = new KVMap;
+      *saved = map_;
       return new ModelIter(saved, true);
     } else {
       const KVMap* snapshot_state =
@@ -1842,6 +3695,12 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin_key, const Slice& end_key) {
+        if (begin_key.compare(end_key) < 0) {
+          map_->erase(map_->lower_bound(begin_key.ToString()),
+                      map_->lower_bound(end_key.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -1859,6 +3718,42 @@ class ModelDB: public DB {
   virtual void CompactRange(const Slice* start, const Slice* end) {
   }
 
+  // The model has a single key space.
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle) {
+    return Status::NotSupported("column families");
+  }
+  virtual Status DropColumnFamily(ColumnFamilyHandle* column_family) {
+    return Status::NotSupported("column families");
+  }
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const {
+    return NULL;
+  }
+  virtual Status Put(const WriteOptions& o, ColumnFamilyHandle* cf,
+                     const Slice& k, const Slice& v) {
+    return Put(o, k, v);
+  }
+  virtual Status Delete(const WriteOptions& o, ColumnFamilyHandle* cf,
+                        const Slice& key) {
+    return Delete(o, key);
+  }
+  virtual Status Get(const ReadOptions& options, ColumnFamilyHandle* cf,
+                     const Slice& key, std::string* value) {
+    return Get(options, key, value);
+  }
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* cf) {
+    return NewIterator(options);
+  }
+  virtual bool GetProperty(ColumnFamilyHandle* cf, const Slice& property,
+                           std::string* value) {
+    return GetProperty(property, value);
+  }
+  virtual void CompactRange(ColumnFamilyHandle* cf,
+                            const Slice* start, const Slice* end) {
+  }
+
  private:
   class ModelIter: public Iterator {
    public:
@@ -1972,11 +3867,19 @@ TEST(DBTest, Randomized) {
         ASSERT_OK(model.Put(WriteOptions(), k, v));
         ASSERT_OK(db_->Put(WriteOptions(), k, v));
 
-      } else if (p < 90) {                        // Delete
+      } else if (p < 89) {                        // Delete
         k = RandomKey(&rnd);
         ASSERT_OK(model.Delete(WriteOptions(), k));
         ASSERT_OK(db_->Delete(WriteOptions(), k));
 
+      } else if (p < 90) {                        // DeleteRange
+        k = RandomKey(&rnd);
+        v = RandomKey(&rnd);
+        if (v < k) {
+          k.swap(v);
+        }
+        ASSERT_OK(model.DeleteRange(WriteOptions(), k, v));
+        ASSERT_OK(db_->DeleteRange(WriteOptions(), k, v));
 
       } else {                                    // Multi-element batch
         WriteBatch b;
@@ -3,7 +3,9 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include <vector>
 #include "db/dbformat.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/coding.h"
 
@@ -98,8 +100,29 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+bool InternalKeyComparator::HashKey(const Slice& key, Slice* hash_key) const {
+  // All versions of a user key must land on the same hash key.
+  return key.size() >= 8 &&
+         user_comparator_->HashKey(ExtractUserKey(key), hash_key);
+}
+
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor)
+    : user_policy_(p),
+      prefix_extractor_(prefix_extractor) {
+  if (user_policy_ != NULL) {
+    // Filters without the prefixes, or with those of another transform,
+    // must not be used to rule prefixes out.
+    name_ = user_policy_->Name();
+    if (prefix_extractor_ != NULL) {
+      name_.append("+prefix.");
+      name_.append(prefix_extractor_->Name());
+    }
+  }
+}
+
 const char* InternalFilterPolicy::Name() const {
-  return user_policy_->Name();
+  return name_.c_str();
 }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
@@ -111,7 +134,28 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == NULL || n == 0) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Add each prefix ahead of the first of the keys that share it
+  std::vector<Slice> all;
+  all.reserve(2 * n);
+  Slice last_prefix;
+  bool has_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!has_prefix || prefix != last_prefix) {
+        all.push_back(prefix);
+        last_prefix = prefix;
+        has_prefix = true;
+      }
+    }
+    all.push_back(keys[i]);
+  }
+  user_policy_->CreateFilter(&all[0], static_cast<int>(all.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
@@ -20,7 +20,7 @@ namespace leveldb {
 
 namespace {
 
-bool GuessType(const std::string& fname, FileType* type) {
+bool GuessType(const std::string& fname, FileType* type, uint64_t* number) {
   size_t pos = fname.rfind('/');
   std::string basename;
   if (pos == std::string::npos) {
@@ -28,8 +28,7 @@ bool GuessType(const std::string& fname, FileType* type) {
   } else {
     basename = std::string(fname.data() + pos + 1, fname.size() - pos - 1);
   }
-  uint64_t ignored;
-  return ParseFileName(basename, &ignored, type);
+  return ParseFileName(basename, number, type);
 }
 
 // Notified when log reader encounters corruption.
@@ -42,8 +41,8 @@ class CorruptionReporter : public log::Reader::Reporter {
   }
 };
 
-// Print contents of a log file. (*func)() is called on every record.
-bool PrintLogContents(Env* env, const std::string& fname,
+// Print contents of log file "number". (*func)() is called on every record.
+bool PrintLogContents(Env* env, const std::string& fname, uint64_t number,
                       void (*func)(Slice)) {
   SequentialFile* file;
   Status s = env->NewSequentialFile(fname, &file);
@@ -52,7 +51,7 @@ bool PrintLogContents(Env* env, const std::string& fname,
     return false;
   }
   CorruptionReporter reporter;
-  log::Reader reader(file, &reporter, true, 0);
+  log::Reader reader(file, &reporter, true, 0, number);
   Slice record;
   std::string scratch;
   while (reader.ReadRecord(&record, &scratch)) {
@@ -79,6 +78,16 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     printf("  del '%s'\n",
            EscapeString(key).c_str());
   }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    printf("  merge '%s' '%s'\n",
+           EscapeString(key).c_str(),
+           EscapeString(value).c_str());
+  }
+  virtual void DeleteRange(const Slice& begin_key, const Slice& end_key) {
+    printf("  delrange '%s' '%s'\n",
+           EscapeString(begin_key).c_str(),
+           EscapeString(end_key).c_str());
+  }
 };
 
 
@@ -101,8 +110,8 @@ static void WriteBatchPrinter(Slice record) {
   }
 }
 
-bool DumpLog(Env* env, const std::string& fname) {
-  return PrintLogContents(env, fname, WriteBatchPrinter);
+bool DumpLog(Env* env, const std::string& fname, uint64_t number) {
+  return PrintLogContents(env, fname, number, WriteBatchPrinter);
 }
 
 // Called on every log record (each one of which is a WriteBatch)
@@ -117,8 +126,8 @@ static void VersionEditPrinter(Slice record) {
   printf("%s", edit.DebugString().c_str());
 }
 
-bool DumpDescriptor(Env* env, const std::string& fname) {
-  return PrintLogContents(env, fname, VersionEditPrinter);
+bool DumpDescriptor(Env* env, const std::string& fname, uint64_t number) {
+  return PrintLogContents(env, fname, number, VersionEditPrinter);
 }
 
 bool DumpTable(Env* env, const std::string& fname) {
@@ -159,6 +168,10 @@ bool DumpTable(Env* env, const std::string& fname) {
         type = "del";
       } else if (key.type == kTypeValue) {
         type = "val";
+      } else if (key.type == kTypeMerge) {
+        type = "merge";
+      } else if (key.type == kTypeRangeDeletion) {
+        type = "delrange";
       } else {
         snprintf(kbuf, sizeof(kbuf), "%d", static_cast<int>(key.type));
         type = kbuf;
@@ -183,13 +196,14 @@ bool DumpTable(Env* env, const std::string& fname) {
 
 bool DumpFile(Env* env, const std::string& fname) {
   FileType ftype;
-  if (!GuessType(fname, &ftype)) {
+  uint64_t number;
+  if (!GuessType(fname, &ftype, &number)) {
     fprintf(stderr, "%s: unknown file type\n", fname.c_str());
     return false;
   }
   switch (ftype) {
-    case kLogFile:         return DumpLog(env, fname);
-    case kDescriptorFile:  return DumpDescriptor(env, fname);
+    case kLogFile:         return DumpLog(env, fname, number);
+    case kDescriptorFile:  return DumpDescriptor(env, fname, number);
     case kTableFile:       return DumpTable(env, fname);
 
     default: {
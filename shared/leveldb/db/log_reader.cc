@@ -16,16 +16,18 @@ Reader::Reporter::~Reporter() {
 }
 
 Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-               uint64_t initial_offset)
+               uint64_t initial_offset, uint64_t log_number)
     : file_(file),
       reporter_(reporter),
       checksum_(checksum),
       backing_store_(new char[kBlockSize]),
       buffer_(),
       eof_(false),
+      recycled_(false),
       last_record_offset_(0),
       end_of_buffer_offset_(0),
-      initial_offset_(initial_offset) {
+      initial_offset_(initial_offset),
+      log_number_(log_number) {
 }
 
 Reader::~Reader() {
@@ -138,6 +140,13 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         }
         return false;
 
+      case kOldRecord:
+        if (in_fragmented_record) {
+          ReportCorruption(scratch->size(), "partial record without end(4)");
+          scratch->clear();
+        }
+        return false;
+
       case kBadRecord:
         if (in_fragmented_record) {
           ReportCorruption(scratch->size(), "error in middle of record");
@@ -208,9 +217,17 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const char* header = buffer_.data();
     const uint32_t a = static_cast<uint32_t>(header[4]) & 0xff;
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
-    const unsigned int type = header[6];
+    unsigned int type = header[6];
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    size_t header_size = kHeaderSize;
+    if (type >= kRecyclableFullType && type <= kRecyclableLastType) {
+      recycled_ = true;
+      header_size = kRecyclableHeaderSize;
+    }
+    if (header_size + length > buffer_.size()) {
+      if (recycled_) {
+        return OldRecord();
+      }
       size_t drop_size = buffer_.size();
       buffer_.clear();
       ReportCorruption(drop_size, "bad record length");
@@ -228,8 +245,13 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     // Check crc
     if (checksum_) {
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc = crc32c::Value(header + 6,
+                                          header_size - 6 + length);
       if (actual_crc != expected_crc) {
+        if (recycled_) {
+          // Likely a torn write over an old record, not a corruption
+          return OldRecord();
+        }
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
         // fragment of a real log record that just happens to look
@@ -241,19 +263,34 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
       }
     }
 
-    buffer_.remove_prefix(kHeaderSize + length);
+    if (header_size == kRecyclableHeaderSize) {
+      if (DecodeFixed32(header + kHeaderSize) !=
+          static_cast<uint32_t>(log_number_)) {
+        return OldRecord();
+      }
+      type -= kRecyclableFullType - kFullType;
+    }
+
+    buffer_.remove_prefix(header_size + length);
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + header_size, length);
     return type;
   }
 }
 
+unsigned int Reader::OldRecord() {
+  // Nothing of this log follows, so stop reading the file.
+  buffer_.clear();
+  eof_ = true;
+  return kOldRecord;
+}
+
 }  // namespace log
 }  // namespace leveldb
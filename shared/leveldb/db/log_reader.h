@@ -40,8 +40,13 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // "log_number" is the number of the log held by "*file".  Recyclable
+  // records of other logs (see Writer) mark the end of the log, as does
+  // any invalid record after the first recyclable one: the rest of the
+  // file is what was left of its previous use.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number = 0);
 
   ~Reader();
 
@@ -64,6 +69,7 @@ class Reader {
   char* const backing_store_;
   Slice buffer_;
   bool eof_;   // Last Read() indicated EOF by returning < kBlockSize
+  bool recycled_;   // Have we read a recyclable record?
 
   // Offset of the last record returned by ReadRecord.
   uint64_t last_record_offset_;
@@ -73,6 +79,8 @@ class Reader {
   // Offset at which to start looking for the first record to return
   uint64_t const initial_offset_;
 
+  uint64_t const log_number_;
+
   // Extend record types with the following special values
   enum {
     kEof = kMaxRecordType + 1,
@@ -81,7 +89,10 @@ class Reader {
     // * The record has an invalid CRC (ReadPhysicalRecord reports a drop)
     // * The record is a 0-length record (No drop is reported)
     // * The record is below constructor's initial_offset (No drop is reported)
-    kBadRecord = kMaxRecordType + 2
+    kBadRecord = kMaxRecordType + 2,
+    // Returned when we find a record that was left in a recycled file
+    // by the log previously written to it.
+    kOldRecord = kMaxRecordType + 3
   };
 
   // Skips all blocks that are completely before "initial_offset_".
@@ -92,6 +103,9 @@ class Reader {
   // Return type, or one of the preceding special values
   unsigned int ReadPhysicalRecord(Slice* result);
 
+  // Skips the rest of the file and returns kOldRecord.
+  unsigned int OldRecord();
+
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
   void ReportCorruption(size_t bytes, const char* reason);
@@ -164,6 +164,43 @@ class LogTest {
     source_.force_error_ = true;
   }
 
+  // Overwrite the start of the log written so far with the records of
+  // the recyclable log "log_number", as if its file had been reused.
+  // Returns the size of the new log.
+  size_t WriteRecycledLog(uint64_t log_number,
+                          const std::vector<std::string>& records) {
+    StringDest dest;
+    Writer writer(&dest, log_number, true/*recyclable*/);
+    for (size_t i = 0; i < records.size(); i++) {
+      writer.AddRecord(Slice(records[i]));
+    }
+    if (dest.contents_.size() >= dest_.contents_.size()) {
+      dest_.contents_ = dest.contents_;
+    } else {
+      dest_.contents_.replace(0, dest.contents_.size(), dest.contents_);
+    }
+    return dest.contents_.size();
+  }
+
+  // Return the records of log "log_number", separated by '|'.
+  std::string ReadRecycledLog(uint64_t log_number) {
+    reading_ = true;
+    StringSource source;
+    source.contents_ = Slice(dest_.contents_);
+    Reader reader(&source, &report_, true/*checksum*/, 0/*initial_offset*/,
+                  log_number);
+    std::string result;
+    std::string scratch;
+    Slice record;
+    while (reader.ReadRecord(&record, &scratch)) {
+      if (!result.empty()) {
+        result.push_back('|');
+      }
+      result.append(record.data(), record.size());
+    }
+    return result;
+  }
+
   size_t DroppedBytes() const {
     return report_.dropped_bytes_;
   }
@@ -484,6 +521,64 @@ TEST(LogTest, ReadFourthStart) {
       3);
 }
 
+TEST(LogTest, RecyclableReadWrite) {
+  std::vector<std::string> records;
+  records.push_back("foo");
+  records.push_back(BigString("bar", 3 * kBlockSize));
+  records.push_back(BigString("baz", kBlockSize - 2 * kRecyclableHeaderSize));
+  records.push_back("");
+  records.push_back("xxxx");
+  WriteRecycledLog(7, records);
+  std::string expected;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (i > 0) {
+      expected.push_back('|');
+    }
+    expected.append(records[i]);
+  }
+  ASSERT_EQ(expected, ReadRecycledLog(7));
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledOldFormatLog) {
+  for (int i = 0; i < 1000; i++) {
+    Write(NumberString(i));
+  }
+  std::vector<std::string> records;
+  records.push_back("foo");
+  records.push_back("bar");
+  WriteRecycledLog(2, records);
+  ASSERT_EQ("foo|bar", ReadRecycledLog(2));
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledRecyclableLog) {
+  std::vector<std::string> records;
+  records.push_back("old1");
+  records.push_back("old2");
+  records.push_back("old3");
+  WriteRecycledLog(2, records);
+  records.resize(1);
+  records[0] = "new1";
+  WriteRecycledLog(3, records);
+  // "old2" follows with a valid checksum, but belongs to log 2
+  ASSERT_EQ("new1", ReadRecycledLog(3));
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogTornFragment) {
+  std::vector<std::string> records;
+  records.push_back(BigString("old", 4 * kBlockSize));
+  WriteRecycledLog(2, records);
+  records[0] = "new1";
+  records.push_back(BigString("new", 2 * kBlockSize));
+  const size_t size = WriteRecycledLog(3, records);
+  // The last fragment of log 3 was not completely written
+  IncrementByte(size - 1, 1);
+  ASSERT_EQ("new1", ReadRecycledLog(3));
+  ASSERT_EQ("OK", MatchError("partial record without end(4)"));
+}
+
 TEST(LogTest, ReadEnd) {
   CheckOffsetPastEndReturnsNoRecords(0);
 }
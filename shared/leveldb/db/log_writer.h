@@ -22,6 +22,12 @@ class Writer {
   // "*dest" must be initially empty.
   // "*dest" must remain live while this Writer is in use.
   explicit Writer(WritableFile* dest);
+
+  // Create a writer that will append the records of log "log_number" to
+  // "*dest".  If "recyclable" is true, the records are written in a
+  // format that lets readers stop at the end of the log even if "*dest"
+  // was not initially empty but holds the contents of a recycled log.
+  Writer(WritableFile* dest, uint64_t log_number, bool recyclable);
   ~Writer();
 
   Status AddRecord(const Slice& slice);
@@ -29,6 +35,8 @@ class Writer {
  private:
   WritableFile* dest_;
   int block_offset_;       // Current offset in block
+  uint64_t log_number_;
+  bool recyclable_;
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -3,11 +3,14 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/memtable.h"
+
+#include <algorithm>
 #include "db/dbformat.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -18,17 +21,32 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& cmp)
+MemTable::MemTable(const InternalKeyComparator& cmp,
+                   const MemTableRepFactory* factory)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      range_del_index_(NULL) {
+  if (factory == NULL) {
+    static const MemTableRepFactory* default_factory = NewSkipListRepFactory();
+    factory = default_factory;
+  }
+  table_ = factory->CreateMemTableRep(comparator_, &arena_);
 }
 
 MemTable::~MemTable() {
   assert(refs_ == 0);
+  delete table_;
+  for (size_t i = 0; i < range_del_indexes_.size(); i++) {
+    delete range_del_indexes_[i];
+  }
+  for (size_t i = 0; i < range_del_maps_.size(); i++) {
+    delete range_del_maps_[i];
+  }
 }
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + table_->ApproximateMemoryUsage();
+}
 
 int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr)
     const {
@@ -38,6 +56,10 @@ int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr)
   return comparator.Compare(a, b);
 }
 
+Slice MemTable::KeyComparator::UserKey(const char* entry) const {
+  return ExtractUserKey(GetLengthPrefixedSlice(entry));
+}
+
 // Encode a suitable internal key target for "target" and return it.
 // Uses *scratch as scratch space, and the returned pointer will point
 // into this scratch space.
@@ -50,24 +72,26 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 
 class MemTableIterator: public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) { }
-
-  virtual bool Valid() const { return iter_.Valid(); }
-  virtual void Seek(const Slice& k) { iter_.Seek(EncodeKey(&tmp_, k)); }
-  virtual void SeekToFirst() { iter_.SeekToFirst(); }
-  virtual void SeekToLast() { iter_.SeekToLast(); }
-  virtual void Next() { iter_.Next(); }
-  virtual void Prev() { iter_.Prev(); }
-  virtual Slice key() const { return GetLengthPrefixedSlice(iter_.key()); }
+  explicit MemTableIterator(MemTableRep* table)
+      : iter_(table->NewIterator()) { }
+  virtual ~MemTableIterator() { delete iter_; }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void Seek(const Slice& k) { iter_->Seek(EncodeKey(&tmp_, k)); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual Slice key() const { return GetLengthPrefixedSlice(iter_->key()); }
   virtual Slice value() const {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   virtual Status status() const { return Status::OK(); }
 
  private:
-  MemTable::Table::Iterator iter_;
+  MemTableRep::Iterator* iter_;
   std::string tmp_;       // For passing to EncodeKey
 
   // No copying allowed
@@ -76,12 +100,12 @@ class MemTableIterator: public Iterator {
 };
 
 Iterator* MemTable::NewIterator() {
-  return new MemTableIterator(&table_);
+  return new MemTableIterator(table_);
 }
 
-void MemTable::Add(SequenceNumber s, ValueType type,
-                   const Slice& key,
-                   const Slice& value) {
+const char* MemTable::EncodeEntry(SequenceNumber s, ValueType type,
+                                  const Slice& key, const Slice& value,
+                                  bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -93,7 +117,8 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   const size_t encoded_len =
       VarintLength(internal_key_size) + internal_key_size +
       VarintLength(val_size) + val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   memcpy(p, key.data(), key_size);
   p += key_size;
@@ -102,14 +127,134 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);
+  return buf;
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::RecordRangeTombstone(SequenceNumber s, const Slice& begin,
+                                    const Slice& end) {
+  if (comparator_.comparator.user_comparator()->Compare(begin, end) >= 0) {
+    return false;
+  }
+  MutexLock l(&range_dels_mutex_);
+  range_dels_.push_back(RangeTombstone(begin, end, s));
+
+  // Add a run of the new entry, merging runs of equal size like the
+  // digits of a binary counter, so that each entry is copied into
+  // O(log n) maps and reads search at most O(log n) maps.
+  const RangeDelIndex* index =
+      reinterpret_cast<const RangeDelIndex*>(range_del_index_.NoBarrier_Load());
+  std::vector<const RangeDelMap*> maps;
+  std::vector<size_t> sizes;
+  if (index != NULL) {
+    maps = index->maps;
+    sizes = index->sizes;
+  }
+  size_t n = 1;
+  while (!sizes.empty() && sizes.back() == n) {
+    maps.pop_back();
+    sizes.pop_back();
+    n *= 2;
+  }
+  maps.push_back(NewRangeDelMap(range_dels_.size() - n, n));
+  sizes.push_back(n);
+  PublishRangeDelIndex(maps, sizes);
+  return true;
+}
+
+const RangeDelMap* MemTable::NewRangeDelMap(size_t start, size_t n) {
+  std::vector<RangeTombstone> run(range_dels_.begin() + start,
+                                  range_dels_.begin() + start + n);
+  const RangeDelMap* map =
+      new RangeDelMap(comparator_.comparator.user_comparator(), run);
+  range_del_maps_.push_back(map);
+  return map;
+}
+
+void MemTable::PublishRangeDelIndex(
+    const std::vector<const RangeDelMap*>& maps,
+    const std::vector<size_t>& sizes) {
+  RangeDelIndex* index = new RangeDelIndex;
+  index->maps = maps;
+  index->sizes = sizes;
+  range_del_indexes_.push_back(index);
+  range_del_index_.Release_Store(index);
+}
+
+void MemTable::MarkReadOnly() {
+  table_->MarkReadOnly();
+
+  // No more range deletions can be added: merge them into a single map
+  // so that reads search it once.
+  MutexLock l(&range_dels_mutex_);
+  const RangeDelIndex* index =
+      reinterpret_cast<const RangeDelIndex*>(range_del_index_.NoBarrier_Load());
+  if (index != NULL && index->maps.size() > 1) {
+    std::vector<const RangeDelMap*> maps(
+        1, NewRangeDelMap(0, range_dels_.size()));
+    std::vector<size_t> sizes(1, range_dels_.size());
+    PublishRangeDelIndex(maps, sizes);
+  }
+}
+
+void MemTable::AddRangeTombstones(std::vector<RangeTombstone>* result) {
+  if (range_del_index_.Acquire_Load() == NULL) {
+    return;
+  }
+  MutexLock l(&range_dels_mutex_);
+  result->insert(result->end(), range_dels_.begin(), range_dels_.end());
+}
+
+SequenceNumber MemTable::MaxCoveringSequence(const Slice& user_key,
+                                             SequenceNumber snapshot) {
+  const RangeDelIndex* index =
+      reinterpret_cast<const RangeDelIndex*>(range_del_index_.Acquire_Load());
+  SequenceNumber result = 0;
+  if (index != NULL) {
+    for (size_t i = 0; i < index->maps.size(); i++) {
+      result = std::max(result,
+                        index->maps[i]->MaxCoveringSequence(user_key,
+                                                            snapshot));
+    }
+  }
+  return result;
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type,
+                   const Slice& key,
+                   const Slice& value) {
+  if (type == kTypeRangeDeletion && !RecordRangeTombstone(s, key, value)) {
+    return;  // An empty range deletes nothing
+  }
+  table_->Insert(EncodeEntry(s, type, key, value, false));
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key,
+                               const Slice& value) {
+  if (type == kTypeRangeDeletion && !RecordRangeTombstone(s, key, value)) {
+    return;  // An empty range deletes nothing
+  }
+  table_->InsertConcurrently(EncodeEntry(s, type, key, value, true));
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   std::deque<std::string>* operands,
+                   SequenceNumber* covering) {
+  // Entries older than the newest range deletion that covers the key
+  // are deleted.
+  if (range_del_index_.Acquire_Load() != NULL) {
+    const Slice ikey = key.internal_key();
+    const SequenceNumber snapshot =
+        DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+    *covering = std::max(*covering,
+                         MaxCoveringSequence(key.user_key(), snapshot));
+  }
+
   Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  const char* entry = table_->FindGreaterOrEqual(memkey.data());
+  MemTableRep::Iterator* iter = NULL;  // Reads the entries after operands
+  bool found = false;
+  while (entry != NULL) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -117,29 +262,50 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     //    vlength  varint32
     //    value    char[vlength]
     // Check that it belongs to same user key.  We do not check the
-    // sequence number since the Seek() call above should have skipped
+    // sequence number since FindGreaterOrEqual() above should have skipped
     // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
             Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
-      }
+            key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    const ValueType type = static_cast<ValueType>(tag & 0xff);
+    if ((tag >> 8) < *covering) {
+      *s = Status::NotFound(Slice());
+      found = true;
+      break;
+    } else if (type == kTypeValue) {
+      Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+      value->assign(v.data(), v.size());
+      found = true;
+      break;
+    } else if (type == kTypeDeletion) {
+      *s = Status::NotFound(Slice());
+      found = true;
+      break;
+    } else if (type == kTypeMerge) {
+      // A merge operand, older than those found so far.  The older
+      // entries for the key hold the rest of its value.
+      Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+      operands->push_front(v.ToString());
+    } else if (type != kTypeRangeDeletion) {
+      break;
+    }
+    // A range deletion that starts at the key takes effect through
+    // "covering" above; look at the older entries.
+    if (iter == NULL) {
+      iter = table_->NewIterator();
+      iter->Seek(entry);
     }
+    iter->Next();
+    entry = iter->Valid() ? iter->key() : NULL;
   }
-  return false;
+  delete iter;
+  return found;
 }
 
 }  // namespace leveldb
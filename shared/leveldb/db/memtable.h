@@ -5,10 +5,14 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <deque>
 #include <string>
+#include <vector>
 #include "leveldb/db.h"
+#include "leveldb/memtablerep.h"
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/range_del.h"
+#include "port/port.h"
 #include "util/arena.h"
 
 namespace leveldb {
@@ -21,7 +25,11 @@ class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // Entries are kept in a representation made by "factory", or in a
+  // skiplist if "factory" is NULL.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    const MemTableRepFactory* factory = NULL);
 
   // Increase reference count.
   void Ref() { ++refs_; }
@@ -52,34 +60,98 @@ class MemTable {
 
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  The value
+  // of a kTypeRangeDeletion entry is the end of its range; such an
+  // entry is not added if the range is empty.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called from several threads at once.
+  // REQUIRES: no concurrent call to Add(); no two concurrent calls
+  // use the same seq.
+  void AddConcurrently(SequenceNumber seq, ValueType type,
+                       const Slice& key,
+                       const Slice& value);
+
+  // Called when the memtable stops taking writes, so that the
+  // representation can prepare for being read and flushed.
+  void MarkReadOnly();
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
-  // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // If memtable contains a deletion for key, store a NotFound() error in
+  // *status and return true.  Else, return false.
+  // Entries older than *covering, the largest sequence number of the
+  // range deletions from newer data that cover key, count as deletions.
+  // *covering is raised to include the range deletions of this memtable,
+  // for the caller to apply to older data.
+  // In all cases, add the merge operands for key that are newer than
+  // that value or deletion to the front of *operands, oldest first.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           std::deque<std::string>* operands, SequenceNumber* covering);
+
+  // Append the range deletions added so far to *result.
+  void AddRangeTombstones(std::vector<RangeTombstone>* result);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
 
-  struct KeyComparator {
+  struct KeyComparator : public MemTableRep::KeyComparator {
     const InternalKeyComparator comparator;
     explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) { }
-    int operator()(const char* a, const char* b) const;
+    virtual int operator()(const char* a, const char* b) const;
+    virtual Slice UserKey(const char* entry) const;
   };
   friend class MemTableIterator;
   friend class MemTableBackwardIterator;
 
-  typedef SkipList<const char*, KeyComparator> Table;
+  // Allocate and fill in the memtable entry for Add()/AddConcurrently().
+  const char* EncodeEntry(SequenceNumber seq, ValueType type,
+                          const Slice& key, const Slice& value,
+                          bool concurrent);
+
+  // Record the range deletion [begin,end) added at sequence number s.
+  // Returns false, recording nothing, if the range is empty.
+  bool RecordRangeTombstone(SequenceNumber s, const Slice& begin,
+                            const Slice& end);
+
+  // An immutable index over the entries of range_dels_ at the time it
+  // was published.  Map i covers the run of sizes[i] entries that
+  // follows those of the maps before it.
+  struct RangeDelIndex {
+    std::vector<const RangeDelMap*> maps;
+    std::vector<size_t> sizes;
+  };
+
+  // Publish an index of all of range_dels_ made of the given runs.
+  // REQUIRES: range_dels_mutex_ is held.
+  void PublishRangeDelIndex(const std::vector<const RangeDelMap*>& maps,
+                            const std::vector<size_t>& sizes);
+
+  // Return a new map of the "n" entries of range_dels_ from "start".
+  // REQUIRES: range_dels_mutex_ is held.
+  const RangeDelMap* NewRangeDelMap(size_t start, size_t n);
+
+  // Return the largest sequence number not above "snapshot" of the
+  // range deletions that cover "user_key", or zero if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot);
 
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
-  Table table_;
+  MemTableRep* table_;
+
+  // The range deletions also kept in table_, so that reads can find
+  // those that cover a key without scanning for them.  Writers append
+  // under range_dels_mutex_ and publish a new RangeDelIndex that reads
+  // use without locking.  Readers may still hold a replaced index or
+  // map, so all of them live until the memtable is deleted.
+  port::Mutex range_dels_mutex_;
+  std::vector<RangeTombstone> range_dels_;
+  std::vector<const RangeDelMap*> range_del_maps_;    // All maps built
+  std::vector<const RangeDelIndex*> range_del_indexes_;  // All published
+  port::AtomicPointer range_del_index_;  // Latest index, or NULL if none
 
   // No copying allowed
   MemTable(const MemTable&);
@@ -0,0 +1,426 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <algorithm>
+#include <new>
+#include <vector>
+#include "db/skiplist.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+MemTableRep::KeyComparator::~KeyComparator() { }
+
+MemTableRep::Iterator::~Iterator() { }
+
+MemTableRep::~MemTableRep() { }
+
+void MemTableRep::InsertConcurrently(const char* entry) {
+  // Only reached through a factory that claims support without
+  // overriding this; such a representation must lock internally.
+  Insert(entry);
+}
+
+MemTableRepFactory::~MemTableRepFactory() { }
+
+namespace {
+
+// Adapts a MemTableRep::KeyComparator to the interface SkipList expects.
+struct RepComparator {
+  const MemTableRep::KeyComparator* cmp;
+  explicit RepComparator(const MemTableRep::KeyComparator* c) : cmp(c) { }
+  int operator()(const char* a, const char* b) const { return (*cmp)(a, b); }
+};
+
+// Adapts a MemTableRep::KeyComparator to the interface std::sort expects.
+struct RepLess {
+  const MemTableRep::KeyComparator* cmp;
+  explicit RepLess(const MemTableRep::KeyComparator* c) : cmp(c) { }
+  bool operator()(const char* a, const char* b) const {
+    return (*cmp)(a, b) < 0;
+  }
+};
+
+typedef SkipList<const char*, RepComparator> EntryList;
+
+// Iterator over a sorted array of entries.  The array is either owned
+// by the iterator or borrowed from a representation that no longer
+// changes.
+class SortedVectorIterator : public MemTableRep::Iterator {
+ public:
+  // Takes the contents of *entries, which must be sorted.
+  SortedVectorIterator(const MemTableRep::KeyComparator* cmp,
+                       std::vector<const char*>* entries)
+      : cmp_(cmp), entries_(&owned_) {
+    owned_.swap(*entries);
+    pos_ = entries_->size();
+  }
+
+  // Borrows *entries, which must be sorted and outlive the iterator.
+  SortedVectorIterator(const MemTableRep::KeyComparator* cmp,
+                       const std::vector<const char*>* entries)
+      : cmp_(cmp), entries_(entries) {
+    pos_ = entries_->size();
+  }
+
+  virtual bool Valid() const { return pos_ < entries_->size(); }
+  virtual const char* key() const {
+    assert(Valid());
+    return (*entries_)[pos_];
+  }
+  virtual void Next() {
+    assert(Valid());
+    pos_++;
+  }
+  virtual void Prev() {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+  }
+  virtual void Seek(const char* target) {
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                            RepLess(cmp_)) - entries_->begin();
+  }
+  virtual void SeekToFirst() { pos_ = 0; }
+  virtual void SeekToLast() {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+ private:
+  const MemTableRep::KeyComparator* const cmp_;
+  std::vector<const char*> owned_;
+  const std::vector<const char*>* const entries_;
+  size_t pos_;
+
+  // No copying allowed
+  SortedVectorIterator(const SortedVectorIterator&);
+  void operator=(const SortedVectorIterator&);
+};
+
+// ----------------------------------------------------------------------
+// Skiplist
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const KeyComparator& cmp, Arena* arena)
+      : list_(RepComparator(&cmp), arena) { }
+
+  virtual void Insert(const char* entry) { list_.Insert(entry); }
+  virtual void InsertConcurrently(const char* entry) {
+    list_.InsertConcurrently(entry);
+  }
+
+  virtual const char* FindGreaterOrEqual(const char* key) const {
+    EntryList::Iterator iter(&list_);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : NULL;
+  }
+
+  virtual size_t ApproximateMemoryUsage() { return 0; }  // All in the arena
+
+  virtual MemTableRep::Iterator* NewIterator() { return new Iter(&list_); }
+
+ private:
+  class Iter : public MemTableRep::Iterator {
+   public:
+    explicit Iter(const EntryList* list) : iter_(list) { }
+    virtual bool Valid() const { return iter_.Valid(); }
+    virtual const char* key() const { return iter_.key(); }
+    virtual void Next() { iter_.Next(); }
+    virtual void Prev() { iter_.Prev(); }
+    virtual void Seek(const char* target) { iter_.Seek(target); }
+    virtual void SeekToFirst() { iter_.SeekToFirst(); }
+    virtual void SeekToLast() { iter_.SeekToLast(); }
+
+   private:
+    EntryList::Iterator iter_;
+  };
+
+  EntryList list_;
+};
+
+class SkipListRepFactory : public MemTableRepFactory {
+ public:
+  virtual const char* Name() const { return "leveldb.SkipListRep"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const {
+    return new SkipListRep(cmp, arena);
+  }
+
+  virtual bool IsInsertConcurrentlySupported() const { return true; }
+};
+
+// ----------------------------------------------------------------------
+// Vector
+
+// Appends entries to an unsorted array.  Readers and writers share mu_;
+// the first read after the representation becomes read-only sorts it in
+// place, after which lookups are binary searches and iterators borrow
+// the array.
+class VectorRep : public MemTableRep {
+ public:
+  VectorRep(const KeyComparator& cmp, size_t reserve)
+      : cmp_(&cmp),
+        read_only_(false),
+        sorted_(false),
+        memory_usage_(NULL) {
+    entries_.reserve(reserve);
+    UpdateMemoryUsage();
+  }
+
+  virtual void Insert(const char* entry) {
+    MutexLock l(&mu_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+    UpdateMemoryUsage();
+  }
+
+  // Appends are serialized by mu_ anyway.
+  virtual void InsertConcurrently(const char* entry) { Insert(entry); }
+
+  virtual const char* FindGreaterOrEqual(const char* key) const {
+    MutexLock l(&mu_);
+    if (read_only_) {
+      Sort();
+    }
+    if (sorted_) {
+      std::vector<const char*>::const_iterator iter = std::lower_bound(
+          entries_.begin(), entries_.end(), key, RepLess(cmp_));
+      return (iter == entries_.end()) ? NULL : *iter;
+    }
+    // Still taking writes: look at every entry
+    const char* result = NULL;
+    for (size_t i = 0; i < entries_.size(); i++) {
+      const char* entry = entries_[i];
+      if ((*cmp_)(entry, key) >= 0 &&
+          (result == NULL || (*cmp_)(entry, result) < 0)) {
+        result = entry;
+      }
+    }
+    return result;
+  }
+
+  virtual void MarkReadOnly() {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  virtual size_t ApproximateMemoryUsage() {
+    return reinterpret_cast<uintptr_t>(memory_usage_.NoBarrier_Load());
+  }
+
+  virtual MemTableRep::Iterator* NewIterator() {
+    MutexLock l(&mu_);
+    if (read_only_) {
+      Sort();
+      const std::vector<const char*>* sorted = &entries_;  // Borrowed
+      return new SortedVectorIterator(cmp_, sorted);
+    }
+    std::vector<const char*> copy(entries_);
+    std::sort(copy.begin(), copy.end(), RepLess(cmp_));
+    return new SortedVectorIterator(cmp_, &copy);
+  }
+
+ private:
+  void UpdateMemoryUsage() {
+    memory_usage_.NoBarrier_Store(reinterpret_cast<void*>(
+        entries_.capacity() * sizeof(const char*)));
+  }
+
+  // Sort the entries once, typically in the first reader of the
+  // immutable memtable or in the thread that flushes it.
+  // REQUIRES: mu_ is held and read_only_
+  void Sort() const {
+    if (!sorted_) {
+      std::sort(entries_.begin(), entries_.end(), RepLess(cmp_));
+      sorted_ = true;
+    }
+  }
+
+  const KeyComparator* const cmp_;
+  mutable port::Mutex mu_;
+  mutable std::vector<const char*> entries_;
+  bool read_only_;
+  mutable bool sorted_;               // Implies read_only_
+  port::AtomicPointer memory_usage_;  // Readable without mu_
+};
+
+class VectorRepFactory : public MemTableRepFactory {
+ public:
+  explicit VectorRepFactory(size_t reserve) : reserve_(reserve) { }
+
+  virtual const char* Name() const { return "leveldb.VectorRep"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const {
+    return new VectorRep(cmp, reserve_);
+  }
+
+  virtual bool IsInsertConcurrentlySupported() const { return true; }
+
+ private:
+  const size_t reserve_;
+};
+
+// ----------------------------------------------------------------------
+// Hashed skiplists
+
+// Entries whose user keys share a prefix go into the same skiplist, so
+// a point lookup only searches among keys with the same prefix.
+// Buckets are created on first use, in the arena.  Iterators read a
+// sorted copy of all buckets; once the representation is read-only, the
+// copy is made once and shared.
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const KeyComparator& cmp, Arena* arena,
+                  size_t prefix_length, size_t bucket_count)
+      : cmp_(&cmp),
+        arena_(arena),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count),
+        buckets_(new port::AtomicPointer[bucket_count]),
+        read_only_(false),
+        sorted_(false),
+        sorted_memory_usage_(NULL) {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      buckets_[i].NoBarrier_Store(NULL);
+    }
+  }
+
+  virtual ~HashSkipListRep() {
+    // The skiplists themselves live in the arena
+    delete[] buckets_;
+  }
+
+  virtual void Insert(const char* entry) {
+    port::AtomicPointer* bucket = BucketFor(entry);
+    EntryList* list = reinterpret_cast<EntryList*>(bucket->NoBarrier_Load());
+    if (list == NULL) {
+      list = new (arena_->AllocateAligned(sizeof(EntryList)))
+          EntryList(RepComparator(cmp_), arena_);
+      // Publish the list only after it is initialized
+      bucket->Release_Store(list);
+    }
+    list->Insert(entry);
+  }
+
+  virtual const char* FindGreaterOrEqual(const char* key) const {
+    const EntryList* list = GetList(BucketFor(key));
+    if (list == NULL) {
+      return NULL;
+    }
+    EntryList::Iterator iter(list);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : NULL;
+  }
+
+  virtual void MarkReadOnly() {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  virtual size_t ApproximateMemoryUsage() {
+    return bucket_count_ * sizeof(port::AtomicPointer) +
+        reinterpret_cast<uintptr_t>(sorted_memory_usage_.NoBarrier_Load());
+  }
+
+  // Gathers and sorts every bucket, so scans cost O(n log n) up front.
+  virtual MemTableRep::Iterator* NewIterator() {
+    MutexLock l(&mu_);
+    if (read_only_) {
+      if (!sorted_) {
+        GatherSorted(&entries_);
+        sorted_ = true;
+        sorted_memory_usage_.NoBarrier_Store(reinterpret_cast<void*>(
+            entries_.capacity() * sizeof(const char*)));
+      }
+      const std::vector<const char*>* sorted = &entries_;  // Borrowed
+      return new SortedVectorIterator(cmp_, sorted);
+    }
+    std::vector<const char*> entries;
+    GatherSorted(&entries);
+    return new SortedVectorIterator(cmp_, &entries);
+  }
+
+ private:
+  void GatherSorted(std::vector<const char*>* entries) const {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      const EntryList* list = GetList(&buckets_[i]);
+      if (list != NULL) {
+        EntryList::Iterator iter(list);
+        for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+          entries->push_back(iter.key());
+        }
+      }
+    }
+    std::sort(entries->begin(), entries->end(), RepLess(cmp_));
+  }
+
+  port::AtomicPointer* BucketFor(const char* entry) const {
+    Slice user_key = cmp_->UserKey(entry);
+    const size_t n = std::min(user_key.size(), prefix_length_);
+    return &buckets_[Hash(user_key.data(), n, 0) % bucket_count_];
+  }
+
+  static const EntryList* GetList(const port::AtomicPointer* bucket) {
+    return reinterpret_cast<const EntryList*>(bucket->Acquire_Load());
+  }
+
+  const KeyComparator* const cmp_;
+  Arena* const arena_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  port::AtomicPointer* const buckets_;  // Each holds an EntryList* or NULL
+
+  // Iterators of a read-only representation share entries_, which
+  // holds every entry in order once sorted_ is set.
+  port::Mutex mu_;
+  bool read_only_;
+  bool sorted_;
+  std::vector<const char*> entries_;
+  port::AtomicPointer sorted_memory_usage_;  // Readable without mu_
+};
+
+class HashSkipListRepFactory : public MemTableRepFactory {
+ public:
+  HashSkipListRepFactory(size_t prefix_length, size_t bucket_count)
+      : prefix_length_(prefix_length),
+        bucket_count_(bucket_count > 0 ? bucket_count : 1) { }
+
+  virtual const char* Name() const { return "leveldb.HashSkipListRep"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const {
+    return new HashSkipListRep(cmp, arena, prefix_length_, bucket_count_);
+  }
+
+  // Creating a bucket allocates from the arena without synchronization,
+  // so inserts have to stay serial.
+
+ private:
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+};
+
+}  // namespace
+
+const MemTableRepFactory* NewSkipListRepFactory() {
+  return new SkipListRepFactory;
+}
+
+const MemTableRepFactory* NewVectorRepFactory(size_t reserve) {
+  return new VectorRepFactory(reserve);
+}
+
+const MemTableRepFactory* NewHashSkipListRepFactory(size_t prefix_length,
+                                                    size_t bucket_count) {
+  return new HashSkipListRepFactory(prefix_length, bucket_count);
+}
+
+}  // namespace leveldb
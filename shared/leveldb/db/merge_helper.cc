@@ -0,0 +1,114 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status ApplyMergeOperands(const MergeOperator* op,
+                          const Slice& key,
+                          const Slice* existing_value,
+                          const std::deque<std::string>& operands,
+                          std::string* result,
+                          Logger* logger) {
+  if (op == NULL) {
+    return Status::InvalidArgument("merge operands found without a "
+                                   "merge operator");
+  }
+  std::string merged;
+  if (!op->FullMerge(key, existing_value, operands, &merged, logger)) {
+    return Status::Corruption("merge failed for ", key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+Status CompactMergeOperands(const Comparator* user_comparator,
+                            const MergeOperator* op,
+                            Logger* logger,
+                            Iterator* iter,
+                            bool at_bottom,
+                            SequenceNumber covering,
+                            std::vector<std::string>* keys,
+                            std::vector<std::string>* values) {
+  keys->clear();
+  values->clear();
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(iter->key(), &ikey)) {
+    return Status::Corruption("corrupted merge operand key");
+  }
+  assert(ikey.type == kTypeMerge);
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber sequence = ikey.sequence;
+
+  // Collect the operands, newest first, and the entry they apply to
+  bool has_base = at_bottom;
+  bool has_value = false;
+  std::string existing_value;
+  while (iter->Valid()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        user_comparator->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (ikey.sequence < covering || ikey.type == kTypeRangeDeletion) {
+      // Deleted.  The caller drops or keeps the entry itself.
+      has_base = true;
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      keys->push_back(iter->key().ToString());
+      values->push_back(iter->value().ToString());
+      iter->Next();
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      existing_value = iter->value().ToString();
+      has_value = true;
+    }
+    has_base = true;
+    iter->Next();
+    break;
+  }
+
+  if (has_base) {
+    // Replace everything by the value at the newest operand's place
+    std::deque<std::string> operands(values->rbegin(), values->rend());
+    Slice existing(existing_value);
+    std::string result;
+    Status s = ApplyMergeOperands(op, user_key,
+                                  has_value ? &existing : NULL,
+                                  operands, &result, logger);
+    if (!s.ok()) {
+      return s;
+    }
+    keys->resize(1);
+    (*keys)[0].clear();
+    AppendInternalKey(&(*keys)[0],
+                      ParsedInternalKey(user_key, sequence, kTypeValue));
+    values->resize(1);
+    (*values)[0].swap(result);
+  } else if (values->size() > 1) {
+    // Combine the operands from the oldest one, if they all allow it
+    std::string merged = values->back();
+    for (size_t i = values->size() - 1; i > 0; i--) {
+      std::string combined;
+      if (!op->PartialMerge(user_key, merged, (*values)[i - 1], &combined,
+                            logger)) {
+        return Status::OK();  // Write the operands unchanged
+      }
+      merged.swap(combined);
+    }
+    keys->resize(1);
+    values->resize(1);
+    (*values)[0].swap(merged);
+  }
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,60 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+class Logger;
+class MergeOperator;
+class Slice;
+
+// Stores in *result the value of "key" made by applying "operands",
+// oldest first, to "existing_value", which is NULL if the key had no
+// value.  *result may hold *existing_value.
+//
+// Returns InvalidArgument if "op" is NULL, and Corruption if the merge
+// operator fails.
+extern Status ApplyMergeOperands(const MergeOperator* op,
+                                 const Slice& key,
+                                 const Slice* existing_value,
+                                 const std::deque<std::string>& operands,
+                                 std::string* result,
+                                 Logger* logger);
+
+// Used by compactions.  REQUIRES: "*iter" is positioned at a merge
+// operand that no snapshot separates from the older entries of its key.
+//
+// Reads the operands of the key that follow, down to the value or
+// deletion they apply to, if any, and leaves "*iter" past them.  Stores
+// in *keys and *values the internal keys and values of the entries to
+// write instead: a value made by applying the operands if there is
+// such an entry or if "at_bottom" says that the key has no older
+// entries, or else the operands, combined into one with
+// MergeOperator::PartialMerge() if the operator allows it.
+//
+// Entries with sequence numbers below "covering" are deleted by a range
+// deletion, and so is the key of a range deletion entry: the operands
+// apply to no value, and "*iter" is left at the first such entry.
+extern Status CompactMergeOperands(const Comparator* user_comparator,
+                                   const MergeOperator* op,
+                                   Logger* logger,
+                                   Iterator* iter,
+                                   bool at_bottom,
+                                   SequenceNumber covering,
+                                   std::vector<std::string>* keys,
+                                   std::vector<std::string>* values);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
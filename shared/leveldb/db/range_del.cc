@@ -0,0 +1,127 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+namespace {
+struct BoundLess {
+  const Comparator* ucmp;
+  explicit BoundLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+struct BoundEqual {
+  const Comparator* ucmp;
+  explicit BoundEqual(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) == 0;
+  }
+};
+}  // namespace
+
+RangeDelMap::RangeDelMap(const Comparator* user_comparator,
+                         const std::vector<RangeTombstone>& tombstones)
+    : ucmp_(user_comparator) {
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    const RangeTombstone& t = tombstones[i];
+    if (ucmp_->Compare(t.begin, t.end) < 0) {
+      bounds_.push_back(t.begin);
+      bounds_.push_back(t.end);
+    }
+  }
+  if (bounds_.empty()) {
+    return;
+  }
+  std::sort(bounds_.begin(), bounds_.end(), BoundLess(ucmp_));
+  bounds_.erase(std::unique(bounds_.begin(), bounds_.end(),
+                            BoundEqual(ucmp_)),
+                bounds_.end());
+
+  sequences_.resize(bounds_.size() - 1);
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    const RangeTombstone& t = tombstones[i];
+    if (ucmp_->Compare(t.begin, t.end) >= 0) {
+      continue;
+    }
+    // The bounds of t are in bounds_, so the fragments from the one
+    // that starts at t.begin up to the one that ends at t.end are
+    // exactly those that t covers.
+    size_t f = std::lower_bound(bounds_.begin(), bounds_.end(), t.begin,
+                                BoundLess(ucmp_)) - bounds_.begin();
+    for (; ucmp_->Compare(bounds_[f], t.end) < 0; f++) {
+      sequences_[f].push_back(t.sequence);
+    }
+  }
+  for (size_t f = 0; f < sequences_.size(); f++) {
+    std::sort(sequences_[f].begin(), sequences_[f].end(),
+              std::greater<SequenceNumber>());
+  }
+}
+
+int RangeDelMap::FindFragment(const Slice& user_key) const {
+  // Binary search for the last bound at or before user_key
+  int left = 0;
+  int right = static_cast<int>(bounds_.size());
+  while (left < right) {
+    const int mid = (left + right) / 2;
+    if (ucmp_->Compare(bounds_[mid], user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  const int i = left - 1;
+  if (i < 0 || i >= static_cast<int>(sequences_.size())) {
+    return -1;
+  }
+  return i;
+}
+
+SequenceNumber RangeDelMap::Covering(int i, SequenceNumber snapshot) const {
+  const std::vector<SequenceNumber>& seqs = sequences_[i];
+  for (size_t j = 0; j < seqs.size(); j++) {
+    if (seqs[j] <= snapshot) {
+      return seqs[j];
+    }
+  }
+  return 0;
+}
+
+SequenceNumber RangeDelMap::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  const int i = FindFragment(user_key);
+  return (i < 0) ? 0 : Covering(i, snapshot);
+}
+
+SequenceNumber RangeDelMap::MinCoveringSequence(
+    const Slice& first, const Slice& last, SequenceNumber snapshot) const {
+  int i = FindFragment(first);
+  if (i < 0) {
+    return 0;
+  }
+  SequenceNumber result = kMaxSequenceNumber;
+  const int n = static_cast<int>(sequences_.size());
+  for (; i < n && ucmp_->Compare(bounds_[i], last) <= 0; i++) {
+    const SequenceNumber s = Covering(i, snapshot);
+    if (s == 0) {
+      return 0;
+    }
+    result = std::min(result, s);
+  }
+  if (i == n && ucmp_->Compare(bounds_[n], last) <= 0) {
+    // "last" is at or past the end of the last fragment
+    return 0;
+  }
+  return result;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,76 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range deletion written with DB::DeleteRange() is stored as a single
+// entry of type kTypeRangeDeletion whose user key is the beginning of
+// the range and whose value is its (exclusive) end.  It deletes the
+// entries of the keys in the range that are older than it.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+class Comparator;
+
+struct RangeTombstone {
+  std::string begin;          // First user key of the range
+  std::string end;            // User key just past the range
+  SequenceNumber sequence;
+
+  RangeTombstone() : sequence(0) { }
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.data(), b.size()), end(e.data(), e.size()), sequence(s) { }
+};
+
+// An immutable index over a set of range tombstones that answers which
+// of them cover a key.  The ranges are cut at every bound into disjoint
+// fragments, each listing the sequence numbers of the tombstones that
+// cover it.
+class RangeDelMap {
+ public:
+  RangeDelMap(const Comparator* user_comparator,
+              const std::vector<RangeTombstone>& tombstones);
+
+  bool empty() const { return bounds_.empty(); }
+
+  // Return the largest sequence number not above "snapshot" of the
+  // tombstones that cover "user_key", or zero if there is none.  Entries
+  // of the key older than the result are deleted as of "snapshot".
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Return the largest sequence number S such that every key in
+  // ["first","last"] is covered by a tombstone of sequence number at
+  // least S and not above "snapshot", or zero if some key of the range
+  // is covered by no such tombstone.
+  SequenceNumber MinCoveringSequence(const Slice& first, const Slice& last,
+                                     SequenceNumber snapshot) const;
+
+ private:
+  // Return the index of the fragment that holds "user_key", or -1 if
+  // the key is outside of all fragments.
+  int FindFragment(const Slice& user_key) const;
+
+  // Return the largest sequence number in fragment "i" not above
+  // "snapshot", or zero if there is none.
+  SequenceNumber Covering(int i, SequenceNumber snapshot) const;
+
+  const Comparator* ucmp_;
+
+  // Fragment i spans [bounds_[i], bounds_[i+1]).
+  std::vector<std::string> bounds_;
+
+  // Sequence numbers of the tombstones that cover each fragment, in
+  // decreasing order.
+  std::vector< std::vector<SequenceNumber> > sequences_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
@@ -3,7 +3,9 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 //
 // We recover the contents of the descriptor from the other files we find.
-// (1) Any log files are first converted to tables
+// (0) The old descriptors are read, as far as they can be, for the
+//     column families and the family of each table file
+// (1) Any log files are first converted to tables, one per family
 // (2) We scan every table to compute
 //     (a) smallest/largest for the table
 //     (b) largest sequence number in the table
@@ -13,7 +15,7 @@
 //      - last-sequence-number is set to largest sequence# found across
 //        all tables (see 2c)
 //      - compaction pointers are cleared
-//      - every table file is added at level 0
+//      - every table file is added at level 0 of its column family
 //
 // Possible optimization 1:
 //   (a) Compute total size and use to pick appropriate max-level M
@@ -24,6 +26,7 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <algorithm>
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -33,6 +36,7 @@
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
+#include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
@@ -44,20 +48,28 @@ namespace {
 
 class Repairer {
  public:
-  Repairer(const std::string& dbname, const Options& options)
+  Repairer(const std::string& dbname, const Options& options,
+           const std::vector<ColumnFamilyDescriptor>& column_families)
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, NULL, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
+        user_options_(options),
+        column_families_(column_families),
+        max_column_family_(0),
         next_file_number_(1) {
     // TableCache can be small since we expect each table to be opened once.
     table_cache_ = new TableCache(dbname_, &options_, 10);
   }
 
   ~Repairer() {
+    for (std::map<uint32_t, Family*>::iterator it = families_.begin();
+         it != families_.end(); ++it) {
+      delete it->second;
+    }
     delete table_cache_;
     if (owns_info_log_) {
       delete options_.info_log;
@@ -69,6 +81,9 @@ class Repairer {
 
   Status Run() {
     Status status = FindFiles();
+    if (status.ok()) {
+      status = FindColumnFamilies();
+    }
     if (status.ok()) {
       ConvertLogFilesToTables();
       ExtractMetaData();
@@ -95,6 +110,29 @@ class Repairer {
   struct TableInfo {
     FileMetaData meta;
     SequenceNumber max_sequence;
+    uint32_t column_family;
+  };
+
+  // A column family and the options that its tables are built and read
+  // with.
+  struct Family {
+    std::string name;
+    InternalKeyComparator icmp;
+    InternalFilterPolicy ipolicy;
+    Options options;
+    TableCache table_cache;
+
+    // "options" are sanitized options that hold the user comparator and
+    // filter policy of the family.
+    Family(const std::string& n, const Options& o, const TableCache* base)
+        : name(n),
+          icmp(o.comparator),
+          ipolicy(o.filter_policy, o.prefix_extractor),
+          options(o),
+          table_cache(base, &options) {
+      options.comparator = &icmp;
+      options.filter_policy = (o.filter_policy != NULL) ? &ipolicy : NULL;
+    }
   };
 
   std::string const dbname_;
@@ -105,12 +143,16 @@ class Repairer {
   bool owns_info_log_;
   bool owns_cache_;
   TableCache* table_cache_;
-  VersionEdit edit_;
+  Options const user_options_;
+  std::vector<ColumnFamilyDescriptor> const column_families_;
 
-  std::vector<std::string> manifests_;
+  std::vector<std::pair<uint64_t, std::string> > manifests_;
   std::vector<uint64_t> table_numbers_;
   std::vector<uint64_t> logs_;
   std::vector<TableInfo> tables_;
+  std::map<uint32_t, Family*> families_;          // By id
+  std::map<uint64_t, uint32_t> table_families_;   // File number => id
+  uint32_t max_column_family_;
   uint64_t next_file_number_;
 
   Status FindFiles() {
@@ -128,7 +170,7 @@ class Repairer {
     for (size_t i = 0; i < filenames.size(); i++) {
       if (ParseFileName(filenames[i], &number, &type)) {
         if (type == kDescriptorFile) {
-          manifests_.push_back(filenames[i]);
+          manifests_.push_back(std::make_pair(number, filenames[i]));
         } else {
           if (number + 1 > next_file_number_) {
             next_file_number_ = number + 1;
@@ -146,6 +188,51 @@ class Repairer {
     return status;
   }
 
+  // Learn the column families, and the family of each table, from the
+  // old descriptors, oldest first, and set up the options of each.
+  Status FindColumnFamilies() {
+    std::map<uint32_t, std::string> names;
+    std::sort(manifests_.begin(), manifests_.end());
+    bool found = false;
+    for (size_t i = 0; i < manifests_.size(); i++) {
+      if (VersionSet::ReadColumnFamilyLayout(
+              env_, dbname_ + "/" + manifests_[i].second, &names,
+              &table_families_, &max_column_family_)) {
+        found = true;
+      }
+    }
+    names[0] = kDefaultColumnFamilyName;
+
+    bool other_families = false;
+    for (size_t i = 0; i < column_families_.size(); i++) {
+      if (column_families_[i].name != kDefaultColumnFamilyName) {
+        other_families = true;
+      }
+    }
+    if (!found && other_families) {
+      return Status::NotSupported(
+          "no readable descriptor records the column families of the tables");
+    }
+
+    for (std::map<uint32_t, std::string>::const_iterator it = names.begin();
+         it != names.end(); ++it) {
+      const Options* src = (it->first == 0) ? &user_options_ : NULL;
+      for (size_t i = 0; i < column_families_.size(); i++) {
+        if (column_families_[i].name == it->second) {
+          src = &column_families_[i].options;
+        }
+      }
+      if (src == NULL) {
+        return Status::InvalidArgument(it->second,
+                                       "column family has no options");
+      }
+      families_[it->first] = new Family(
+          it->second, SanitizeColumnFamilyOptions(options_, *src),
+          table_cache_);
+    }
+    return Status::OK();
+  }
+
   void ConvertLogFilesToTables() {
     for (size_t i = 0; i < logs_.size(); i++) {
       std::string logname = LogFileName(dbname_, logs_[i]);
@@ -191,14 +278,19 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false/*do not checksum*/,
-                       0/*initial_offset*/);
+                       0/*initial_offset*/, log);
 
-    // Read all the records and add to a memtable
+    // Read all the records and add them to the memtables of their
+    // column families
     std::string scratch;
     Slice record;
     WriteBatch batch;
-    MemTable* mem = new MemTable(icmp_);
-    mem->Ref();
+    std::vector<MemTable*> mems(max_column_family_ + 1, NULL);
+    for (std::map<uint32_t, Family*>::const_iterator it = families_.begin();
+         it != families_.end(); ++it) {
+      mems[it->first] = new MemTable(it->second->icmp);
+      mems[it->first]->Ref();
+    }
     int counter = 0;
     while (reader.ReadRecord(&record, &scratch)) {
       if (record.size() < 12) {
@@ -207,7 +299,7 @@ class Repairer {
         continue;
       }
       WriteBatchInternal::SetContents(&batch, record);
-      status = WriteBatchInternal::InsertInto(&batch, mem);
+      status = WriteBatchInternal::InsertInto(&batch, mems);
       if (status.ok()) {
         counter += WriteBatchInternal::Count(&batch);
       } else {
@@ -221,32 +313,54 @@ class Repairer {
 
     // Do not record a version edit for this conversion to a Table
     // since ExtractMetaData() will also generate edits.
-    FileMetaData meta;
-    meta.number = next_file_number_++;
-    Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
-    delete iter;
-    mem->Unref();
-    mem = NULL;
-    if (status.ok()) {
-      if (meta.file_size > 0) {
+    Log(options_.info_log, "Log #%llu: %d ops read",
+        (unsigned long long) log, counter);
+    for (std::map<uint32_t, Family*>::const_iterator it = families_.begin();
+         it != families_.end(); ++it) {
+      Family* family = it->second;
+      MemTable* mem = mems[it->first];
+      FileMetaData meta;
+      meta.number = next_file_number_++;
+      Iterator* iter = mem->NewIterator();
+      Status s = BuildTable(dbname_, env_,
+                            TableOptionsForLevel(family->options, 0),
+                            &family->table_cache, iter, &meta);
+      delete iter;
+      mem->Unref();
+      if (s.ok() && meta.file_size > 0) {
         table_numbers_.push_back(meta.number);
+        table_families_[meta.number] = it->first;
+        Log(options_.info_log, "Log #%llu: saved %s to Table #%llu",
+            (unsigned long long) log, family->name.c_str(),
+            (unsigned long long) meta.number);
+      }
+      if (status.ok()) {
+        status = s;
       }
     }
-    Log(options_.info_log, "Log #%llu: %d ops saved to Table #%llu %s",
-        (unsigned long long) log,
-        counter,
-        (unsigned long long) meta.number,
-        status.ToString().c_str());
     return status;
   }
 
   void ExtractMetaData() {
-    std::vector<TableInfo> kept;
     for (size_t i = 0; i < table_numbers_.size(); i++) {
       TableInfo t;
       t.meta.number = table_numbers_[i];
-      Status status = ScanTable(&t);
+      Status status;
+      std::map<uint64_t, uint32_t>::const_iterator it =
+          table_families_.find(t.meta.number);
+      if (it != table_families_.end()) {
+        t.column_family = it->second;
+      } else if (families_.size() == 1) {
+        t.column_family = 0;
+      } else {
+        status = Status::Corruption("column family unknown");
+      }
+      if (status.ok() && families_.count(t.column_family) == 0) {
+        status = Status::Corruption("column family dropped");
+      }
+      if (status.ok()) {
+        status = ScanTable(&t);
+      }
       if (!status.ok()) {
         std::string fname = TableFileName(dbname_, table_numbers_[i]);
         Log(options_.info_log, "Table #%llu: ignoring %s",
@@ -264,7 +378,8 @@ class Repairer {
     int counter = 0;
     Status status = env_->GetFileSize(fname, &t->meta.file_size);
     if (status.ok()) {
-      Iterator* iter = table_cache_->NewIterator(
+      TableCache* table_cache = &families_[t->column_family]->table_cache;
+      Iterator* iter = table_cache->NewIterator(
           ReadOptions(), t->meta.number, t->meta.file_size);
       bool empty = true;
       ParsedInternalKey parsed;
@@ -287,7 +402,13 @@ class Repairer {
         if (parsed.sequence > t->max_sequence) {
           t->max_sequence = parsed.sequence;
         }
+        if (parsed.type == kTypeRangeDeletion) {
+          t->meta.range_dels.push_back(
+              RangeTombstone(parsed.user_key, iter->value(),
+                             parsed.sequence));
+        }
       }
+      t->meta.largest_seqno = t->max_sequence;
       if (!iter->status().ok()) {
         status = iter->status();
       }
@@ -315,24 +436,38 @@ class Repairer {
       }
     }
 
-    edit_.SetComparatorName(icmp_.user_comparator()->Name());
-    edit_.SetLogNumber(0);
-    edit_.SetNextFile(next_file_number_);
-    edit_.SetLastSequence(max_sequence);
-
-    for (size_t i = 0; i < tables_.size(); i++) {
-      // TODO(opt): separate out into multiple levels
-      const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
-    }
-
-    //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
+    // One record per column family, the default one first
     {
       log::Writer log(file);
-      std::string record;
-      edit_.EncodeTo(&record);
-      status = log.AddRecord(record);
+      for (std::map<uint32_t, Family*>::const_iterator it = families_.begin();
+           status.ok() && it != families_.end(); ++it) {
+        const Family* family = it->second;
+        VersionEdit edit;
+        edit.SetColumnFamily(it->first);
+        if (it->first != 0) {
+          edit.AddColumnFamily(family->name);
+        } else {
+          edit.SetNextFile(next_file_number_);
+          edit.SetLastSequence(max_sequence);
+          if (max_column_family_ > 0) {
+            edit.SetMaxColumnFamily(max_column_family_);
+          }
+        }
+        edit.SetComparatorName(family->icmp.user_comparator()->Name());
+        edit.SetLogNumber(0);
+
+        for (size_t i = 0; i < tables_.size(); i++) {
+          // TODO(opt): separate out into multiple levels
+          const TableInfo& t = tables_[i];
+          if (t.column_family == it->first) {
+            edit.AddFile(0, t.meta);
+          }
+        }
+
+        std::string record;
+        edit.EncodeTo(&record);
+        status = log.AddRecord(record);
+      }
     }
     if (status.ok()) {
       status = file->Close();
@@ -345,7 +480,7 @@ class Repairer {
     } else {
       // Discard older manifests
       for (size_t i = 0; i < manifests_.size(); i++) {
-        ArchiveFile(dbname_ + "/" + manifests_[i]);
+        ArchiveFile(dbname_ + "/" + manifests_[i].second);
       }
 
       // Install new manifest
@@ -382,7 +517,12 @@ class Repairer {
 }  // namespace
 
 Status RepairDB(const std::string& dbname, const Options& options) {
-  Repairer repairer(dbname, options);
+  return RepairDB(dbname, options, std::vector<ColumnFamilyDescriptor>());
+}
+
+Status RepairDB(const std::string& dbname, const Options& options,
+                const std::vector<ColumnFamilyDescriptor>& column_families) {
+  Repairer repairer(dbname, options, column_families);
   return repairer.Run();
 }
 
@@ -5,7 +5,9 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Writes require external synchronization, most likely a mutex.  The
+// exception is InsertConcurrently(), which may be called from several
+// threads at once as long as no thread is calling Insert().
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -18,9 +20,9 @@
 //
 // (2) The contents of a Node except for the next/prev pointers are
 // immutable after the Node has been linked into the SkipList.
-// Only Insert() modifies the list, and it is careful to initialize
-// a node and use release-stores to publish the nodes in one or
-// more lists.
+// Only Insert() and InsertConcurrently() modify the list, and they are
+// careful to initialize a node and use release-stores (or
+// compare-and-swap) to publish the nodes in one or more lists.
 //
 // ... prev vs. next pointer ordering ...
 
@@ -28,6 +30,7 @@
 #include <stdlib.h>
 #include "port/port.h"
 #include "util/arena.h"
+#include "util/hash.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -49,6 +52,13 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but may run in several threads at the same time.
+  // Nodes are linked in with compare-and-swap and allocated with
+  // Arena::AllocateConcurrently().
+  // REQUIRES: nothing that compares equal to key is in the list or is
+  // being inserted concurrently; no concurrent call to Insert().
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -100,8 +110,8 @@ class SkipList {
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
   port::AtomicPointer max_height_;   // Height of the entire list
 
   inline int GetMaxHeight() const {
@@ -112,8 +122,13 @@ class SkipList {
   // Read/written only by Insert().
   Random rnd_;
 
-  Node* NewNode(const Key& key, int height);
+  // Bumped by InsertConcurrently() to pick node heights.  Updates may
+  // be lost under contention, which only costs a little randomness.
+  port::AtomicPointer insert_counter_;
+
+  Node* NewNode(const Key& key, int height, bool concurrent);
   int RandomHeight();
+  int RandomHeightConcurrently();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -130,6 +145,12 @@ class SkipList {
   // Return head_ if there is no such node.
   Node* FindLessThan(const Key& key) const;
 
+  // Starting the search at "before", which must come before key, store
+  // in *prev the last node at "level" with a key < key and in *next the
+  // node that follows it.
+  void FindSpliceForLevel(const Key& key, Node* before, int level,
+                          Node** prev, Node** next) const;
+
   // Return the last node in the list.
   // Return head_ if list is empty.
   Node* FindLast() const;
@@ -171,6 +192,13 @@ struct SkipList<Key,Comparator>::Node {
     next_[n].NoBarrier_Store(x);
   }
 
+  // Link "x" in at level n iff the current successor is still
+  // "expected".  Acts as a full barrier, like SetNext().
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].CompareAndSwap(expected, x);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   port::AtomicPointer next_[1];
@@ -178,9 +206,12 @@ struct SkipList<Key,Comparator>::Node {
 
 template<typename Key, class Comparator>
 typename SkipList<Key,Comparator>::Node*
-SkipList<Key,Comparator>::NewNode(const Key& key, int height) {
-  char* mem = arena_->AllocateAligned(
-      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+SkipList<Key,Comparator>::NewNode(const Key& key, int height,
+                                  bool concurrent) {
+  const size_t bytes =
+      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1);
+  char* mem = concurrent ? arena_->AllocateConcurrently(bytes)
+                         : arena_->AllocateAligned(bytes);
   return new (mem) Node(key);
 }
 
@@ -249,6 +280,28 @@ int SkipList<Key,Comparator>::RandomHeight() {
   return height;
 }
 
+template<typename Key, class Comparator>
+int SkipList<Key,Comparator>::RandomHeightConcurrently() {
+  // rnd_ cannot be shared between threads, so hash a shared counter
+  // together with an address on the caller's stack instead.  Threads
+  // that race on the counter still get different values.
+  static const unsigned int kBranching = 4;
+  uintptr_t seed[2];
+  seed[0] = reinterpret_cast<uintptr_t>(insert_counter_.NoBarrier_Load());
+  seed[1] = reinterpret_cast<uintptr_t>(&seed);
+  insert_counter_.NoBarrier_Store(reinterpret_cast<void*>(seed[0] + 1));
+  uint32_t bits = Hash(reinterpret_cast<const char*>(seed), sizeof(seed),
+                       0xdeadbeef);
+  int height = 1;
+  while (height < kMaxHeight && ((bits % kBranching) == 0)) {
+    height++;
+    bits /= kBranching;
+  }
+  assert(height > 0);
+  assert(height <= kMaxHeight);
+  return height;
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   // NULL n is considered infinite
@@ -298,6 +351,25 @@ SkipList<Key,Comparator>::FindLessThan(const Key& key) const {
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::FindSpliceForLevel(const Key& key,
+                                                  Node* before, int level,
+                                                  Node** prev,
+                                                  Node** next) const {
+  Node* x = before;
+  while (true) {
+    Node* n = x->Next(level);
+    if (KeyIsAfterNode(key, n)) {
+      x = n;
+    } else {
+      assert(n == NULL || !Equal(key, n->key));
+      *prev = x;
+      *next = n;
+      return;
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 typename SkipList<Key,Comparator>::Node* SkipList<Key,Comparator>::FindLast()
     const {
@@ -322,9 +394,10 @@ template<typename Key, class Comparator>
 SkipList<Key,Comparator>::SkipList(Comparator cmp, Arena* arena)
     : compare_(cmp),
       arena_(arena),
-      head_(NewNode(0 /* any key will do */, kMaxHeight)),
+      head_(NewNode(0 /* any key will do */, kMaxHeight, false)),
       max_height_(reinterpret_cast<void*>(1)),
-      rnd_(0xdeadbeef) {
+      rnd_(0xdeadbeef),
+      insert_counter_(NULL) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, NULL);
   }
@@ -357,7 +430,7 @@ void SkipList<Key,Comparator>::Insert(const Key& key) {
     max_height_.NoBarrier_Store(reinterpret_cast<void*>(height));
   }
 
-  x = NewNode(key, height);
+  x = NewNode(key, height, false);
   for (int i = 0; i < height; i++) {
     // NoBarrier_SetNext() suffices since we will add a barrier when
     // we publish a pointer to "x" in prev[i].
@@ -366,6 +439,47 @@ void SkipList<Key,Comparator>::Insert(const Key& key) {
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::InsertConcurrently(const Key& key) {
+  const int height = RandomHeightConcurrently();
+
+  // Raise max_height_ unless another inserter already raised it at
+  // least as far.  Readers cope with a raised height before the new
+  // levels are linked for the same reason as in Insert().
+  int max_height = GetMaxHeight();
+  while (height > max_height &&
+         !max_height_.CompareAndSwap(reinterpret_cast<void*>(max_height),
+                                     reinterpret_cast<void*>(height))) {
+    max_height = GetMaxHeight();
+  }
+
+  // Find the splice at every level, top down.  Another inserter may
+  // have raised the height since we read it, so start at the top of
+  // head_; empty levels are just a NULL link.
+  Node* prev[kMaxHeight];
+  Node* next[kMaxHeight];
+  Node* x = head_;
+  for (int i = kMaxHeight - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, x, i, &prev[i], &next[i]);
+    x = prev[i];
+  }
+
+  // Link bottom up so that the node is reachable at level 0 before it
+  // shows up in any express lane.  If another thread slipped a node in
+  // between prev[i] and next[i], search again from prev[i]: nodes are
+  // never removed, so prev[i] still precedes key.
+  x = NewNode(key, height, true);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, NULL);
@@ -3,10 +3,13 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/skiplist.h"
+#include <algorithm>
 #include <set>
+#include <vector>
 #include "leveldb/env.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -222,6 +225,17 @@ class ConcurrentTest {
     current_.Set(k, g);
   }
 
+  // Like WriteStep(), but only touches the keys k with k % n == i, so
+  // that n threads with different i can run it at the same time.
+  // REQUIRES: K % n == 0; no concurrent WriteStep()
+  void ConcurrentWriteStep(Random* rnd, int i, int n) {
+    const uint32_t k = i + n * (rnd->Next() % (K / n));
+    const intptr_t g = current_.Get(k) + 1;
+    const Key key = MakeKey(k, g);
+    list_.InsertConcurrently(key);
+    current_.Set(k, g);
+  }
+
   void ReadStep(Random* rnd) {
     // Remember the initial committed state of the skiplist.
     State initial_state;
@@ -310,7 +324,8 @@ class TestState {
       : seed_(s),
         quit_flag_(NULL),
         state_(STARTING),
-        state_cv_(&mu_) {}
+        state_cv_(&mu_),
+        writers_(0) {}
 
   void Wait(ReaderState s) {
     mu_.Lock();
@@ -327,10 +342,32 @@ class TestState {
     mu_.Unlock();
   }
 
+  void AddWriter() {
+    mu_.Lock();
+    writers_++;
+    mu_.Unlock();
+  }
+
+  void WriterDone() {
+    mu_.Lock();
+    writers_--;
+    state_cv_.SignalAll();
+    mu_.Unlock();
+  }
+
+  void WaitForWriters() {
+    mu_.Lock();
+    while (writers_ > 0) {
+      state_cv_.Wait();
+    }
+    mu_.Unlock();
+  }
+
  private:
   port::Mutex mu_;
   ReaderState state_;
   port::CondVar state_cv_;
+  int writers_;
 };
 
 static void ConcurrentReader(void* arg) {
@@ -371,6 +408,133 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Same as above, but with several writers using InsertConcurrently()
+// while the reader checks that nothing inserted so far goes missing.
+static const int kWriters = 4;
+static const int kWriterSteps = 250;
+
+struct WriterArg {
+  TestState* state;
+  int id;
+  int seed;
+};
+
+static void ConcurrentWriter(void* arg) {
+  WriterArg* w = reinterpret_cast<WriterArg*>(arg);
+  Random rnd(w->seed);
+  for (int i = 0; i < kWriterSteps; i++) {
+    w->state->t_.ConcurrentWriteStep(&rnd, w->id, kWriters);
+  }
+  w->state->WriterDone();
+}
+
+static void RunConcurrentWriters(int run) {
+  const int seed = test::RandomSeed() + (run * 100);
+  Random rnd(seed);
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    if ((i % 100) == 0) {
+      fprintf(stderr, "Run %d of %d\n", i, N);
+    }
+    TestState state(seed + 1);
+    Env::Default()->Schedule(ConcurrentReader, &state);
+    state.Wait(TestState::RUNNING);
+    WriterArg args[kWriters];
+    for (int w = 0; w < kWriters; w++) {
+      args[w].state = &state;
+      args[w].id = w;
+      args[w].seed = seed + 2 + w;
+      state.AddWriter();
+      Env::Default()->StartThread(ConcurrentWriter, &args[w]);
+    }
+    state.WaitForWriters();
+    state.quit_flag_.Release_Store(&state);  // Any non-NULL arg will do
+    state.Wait(TestState::DONE);
+
+    // Everything written must now be visible
+    state.t_.ReadStep(&rnd);
+  }
+}
+
+TEST(SkipTest, ConcurrentWriters1) { RunConcurrentWriters(1); }
+TEST(SkipTest, ConcurrentWriters2) { RunConcurrentWriters(2); }
+TEST(SkipTest, ConcurrentWriters3) { RunConcurrentWriters(3); }
+
+// Many threads inserting disjoint keys at once must leave a list that
+// holds exactly those keys, in order.
+namespace {
+
+struct InsertState {
+  SkipList<Key, Comparator>* list;
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;
+  InsertState() : cv(&mu) { }
+};
+
+struct InsertArg {
+  InsertState* state;
+  int id;
+};
+
+static const int kInsertThreads = 8;
+static const int kInsertsPerThread = 20000;
+
+static void ConcurrentInserter(void* arg) {
+  InsertArg* a = reinterpret_cast<InsertArg*>(arg);
+  // Insert keys id, id + kInsertThreads, ... in a random order
+  std::vector<Key> keys;
+  for (int i = 0; i < kInsertsPerThread; i++) {
+    keys.push_back(a->id + static_cast<Key>(i) * kInsertThreads);
+  }
+  Random rnd(1000 + a->id);
+  for (int i = keys.size() - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    a->state->list->InsertConcurrently(keys[i]);
+  }
+  MutexLock l(&a->state->mu);
+  a->state->running--;
+  a->state->cv.Signal();
+}
+
+}  // namespace
+
+TEST(SkipTest, ConcurrentInsertStress) {
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  InsertState state;
+  state.list = &list;
+  state.running = kInsertThreads;
+  InsertArg args[kInsertThreads];
+  for (int i = 0; i < kInsertThreads; i++) {
+    args[i].state = &state;
+    args[i].id = i;
+    Env::Default()->StartThread(ConcurrentInserter, &args[i]);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.running > 0) {
+      state.cv.Wait();
+    }
+  }
+
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  const Key n = static_cast<Key>(kInsertThreads) * kInsertsPerThread;
+  for (Key k = 0; k < n; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < n; k += 997) {
+    ASSERT_TRUE(list.Contains(k));
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,121 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// The file holds internal keys, as the tables of a database do, with
+// sequence number zero.  DB::IngestExternalFile() assigns the entries
+// their real sequence number when it adds the file.
+struct SstFileWriter::Rep {
+  const InternalKeyComparator icmp;
+  const InternalFilterPolicy ipolicy;
+  Options options;
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;       // User key of the last entry added
+  uint64_t num_entries;
+  bool finished;
+  std::string ikey;           // Scratch space for internal keys
+
+  explicit Rep(const Options& opt)
+      : icmp(opt.comparator),
+        ipolicy(opt.filter_policy, opt.prefix_extractor),
+        options(opt),
+        file(NULL),
+        builder(NULL),
+        num_entries(0),
+        finished(false) {
+    options.comparator = &icmp;
+    options.filter_policy = (opt.filter_policy != NULL) ? &ipolicy : NULL;
+  }
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {
+}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != NULL && !rep_->finished) {
+    rep_->builder->Abandon();
+  }
+  delete rep_->builder;
+  delete rep_->file;
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  if (r->file != NULL) {
+    return Status::InvalidArgument("SstFileWriter is already open");
+  }
+  Status s = r->options.env->NewWritableFile(fname, &r->file);
+  if (s.ok()) {
+    r->builder = new TableBuilder(r->options, r->file);
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  if (r->builder == NULL || r->finished) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  if (r->num_entries > 0 &&
+      r->icmp.user_comparator()->Compare(key, r->last_key) <= 0) {
+    return Status::InvalidArgument(
+        "keys must be added in strictly increasing order", key);
+  }
+  r->last_key.assign(key.data(), key.size());
+  r->ikey.clear();
+  AppendInternalKey(&r->ikey, ParsedInternalKey(
+      key, 0, deletion ? kTypeDeletion : kTypeValue));
+  r->builder->Add(r->ikey, value);
+  r->num_entries++;
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == NULL || r->finished) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  r->finished = true;
+  if (r->num_entries == 0) {
+    r->builder->Abandon();
+    return Status::InvalidArgument("no entries were added");
+  }
+  Status s = r->builder->Finish();
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::NumEntries() const {
+  return rep_->num_entries;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return (rep_->builder != NULL) ? rep_->builder->FileSize() : 0;
+}
+
+}  // namespace leveldb
@@ -35,11 +35,22 @@ TableCache::TableCache(const std::string& dbname,
     : env_(options->env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      owns_cache_(true) {
+}
+
+TableCache::TableCache(const TableCache* base, const Options* options)
+    : env_(options->env),
+      dbname_(base->dbname_),
+      options_(options),
+      cache_(base->cache_),
+      owns_cache_(false) {
 }
 
 TableCache::~TableCache() {
-  delete cache_;
+  if (owns_cache_) {
+    delete cache_;
+  }
 }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
@@ -112,6 +123,27 @@ Status TableCache::Get(const ReadOptions& options,
   return s;
 }
 
+void TableCache::MultiGet(const ReadOptions& options,
+                          uint64_t file_number,
+                          uint64_t file_size,
+                          const Slice* keys,
+                          int n,
+                          void* const* args,
+                          void (*saver)(void*, const Slice&, const Slice&),
+                          Status* statuses) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    t->InternalMultiGet(options, keys, n, args, saver, statuses);
+    cache_->Release(handle);
+  } else {
+    for (int i = 0; i < n; i++) {
+      statuses[i] = s;
+    }
+  }
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -21,6 +21,11 @@ class Env;
 class TableCache {
  public:
   TableCache(const std::string& dbname, const Options* options, int entries);
+
+  // Return a cache that opens tables with "*options" but keeps them in
+  // the cache of "base", which must outlive it.
+  TableCache(const TableCache* base, const Options* options);
+
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
@@ -44,6 +49,17 @@ class TableCache {
              void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Like Get() for each of the internal keys keys[0,n-1], which should
+  // be sorted, with the outcome stored in statuses[i].
+  void MultiGet(const ReadOptions& options,
+                uint64_t file_number,
+                uint64_t file_size,
+                const Slice* keys,
+                int n,
+                void* const* args,
+                void (*handle_result)(void*, const Slice&, const Slice&),
+                Status* statuses);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
@@ -52,6 +68,7 @@ class TableCache {
   const std::string dbname_;
   const Options* options_;
   Cache* cache_;
+  bool owns_cache_;
 
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
 };
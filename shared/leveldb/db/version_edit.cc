@@ -6,6 +6,7 @@
 
 #include "db/version_set.h"
 #include "util/coding.h"
+#include "util/logging.h"
 
 namespace leveldb {
 
@@ -20,7 +21,15 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewIngestedFile      = 10,
+  kColumnFamily         = 11,
+  kColumnFamilyAdd      = 12,
+  kColumnFamilyDrop     = 13,
+  kMaxColumnFamily      = 14,
+  kNewFileWithSeqno     = 15,
+  kRangeDeletion        = 16,  // Belongs to the preceding new file
+  kFileCreationTime     = 17   // Belongs to the preceding new file
 };
 
 void VersionEdit::Clear() {
@@ -34,11 +43,34 @@ void VersionEdit::Clear() {
   has_prev_log_number_ = false;
   has_next_file_number_ = false;
   has_last_sequence_ = false;
+  column_family_ = 0;
+  column_family_name_.clear();
+  is_column_family_add_ = false;
+  is_column_family_drop_ = false;
+  max_column_family_ = 0;
+  has_max_column_family_ = false;
   deleted_files_.clear();
   new_files_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
+  // Edits of the default column family carry no column family tag, so
+  // that they read the same as those of databases without families.
+  if (column_family_ != 0) {
+    PutVarint32(dst, kColumnFamily);
+    PutVarint32(dst, column_family_);
+  }
+  if (is_column_family_add_) {
+    PutVarint32(dst, kColumnFamilyAdd);
+    PutLengthPrefixedSlice(dst, column_family_name_);
+  }
+  if (is_column_family_drop_) {
+    PutVarint32(dst, kColumnFamilyDrop);
+  }
+  if (has_max_column_family_) {
+    PutVarint32(dst, kMaxColumnFamily);
+    PutVarint32(dst, max_column_family_);
+  }
   if (has_comparator_) {
     PutVarint32(dst, kComparator);
     PutLengthPrefixedSlice(dst, comparator_);
@@ -76,12 +108,36 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // The largest sequence number of an ingested file is its global
+    // sequence number, so it is not stored separately.
+    uint32_t tag = kNewFile;
+    if (f.global_seqno != 0) {
+      tag = kNewIngestedFile;
+    } else if (f.largest_seqno != 0) {
+      tag = kNewFileWithSeqno;
+    }
+    PutVarint32(dst, tag);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (tag == kNewIngestedFile) {
+      PutVarint64(dst, f.global_seqno);
+    } else if (tag == kNewFileWithSeqno) {
+      PutVarint64(dst, f.largest_seqno);
+    }
+    if (f.creation_time != 0) {
+      PutVarint32(dst, kFileCreationTime);
+      PutVarint64(dst, f.creation_time);
+    }
+    for (size_t j = 0; j < f.range_dels.size(); j++) {
+      const RangeTombstone& t = f.range_dels[j];
+      PutVarint32(dst, kRangeDeletion);
+      PutLengthPrefixedSlice(dst, t.begin);
+      PutLengthPrefixedSlice(dst, t.end);
+      PutVarint64(dst, t.sequence);
+    }
   }
 }
 
@@ -186,12 +242,93 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.global_seqno = 0;
+          f.largest_seqno = 0;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kNewFileWithSeqno:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.largest_seqno) &&
+            f.largest_seqno != 0) {
+          f.global_seqno = 0;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file-with-seqno entry";
+        }
+        break;
+
+      case kNewIngestedFile:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.global_seqno) &&
+            f.global_seqno != 0) {
+          f.largest_seqno = f.global_seqno;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-ingested-file entry";
+        }
+        break;
+
+      case kRangeDeletion: {
+        Slice begin, end;
+        SequenceNumber seq;
+        if (!new_files_.empty() &&
+            GetLengthPrefixedSlice(&input, &begin) &&
+            GetLengthPrefixedSlice(&input, &end) &&
+            GetVarint64(&input, &seq)) {
+          new_files_.back().second.range_dels.push_back(
+              RangeTombstone(begin, end, seq));
+        } else {
+          msg = "range deletion";
+        }
+        break;
+      }
+
+      case kFileCreationTime:
+        if (new_files_.empty() ||
+            !GetVarint64(&input, &new_files_.back().second.creation_time)) {
+          msg = "file creation time";
+        }
+        break;
+
+      case kColumnFamily:
+        if (!GetVarint32(&input, &column_family_)) {
+          msg = "column family";
+        }
+        break;
+
+      case kColumnFamilyAdd:
+        if (GetLengthPrefixedSlice(&input, &str)) {
+          column_family_name_ = str.ToString();
+          is_column_family_add_ = true;
+        } else {
+          msg = "column family name";
+        }
+        break;
+
+      case kColumnFamilyDrop:
+        is_column_family_drop_ = true;
+        break;
+
+      case kMaxColumnFamily:
+        if (GetVarint32(&input, &max_column_family_)) {
+          has_max_column_family_ = true;
+        } else {
+          msg = "max column family";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -212,6 +349,21 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
 std::string VersionEdit::DebugString() const {
   std::string r;
   r.append("VersionEdit {");
+  if (column_family_ != 0) {
+    r.append("\n  ColumnFamily: ");
+    AppendNumberTo(&r, column_family_);
+  }
+  if (is_column_family_add_) {
+    r.append("\n  ColumnFamilyAdd: ");
+    r.append(column_family_name_);
+  }
+  if (is_column_family_drop_) {
+    r.append("\n  ColumnFamilyDrop");
+  }
+  if (has_max_column_family_) {
+    r.append("\n  MaxColumnFamily: ");
+    AppendNumberTo(&r, max_column_family_);
+  }
   if (has_comparator_) {
     r.append("\n  Comparator: ");
     r.append(comparator_);
@@ -258,6 +410,25 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.global_seqno != 0) {
+      r.append(" @ ");
+      AppendNumberTo(&r, f.global_seqno);
+    } else if (f.largest_seqno != 0) {
+      r.append(" seq ");
+      AppendNumberTo(&r, f.largest_seqno);
+    }
+    if (f.creation_time != 0) {
+      r.append(" time ");
+      AppendNumberTo(&r, f.creation_time);
+    }
+    for (size_t j = 0; j < f.range_dels.size(); j++) {
+      r.append("\n    DeleteRange: '");
+      AppendEscapedStringTo(&r, f.range_dels[j].begin);
+      r.append("' .. '");
+      AppendEscapedStringTo(&r, f.range_dels[j].end);
+      r.append("' @ ");
+      AppendNumberTo(&r, f.range_dels[j].sequence);
+    }
   }
   r.append("\n}\n");
   return r;
@@ -9,6 +9,7 @@
 #include <utility>
 #include <vector>
 #include "db/dbformat.h"
+#include "db/range_del.h"
 
 namespace leveldb {
 
@@ -21,8 +22,31 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
-
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  bool being_compacted;       // Claimed as input by a running compaction
+
+  // If non-zero, the file was ingested with DB::IngestExternalFile().
+  // It stores its keys with sequence number zero, and every entry in it
+  // is served with this sequence number instead.  "smallest" and
+  // "largest" carry this sequence number too.
+  SequenceNumber global_seqno;
+
+  // Largest sequence number of the entries in the file, or zero if it is
+  // not known (files added by older versions).  Orders level-0 files
+  // from newest to oldest.
+  SequenceNumber largest_seqno;
+
+  // The range deletions stored in the file.  Reads consult them without
+  // opening the file.
+  std::vector<RangeTombstone> range_dels;
+
+  // When the file was written, in seconds since the epoch, or zero if it
+  // is not known.
+  uint64_t creation_time;
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0),
+        being_compacted(false), global_seqno(0), largest_seqno(0),
+        creation_time(0) { }
 };
 
 class VersionEdit {
@@ -56,6 +80,32 @@ class VersionEdit {
     compact_pointers_.push_back(std::make_pair(level, key));
   }
 
+  // The column family that the edit applies to.  Defaults to the
+  // default column family, id 0.
+  void SetColumnFamily(uint32_t id) {
+    column_family_ = id;
+  }
+  uint32_t column_family() const { return column_family_; }
+
+  // Record the creation of the column family set by SetColumnFamily(),
+  // under the specified name.
+  void AddColumnFamily(const std::string& name) {
+    is_column_family_add_ = true;
+    column_family_name_ = name;
+  }
+
+  // Record that the column family set by SetColumnFamily() was dropped.
+  void DropColumnFamily() {
+    is_column_family_drop_ = true;
+  }
+
+  // Record the largest column family id handed out so far, so that ids
+  // of dropped families are not reused.
+  void SetMaxColumnFamily(uint32_t id) {
+    has_max_column_family_ = true;
+    max_column_family_ = id;
+  }
+
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
@@ -71,6 +121,17 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add a copy of the existing file "f", including its global and
+  // largest sequence numbers, its range deletions and its creation time,
+  // at the specified level.
+  void AddFile(int level, const FileMetaData& f) {
+    AddFile(level, f.number, f.file_size, f.smallest, f.largest);
+    new_files_.back().second.global_seqno = f.global_seqno;
+    new_files_.back().second.largest_seqno = f.largest_seqno;
+    new_files_.back().second.range_dels = f.range_dels;
+    new_files_.back().second.creation_time = f.creation_time;
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
@@ -97,6 +158,13 @@ class VersionEdit {
   bool has_next_file_number_;
   bool has_last_sequence_;
 
+  uint32_t column_family_;
+  std::string column_family_name_;
+  bool is_column_family_add_;
+  bool is_column_family_drop_;
+  uint32_t max_column_family_;
+  bool has_max_column_family_;
+
   std::vector< std::pair<int, InternalKey> > compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector< std::pair<int, FileMetaData> > new_files_;
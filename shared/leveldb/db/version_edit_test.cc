@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/version_edit.h"
+#include "util/coding.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -39,6 +40,150 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, IngestedFile) {
+  FileMetaData f;
+  f.number = 10;
+  f.file_size = 2000;
+  f.smallest = InternalKey("bar", 30, kTypeValue);
+  f.largest = InternalKey("foo", 30, kTypeValue);
+  f.global_seqno = 30;
+
+  // A plain file that follows an ingested one has no global sequence
+  // number.
+  VersionEdit edit;
+  edit.AddFile(1, f);
+  edit.AddFile(2, 11, 3000, InternalKey("a", 5, kTypeValue),
+               InternalKey("b", 6, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_EQ(edit.DebugString(), parsed.DebugString());
+  ASSERT_TRUE(parsed.DebugString().find("@ 30") != std::string::npos);
+}
+
+TEST(VersionEditTest, LargestSeqno) {
+  FileMetaData f;
+  f.number = 10;
+  f.file_size = 2000;
+  f.smallest = InternalKey("bar", 30, kTypeValue);
+  f.largest = InternalKey("foo", 20, kTypeValue);
+  f.largest_seqno = 40;
+
+  VersionEdit edit;
+  edit.AddFile(0, f);
+  f.number = 11;
+  f.largest_seqno = 0;
+  edit.AddFile(0, f);
+  f.number = 12;
+  f.global_seqno = 50;
+  f.largest_seqno = 50;
+  edit.AddFile(0, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_EQ(edit.DebugString(), parsed.DebugString());
+  ASSERT_TRUE(parsed.DebugString().find("seq 40") != std::string::npos);
+}
+
+TEST(VersionEditTest, RangeDeletions) {
+  FileMetaData f;
+  f.number = 10;
+  f.file_size = 2000;
+  f.smallest = InternalKey("bar", 30, kTypeRangeDeletion);
+  f.largest = InternalKey("foo", 20, kTypeValue);
+  f.largest_seqno = 40;
+  f.range_dels.push_back(RangeTombstone("bar", "baz", 30));
+  f.range_dels.push_back(RangeTombstone("c", "z", 40));
+
+  // The range deletions stay with their own file.
+  VersionEdit edit;
+  edit.AddFile(1, f);
+  edit.AddFile(2, 11, 3000, InternalKey("a", 5, kTypeValue),
+               InternalKey("b", 6, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_EQ(edit.DebugString(), parsed.DebugString());
+  ASSERT_TRUE(parsed.DebugString().find("DeleteRange: 'c' .. 'z' @ 40") !=
+              std::string::npos);
+
+  // A range deletion must follow the file that holds it.
+  std::string lone;
+  PutVarint32(&lone, 16);  // kRangeDeletion
+  PutLengthPrefixedSlice(&lone, "a");
+  PutLengthPrefixedSlice(&lone, "b");
+  PutVarint64(&lone, 7);
+  ASSERT_TRUE(!parsed.DecodeFrom(lone).ok());
+}
+
+TEST(VersionEditTest, CreationTime) {
+  FileMetaData f;
+  f.number = 10;
+  f.file_size = 2000;
+  f.smallest = InternalKey("bar", 30, kTypeValue);
+  f.largest = InternalKey("foo", 20, kTypeValue);
+  f.largest_seqno = 40;
+  f.creation_time = 1381000000;
+
+  VersionEdit edit;
+  edit.AddFile(1, f);
+  edit.AddFile(2, 11, 3000, InternalKey("a", 5, kTypeValue),
+               InternalKey("b", 6, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_EQ(edit.DebugString(), parsed.DebugString());
+  ASSERT_TRUE(parsed.DebugString().find("seq 40 time 1381000000") !=
+              std::string::npos);
+}
+
+TEST(VersionEditTest, ColumnFamily) {
+  VersionEdit edit;
+  edit.SetColumnFamily(3);
+  edit.AddColumnFamily("people");
+  edit.SetComparatorName("foo");
+  edit.SetLogNumber(7);
+  edit.SetMaxColumnFamily(3);
+  edit.AddFile(0, 12, 1000, InternalKey("a", 5, kTypeValue),
+               InternalKey("b", 6, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_EQ(3, parsed.column_family());
+  ASSERT_EQ(edit.DebugString(), parsed.DebugString());
+
+  VersionEdit drop;
+  drop.SetColumnFamily(3);
+  drop.DropColumnFamily();
+  TestEncodeDecode(drop);
+
+  // Edits of the default column family are encoded as before.
+  VersionEdit plain;
+  plain.SetColumnFamily(0);
+  plain.SetLogNumber(7);
+  VersionEdit old;
+  old.SetLogNumber(7);
+  std::string plain_encoded, old_encoded;
+  plain.EncodeTo(&plain_encoded);
+  old.EncodeTo(&old_encoded);
+  ASSERT_EQ(old_encoded, plain_encoded);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
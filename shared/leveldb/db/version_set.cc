@@ -6,17 +6,21 @@
 
 #include <algorithm>
 #include <stdio.h>
+#include "db/column_family.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -54,6 +58,10 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
   return sum;
 }
 
+static bool IsUniversal(const ColumnFamilyData* cfd) {
+  return cfd->options().compaction_style == kCompactionStyleUniversal;
+}
+
 namespace {
 std::string IntSetToString(const std::set<uint64_t>& s) {
   std::string result = "{";
@@ -70,6 +78,7 @@ std::string IntSetToString(const std::set<uint64_t>& s) {
 
 Version::~Version() {
   assert(refs_ == 0);
+  delete range_dels_;
 
   // Remove from linked list
   prev_->next_ = next_;
@@ -160,11 +169,175 @@ bool SomeFileOverlapsRange(
   return !BeforeFile(ucmp, largest_user_key, files[index]);
 }
 
+namespace {
+// Serves the entries of an ingested file, which stores its keys with
+// sequence number zero, under the file's global sequence number.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(Iterator* iter, const Comparator* ucmp,
+                      SequenceNumber seqno)
+      : iter_(iter), ucmp_(ucmp), seqno_(seqno) {
+  }
+  virtual ~GlobalSeqnoIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); Update(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); Update(); }
+  virtual void Next() { iter_->Next(); Update(); }
+  virtual void Prev() { iter_->Prev(); Update(); }
+
+  virtual void Seek(const Slice& target) {
+    ParsedInternalKey t;
+    if (!ParseInternalKey(target, &t)) {
+      iter_->Seek(target);
+      Update();
+      return;
+    }
+    // The file holds at most one entry per user key.  The entry for the
+    // target's user key sorts before the target if its sequence number
+    // is the larger one.
+    std::string start;
+    AppendInternalKey(&start, ParsedInternalKey(t.user_key,
+                                                kMaxSequenceNumber,
+                                                kValueTypeForSeek));
+    iter_->Seek(start);
+    if (iter_->Valid() && seqno_ > t.sequence &&
+        ucmp_->Compare(ExtractUserKey(iter_->key()), t.user_key) == 0) {
+      iter_->Next();
+    }
+    Update();
+  }
+
+  virtual Slice key() const {
+    assert(Valid());
+    return key_;
+  }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  void Update() {
+    key_.clear();
+    if (iter_->Valid()) {
+      ParsedInternalKey k;
+      if (ParseInternalKey(iter_->key(), &k)) {
+        AppendInternalKey(&key_, ParsedInternalKey(k.user_key, seqno_,
+                                                   k.type));
+      } else {
+        // Let the reader report the corruption
+        key_.assign(iter_->key().data(), iter_->key().size());
+      }
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const ucmp_;
+  const SequenceNumber seqno_;
+  std::string key_;
+};
+
+// Serves the entries of a table for ReadOptions::prefix_same_as_start.
+// A Seek() to a key whose prefix the table's filter rules out leaves the
+// iterator invalid without reading the table's index or data blocks:
+// the DBIter that seeks stops at the end of the prefix anyway.  Only the
+// Seek()s made while *prefix_seek is true are filtered, if prefix_seek
+// is not NULL, so that the DBIter can also position at a key exactly.
+class PrefixFilterIterator : public Iterator {
+ public:
+  PrefixFilterIterator(Iterator* iter, const Table* table,
+                       const SliceTransform* prefix_extractor,
+                       const bool* prefix_seek)
+      : iter_(iter),
+        table_(table),
+        prefix_extractor_(prefix_extractor),
+        prefix_seek_(prefix_seek),
+        excluded_(false) {
+  }
+  virtual ~PrefixFilterIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const { return !excluded_ && iter_->Valid(); }
+  virtual void SeekToFirst() { excluded_ = false; iter_->SeekToFirst(); }
+  virtual void SeekToLast() { excluded_ = false; iter_->SeekToLast(); }
+  virtual void Next() { assert(Valid()); iter_->Next(); }
+  virtual void Prev() { assert(Valid()); iter_->Prev(); }
+
+  virtual void Seek(const Slice& target) {
+    const Slice user_key = ExtractUserKey(target);
+    if ((prefix_seek_ == NULL || *prefix_seek_) &&
+        prefix_extractor_->InDomain(user_key)) {
+      InternalKey probe(prefix_extractor_->Transform(user_key),
+                        kMaxSequenceNumber, kValueTypeForSeek);
+      if (!table_->FullFilterMayMatch(probe.Encode())) {
+        PERF_COUNTER_ADD(bloom_useful_count, 1);
+        excluded_ = true;
+        return;
+      }
+    }
+    excluded_ = false;
+    iter_->Seek(target);
+  }
+
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  Iterator* const iter_;
+  const Table* const table_;
+  const SliceTransform* const prefix_extractor_;
+  const bool* const prefix_seek_;
+  bool excluded_;           // The last Seek() was ruled out by the filter
+};
+
+// The "arg" of VersionSet::GetPrefixSeekFileIterator().
+struct PrefixSeekFileArg {
+  ColumnFamilyData* cfd;
+  const bool* prefix_seek;
+};
+
+void DeletePrefixSeekFileArg(void* arg1, void* arg2) {
+  delete reinterpret_cast<PrefixSeekFileArg*>(arg1);
+}
+
+// Returns the sequence number of the snapshot that "k" is looked up in.
+SequenceNumber SnapshotOf(const LookupKey& k) {
+  const Slice ikey = k.internal_key();
+  return DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+}
+}  // namespace
+
+Iterator* VersionSet::NewFileIterator(const ColumnFamilyData* cfd,
+                                      const ReadOptions& options,
+                                      uint64_t number,
+                                      uint64_t file_size,
+                                      SequenceNumber global_seqno,
+                                      const bool* prefix_seek) {
+  Table* table = NULL;
+  Iterator* iter = cfd->table_cache_->NewIterator(options, number, file_size,
+                                                  &table);
+  const Options& cf_options = cfd->options();
+  if (options.prefix_same_as_start && table != NULL &&
+      cf_options.prefix_extractor != NULL &&
+      cf_options.filter_policy != NULL) {
+    iter = new PrefixFilterIterator(iter, table, cf_options.prefix_extractor,
+                                    prefix_seek);
+  }
+  if (global_seqno != 0) {
+    iter = new GlobalSeqnoIterator(iter, cfd->icmp_.user_comparator(),
+                                   global_seqno);
+  }
+  return iter;
+}
+
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// 24-byte value containing the file number, file size and global
+// sequence number, all encoded using EncodeFixed64.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
@@ -203,6 +376,7 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_+8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_+16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   virtual Status status() const { return Status::OK(); }
@@ -211,38 +385,70 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
-static Iterator* GetFileIterator(void* arg,
-                                 const ReadOptions& options,
-                                 const Slice& file_value) {
-  TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+Iterator* VersionSet::GetFileIterator(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& file_value) {
+  ColumnFamilyData* cfd = reinterpret_cast<ColumnFamilyData*>(arg);
+  if (file_value.size() != 24) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return NewFileIterator(cfd, options,
+                           DecodeFixed64(file_value.data()),
+                           DecodeFixed64(file_value.data() + 8),
+                           DecodeFixed64(file_value.data() + 16));
+  }
+}
+
+Iterator* VersionSet::GetPrefixSeekFileIterator(void* arg,
+                                                const ReadOptions& options,
+                                                const Slice& file_value) {
+  PrefixSeekFileArg* a = reinterpret_cast<PrefixSeekFileArg*>(arg);
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
-    return cache->NewIterator(options,
-                              DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+    return NewFileIterator(a->cfd, options,
+                           DecodeFixed64(file_value.data()),
+                           DecodeFixed64(file_value.data() + 8),
+                           DecodeFixed64(file_value.data() + 16),
+                           a->prefix_seek);
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
-                                            int level) const {
-  return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]),
-      &GetFileIterator, vset_->table_cache_, options);
+                                            int level,
+                                            const bool* prefix_seek) const {
+  if (prefix_seek == NULL) {
+    return NewTwoLevelIterator(
+        new LevelFileNumIterator(cfd_->icmp_, &files_[level]),
+        &VersionSet::GetFileIterator, cfd_, options);
+  }
+  PrefixSeekFileArg* arg = new PrefixSeekFileArg;
+  arg->cfd = cfd_;
+  arg->prefix_seek = prefix_seek;
+  Iterator* iter = NewTwoLevelIterator(
+      new LevelFileNumIterator(cfd_->icmp_, &files_[level]),
+      &VersionSet::GetPrefixSeekFileIterator, arg, options);
+  iter->RegisterCleanup(DeletePrefixSeekFileArg, arg, NULL);
+  return iter;
 }
 
 void Version::AddIterators(const ReadOptions& options,
-                           std::vector<Iterator*>* iters) {
+                           std::vector<Iterator*>* iters,
+                           const bool* prefix_seek) {
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(
-        vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+    const FileMetaData* f = files_[0][i];
+    iters->push_back(VersionSet::NewFileIterator(cfd_, options, f->number,
+                                                 f->file_size,
+                                                 f->global_seqno,
+                                                 prefix_seek));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -250,7 +456,7 @@ void Version::AddIterators(const ReadOptions& options,
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
     if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+      iters->push_back(NewConcatenatingIterator(options, level, prefix_seek));
     }
   }
 }
@@ -262,12 +468,16 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,     // Found a merge operand, which older entries complete
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  std::deque<std::string>* operands;
+  SequenceNumber covering;      // Entries older than this are deleted
+  SequenceNumber global_seqno;  // Of the file being read, or zero
 };
 }
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -277,15 +487,70 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+      const SequenceNumber seq =
+          (s->global_seqno != 0) ? s->global_seqno : parsed_key.sequence;
+      if (seq < s->covering) {
+        s->state = kDeleted;  // Covered by a newer range deletion
+        return;
+      }
+      switch (parsed_key.type) {
+        case kTypeValue:
+          s->state = kFound;
+          s->value->assign(v.data(), v.size());
+          break;
+        case kTypeDeletion:
+          s->state = kDeleted;
+          break;
+        case kTypeMerge:
+          s->state = kMerge;
+          s->operands->push_front(v.ToString());
+          break;
+        case kTypeRangeDeletion:
+          // Covers the key itself
+          s->state = kDeleted;
+          break;
       }
     }
   }
 }
 
+// Called when the entry of file "f" that was found for "ikey" is a merge
+// operand.  Passes the entries that follow it in the file to the saver
+// until one of them is not an operand of the same key.
+static Status SaveOlderEntries(const ColumnFamilyData* cfd,
+                               const ReadOptions& options,
+                               FileMetaData* f,
+                               const Slice& ikey,
+                               Saver* saver) {
+  Iterator* iter = VersionSet::NewFileIterator(cfd, options, f->number,
+                                               f->file_size, f->global_seqno);
+  iter->Seek(ikey);
+  if (iter->Valid()) {
+    iter->Next();  // Skip the operand that was already saved
+  }
+  while (saver->state == kMerge && iter->Valid()) {
+    saver->state = kNotFound;
+    SaveValue(saver, iter->key(), iter->value());
+    iter->Next();
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+static void CountLevelHit(int level) {
+  if (level < kPerfContextNumLevels) {
+    PERF_COUNTER_ADD(get_from_level_count[level], 1);
+  }
+}
+
+// Files of unknown age (see FileMetaData::largest_seqno) are older
+// than all others.  Compaction outputs that stay in level-0 may have
+// larger file numbers than newer files, so file numbers only break ties.
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+  if (a->largest_seqno != b->largest_seqno) {
+    return a->largest_seqno > b->largest_seqno;
+  }
   return a->number > b->number;
 }
 
@@ -293,7 +558,7 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
                                  void* arg,
                                  bool (*func)(void*, int, FileMetaData*)) {
   // TODO(sanjay): Change Version::Get() to use this function.
-  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const Comparator* ucmp = cfd_->icmp_.user_comparator();
 
   // Search level-0 in order from newest to oldest.
   std::vector<FileMetaData*> tmp;
@@ -320,7 +585,7 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
     if (num_files == 0) continue;
 
     // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
+    uint32_t index = FindFile(cfd_->icmp_, files_[level], internal_key);
     if (index < num_files) {
       FileMetaData* f = files_[level][index];
       if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
@@ -336,17 +601,23 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
+                    SequenceNumber covering,
                     std::string* value,
+                    std::deque<std::string>* operands,
                     GetStats* stats) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
-  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const Comparator* ucmp = cfd_->icmp_.user_comparator();
   Status s;
 
   stats->seek_file = NULL;
   stats->seek_file_level = -1;
   FileMetaData* last_file_read = NULL;
   int last_file_read_level = -1;
+  if (range_dels_ != NULL) {
+    covering = std::max(covering, range_dels_->MaxCoveringSequence(
+        user_key, SnapshotOf(k)));
+  }
 
   // We can search level-by-level since entries never hop across
   // levels.  Therefore we are guaranteed that if we find data
@@ -377,7 +648,7 @@ Status Version::Get(const ReadOptions& options,
       num_files = tmp.size();
     } else {
       // Binary search to find earliest index whose largest key >= ikey.
-      uint32_t index = FindFile(vset_->icmp_, files_[level], ikey);
+      uint32_t index = FindFile(cfd_->icmp_, files_[level], ikey);
       if (index >= num_files) {
         files = NULL;
         num_files = 0;
@@ -395,13 +666,17 @@ Status Version::Get(const ReadOptions& options,
     }
 
     for (uint32_t i = 0; i < num_files; ++i) {
+      FileMetaData* f = files[i];
+      if (f->global_seqno > SnapshotOf(k)) {
+        continue;  // Ingested after the snapshot was taken
+      }
+
       if (last_file_read != NULL && stats->seek_file == NULL) {
         // We have had more than one seek for this read.  Charge the 1st file.
         stats->seek_file = last_file_read;
         stats->seek_file_level = last_file_read_level;
       }
 
-      FileMetaData* f = files[i];
       last_file_read = f;
       last_file_read_level = level;
 
@@ -410,17 +685,26 @@ Status Version::Get(const ReadOptions& options,
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
-      s = vset_->table_cache_->Get(options, f->number, f->file_size,
+      saver.operands = operands;
+      saver.covering = covering;
+      saver.global_seqno = f->global_seqno;
+      s = cfd_->table_cache_->Get(options, f->number, f->file_size,
                                    ikey, &saver, SaveValue);
+      if (s.ok() && saver.state == kMerge) {
+        s = SaveOlderEntries(cfd_, options, f, ikey, &saver);
+      }
       if (!s.ok()) {
         return s;
       }
       switch (saver.state) {
         case kNotFound:
+        case kMerge:
           break;      // Keep searching in other files
         case kFound:
+          CountLevelHit(level);
           return s;
         case kDeleted:
+          CountLevelHit(level);
           s = Status::NotFound(Slice());  // Use empty error message for speed
           return s;
         case kCorrupt:
@@ -433,9 +717,204 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+namespace {
+// State of the keys of one Version::MultiGet() call.
+class MultiGetter {
+ public:
+  MultiGetter(const ColumnFamilyData* cfd, const ReadOptions& options,
+              const LookupKey* const* keys, int n,
+              const SequenceNumber* coverings,
+              std::string* const* values,
+              std::deque<std::string>* const* operands,
+              Status* statuses, Version::GetStats* stats,
+              const RangeDelMap* range_dels)
+      : cfd_(cfd),
+        options_(options),
+        keys_(keys),
+        statuses_(statuses),
+        stats_(stats),
+        savers_(n),
+        last_file_read_(n, static_cast<FileMetaData*>(NULL)),
+        last_file_read_level_(n, -1),
+        settled_(n, false) {
+    pending_.reserve(n);
+    for (int i = 0; i < n; i++) {
+      savers_[i].state = kNotFound;
+      savers_[i].ucmp = cfd->user_comparator();
+      savers_[i].user_key = keys[i]->user_key();
+      savers_[i].value = values[i];
+      savers_[i].operands = operands[i];
+      savers_[i].covering = coverings[i];
+      if (range_dels != NULL) {
+        savers_[i].covering = std::max(
+            coverings[i], range_dels->MaxCoveringSequence(
+                keys[i]->user_key(), SnapshotOf(*keys[i])));
+      }
+      statuses_[i] = Status::OK();
+      stats_[i].seek_file = NULL;
+      stats_[i].seek_file_level = -1;
+      pending_.push_back(i);
+    }
+  }
+
+  ~MultiGetter() {
+    for (size_t p = 0; p < pending_.size(); p++) {
+      statuses_[pending_[p]] = Status::NotFound(Slice());
+    }
+  }
+
+  // Keys that have not been found yet, in key order
+  const std::vector<int>& pending() const { return pending_; }
+
+  const LookupKey& key(int i) const { return *keys_[i]; }
+
+  // Look up the keys in "batch", a subsequence of pending(), in file f,
+  // and remove those that this settles from pending().
+  void Lookup(int level, FileMetaData* f, const std::vector<int>& batch) {
+    if (batch.empty() || f->global_seqno > SnapshotOf(*keys_[batch[0]])) {
+      // All keys are looked up in one snapshot, which does not see
+      // files ingested after it was taken.
+      return;
+    }
+    std::vector<Slice> ikeys(batch.size());
+    std::vector<void*> args(batch.size());
+    std::vector<Status> status(batch.size());
+    for (size_t b = 0; b < batch.size(); b++) {
+      const int i = batch[b];
+      if (last_file_read_[i] != NULL && stats_[i].seek_file == NULL) {
+        // More than one seek for this key.  Charge the 1st file.
+        stats_[i].seek_file = last_file_read_[i];
+        stats_[i].seek_file_level = last_file_read_level_[i];
+      }
+      last_file_read_[i] = f;
+      last_file_read_level_[i] = level;
+      savers_[i].state = kNotFound;  // May be kMerge after other files
+      savers_[i].global_seqno = f->global_seqno;
+      ikeys[b] = keys_[i]->internal_key();
+      args[b] = &savers_[i];
+    }
+    cfd_->table_cache()->MultiGet(options_, f->number, f->file_size,
+                                  &ikeys[0], batch.size(), &args[0],
+                                  SaveValue, &status[0]);
+
+    bool any_settled = false;
+    for (size_t b = 0; b < batch.size(); b++) {
+      const int i = batch[b];
+      Saver* saver = &savers_[i];
+      if (status[b].ok() && saver->state == kMerge) {
+        status[b] = SaveOlderEntries(cfd_, options_, f, ikeys[b], saver);
+      }
+      if (!status[b].ok()) {
+        statuses_[i] = status[b];
+      } else if (saver->state == kFound) {
+        // statuses_[i] is already OK
+        CountLevelHit(level);
+      } else if (saver->state == kDeleted) {
+        statuses_[i] = Status::NotFound(Slice());
+        CountLevelHit(level);
+      } else if (saver->state == kCorrupt) {
+        statuses_[i] = Status::Corruption("corrupted key for ",
+                                          saver->user_key);
+      } else {
+        continue;  // Keep searching in other files
+      }
+      settled_[i] = true;
+      any_settled = true;
+    }
+    if (any_settled) {
+      size_t kept = 0;
+      for (size_t p = 0; p < pending_.size(); p++) {
+        if (!settled_[pending_[p]]) {
+          pending_[kept++] = pending_[p];
+        }
+      }
+      pending_.resize(kept);
+    }
+  }
+
+ private:
+  const ColumnFamilyData* const cfd_;
+  const ReadOptions& options_;
+  const LookupKey* const* const keys_;
+  Status* const statuses_;
+  Version::GetStats* const stats_;
+  std::vector<Saver> savers_;
+  std::vector<FileMetaData*> last_file_read_;
+  std::vector<int> last_file_read_level_;
+  std::vector<bool> settled_;
+  std::vector<int> pending_;
+};
+}  // namespace
+
+void Version::MultiGet(const ReadOptions& options,
+                       const LookupKey* const* keys, int n,
+                       const SequenceNumber* coverings,
+                       std::string* const* values,
+                       std::deque<std::string>* const* operands,
+                       Status* statuses, GetStats* stats) {
+  const Comparator* ucmp = cfd_->icmp_.user_comparator();
+  MultiGetter getter(cfd_, options, keys, n, coverings, values, operands,
+                     statuses, stats, range_dels_);
+
+  // As in Get(), search level-by-level, and level-0 files from newest to
+  // oldest, but look up all the keys that a file may hold at once.
+  std::vector<int> batch;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty() || getter.pending().empty()) continue;
+
+    if (level == 0) {
+      std::vector<FileMetaData*> tmp(files);
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (size_t f = 0; f < tmp.size(); f++) {
+        batch.clear();
+        const std::vector<int>& pending = getter.pending();
+        for (size_t p = 0; p < pending.size(); p++) {
+          const Slice user_key = getter.key(pending[p]).user_key();
+          if (ucmp->Compare(user_key, tmp[f]->smallest.user_key()) >= 0 &&
+              ucmp->Compare(user_key, tmp[f]->largest.user_key()) <= 0) {
+            batch.push_back(pending[p]);
+          }
+        }
+        getter.Lookup(level, tmp[f], batch);
+      }
+      continue;
+    }
+
+    // The files of this level are sorted and disjoint, so consecutive
+    // keys fall in the same or later files.  Collect the batches first,
+    // since Lookup() changes pending().
+    std::vector<std::pair<FileMetaData*, std::vector<int> > > batches;
+    const std::vector<int>& pending = getter.pending();
+    size_t p = 0;
+    while (p < pending.size()) {
+      // Binary search to find earliest index whose largest key >= ikey.
+      const Slice ikey = getter.key(pending[p]).internal_key();
+      uint32_t index = FindFile(cfd_->icmp_, files, ikey);
+      if (index >= files.size()) {
+        break;  // This and all later keys are past the last file
+      }
+      FileMetaData* f = files[index];
+      batches.push_back(std::make_pair(f, std::vector<int>()));
+      for (; p < pending.size(); p++) {
+        const LookupKey& k = getter.key(pending[p]);
+        if (cfd_->icmp_.Compare(k.internal_key(), f->largest.Encode()) > 0) {
+          break;
+        }
+        if (ucmp->Compare(k.user_key(), f->smallest.user_key()) >= 0) {
+          batches.back().second.push_back(pending[p]);
+        }
+      }
+    }
+    for (size_t b = 0; b < batches.size(); b++) {
+      getter.Lookup(level, batches[b].first, batches[b].second);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != NULL) {
+  if (f != NULL && !IsUniversal(cfd_)) {
     f->allowed_seeks--;
     if (f->allowed_seeks <= 0 && file_to_compact_ == NULL) {
       file_to_compact_ = f;
@@ -489,7 +968,7 @@ void Version::Ref() {
 }
 
 void Version::Unref() {
-  assert(this != &vset_->dummy_versions_);
+  assert(this != &cfd_->dummy_versions_);
   assert(refs_ >= 1);
   --refs_;
   if (refs_ == 0) {
@@ -500,7 +979,7 @@ void Version::Unref() {
 bool Version::OverlapInLevel(int level,
                              const Slice* smallest_user_key,
                              const Slice* largest_user_key) {
-  return SomeFileOverlapsRange(vset_->icmp_, (level > 0), files_[level],
+  return SomeFileOverlapsRange(cfd_->icmp_, (level > 0), files_[level],
                                smallest_user_key, largest_user_key);
 }
 
@@ -508,6 +987,10 @@ int Version::PickLevelForMemTableOutput(
     const Slice& smallest_user_key,
     const Slice& largest_user_key) {
   int level = 0;
+  if (IsUniversal(cfd_)) {
+    // Every table is a new sorted run
+    return level;
+  }
   if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
@@ -532,6 +1015,22 @@ int Version::PickLevelForMemTableOutput(
   return level;
 }
 
+int Version::PickLevelForIngestedFile(const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) {
+  // Unlike a memtable, an ingested file is usually large and the only
+  // data for its range, so we push it as deep as it goes: compacting it
+  // down later would only rewrite it.
+  int level = 0;
+  if (!IsUniversal(cfd_) &&
+      !OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+    while (level < config::kNumLevels - 1 &&
+           !OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+      level++;
+    }
+  }
+  return level;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(
     int level,
@@ -548,7 +1047,7 @@ void Version::GetOverlappingInputs(
   if (end != NULL) {
     user_end = end->user_key();
   }
-  const Comparator* user_cmp = vset_->icmp_.user_comparator();
+  const Comparator* user_cmp = cfd_->user_comparator();
   for (size_t i = 0; i < files_[level].size(); ) {
     FileMetaData* f = files_[level][i++];
     const Slice file_start = f->smallest.user_key();
@@ -628,18 +1127,18 @@ class VersionSet::Builder {
     FileSet* added_files;
   };
 
-  VersionSet* vset_;
+  ColumnFamilyData* cfd_;
   Version* base_;
   LevelState levels_[config::kNumLevels];
 
  public:
-  // Initialize a builder with the files from *base and other info from *vset
-  Builder(VersionSet* vset, Version* base)
-      : vset_(vset),
+  // Initialize a builder with the files from *base and other info from *cfd
+  Builder(ColumnFamilyData* cfd, Version* base)
+      : cfd_(cfd),
         base_(base) {
     base_->Ref();
     BySmallestKey cmp;
-    cmp.internal_comparator = &vset_->icmp_;
+    cmp.internal_comparator = &cfd_->icmp_;
     for (int level = 0; level < config::kNumLevels; level++) {
       levels_[level].added_files = new FileSet(cmp);
     }
@@ -671,7 +1170,7 @@ class VersionSet::Builder {
     // Update compaction pointers
     for (size_t i = 0; i < edit->compact_pointers_.size(); i++) {
       const int level = edit->compact_pointers_[i].first;
-      vset_->compact_pointer_[level] =
+      cfd_->compact_pointer_[level] =
           edit->compact_pointers_[i].second.Encode().ToString();
     }
 
@@ -715,7 +1214,7 @@ class VersionSet::Builder {
   // Save the current state in *v.
   void SaveTo(Version* v) {
     BySmallestKey cmp;
-    cmp.internal_comparator = &vset_->icmp_;
+    cmp.internal_comparator = &cfd_->icmp_;
     for (int level = 0; level < config::kNumLevels; level++) {
       // Merge the set of added files with the set of pre-existing files.
       // Drop any deleted files.  Store the result in *v.
@@ -749,7 +1248,7 @@ class VersionSet::Builder {
         for (uint32_t i = 1; i < v->files_[level].size(); i++) {
           const InternalKey& prev_end = v->files_[level][i-1]->largest;
           const InternalKey& this_begin = v->files_[level][i]->smallest;
-          if (vset_->icmp_.Compare(prev_end, this_begin) >= 0) {
+          if (cfd_->icmp_.Compare(prev_end, this_begin) >= 0) {
             fprintf(stderr, "overlapping ranges in same level %s vs. %s\n",
                     prev_end.DebugString().c_str(),
                     this_begin.DebugString().c_str());
@@ -768,7 +1267,7 @@ class VersionSet::Builder {
       std::vector<FileMetaData*>* files = &v->files_[level];
       if (level > 0 && !files->empty()) {
         // Must not overlap
-        assert(vset_->icmp_.Compare((*files)[files->size()-1]->largest,
+        assert(cfd_->icmp_.Compare((*files)[files->size()-1]->largest,
                                     f->smallest) < 0);
       }
       f->refs++;
@@ -785,66 +1284,151 @@ VersionSet::VersionSet(const std::string& dbname,
       dbname_(dbname),
       options_(options),
       table_cache_(table_cache),
-      icmp_(*cmp),
       next_file_number_(2),
       manifest_file_number_(0),  // Filled by Recover()
       last_sequence_(0),
-      log_number_(0),
       prev_log_number_(0),
       descriptor_file_(NULL),
       descriptor_log_(NULL),
-      dummy_versions_(this),
-      current_(NULL) {
-  AppendVersion(new Version(this));
+      default_cfd_(new ColumnFamilyData(options, table_cache, *cmp)),
+      max_column_family_(0) {
+  column_families_.push_back(default_cfd_);
+  AppendVersion(default_cfd_, new Version(default_cfd_));
 }
 
 VersionSet::~VersionSet() {
-  current_->Unref();
-  assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    ColumnFamilyData* cfd = column_families_[i];
+    cfd->current_->Unref();
+    cfd->current_ = NULL;
+    delete cfd;
+  }
+  for (size_t i = 0; i < dropped_column_families_.size(); i++) {
+    delete dropped_column_families_[i];
+  }
   delete descriptor_log_;
   delete descriptor_file_;
 }
 
-void VersionSet::AppendVersion(Version* v) {
+void VersionSet::AppendVersion(ColumnFamilyData* cfd, Version* v) {
   // Make "v" current
   assert(v->refs_ == 0);
-  assert(v != current_);
-  if (current_ != NULL) {
-    current_->Unref();
+  assert(v != cfd->current_);
+  if (cfd->current_ != NULL) {
+    cfd->current_->Unref();
   }
-  current_ = v;
+  cfd->current_ = v;
   v->Ref();
 
   // Append to linked list
-  v->prev_ = dummy_versions_.prev_;
-  v->next_ = &dummy_versions_;
+  v->prev_ = cfd->dummy_versions_.prev_;
+  v->next_ = &cfd->dummy_versions_;
   v->prev_->next_ = v;
   v->next_->prev_ = v;
 }
 
+ColumnFamilyData* VersionSet::GetColumnFamily(uint32_t id) const {
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    if (column_families_[i]->id_ == id) {
+      return column_families_[i];
+    }
+  }
+  return NULL;
+}
+
+ColumnFamilyData* VersionSet::GetColumnFamily(const std::string& name) const {
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    if (column_families_[i]->name_ == name) {
+      return column_families_[i];
+    }
+  }
+  return NULL;
+}
+
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
+  ColumnFamilyData* cfd = GetColumnFamily(edit->column_family_);
+  assert(cfd != NULL);
   if (edit->has_log_number_) {
-    assert(edit->log_number_ >= log_number_);
+    assert(edit->log_number_ >= cfd->log_number_);
     assert(edit->log_number_ < next_file_number_);
   } else {
-    edit->SetLogNumber(log_number_);
+    edit->SetLogNumber(cfd->log_number_);
   }
 
   if (!edit->has_prev_log_number_) {
     edit->SetPrevLogNumber(prev_log_number_);
   }
 
-  edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
-
-  Version* v = new Version(this);
+  Version* v = new Version(cfd);
   {
-    Builder builder(this, current_);
+    Builder builder(cfd, cfd->current_);
     builder.Apply(edit);
     builder.SaveTo(v);
   }
   Finalize(v);
 
+  Status s = WriteEdit(edit, mu);
+
+  // Install the new version
+  if (s.ok()) {
+    AppendVersion(cfd, v);
+    cfd->log_number_ = edit->log_number_;
+    prev_log_number_ = edit->prev_log_number_;
+  } else {
+    delete v;
+  }
+  return s;
+}
+
+Status VersionSet::CreateColumnFamily(const std::string& name,
+                                      const Options& options,
+                                      uint64_t log_number,
+                                      port::Mutex* mu,
+                                      ColumnFamilyData** result) {
+  assert(GetColumnFamily(name) == NULL);
+  const uint32_t id = max_column_family_ + 1;
+  VersionEdit edit;
+  edit.SetColumnFamily(id);
+  edit.AddColumnFamily(name);
+  edit.SetComparatorName(options.comparator->Name());
+  edit.SetLogNumber(log_number);
+  Status s = WriteEdit(&edit, mu);
+  if (s.ok()) {
+    max_column_family_ = id;
+    ColumnFamilyData* cfd = new ColumnFamilyData(id, name, options,
+                                                 table_cache_);
+    cfd->log_number_ = log_number;
+    Version* v = new Version(cfd);
+    Finalize(v);
+    AppendVersion(cfd, v);
+    column_families_.push_back(cfd);
+    *result = cfd;
+  }
+  return s;
+}
+
+Status VersionSet::DropColumnFamily(ColumnFamilyData* cfd, port::Mutex* mu) {
+  assert(cfd != default_cfd_);
+  assert(!cfd->dropped_);
+  VersionEdit edit;
+  edit.SetColumnFamily(cfd->id_);
+  edit.DropColumnFamily();
+  Status s = WriteEdit(&edit, mu);
+  if (s.ok()) {
+    cfd->dropped_ = true;
+    cfd->current_->Unref();
+    cfd->current_ = NULL;
+    column_families_.erase(std::find(column_families_.begin(),
+                                     column_families_.end(), cfd));
+    dropped_column_families_.push_back(cfd);
+  }
+  return s;
+}
+
+Status VersionSet::WriteEdit(VersionEdit* edit, port::Mutex* mu) {
+  edit->SetNextFile(next_file_number_);
+  edit->SetLastSequence(last_sequence_);
+
   // Initialize new descriptor log file if necessary by creating
   // a temporary file that contains a snapshot of the current version.
   std::string new_manifest_file;
@@ -896,13 +1480,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     mu->Lock();
   }
 
-  // Install the new version
-  if (s.ok()) {
-    AppendVersion(v);
-    log_number_ = edit->log_number_;
-    prev_log_number_ = edit->prev_log_number_;
-  } else {
-    delete v;
+  if (!s.ok()) {
     if (!new_manifest_file.empty()) {
       delete descriptor_log_;
       delete descriptor_file_;
@@ -915,7 +1493,8 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   return s;
 }
 
-Status VersionSet::Recover() {
+Status VersionSet::Recover(
+    const std::map<std::string, Options>& column_families) {
   struct LogReporter : public log::Reader::Reporter {
     Status* status;
     virtual void Corruption(size_t bytes, const Status& s) {
@@ -947,9 +1526,13 @@ Status VersionSet::Recover() {
   bool have_last_sequence = false;
   uint64_t next_file = 0;
   uint64_t last_sequence = 0;
-  uint64_t log_number = 0;
   uint64_t prev_log_number = 0;
-  Builder builder(this, current_);
+
+  // One builder per column family, indexed by id.  Families that the
+  // caller did not ask for are only tracked by name.
+  std::map<uint32_t, Builder*> builders;
+  std::map<uint32_t, std::string> unopened;
+  builders[0] = new Builder(default_cfd_, default_cfd_->current_);
 
   {
     LogReporter reporter;
@@ -960,22 +1543,75 @@ Status VersionSet::Recover() {
     while (reader.ReadRecord(&record, &scratch) && s.ok()) {
       VersionEdit edit;
       s = edit.DecodeFrom(record);
-      if (s.ok()) {
-        if (edit.has_comparator_ &&
-            edit.comparator_ != icmp_.user_comparator()->Name()) {
+      const uint32_t id = edit.column_family_;
+      if (s.ok() && edit.is_column_family_add_) {
+        if (builders.count(id) > 0 || unopened.count(id) > 0) {
+          s = Status::Corruption("duplicate column family in descriptor");
+        } else {
+          std::map<std::string, Options>::const_iterator it =
+              column_families.find(edit.column_family_name_);
+          if (it == column_families.end()) {
+            unopened[id] = edit.column_family_name_;
+          } else {
+            ColumnFamilyData* cfd = new ColumnFamilyData(
+                id, edit.column_family_name_, it->second, table_cache_);
+            AppendVersion(cfd, new Version(cfd));
+            column_families_.push_back(cfd);
+            builders[id] = new Builder(cfd, cfd->current_);
+          }
+          if (id > max_column_family_) {
+            max_column_family_ = id;
+          }
+        }
+      }
+
+      ColumnFamilyData* cfd = NULL;
+      if (s.ok() && unopened.count(id) == 0) {
+        cfd = GetColumnFamily(id);
+        if (cfd == NULL) {
+          s = Status::Corruption("unknown column family in descriptor");
+        }
+      }
+
+      if (s.ok() && edit.is_column_family_drop_) {
+        if (cfd == default_cfd_) {
+          s = Status::Corruption("default column family dropped");
+        } else if (cfd == NULL) {
+          unopened.erase(id);
+        } else {
+          delete builders[id];
+          builders.erase(id);
+          cfd->current_->Unref();
+          cfd->current_ = NULL;
+          column_families_.erase(std::find(column_families_.begin(),
+                                           column_families_.end(), cfd));
+          delete cfd;
+          cfd = NULL;
+        }
+      }
+
+      if (s.ok() && cfd != NULL) {
+        const Comparator* ucmp = cfd->icmp_.user_comparator();
+        if (edit.has_comparator_ && edit.comparator_ != ucmp->Name()) {
           s = Status::InvalidArgument(
               edit.comparator_ + " does not match existing comparator ",
-              icmp_.user_comparator()->Name());
+              ucmp->Name());
         }
       }
 
-      if (s.ok()) {
-        builder.Apply(&edit);
+      if (s.ok() && cfd != NULL) {
+        builders[id]->Apply(&edit);
+        if (edit.has_log_number_) {
+          cfd->log_number_ = edit.log_number_;
+          if (cfd == default_cfd_) {
+            have_log_number = true;
+          }
+        }
       }
 
-      if (edit.has_log_number_) {
-        log_number = edit.log_number_;
-        have_log_number = true;
+      if (edit.has_max_column_family_ &&
+          edit.max_column_family_ > max_column_family_) {
+        max_column_family_ = edit.max_column_family_;
       }
 
       if (edit.has_prev_log_number_) {
@@ -1011,25 +1647,137 @@ Status VersionSet::Recover() {
     }
 
     MarkFileNumberUsed(prev_log_number);
-    MarkFileNumberUsed(log_number);
+    for (size_t i = 0; i < column_families_.size(); i++) {
+      MarkFileNumberUsed(column_families_[i]->log_number_);
+    }
+  }
+
+  if (s.ok() && !unopened.empty()) {
+    s = Status::InvalidArgument("column family not opened",
+                                unopened.begin()->second);
   }
 
   if (s.ok()) {
-    Version* v = new Version(this);
-    builder.SaveTo(v);
-    // Install recovered version
-    Finalize(v);
-    AppendVersion(v);
+    for (size_t i = 0; i < column_families_.size(); i++) {
+      ColumnFamilyData* cfd = column_families_[i];
+      Version* v = new Version(cfd);
+      builders[cfd->id_]->SaveTo(v);
+      EstimateCreationTimes(v);
+      // Install recovered version
+      Finalize(v);
+      AppendVersion(cfd, v);
+    }
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
     last_sequence_ = last_sequence;
-    log_number_ = log_number;
     prev_log_number_ = prev_log_number;
   }
 
+  for (std::map<uint32_t, Builder*>::iterator it = builders.begin();
+       it != builders.end(); ++it) {
+    delete it->second;
+  }
+  return s;
+}
+
+Status VersionSet::ListColumnFamilies(Env* env, const std::string& dbname,
+                                      std::vector<std::string>* result) {
+  struct LogReporter : public log::Reader::Reporter {
+    Status* status;
+    virtual void Corruption(size_t bytes, const Status& s) {
+      if (this->status->ok()) *this->status = s;
+    }
+  };
+
+  result->clear();
+  std::string current;
+  Status s = ReadFileToString(env, CurrentFileName(dbname), &current);
+  if (!s.ok()) {
+    return s;
+  }
+  if (current.empty() || current[current.size()-1] != '\n') {
+    return Status::Corruption("CURRENT file does not end with newline");
+  }
+  current.resize(current.size() - 1);
+
+  SequentialFile* file;
+  s = env->NewSequentialFile(dbname + "/" + current, &file);
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::map<uint32_t, std::string> names;
+  names[0] = kDefaultColumnFamilyName;
+  {
+    LogReporter reporter;
+    reporter.status = &s;
+    log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/);
+    Slice record;
+    std::string scratch;
+    while (reader.ReadRecord(&record, &scratch) && s.ok()) {
+      VersionEdit edit;
+      s = edit.DecodeFrom(record);
+      if (s.ok() && edit.is_column_family_add_) {
+        names[edit.column_family_] = edit.column_family_name_;
+      } else if (s.ok() && edit.is_column_family_drop_) {
+        names.erase(edit.column_family_);
+      }
+    }
+  }
+  delete file;
+
+  if (s.ok()) {
+    for (std::map<uint32_t, std::string>::const_iterator it = names.begin();
+         it != names.end(); ++it) {
+      result->push_back(it->second);
+    }
+  }
   return s;
 }
 
+bool VersionSet::ReadColumnFamilyLayout(
+    Env* env, const std::string& fname,
+    std::map<uint32_t, std::string>* names,
+    std::map<uint64_t, uint32_t>* file_families,
+    uint32_t* max_column_family) {
+  struct LogReporter : public log::Reader::Reporter {
+    virtual void Corruption(size_t bytes, const Status& s) { }
+  };
+
+  SequentialFile* file;
+  if (!env->NewSequentialFile(fname, &file).ok()) {
+    return false;
+  }
+  bool found = false;
+  LogReporter reporter;
+  log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/);
+  Slice record;
+  std::string scratch;
+  while (reader.ReadRecord(&record, &scratch)) {
+    VersionEdit edit;
+    if (!edit.DecodeFrom(record).ok()) {
+      continue;
+    }
+    found = true;
+    const uint32_t id = edit.column_family_;
+    if (edit.is_column_family_add_) {
+      (*names)[id] = edit.column_family_name_;
+    } else if (edit.is_column_family_drop_) {
+      names->erase(id);
+    }
+    *max_column_family = std::max(*max_column_family, id);
+    if (edit.has_max_column_family_) {
+      *max_column_family = std::max(*max_column_family,
+                                    edit.max_column_family_);
+    }
+    for (size_t i = 0; i < edit.new_files_.size(); i++) {
+      (*file_families)[edit.new_files_[i].second.number] = id;
+    }
+  }
+  delete file;
+  return found;
+}
+
 void VersionSet::MarkFileNumberUsed(uint64_t number) {
   if (next_file_number_ <= number) {
     next_file_number_ = number + 1;
@@ -1037,6 +1785,33 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
+  std::vector<RangeTombstone> tombstones;
+  v->AddRangeTombstones(&tombstones);
+  if (!tombstones.empty()) {
+    v->range_dels_ = new RangeDelMap(v->cfd_->user_comparator(), tombstones);
+  }
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < v->files_[level].size(); i++) {
+      v->oldest_creation_time_ = std::min(v->oldest_creation_time_,
+                                          v->files_[level][i]->creation_time);
+    }
+  }
+
+  if (IsUniversal(v->cfd_)) {
+    // Only the number of runs in level-0 matters, and getting it back
+    // under the trigger takes rewriting roughly all of them.
+    const int runs = v->files_[0].size();
+    v->compaction_level_ = 0;
+    v->compaction_score_ =
+        runs / static_cast<double>(config::kL0_CompactionTrigger);
+    for (int level = 0; level < config::kNumLevels; level++) {
+      v->compaction_scores_[level] = (level == 0) ? v->compaction_score_ : 0;
+    }
+    v->compaction_debt_ = (runs >= config::kL0_CompactionTrigger) ?
+        TotalFileSize(v->files_[0]) : 0;
+    return;
+  }
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
@@ -1063,6 +1838,7 @@ void VersionSet::Finalize(Version* v) {
       score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
     }
 
+    v->compaction_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1071,56 +1847,161 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate the compaction debt.  Once level-0 reaches its trigger,
+  // compacting it rewrites all of it along with the level-1 files it
+  // overlaps, which we take to be all of them.  Each later level that
+  // is over its limit, counting the bytes about to be pushed into it
+  // from above, must push the excess down and rewrite the part of the
+  // next level that it overlaps, assumed to be proportional to the
+  // relative sizes of the two levels.
+  double debt = 0;
+  double incoming = 0;
+  const int level0_files = v->files_[0].size();
+  if (level0_files >= config::kL0_CompactionTrigger) {
+    incoming = TotalFileSize(v->files_[0]);
+    debt += incoming + TotalFileSize(v->files_[1]);
+  }
+  for (int level = 1; level < config::kNumLevels-1; level++) {
+    const double level_bytes = TotalFileSize(v->files_[level]) + incoming;
+    const double excess = level_bytes - MaxBytesForLevel(level);
+    incoming = 0;
+    if (excess > 0) {
+      const double next_bytes = TotalFileSize(v->files_[level+1]);
+      debt += excess * (1 + next_bytes / level_bytes);
+      incoming = excess;
+    }
+  }
+  v->compaction_debt_ = static_cast<uint64_t>(debt);
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
 
-  // Save metadata
-  VersionEdit edit;
-  edit.SetComparatorName(icmp_.user_comparator()->Name());
+  // One record per column family, the default one first
+  Status s;
+  for (size_t f = 0; s.ok() && f < column_families_.size(); f++) {
+    const ColumnFamilyData* cfd = column_families_[f];
+
+    // Save metadata
+    VersionEdit edit;
+    edit.SetColumnFamily(cfd->id_);
+    if (cfd != default_cfd_) {
+      edit.AddColumnFamily(cfd->name_);
+    } else if (max_column_family_ > 0) {
+      edit.SetMaxColumnFamily(max_column_family_);
+    }
+    edit.SetComparatorName(cfd->icmp_.user_comparator()->Name());
+    edit.SetLogNumber(cfd->log_number_);
 
-  // Save compaction pointers
-  for (int level = 0; level < config::kNumLevels; level++) {
-    if (!compact_pointer_[level].empty()) {
-      InternalKey key;
-      key.DecodeFrom(compact_pointer_[level]);
-      edit.SetCompactPointer(level, key);
+    // Save compaction pointers
+    for (int level = 0; level < config::kNumLevels; level++) {
+      if (!cfd->compact_pointer_[level].empty()) {
+        InternalKey key;
+        key.DecodeFrom(cfd->compact_pointer_[level]);
+        edit.SetCompactPointer(level, key);
+      }
+    }
+
+    // Save files
+    for (int level = 0; level < config::kNumLevels; level++) {
+      const std::vector<FileMetaData*>& files = cfd->current_->files_[level];
+      for (size_t i = 0; i < files.size(); i++) {
+        edit.AddFile(level, *files[i]);
+      }
     }
+
+    std::string record;
+    edit.EncodeTo(&record);
+    s = log->AddRecord(record);
   }
+  return s;
+}
 
-  // Save files
-  for (int level = 0; level < config::kNumLevels; level++) {
-    const std::vector<FileMetaData*>& files = current_->files_[level];
-    for (size_t i = 0; i < files.size(); i++) {
-      const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+int VersionSet::MaxLevel0Files() const {
+  int result = 0;
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    const int files = column_families_[i]->current_->files_[0].size();
+    if (files > result) {
+      result = files;
     }
   }
+  return result;
+}
 
-  std::string record;
-  edit.EncodeTo(&record);
-  return log->AddRecord(record);
+uint64_t VersionSet::EstimatedCompactionDebt() const {
+  uint64_t result = 0;
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    result += column_families_[i]->current_->compaction_debt_;
+  }
+  return result;
 }
 
-int VersionSet::NumLevelFiles(int level) const {
-  assert(level >= 0);
-  assert(level < config::kNumLevels);
-  return current_->files_[level].size();
+uint64_t VersionSet::LogNumber() const {
+  uint64_t result = column_families_[0]->log_number_;
+  for (size_t i = 1; i < column_families_.size(); i++) {
+    if (column_families_[i]->log_number_ < result) {
+      result = column_families_[i]->log_number_;
+    }
+  }
+  return result;
+}
+
+bool VersionSet::NeedsCompaction() const {
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    const Version* v = column_families_[i]->current_;
+    if ((v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL) ||
+        NeedsPeriodicCompaction(column_families_[i])) {
+      return true;
+    }
+  }
+  return false;
 }
 
-const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
+bool VersionSet::NeedsPeriodicCompaction(const ColumnFamilyData* cfd) const {
+  const uint64_t period = cfd->options().periodic_compaction_seconds;
+  const uint64_t oldest = cfd->current_->oldest_creation_time_;
+  if (period == 0 || oldest == ~static_cast<uint64_t>(0)) {
+    return false;
+  }
+  return oldest + period <= env_->NowMicros() / 1000000;
+}
+
+void VersionSet::EstimateCreationTimes(Version* v) {
+  const uint64_t period = v->cfd_->options().periodic_compaction_seconds;
+  if (period == 0) {
+    return;
+  }
+  const uint64_t now = env_->NowMicros() / 1000000;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < v->files_[level].size(); i++) {
+      FileMetaData* f = v->files_[level][i];
+      if (f->creation_time == 0) {
+        // Hash the file number so that consecutive files do not all
+        // come due together.
+        char buf[8];
+        EncodeFixed64(buf, f->number);
+        const uint64_t age = Hash(buf, sizeof(buf), 0) % period;
+        f->creation_time = (now > age) ? now - age : 1;
+      }
+    }
+  }
+}
+
+const char* VersionSet::LevelSummary(const ColumnFamilyData* cfd,
+                                     LevelSummaryStorage* scratch) const {
   // Update code if kNumLevels changes
   assert(config::kNumLevels == 7);
+  const Version* current = cfd->current_;
   snprintf(scratch->buffer, sizeof(scratch->buffer),
            "files[ %d %d %d %d %d %d %d ]",
-           int(current_->files_[0].size()),
-           int(current_->files_[1].size()),
-           int(current_->files_[2].size()),
-           int(current_->files_[3].size()),
-           int(current_->files_[4].size()),
-           int(current_->files_[5].size()),
-           int(current_->files_[6].size()));
+           int(current->files_[0].size()),
+           int(current->files_[1].size()),
+           int(current->files_[2].size()),
+           int(current->files_[3].size()),
+           int(current->files_[4].size()),
+           int(current->files_[5].size()),
+           int(current->files_[6].size()));
   return scratch->buffer;
 }
 
@@ -1150,14 +2031,15 @@ bool VersionSet::ManifestContains(const std::string& record) const {
 }
 
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
+  const InternalKeyComparator& icmp = v->cfd_->icmp_;
   uint64_t result = 0;
   for (int level = 0; level < config::kNumLevels; level++) {
     const std::vector<FileMetaData*>& files = v->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
-      if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
+      if (icmp.Compare(files[i]->largest, ikey) <= 0) {
         // Entire file is before "ikey", so just add the file size
         result += files[i]->file_size;
-      } else if (icmp_.Compare(files[i]->smallest, ikey) > 0) {
+      } else if (icmp.Compare(files[i]->smallest, ikey) > 0) {
         // Entire file is after "ikey", so ignore
         if (level > 0) {
           // Files other than level 0 are sorted by meta->smallest, so
@@ -1169,7 +2051,7 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
         Table* tableptr;
-        Iterator* iter = table_cache_->NewIterator(
+        Iterator* iter = v->cfd_->table_cache_->NewIterator(
             ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
         if (tableptr != NULL) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
@@ -1182,32 +2064,74 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
 }
 
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
-  for (Version* v = dummy_versions_.next_;
-       v != &dummy_versions_;
-       v = v->next_) {
-    for (int level = 0; level < config::kNumLevels; level++) {
-      const std::vector<FileMetaData*>& files = v->files_[level];
-      for (size_t i = 0; i < files.size(); i++) {
-        live->insert(files[i]->number);
+  // Versions of dropped column families may still be used by iterators
+  std::vector<ColumnFamilyData*> all(column_families_);
+  all.insert(all.end(), dropped_column_families_.begin(),
+             dropped_column_families_.end());
+  for (size_t f = 0; f < all.size(); f++) {
+    const Version* dummy_versions = &all[f]->dummy_versions_;
+    for (Version* v = dummy_versions->next_;
+         v != dummy_versions;
+         v = v->next_) {
+      for (int level = 0; level < config::kNumLevels; level++) {
+        const std::vector<FileMetaData*>& files = v->files_[level];
+        for (size_t i = 0; i < files.size(); i++) {
+          live->insert(files[i]->number);
+        }
       }
     }
   }
 }
 
-int64_t VersionSet::NumLevelBytes(int level) const {
+int64_t Version::NumLevelBytes(int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
-  return TotalFileSize(current_->files_[level]);
+  return TotalFileSize(files_[level]);
+}
+
+void Version::GetFilesInDeletedRanges(
+    SequenceNumber snapshot,
+    std::vector< std::pair<int, FileMetaData*> >* result) const {
+  if (range_dels_ == NULL) {
+    return;
+  }
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < files_[level].size(); i++) {
+      FileMetaData* f = files_[level][i];
+      // Files that hold range deletions are kept for the entries of
+      // other files that those delete, and files of unknown age are
+      // kept too.
+      if (f->being_compacted || f->largest_seqno == 0 ||
+          !f->range_dels.empty()) {
+        continue;
+      }
+      if (range_dels_->MinCoveringSequence(f->smallest.user_key(),
+                                           f->largest.user_key(),
+                                           snapshot) > f->largest_seqno) {
+        result->push_back(std::make_pair(level, f));
+      }
+    }
+  }
+}
+
+void Version::AddRangeTombstones(std::vector<RangeTombstone>* result) const {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < files_[level].size(); i++) {
+      const std::vector<RangeTombstone>& r = files_[level][i]->range_dels;
+      result->insert(result->end(), r.begin(), r.end());
+    }
+  }
 }
 
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
+  Version* current = default_cfd_->current_;
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
   for (int level = 1; level < config::kNumLevels - 1; level++) {
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      const FileMetaData* f = current_->files_[level][i];
-      current_->GetOverlappingInputs(level+1, &f->smallest, &f->largest,
-                                     &overlaps);
+    for (size_t i = 0; i < current->files_[level].size(); i++) {
+      const FileMetaData* f = current->files_[level][i];
+      current->GetOverlappingInputs(level+1, &f->smallest, &f->largest,
+                                    &overlaps);
       const int64_t sum = TotalFileSize(overlaps);
       if (sum > result) {
         result = sum;
@@ -1220,7 +2144,8 @@ int64_t VersionSet::MaxNextLevelOverlappingBytes() {
 // Stores the minimal range that covers all entries in inputs in
 // *smallest, *largest.
 // REQUIRES: inputs is not empty
-void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
+void VersionSet::GetRange(const InternalKeyComparator& icmp,
+                          const std::vector<FileMetaData*>& inputs,
                           InternalKey* smallest,
                           InternalKey* largest) {
   assert(!inputs.empty());
@@ -1232,10 +2157,10 @@ void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
       *smallest = f->smallest;
       *largest = f->largest;
     } else {
-      if (icmp_.Compare(f->smallest, *smallest) < 0) {
+      if (icmp.Compare(f->smallest, *smallest) < 0) {
         *smallest = f->smallest;
       }
-      if (icmp_.Compare(f->largest, *largest) > 0) {
+      if (icmp.Compare(f->largest, *largest) > 0) {
         *largest = f->largest;
       }
     }
@@ -1245,19 +2170,22 @@ void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
 // Stores the minimal range that covers all entries in inputs1 and inputs2
 // in *smallest, *largest.
 // REQUIRES: inputs is not empty
-void VersionSet::GetRange2(const std::vector<FileMetaData*>& inputs1,
+void VersionSet::GetRange2(const InternalKeyComparator& icmp,
+                           const std::vector<FileMetaData*>& inputs1,
                            const std::vector<FileMetaData*>& inputs2,
                            InternalKey* smallest,
                            InternalKey* largest) {
   std::vector<FileMetaData*> all = inputs1;
   all.insert(all.end(), inputs2.begin(), inputs2.end());
-  GetRange(all, smallest, largest);
+  GetRange(icmp, all, smallest, largest);
 }
 
 Iterator* VersionSet::MakeInputIterator(Compaction* c) {
+  ColumnFamilyData* cfd = c->cfd_;
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.rate_limiter = options_->rate_limiter;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1270,103 +2198,320 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+          list[num++] = NewFileIterator(cfd, options, files[i]->number,
+                                        files[i]->file_size,
+                                        files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            new Version::LevelFileNumIterator(cfd->icmp_, &c->inputs_[which]),
+            &GetFileIterator, cfd, options);
       }
     }
   }
   assert(num <= space);
-  Iterator* result = NewMergingIterator(&icmp_, list, num);
+  Iterator* result = NewMergingIterator(&cfd->icmp_, list, num);
   delete[] list;
   return result;
 }
 
+// Returns true iff some file in "files" is an input of a running compaction.
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool VersionSet::ByCompactionScore(const ColumnFamilyData* a,
+                                   const ColumnFamilyData* b) {
+  return a->current_->compaction_score_ > b->current_->compaction_score_;
+}
+
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  // Try the column families with the most urgent compactions first
+  std::vector<ColumnFamilyData*> families(column_families_);
+  std::stable_sort(families.begin(), families.end(), ByCompactionScore);
+  for (size_t i = 0; i < families.size(); i++) {
+    Compaction* c = PickCompaction(families[i]);
+    if (c != NULL) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+Compaction* VersionSet::PickCompaction(ColumnFamilyData* cfd) {
+  if (IsUniversal(cfd)) {
+    Compaction* c = PickUniversalCompaction(cfd);
+    return (c != NULL) ? c : PickPeriodicCompaction(cfd);
+  }
+  Version* current = cfd->current_;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != NULL);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+  // the compactions triggered by seeks.  Levels are tried in decreasing
+  // order of score: if the inputs picked for the most urgent level are
+  // already being compacted by another thread, we try the next level.
+  const double* scores = current->compaction_scores_;
+  bool tried[config::kNumLevels] = { false };
+  while (true) {
+    int level = -1;
+    for (int l = 0; l < config::kNumLevels - 1; l++) {
+      if (!tried[l] && scores[l] >= 1 &&
+          (level < 0 || scores[l] > scores[level])) {
+        level = l;
+      }
+    }
+    if (level < 0) {
+      break;
+    }
+    tried[level] = true;
+
+    // Pick the first unclaimed file that comes after compact_pointer_[level],
+    // wrapping around to the beginning of the key space if necessary.
+    const std::vector<FileMetaData*>& files = current->files_[level];
+    size_t start = 0;
+    if (!cfd->compact_pointer_[level].empty()) {
+      while (start < files.size() &&
+             cfd->icmp_.Compare(files[start]->largest.Encode(),
+                                cfd->compact_pointer_[level]) <= 0) {
+        start++;
+      }
+    }
+    for (size_t n = 0; n < files.size(); n++) {
+      FileMetaData* f = files[(start + n) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = new Compaction(cfd, level);
+      c->inputs_[0].push_back(f);
+      if (SetupPickedInputs(c)) {
+        return c;
+      }
+      delete c;
+      if (level == 0) {
+        // Every level-0 file overlaps the same set of candidates
         break;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+
+  FileMetaData* f = current->file_to_compact_;
+  if (f != NULL && !f->being_compacted) {
+    Compaction* c = new Compaction(cfd, current->file_to_compact_level_);
+    c->inputs_[0].push_back(f);
+    if (SetupPickedInputs(c)) {
+      return c;
+    }
+    delete c;
+  }
+  return PickPeriodicCompaction(cfd);
+}
+
+Compaction* VersionSet::PickPeriodicCompaction(ColumnFamilyData* cfd) {
+  if (!NeedsPeriodicCompaction(cfd)) {
+    return NULL;
+  }
+  Version* current = cfd->current_;
+  const uint64_t now = env_->NowMicros() / 1000000;
+  const uint64_t period = cfd->options().periodic_compaction_seconds;
+  FileMetaData* oldest = NULL;
+  int level = -1;
+  for (int l = 0; l < config::kNumLevels; l++) {
+    const std::vector<FileMetaData*>& files = current->files_[l];
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (!f->being_compacted && f->creation_time + period <= now &&
+          (oldest == NULL || f->creation_time < oldest->creation_time)) {
+        oldest = f;
+        level = l;
+      }
+    }
+  }
+  if (oldest == NULL) {
+    return NULL;
+  }
+
+  Compaction* c = NULL;
+  if (level == 0 && IsUniversal(cfd)) {
+    // Rewrite the run by itself; it keeps its place among the others
+    const std::vector<FileMetaData*>& runs = current->files_[0];
+    if (AnyBeingCompacted(runs)) {
+      return NULL;
+    }
+    bool older_runs_remain = false;
+    for (size_t i = 0; i < runs.size(); i++) {
+      if (runs[i] != oldest && (oldest->largest_seqno == 0 ||
+                                runs[i]->largest_seqno <=
+                                oldest->largest_seqno)) {
+        older_runs_remain = true;
+      }
+    }
+    std::vector<FileMetaData*> inputs(1, oldest);
+    c = NewUniversalCompaction(cfd, inputs, older_runs_remain);
+  } else if (level == 0) {
+    // Other level-0 files may hold older entries for its keys
+    c = new Compaction(cfd, level);
+    c->inputs_[0].push_back(oldest);
+    if (!SetupPickedInputs(c)) {
+      delete c;
+      return NULL;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
   } else {
+    // No other file of the level overlaps it
+    c = new Compaction(cfd, level);
+    c->output_level_ = level;
+    c->inputs_[0].push_back(oldest);
+    c->input_version_ = current;
+    c->input_version_->Ref();
+    c->MarkInputsBeingCompacted(true);
+  }
+  Log(options_->info_log, "Periodic compaction of #%llu at level-%d",
+      static_cast<unsigned long long>(oldest->number), level);
+  return c;
+}
+
+Compaction* VersionSet::PickUniversalCompaction(ColumnFamilyData* cfd) {
+  // Only one merge of a column family runs at a time, so that the runs
+  // of every merge are adjacent in age and its output can take their
+  // place in the order of the runs.
+  std::vector<FileMetaData*> runs(cfd->current_->files_[0]);
+  const size_t n = runs.size();
+  if (n < static_cast<size_t>(config::kL0_CompactionTrigger) ||
+      AnyBeingCompacted(runs)) {
     return NULL;
   }
+  std::sort(runs.begin(), runs.end(), NewestFirst);
+
+  const Options& options = cfd->options();
+  bool known_age = true;
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i < n; i++) {
+    known_age = known_age && (runs[i]->largest_seqno != 0);
+    if (i + 1 < n) {
+      newer_bytes += runs[i]->file_size;
+    }
+  }
+
+  // Merge the runs in [first,limit)
+  size_t first = 0;
+  size_t limit = n;
+  const char* reason = NULL;
+  if (!known_age) {
+    // The output would be ordered after all remaining runs of unknown
+    // age, whatever their actual age
+    reason = "runs of unknown age";
+  } else if (newer_bytes * 100 >= runs[n - 1]->file_size *
+             options.universal_max_size_amplification_percent) {
+    reason = "size amplification";
+  } else {
+    const size_t min_width = options.universal_min_merge_width;
+    const size_t max_width = (options.universal_max_merge_width > 0) ?
+        options.universal_max_merge_width : n;
+    const uint64_t ratio = options.universal_size_ratio;
+    for (size_t start = 0; reason == NULL && start + min_width <= n;
+         start++) {
+      uint64_t candidate_bytes = runs[start]->file_size;
+      size_t end = start + 1;
+      while (end < n && end - start < max_width &&
+             candidate_bytes * (100 + ratio) / 100 >= runs[end]->file_size) {
+        candidate_bytes += runs[end]->file_size;
+        end++;
+      }
+      if (end - start >= min_width) {
+        first = start;
+        limit = end;
+        reason = "size ratio";
+      }
+    }
+    if (reason == NULL) {
+      // Merge just enough of the newest runs to get below the trigger
+      limit = n - config::kL0_CompactionTrigger + 2;
+      reason = "run count";
+    }
+  }
 
-  c->input_version_ = current_;
+  Log(options_->info_log, "Universal compaction of %d of %d runs: %s",
+      static_cast<int>(limit - first), static_cast<int>(n), reason);
+  std::vector<FileMetaData*> inputs(runs.begin() + first,
+                                    runs.begin() + limit);
+  return NewUniversalCompaction(cfd, inputs, limit < n);
+}
+
+Compaction* VersionSet::NewUniversalCompaction(
+    ColumnFamilyData* cfd,
+    const std::vector<FileMetaData*>& inputs,
+    bool older_runs_remain) {
+  Compaction* c = new Compaction(cfd, 0);
+  c->output_level_ = 0;
+  c->max_output_file_size_ = ~static_cast<uint64_t>(0);
+  c->older_runs_remain_ = older_runs_remain;
+  c->inputs_[0] = inputs;
+  c->input_version_ = cfd->current_;
   c->input_version_->Ref();
+  c->MarkInputsBeingCompacted(true);
+  return c;
+}
+
+bool VersionSet::SetupPickedInputs(Compaction* c) {
+  Version* current = c->cfd_->current_;
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
-  if (level == 0) {
+  if (c->level() == 0) {
     InternalKey smallest, largest;
-    GetRange(c->inputs_[0], &smallest, &largest);
+    GetRange(c->cfd_->icmp_, c->inputs_[0], &smallest, &largest);
     // Note that the next call will discard the file we placed in
     // c->inputs_[0] earlier and replace it with an overlapping set
     // which will include the picked file.
-    current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
+    current->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
     assert(!c->inputs_[0].empty());
   }
 
-  SetupOtherInputs(c);
-
-  return c;
+  if (AnyBeingCompacted(c->inputs_[0]) || !SetupOtherInputs(c)) {
+    return false;
+  }
+  c->input_version_ = current;
+  c->input_version_->Ref();
+  c->MarkInputsBeingCompacted(true);
+  return true;
 }
 
-void VersionSet::SetupOtherInputs(Compaction* c) {
+bool VersionSet::SetupOtherInputs(Compaction* c) {
+  ColumnFamilyData* cfd = c->cfd_;
+  const InternalKeyComparator& icmp = cfd->icmp_;
+  Version* current = cfd->current_;
   const int level = c->level();
   InternalKey smallest, largest;
-  GetRange(c->inputs_[0], &smallest, &largest);
+  GetRange(icmp, c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level+1, &smallest, &largest, &c->inputs_[1]);
+  current->GetOverlappingInputs(level+1, &smallest, &largest, &c->inputs_[1]);
+  if (AnyBeingCompacted(c->inputs_[1])) {
+    return false;
+  }
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
-  GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+  GetRange2(icmp, c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
   // changing the number of "level+1" files we pick up.
   if (!c->inputs_[1].empty()) {
     std::vector<FileMetaData*> expanded0;
-    current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
+    current->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
     const int64_t inputs0_size = TotalFileSize(c->inputs_[0]);
     const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
-        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit) {
+        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
-      GetRange(expanded0, &new_start, &new_limit);
+      GetRange(icmp, expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level+1, &new_start, &new_limit,
-                                     &expanded1);
+      current->GetOverlappingInputs(level+1, &new_start, &new_limit,
+                                    &expanded1);
       if (expanded1.size() == c->inputs_[1].size()) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
@@ -1381,7 +2526,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
         largest = new_limit;
         c->inputs_[0] = expanded0;
         c->inputs_[1] = expanded1;
-        GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+        GetRange2(icmp, c->inputs_[0], c->inputs_[1],
+                  &all_start, &all_limit);
       }
     }
   }
@@ -1389,8 +2535,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
   if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
-                                   &c->grandparents_);
+    current->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+                                  &c->grandparents_);
   }
 
   if (false) {
@@ -1404,16 +2550,27 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // We update this immediately instead of waiting for the VersionEdit
   // to be applied so that if the compaction fails, we will try a different
   // key range next time.
-  compact_pointer_[level] = largest.Encode().ToString();
+  cfd->compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+  return true;
 }
 
 Compaction* VersionSet::CompactRange(
+    ColumnFamilyData* cfd,
     int level,
     const InternalKey* begin,
     const InternalKey* end) {
+  Version* current = cfd->current_;
+  if (IsUniversal(cfd) && level == 0) {
+    // The runs are not split by key range: merge all of them into one
+    const std::vector<FileMetaData*>& runs = current->files_[0];
+    if (runs.empty() || AnyBeingCompacted(runs)) {
+      return NULL;
+    }
+    return NewUniversalCompaction(cfd, runs, false);
+  }
   std::vector<FileMetaData*> inputs;
-  current_->GetOverlappingInputs(level, begin, end, &inputs);
+  current->GetOverlappingInputs(level, begin, end, &inputs);
   if (inputs.empty()) {
     return NULL;
   }
@@ -1435,37 +2592,46 @@ Compaction* VersionSet::CompactRange(
     }
   }
 
-  Compaction* c = new Compaction(level);
-  c->input_version_ = current_;
-  c->input_version_->Ref();
+  Compaction* c = new Compaction(cfd, level);
   c->inputs_[0] = inputs;
-  SetupOtherInputs(c);
+  if (AnyBeingCompacted(c->inputs_[0]) || !SetupOtherInputs(c)) {
+    // The DB only runs a manual compaction while no other compaction
+    // is running, so this is not expected to happen.
+    delete c;
+    return NULL;
+  }
+  c->input_version_ = current;
+  c->input_version_->Ref();
+  c->MarkInputsBeingCompacted(true);
   return c;
 }
 
-Compaction::Compaction(int level)
-    : level_(level),
+Compaction::Compaction(ColumnFamilyData* cfd, int level)
+    : cfd_(cfd),
+      level_(level),
+      output_level_(level + 1),
       max_output_file_size_(MaxFileSizeForLevel(level)),
+      older_runs_remain_(false),
       input_version_(NULL),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
+  edit_.SetColumnFamily(cfd->id());
   for (int i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
 }
 
 Compaction::~Compaction() {
-  if (input_version_ != NULL) {
-    input_version_->Unref();
-  }
+  ReleaseInputs();
 }
 
 bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 &&
+  return (output_level_ != level_ &&
+          num_input_files(0) == 1 &&
           num_input_files(1) == 0 &&
           TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes);
 }
@@ -1479,9 +2645,12 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+  if (older_runs_remain_) {
+    return false;
+  }
   // Maybe use binary search to find right entry instead of linear search?
-  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  const Comparator* user_cmp = cfd_->user_comparator();
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     for (; level_ptrs_[lvl] < files.size(); ) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -1499,9 +2668,31 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsRangeDeletionObsolete(const Slice& begin,
+                                         const Slice& end) const {
+  const Comparator* user_cmp = cfd_->user_comparator();
+  for (int lvl = 0; lvl < config::kNumLevels; lvl++) {
+    const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (user_cmp->Compare(f->smallest.user_key(), end) >= 0 ||
+          user_cmp->Compare(f->largest.user_key(), begin) < 0) {
+        continue;  // Outside of the range
+      }
+      if (std::find(inputs_[0].begin(), inputs_[0].end(), f) ==
+              inputs_[0].end() &&
+          std::find(inputs_[1].begin(), inputs_[1].end(), f) ==
+              inputs_[1].end()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   // Scan to find earliest grandparent file that contains key.
-  const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
+  const InternalKeyComparator* icmp = &cfd_->internal_comparator();
   while (grandparent_index_ < grandparents_.size() &&
       icmp->Compare(internal_key,
                     grandparents_[grandparent_index_]->largest.Encode()) > 0) {
@@ -1521,8 +2712,71 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   }
 }
 
+namespace {
+struct BySmallestUserKey {
+  const Comparator* ucmp;
+  bool operator()(FileMetaData* a, FileMetaData* b) const {
+    return ucmp->Compare(a->smallest.user_key(), b->smallest.user_key()) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetSplitPoints(int n, std::vector<Slice>* boundaries) const {
+  boundaries->clear();
+  std::vector<FileMetaData*> files(inputs_[0]);
+  files.insert(files.end(), inputs_[1].begin(), inputs_[1].end());
+  if (n <= 1 || files.size() <= 1 || output_level_ == level_) {
+    // The output of a universal compaction is a single run
+    return;
+  }
+  BySmallestUserKey cmp;
+  cmp.ucmp = cfd_->user_comparator();
+  std::sort(files.begin(), files.end(), cmp);
+
+  // Split before the file at which the input bytes seen so far first
+  // reach the next multiple of total/n.
+  const uint64_t total = TotalFileSize(files);
+  uint64_t seen = files[0]->file_size;
+  for (size_t i = 1; i < files.size(); i++) {
+    const Slice key = files[i]->smallest.user_key();
+    const uint64_t target = total / n * (boundaries->size() + 1);
+    if (seen >= target &&
+        cmp.ucmp->Compare(key, files[0]->smallest.user_key()) > 0 &&
+        (boundaries->empty() ||
+         cmp.ucmp->Compare(key, boundaries->back()) > 0)) {
+      boundaries->push_back(key);
+      if (boundaries->size() + 1 == static_cast<size_t>(n)) {
+        break;
+      }
+    }
+    seen += files[i]->file_size;
+  }
+}
+
+Compaction* Compaction::NewSubcompaction() const {
+  Compaction* c = new Compaction(cfd_, level_);
+  c->output_level_ = output_level_;
+  c->max_output_file_size_ = max_output_file_size_;
+  c->older_runs_remain_ = older_runs_remain_;
+  c->input_version_ = input_version_;
+  c->input_version_->Ref();
+  c->grandparents_ = grandparents_;
+  return c;
+}
+
+void Compaction::MarkInputsBeingCompacted(bool value) {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      assert(inputs_[which][i]->being_compacted != value);
+      inputs_[which][i]->being_compacted = value;
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
+    // input_version_ may hold the last reference to the input files
+    MarkInputsBeingCompacted(false);
     input_version_->Unref();
     input_version_ = NULL;
   }
@@ -6,8 +6,9 @@
 // newest version is called "current".  Older versions may be kept
 // around to provide a consistent view to live iterators.
 //
-// Each Version keeps track of a set of Table files per level.  The
-// entire set of versions is maintained in a VersionSet.
+// Each Version keeps track of a set of Table files per level of one
+// column family.  The versions of every column family are maintained in
+// a VersionSet.
 //
 // Version,VersionSet are thread-compatible, but require external
 // synchronization on all accesses.
@@ -15,8 +16,10 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <deque>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 #include "db/dbformat.h"
 #include "db/version_edit.h"
@@ -27,6 +30,7 @@ namespace leveldb {
 
 namespace log { class Writer; }
 
+class ColumnFamilyData;
 class Compaction;
 class Iterator;
 class MemTable;
@@ -60,18 +64,37 @@ class Version {
  public:
   // Append to *iters a sequence of iterators that will
   // yield the contents of this Version when merged together.
+  // If "prefix_seek" is not NULL, table filters only rule out the Seek()s
+  // made while *prefix_seek is true (see ReadOptions::prefix_same_as_start).
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
-  void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
+  void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters,
+                    const bool* prefix_seek = NULL);
 
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // Entries older than "covering", the largest sequence number of the
+  // range deletions in the memtables that cover key, count as deleted.
+  // The merge operands for key that are newer than the value found, if
+  // any, are added to the front of *operands (see MemTable::Get()).
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+  Status Get(const ReadOptions&, const LookupKey& key,
+             SequenceNumber covering, std::string* val,
+             std::deque<std::string>* operands, GetStats* stats);
+
+  // Like Get(*keys[i], coverings[i], values[i], operands[i], &stats[i])
+  // for each i in [0,n-1], with the result stored in statuses[i].  Keys
+  // that fall in the same file are looked up together.  "keys" must be
+  // sorted by user key and share one sequence number.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const LookupKey* const* keys, int n,
+                const SequenceNumber* coverings,
+                std::string* const* values,
+                std::deque<std::string>* const* operands,
+                Status* statuses, GetStats* stats);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -108,17 +131,45 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the deepest level at which an ingested file that covers the
+  // range [smallest_user_key,largest_user_key] overlaps no file in that
+  // level or any level above it.
+  // REQUIRES: no compaction is running.
+  int PickLevelForIngestedFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Return an index over the range deletions stored in the files of this
+  // version, or NULL if there are none.
+  const RangeDelMap* range_dels() const { return range_dels_; }
+
+  // Append the range deletions stored in the files of this version to
+  // *result.
+  void AddRangeTombstones(std::vector<RangeTombstone>* result) const;
+
+  // Append to *result the level and metadata of every file that is not
+  // being compacted and whose entries are all deleted by range deletions
+  // of other files that "snapshot" and all later snapshots see.  Such
+  // files can be deleted without reading them.
+  void GetFilesInDeletedRanges(
+      SequenceNumber snapshot,
+      std::vector< std::pair<int, FileMetaData*> >* result) const;
+
+  // Return the combined file size of all files at the specified level.
+  int64_t NumLevelBytes(int level) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
  private:
+  friend class ColumnFamilyData;
   friend class Compaction;
   friend class VersionSet;
 
   class LevelFileNumIterator;
-  Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
+  Iterator* NewConcatenatingIterator(const ReadOptions&, int level,
+                                     const bool* prefix_seek) const;
 
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
@@ -129,7 +180,7 @@ class Version {
                           void* arg,
                           bool (*func)(void*, int, FileMetaData*));
 
-  VersionSet* vset_;            // VersionSet to which this Version belongs
+  ColumnFamilyData* cfd_;       // Column family to which this Version belongs
   Version* next_;               // Next version in linked list
   Version* prev_;               // Previous version in linked list
   int refs_;                    // Number of live refs to this version
@@ -147,12 +198,34 @@ class Version {
   double compaction_score_;
   int compaction_level_;
 
-  explicit Version(VersionSet* vset)
-      : vset_(vset), next_(this), prev_(this), refs_(0),
+  // Compaction score of every level but the last.  Lets PickCompaction()
+  // fall back to other levels when the best one is busy.
+  double compaction_scores_[config::kNumLevels];
+
+  // Estimated bytes that compactions must rewrite to bring every level
+  // within its size limit.  Initialized by Finalize().
+  uint64_t compaction_debt_;
+
+  // Index over the range deletions of files_, or NULL if there are none.
+  // Initialized by Finalize().
+  RangeDelMap* range_dels_;
+
+  // Smallest FileMetaData::creation_time of files_, or the largest
+  // uint64_t if there are no files.  Initialized by Finalize().
+  uint64_t oldest_creation_time_;
+
+  explicit Version(ColumnFamilyData* cfd)
+      : cfd_(cfd), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        compaction_debt_(0),
+        range_dels_(NULL),
+        oldest_creation_time_(~static_cast<uint64_t>(0)) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      compaction_scores_[level] = -1;
+    }
   }
 
   ~Version();
@@ -164,25 +237,79 @@ class Version {
 
 class VersionSet {
  public:
+  // The default column family uses "*options", "table_cache" and "*cmp".
+  // Other column families keep their tables in the cache of
+  // "table_cache".
   VersionSet(const std::string& dbname,
              const Options* options,
              TableCache* table_cache,
-             const InternalKeyComparator*);
+             const InternalKeyComparator* cmp);
   ~VersionSet();
 
-  // Apply *edit to the current version to form a new descriptor that
-  // is both saved to persistent state and installed as the new
-  // current version.  Will release *mu while actually writing to the file.
+  // Apply *edit to the current version of the column family that it
+  // names to form a new descriptor that is both saved to persistent
+  // state and installed as the new current version of the family.  Will
+  // release *mu while actually writing to the file.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
+  // REQUIRES: no other thread concurrently calls LogAndApply(),
+  //   CreateColumnFamily() or DropColumnFamily()
+  // REQUIRES: the column family of *edit exists.
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
   // Recover the last saved descriptor from persistent storage.
-  Status Recover();
+  // "column_families" maps the name of every column family besides the
+  // default one to the sanitized options to open it with; a family of
+  // the descriptor that is missing from it is an error.
+  Status Recover(const std::map<std::string, Options>& column_families);
+  Status Recover() {
+    return Recover(std::map<std::string, Options>());
+  }
+
+  // Record the creation of a column family named "name" whose entries
+  // start with log "log_number", and store it in *result.  "options"
+  // are sanitized options that hold the user comparator and filter
+  // policy of the family.  Same requirements as LogAndApply().
+  Status CreateColumnFamily(const std::string& name, const Options& options,
+                            uint64_t log_number, port::Mutex* mu,
+                            ColumnFamilyData** result)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
 
-  // Return the current version.
-  Version* current() const { return current_; }
+  // Record that "cfd" is dropped, and release its current version.  Its
+  // files stay live until no iterator uses them.  Same requirements as
+  // LogAndApply().
+  // REQUIRES: cfd is not the default column family.
+  Status DropColumnFamily(ColumnFamilyData* cfd, port::Mutex* mu)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  // Store the names of the column families in the descriptor of the
+  // database "dbname" in *result, starting with the default one.
+  static Status ListColumnFamilies(Env* env, const std::string& dbname,
+                                   std::vector<std::string>* result);
+
+  // For RepairDB(): read what the descriptor file "fname" records about
+  // column families, skipping the records that cannot be read.  Adds
+  // the name of each family it creates to *names by id, removing the
+  // ones it drops, and the id of the family of each table file it adds
+  // to *file_families by file number.  Raises *max_column_family to the
+  // largest id handed out.  Returns false if no record could be read.
+  static bool ReadColumnFamilyLayout(
+      Env* env, const std::string& fname,
+      std::map<uint32_t, std::string>* names,
+      std::map<uint64_t, uint32_t>* file_families,
+      uint32_t* max_column_family);
+
+  ColumnFamilyData* default_column_family() const { return default_cfd_; }
+
+  // Return the column families that are not dropped, in order of id.
+  const std::vector<ColumnFamilyData*>& column_families() const {
+    return column_families_;
+  }
+
+  // Return the column family with the specified id or name, or NULL if
+  // there is no such family or it is dropped.
+  ColumnFamilyData* GetColumnFamily(uint32_t id) const;
+  ColumnFamilyData* GetColumnFamily(const std::string& name) const;
 
   // Return the current manifest file number
   uint64_t ManifestFileNumber() const { return manifest_file_number_; }
@@ -199,11 +326,14 @@ class VersionSet {
     }
   }
 
-  // Return the number of Table files at the specified level.
-  int NumLevelFiles(int level) const;
+  // Return the largest number of level-0 files in the current version
+  // of any column family.
+  int MaxLevel0Files() const;
 
-  // Return the combined file size of all files at the specified level.
-  int64_t NumLevelBytes(int level) const;
+  // Return an estimate of the bytes that compactions must read and
+  // write before every level of the current versions of all column
+  // families is within its size limit.
+  uint64_t EstimatedCompactionDebt() const;
 
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
@@ -217,56 +347,72 @@ class VersionSet {
   // Mark the specified file number as used.
   void MarkFileNumberUsed(uint64_t number);
 
-  // Return the current log file number.
-  uint64_t LogNumber() const { return log_number_; }
+  // Return the oldest log file that may hold entries that some column
+  // family has not saved in its tables.
+  uint64_t LogNumber() const;
 
   // Return the log file number for the log file that is currently
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
-  // Returns NULL if there is no compaction to be done.
+  // Pick a column family, level and inputs for a new compaction.
+  // Column families are tried in decreasing order of compaction score.
+  // Returns NULL if there is no compaction to be done, or if every
+  // candidate needs files that are claimed by another compaction.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction and claims its inputs until it is
+  // released.  Caller should delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
-  // the specified level.  Returns NULL if there is nothing in that
-  // level that overlaps the specified range.  Caller should delete
-  // the result.
+  // the specified level of "cfd".  Returns NULL if there is nothing in
+  // that level that overlaps the specified range.  Level-0 of a column
+  // family that uses kCompactionStyleUniversal is compacted as a whole.
+  // Caller should delete the result.
+  // REQUIRES: no other compaction is outstanding.
   Compaction* CompactRange(
+      ColumnFamilyData* cfd,
       int level,
       const InternalKey* begin,
       const InternalKey* end);
 
   // Return the maximum overlapping data (in bytes) at next level for any
-  // file at a level >= 1.
+  // file at a level >= 1 of the default column family.
   int64_t MaxNextLevelOverlappingBytes();
 
   // Create an iterator that reads over the compaction inputs for "*c".
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
-  // Returns true iff some level needs a compaction.
-  bool NeedsCompaction() const {
-    Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL);
-  }
+  // Returns true iff some level of some column family needs a compaction.
+  bool NeedsCompaction() const;
 
   // Add all files listed in any live version to *live.
   // May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
-  // Return the approximate offset in the database of the data for
+  // Return the approximate offset in the column family of the data for
   // "key" as of version "v".
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
 
   // Return a human-readable short (single-line) summary of the number
-  // of files per level.  Uses *scratch as backing store.
+  // of files per level of "cfd".  Uses *scratch as backing store.
   struct LevelSummaryStorage {
     char buffer[100];
   };
-  const char* LevelSummary(LevelSummaryStorage* scratch) const;
+  const char* LevelSummary(const ColumnFamilyData* cfd,
+                           LevelSummaryStorage* scratch) const;
+
+  // Return an iterator over the entries of the table file "number" of
+  // "cfd" of "file_size" bytes, served under "global_seqno" if that is
+  // non-zero (see FileMetaData::global_seqno).  "prefix_seek" is as for
+  // Version::AddIterators().
+  static Iterator* NewFileIterator(const ColumnFamilyData* cfd,
+                                   const ReadOptions& options,
+                                   uint64_t number,
+                                   uint64_t file_size,
+                                   SequenceNumber global_seqno,
+                                   const bool* prefix_seek = NULL);
 
  private:
   class Builder;
@@ -276,21 +422,81 @@ class VersionSet {
 
   void Finalize(Version* v);
 
-  void GetRange(const std::vector<FileMetaData*>& inputs,
+  // Opens the file described by a LevelFileNumIterator value; "arg" is
+  // the ColumnFamilyData.
+  static Iterator* GetFileIterator(void* arg,
+                                   const ReadOptions& options,
+                                   const Slice& file_value);
+
+  // Like GetFileIterator(), for a Version::AddIterators() call with a
+  // "prefix_seek" flag; "arg" is a PrefixSeekFileArg.
+  static Iterator* GetPrefixSeekFileIterator(void* arg,
+                                             const ReadOptions& options,
+                                             const Slice& file_value);
+
+  void GetRange(const InternalKeyComparator& icmp,
+                const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
 
-  void GetRange2(const std::vector<FileMetaData*>& inputs1,
+  void GetRange2(const InternalKeyComparator& icmp,
+                 const std::vector<FileMetaData*>& inputs1,
                  const std::vector<FileMetaData*>& inputs2,
                  InternalKey* smallest,
                  InternalKey* largest);
 
-  void SetupOtherInputs(Compaction* c);
+  // Pick a compaction of "cfd"; see PickCompaction().
+  Compaction* PickCompaction(ColumnFamilyData* cfd);
+
+  // Pick a merge of level-0 runs of "cfd", which uses
+  // kCompactionStyleUniversal.  See Options::universal_size_ratio.
+  Compaction* PickUniversalCompaction(ColumnFamilyData* cfd);
+
+  // Returns true iff "cfd" has files older than
+  // Options::periodic_compaction_seconds.
+  bool NeedsPeriodicCompaction(const ColumnFamilyData* cfd) const;
+
+  // Pick a compaction of the oldest file of "cfd" that is older than
+  // Options::periodic_compaction_seconds, or NULL if there is none.
+  Compaction* PickPeriodicCompaction(ColumnFamilyData* cfd);
+
+  // Give the files of the recovered version "v" whose creation time is
+  // unknown one spread over the last periodic compaction period, so
+  // that they come due over the next period instead of all at once.
+  // The times are saved with the next snapshot of the descriptor.
+  void EstimateCreationTimes(Version* v);
+
+  // Return a compaction that merges the level-0 files "inputs" of "cfd"
+  // into a single level-0 file, and claims them.  "older_runs_remain"
+  // tells whether level-0 holds files older than all of "inputs".
+  Compaction* NewUniversalCompaction(ColumnFamilyData* cfd,
+                                     const std::vector<FileMetaData*>& inputs,
+                                     bool older_runs_remain);
+
+  // Orders column families by decreasing compaction score.
+  static bool ByCompactionScore(const ColumnFamilyData* a,
+                                const ColumnFamilyData* b);
+
+  // Add the "level+1" inputs (and possibly more "level" inputs) to *c.
+  // Returns false if the compaction would need a file that is being
+  // compacted by someone else.
+  bool SetupOtherInputs(Compaction* c);
+
+  // Finish setting up a compaction whose seed file has been placed in
+  // c->inputs_[0] and claim its inputs.  Returns false (leaving nothing
+  // claimed) if some input is already being compacted.
+  bool SetupPickedInputs(Compaction* c);
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
-  void AppendVersion(Version* v);
+  // Save *edit to the descriptor, together with the next file number
+  // and last sequence, creating a new descriptor file if there is none.
+  // Releases *mu while writing.
+  Status WriteEdit(VersionEdit* edit, port::Mutex* mu)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  void AppendVersion(ColumnFamilyData* cfd, Version* v);
 
   bool ManifestContains(const std::string& record) const;
 
@@ -298,22 +504,24 @@ class VersionSet {
   const std::string dbname_;
   const Options* const options_;
   TableCache* const table_cache_;
-  const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
   uint64_t last_sequence_;
-  uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
   // Opened lazily
   WritableFile* descriptor_file_;
   log::Writer* descriptor_log_;
-  Version dummy_versions_;  // Head of circular doubly-linked list of versions.
-  Version* current_;        // == dummy_versions_.prev_
 
-  // Per-level key at which the next compaction at that level should start.
-  // Either an empty string, or a valid InternalKey.
-  std::string compact_pointer_[config::kNumLevels];
+  ColumnFamilyData* default_cfd_;
+  std::vector<ColumnFamilyData*> column_families_;
+
+  // Dropped column families, kept until the VersionSet is destroyed
+  // because iterators may still use their versions.
+  std::vector<ColumnFamilyData*> dropped_column_families_;
+
+  // Largest column family id handed out so far.
+  uint32_t max_column_family_;
 
   // No copying allowed
   VersionSet(const VersionSet&);
@@ -329,6 +537,15 @@ class Compaction {
   // and "level+1" will be merged to produce a set of "level+1" files.
   int level() const { return level_; }
 
+  // Return the level that the output files are added to: "level+1", or
+  // "level" itself for a merge of level-0 runs (kCompactionStyleUniversal),
+  // which has a single output file, or for a periodic compaction of a
+  // file past level-0.  These have no "level+1" inputs.
+  int output_level() const { return output_level_; }
+
+  // Return the column family that is being compacted.
+  ColumnFamilyData* column_family() const { return cfd_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -350,26 +567,63 @@ class Compaction {
   void AddInputDeletions(VersionEdit* edit);
 
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
+  // the compaction is producing data in the output level for which no
+  // older data exists in other files.
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Returns true if no file of the input version outside of the inputs
+  // of this compaction overlaps the user key range [begin,end).  A range
+  // deletion of such a range that every snapshot sees then deletes
+  // nothing but entries that this compaction drops.
+  bool IsRangeDeletionObsolete(const Slice& begin, const Slice& end) const;
+
+  // Return an index over the range deletions of the input version, or
+  // NULL if there are none.
+  const RangeDelMap* range_dels() const {
+    return input_version_->range_dels();
+  }
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also makes the inputs available to other compactions.
   void ReleaseInputs();
 
+  // Store in *boundaries up to "n-1" user keys, in increasing order,
+  // that split the key range of this compaction into pieces that hold
+  // roughly equal amounts of input data.  Only the smallest keys of the
+  // input files are considered as split points.  The slices stay valid
+  // until the inputs are released.
+  void GetSplitPoints(int n, std::vector<Slice>* boundaries) const;
+
+  // Return a new compaction that reads nothing by itself but has its own
+  // IsBaseLevelForKey() and ShouldStopBefore() state, so that a disjoint
+  // key range of this compaction can be merged by another thread.
+  // The caller should delete the result before releasing the inputs of
+  // this compaction.
+  // REQUIRES: external synchronization (same as for VersionSet).
+  Compaction* NewSubcompaction() const;
+
  private:
   friend class Version;
   friend class VersionSet;
 
-  explicit Compaction(int level);
+  Compaction(ColumnFamilyData* cfd, int level);
+
+  // Set FileMetaData::being_compacted of every input to "value".
+  void MarkInputsBeingCompacted(bool value);
 
+  ColumnFamilyData* cfd_;
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
+
+  // True if level-0 files older than the inputs of a merge of level-0
+  // runs are left out of it, so that no key is at its base level.
+  bool older_runs_remain_;
+
   Version* input_version_;
   VersionEdit edit_;
 
@@ -389,7 +643,7 @@ class Compaction {
   // level_ptrs_ holds indices into input_version_->levels_: our state
   // is that we are positioned at one of the file ranges for each
   // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
+  // all L >= output_level_ + 1).
   size_t level_ptrs_[config::kNumLevels];
 };
 
@@ -8,7 +8,13 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeMerge varstring varstring         |
+//    kTypeRangeDeletion varstring varstring |
+//    kTypeColumnFamilyValue varint32 varstring varstring |
+//    kTypeColumnFamilyDeletion varint32 varstring |
+//    kTypeColumnFamilyMerge varint32 varstring varstring |
+//    kTypeColumnFamilyRangeDeletion varint32 varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -26,6 +32,16 @@ namespace leveldb {
 // WriteBatch header has an 8-byte sequence number followed by a 4-byte count.
 static const size_t kHeader = 12;
 
+// Tags of the records of column families other than the default one,
+// which carry the id of their family.  These never appear in internal
+// keys.
+enum ColumnFamilyValueType {
+  kTypeColumnFamilyDeletion = 0x4,
+  kTypeColumnFamilyValue = 0x5,
+  kTypeColumnFamilyMerge = 0x6,
+  kTypeColumnFamilyRangeDeletion = 0x7
+};
+
 WriteBatch::WriteBatch() {
   Clear();
 }
@@ -34,6 +50,30 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+void WriteBatch::Handler::PutCF(uint32_t column_family_id, const Slice& key,
+                                const Slice& value) {
+}
+
+void WriteBatch::Handler::DeleteCF(uint32_t column_family_id,
+                                   const Slice& key) {
+}
+
+void WriteBatch::Handler::Merge(const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::MergeCF(uint32_t column_family_id,
+                                  const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::DeleteRange(const Slice& begin_key,
+                                      const Slice& end_key) {
+}
+
+void WriteBatch::Handler::DeleteRangeCF(uint32_t column_family_id,
+                                        const Slice& begin_key,
+                                        const Slice& end_key) {
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -47,6 +87,7 @@ Status WriteBatch::Iterate(Handler* handler) const {
 
   input.remove_prefix(kHeader);
   Slice key, value;
+  uint32_t column_family;
   int found = 0;
   while (!input.empty()) {
     found++;
@@ -68,6 +109,57 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Merge(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
+      case kTypeColumnFamilyValue:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->PutCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Put");
+        }
+        break;
+      case kTypeColumnFamilyDeletion:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key)) {
+          handler->DeleteCF(column_family, key);
+        } else {
+          return Status::Corruption("bad WriteBatch Delete");
+        }
+        break;
+      case kTypeColumnFamilyMerge:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->MergeCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTypeColumnFamilyRangeDeletion:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRangeCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -108,18 +200,125 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::Put(ColumnFamilyHandle* column_family, const Slice& key,
+                     const Slice& value) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Put(key, value);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyValue));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Delete(key);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyDeletion));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+}
+
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::Merge(ColumnFamilyHandle* column_family, const Slice& key,
+                       const Slice& value) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Merge(key, value);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyMerge));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::DeleteRange(const Slice& begin_key, const Slice& end_key) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin_key);
+  PutLengthPrefixedSlice(&rep_, end_key);
+}
+
+void WriteBatch::DeleteRange(ColumnFamilyHandle* column_family,
+                             const Slice& begin_key, const Slice& end_key) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    DeleteRange(begin_key, end_key);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyRangeDeletion));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, begin_key);
+  PutLengthPrefixedSlice(&rep_, end_key);
+}
+
 namespace {
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
-  MemTable* mem_;
+  const std::vector<MemTable*>* mems_;
+  bool concurrent_;
 
   virtual void Put(const Slice& key, const Slice& value) {
-    mem_->Add(sequence_, kTypeValue, key, value);
-    sequence_++;
+    Add(0, kTypeValue, key, value);
   }
   virtual void Delete(const Slice& key) {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    Add(0, kTypeDeletion, key, Slice());
+  }
+  virtual void PutCF(uint32_t column_family, const Slice& key,
+                     const Slice& value) {
+    Add(column_family, kTypeValue, key, value);
+  }
+  virtual void DeleteCF(uint32_t column_family, const Slice& key) {
+    Add(column_family, kTypeDeletion, key, Slice());
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    Add(0, kTypeMerge, key, value);
+  }
+  virtual void MergeCF(uint32_t column_family, const Slice& key,
+                       const Slice& value) {
+    Add(column_family, kTypeMerge, key, value);
+  }
+  virtual void DeleteRange(const Slice& begin_key, const Slice& end_key) {
+    Add(0, kTypeRangeDeletion, begin_key, end_key);
+  }
+  virtual void DeleteRangeCF(uint32_t column_family, const Slice& begin_key,
+                             const Slice& end_key) {
+    Add(column_family, kTypeRangeDeletion, begin_key, end_key);
+  }
+
+ private:
+  void Add(uint32_t column_family, ValueType type, const Slice& key,
+           const Slice& value) {
+    // Entries of families without a memtable still use up their
+    // sequence number.
+    MemTable* mem = NULL;
+    if (column_family < mems_->size()) {
+      mem = (*mems_)[column_family];
+    }
+    if (mem != NULL) {
+      if (concurrent_) {
+        mem->AddConcurrently(sequence_, type, key, value);
+      } else {
+        mem->Add(sequence_, type, key, value);
+      }
+    }
     sequence_++;
   }
 };
@@ -127,9 +326,25 @@ class MemTableInserter : public WriteBatch::Handler {
 
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
                                       MemTable* memtable) {
+  std::vector<MemTable*> memtables(1, memtable);
+  return InsertInto(b, memtables);
+}
+
+Status WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                      const std::vector<MemTable*>& memtables) {
+  MemTableInserter inserter;
+  inserter.sequence_ = WriteBatchInternal::Sequence(b);
+  inserter.mems_ = &memtables;
+  inserter.concurrent_ = false;
+  return b->Iterate(&inserter);
+}
+
+Status WriteBatchInternal::InsertIntoConcurrently(
+    const WriteBatch* b, const std::vector<MemTable*>& memtables) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
-  inserter.mem_ = memtable;
+  inserter.mems_ = &memtables;
+  inserter.concurrent_ = true;
   return b->Iterate(&inserter);
 }
 
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 #define STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 
+#include <vector>
 #include "leveldb/write_batch.h"
 
 namespace leveldb {
@@ -38,8 +39,21 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // Insert the entries of the default column family into "memtable";
+  // those of other families are skipped.
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Insert the entries of each column family into memtables[id], where
+  // id is the id of the family.  Entries of families that have no
+  // memtable in the vector, or a NULL one, are skipped.
+  static Status InsertInto(const WriteBatch* batch,
+                           const std::vector<MemTable*>& memtables);
+
+  // Like InsertInto(), but other threads may be inserting other batches
+  // into the same memtables at the same time.
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       const std::vector<MemTable*>& memtables);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
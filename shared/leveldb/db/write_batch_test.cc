@@ -38,6 +38,22 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
+      case kTypeRangeDeletion:
+        state.append("DeleteRange(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
@@ -74,6 +90,38 @@ TEST(WriteBatchTest, Multiple) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("+1"));
+  batch.Merge(Slice("baz"), Slice("+2"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Merge(baz, +2)@102"
+            "Merge(foo, +1)@101"
+            "Put(foo, bar)@100",
+            PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("g"));
+  batch.Put(Slice("baz"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("DeleteRange(a, g)@101"
+            "Put(baz, boo)@102"
+            "Put(foo, bar)@100",
+            PrintContents(&batch));
+
+  // An empty range is not added to the memtable.
+  batch.Clear();
+  batch.DeleteRange(Slice("g"), Slice("a"));
+  ASSERT_EQ(1, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("CountMismatch()", PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -113,6 +161,97 @@ TEST(WriteBatchTest, Append) {
             PrintContents(&b1));
 }
 
+namespace {
+class FakeColumnFamily : public ColumnFamilyHandle {
+ public:
+  FakeColumnFamily(uint32_t id, const std::string& name)
+      : id_(id), name_(name) { }
+  virtual const std::string& GetName() const { return name_; }
+  virtual uint32_t GetID() const { return id_; }
+
+ private:
+  uint32_t id_;
+  std::string name_;
+};
+
+class ColumnFamilyPrinter : public WriteBatch::Handler {
+ public:
+  std::string state_;
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    PutCF(0, key, value);
+  }
+  virtual void Delete(const Slice& key) {
+    DeleteCF(0, key);
+  }
+  virtual void PutCF(uint32_t column_family, const Slice& key,
+                     const Slice& value) {
+    state_.append("Put(" + NumberToString(column_family) + ", " +
+                  key.ToString() + ", " + value.ToString() + ")");
+  }
+  virtual void DeleteCF(uint32_t column_family, const Slice& key) {
+    state_.append("Delete(" + NumberToString(column_family) + ", " +
+                  key.ToString() + ")");
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    MergeCF(0, key, value);
+  }
+  virtual void MergeCF(uint32_t column_family, const Slice& key,
+                       const Slice& value) {
+    state_.append("Merge(" + NumberToString(column_family) + ", " +
+                  key.ToString() + ", " + value.ToString() + ")");
+  }
+  virtual void DeleteRange(const Slice& begin_key, const Slice& end_key) {
+    DeleteRangeCF(0, begin_key, end_key);
+  }
+  virtual void DeleteRangeCF(uint32_t column_family, const Slice& begin_key,
+                             const Slice& end_key) {
+    state_.append("DeleteRange(" + NumberToString(column_family) + ", " +
+                  begin_key.ToString() + ", " + end_key.ToString() + ")");
+  }
+};
+}  // namespace
+
+TEST(WriteBatchTest, ColumnFamilies) {
+  FakeColumnFamily default_family(0, "default");
+  FakeColumnFamily other(5, "other");
+  WriteBatch batch;
+  batch.Put(&default_family, "a", "va");
+  batch.Put(&other, "b", "vb");
+  batch.Delete(&other, "c");
+  batch.Delete(&default_family, "d");
+  batch.Put("e", "ve");
+  batch.Merge(&other, "f", "vf");
+  batch.Merge(&default_family, "g", "vg");
+  batch.DeleteRange(&other, "h", "i");
+  batch.DeleteRange(&default_family, "j", "k");
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(9, WriteBatchInternal::Count(&batch));
+
+  ColumnFamilyPrinter printer;
+  ASSERT_OK(batch.Iterate(&printer));
+  ASSERT_EQ("Put(0, a, va)"
+            "Put(5, b, vb)"
+            "Delete(5, c)"
+            "Delete(0, d)"
+            "Put(0, e, ve)"
+            "Merge(5, f, vf)"
+            "Merge(0, g, vg)"
+            "DeleteRange(5, h, i)"
+            "DeleteRange(0, j, k)",
+            printer.state_);
+
+  // The entries of other families are skipped, but use up their
+  // sequence numbers.
+  ASSERT_EQ("Put(a, va)@100"
+            "Delete(d)@103"
+            "Put(e, ve)@104"
+            "Merge(g, vg)@106"
+            "DeleteRange(j, k)@108"
+            "CountMismatch()",
+            PrintContents(&batch));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
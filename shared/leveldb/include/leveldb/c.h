@@ -61,6 +61,7 @@ typedef struct leveldb_iterator_t      leveldb_iterator_t;
 typedef struct leveldb_logger_t        leveldb_logger_t;
 typedef struct leveldb_options_t       leveldb_options_t;
 typedef struct leveldb_randomfile_t    leveldb_randomfile_t;
+typedef struct leveldb_ratelimiter_t   leveldb_ratelimiter_t;
 typedef struct leveldb_readoptions_t   leveldb_readoptions_t;
 typedef struct leveldb_seqfile_t       leveldb_seqfile_t;
 typedef struct leveldb_snapshot_t      leveldb_snapshot_t;
@@ -105,6 +106,20 @@ extern char* leveldb_get(
     size_t* vallen,
     char** errptr);
 
+/* Looks up keys_list[0,num_keys-1] as of a single snapshot.  For each i,
+   values_list[i] is NULL if the key is not found and a malloc()ed array
+   of length values_list_sizes[i] otherwise.  errs[i] is NULL unless the
+   lookup failed, in which case it is a malloc()ed error message. */
+extern void leveldb_multiget(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    size_t num_keys,
+    const char* const* keys_list,
+    const size_t* keys_list_sizes,
+    char** values_list,
+    size_t* values_list_sizes,
+    char** errs);
+
 extern leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db,
     const leveldb_readoptions_t* options);
@@ -198,14 +213,23 @@ extern void leveldb_options_set_info_log(leveldb_options_t*, leveldb_logger_t*);
 extern void leveldb_options_set_write_buffer_size(leveldb_options_t*, size_t);
 extern void leveldb_options_set_max_open_files(leveldb_options_t*, int);
 extern void leveldb_options_set_cache(leveldb_options_t*, leveldb_cache_t*);
+extern void leveldb_options_set_rate_limiter(leveldb_options_t*,
+                                             leveldb_ratelimiter_t*);
 extern void leveldb_options_set_block_size(leveldb_options_t*, size_t);
 extern void leveldb_options_set_block_restart_interval(leveldb_options_t*, int);
 
 enum {
   leveldb_no_compression = 0,
-  leveldb_snappy_compression = 1
+  leveldb_snappy_compression = 1,
+  leveldb_zlib_compression = 2
 };
 extern void leveldb_options_set_compression(leveldb_options_t*, int);
+/* level_values[i] is the compression of level i (see
+   Options::compression_per_level) */
+extern void leveldb_options_set_compression_per_level(
+    leveldb_options_t*, const int* level_values, size_t num_levels);
+extern void leveldb_options_set_compression_dict_bytes(leveldb_options_t*,
+                                                       size_t);
 
 /* Comparator */
 
@@ -262,13 +286,33 @@ extern void leveldb_writeoptions_set_sync(
 /* Cache */
 
 extern leveldb_cache_t* leveldb_cache_create_lru(size_t capacity);
+extern leveldb_cache_t* leveldb_cache_create_clock(size_t capacity);
 extern void leveldb_cache_destroy(leveldb_cache_t* cache);
 
+/* Rate limiter */
+
+extern leveldb_ratelimiter_t* leveldb_ratelimiter_create(
+    uint64_t bytes_per_second);
+extern void leveldb_ratelimiter_destroy(leveldb_ratelimiter_t* limiter);
+
 /* Env */
 
 extern leveldb_env_t* leveldb_create_default_env();
 extern void leveldb_env_destroy(leveldb_env_t*);
 
+/* Perf context of the calling thread (see leveldb/perf_context.h) */
+
+enum {
+  leveldb_perf_disable = 0,
+  leveldb_perf_enable_count = 1,
+  leveldb_perf_enable_time = 2
+};
+extern void leveldb_set_perf_level(int);
+extern void leveldb_perf_context_reset();
+
+/* Returns the non-zero counters as a malloc()ed string. */
+extern char* leveldb_perf_context_report();
+
 /* Utility */
 
 /* Calls free(ptr).
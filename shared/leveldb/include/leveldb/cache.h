@@ -10,10 +10,11 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Two builtin cache implementations are provided: one with a
+// least-recently-used eviction policy and one with a CLOCK policy that
+// is cheaper under concurrent lookups.  Clients may use their own
+// implementations if they want something more sophisticated (like
+// scan-resistance, a custom eviction policy, variable cache sizing, etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -27,7 +28,23 @@ class Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
 // of Cache uses a least-recently-used eviction policy.
+//
+// The cache is split into 2^num_shard_bits shards that are locked
+// independently, each with an equal share of the capacity.  A negative
+// num_shard_bits picks the default of 16 shards.
 extern Cache* NewLRUCache(size_t capacity);
+extern Cache* NewLRUCache(size_t capacity, int num_shard_bits);
+
+// Create a new cache with a fixed size capacity.  This implementation
+// of Cache approximates least-recently-used eviction with the CLOCK
+// algorithm.  Lookups take only a shared lock on their shard and
+// Release() takes no lock, so hits from many threads do not serialize.
+// Entries that clients hold handles to are never evicted, so usage may
+// exceed the capacity while many entries are pinned.
+//
+// num_shard_bits has the same meaning as for NewLRUCache().
+extern Cache* NewClockCache(size_t capacity);
+extern Cache* NewClockCache(size_t capacity, int num_shard_bits);
 
 class Cache {
  public:
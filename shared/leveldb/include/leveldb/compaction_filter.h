@@ -0,0 +1,44 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+// A CompactionFilter lets compactions remove or rewrite values as they
+// copy them, e.g. to expire records that have outlived a time-to-live
+// without reading and deleting them separately.
+//
+// Only values that no snapshot can see are passed to the filter, so the
+// results of reads through a snapshot do not change.  Values are not
+// filtered until a compaction reaches them: reads may still return a
+// value the filter would remove.
+//
+// A CompactionFilter implementation must be thread-safe since leveldb
+// may invoke its methods concurrently from multiple threads.
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Called for each value that a compaction of "level" keeps.  Return
+  // true to delete the key.  Otherwise, to replace the value, store the
+  // new value in *new_value and set *value_changed to true.
+  virtual bool Filter(int level,
+                      const Slice& key,
+                      const Slice& existing_value,
+                      std::string* new_value,
+                      bool* value_changed) const = 0;
+
+  // The name of the compaction filter.
+  virtual const char* Name() const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -51,6 +51,15 @@ class Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Used by tables built with options.data_block_hash_index.  If keys
+  // that compare equal always have identical bytes, stores in *hash_key
+  // the part of "key" that a point lookup of "key" must match exactly
+  // (for most comparators, all of "key") and returns true.  Otherwise
+  // returns false, and the tables are built without hash indexes.
+  //
+  // The default implementation returns false.
+  virtual bool HashKey(const Slice& key, Slice* hash_key) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -0,0 +1,82 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Compressor compresses the blocks of table files.  Each block
+// records the CompressionType it was compressed with, and reads find
+// the compressor to uncompress it with in a process-wide registry that
+// maps each type to a Compressor.  The registry starts out with
+// compressors for kSnappyCompression and kZlibCompression;
+// applications may register their own under types from 0x80 up and
+// then select them with Options::compression.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+
+#include <stddef.h>
+#include <string>
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class Slice;
+
+class Compressor {
+ public:
+  virtual ~Compressor();
+
+  // Return the type stored with the blocks that this compressor
+  // compresses.  Note that the type is part of the persistent format
+  // of those blocks, so it must never change, and it must not be
+  // kNoCompression.
+  virtual CompressionType type() const = 0;
+
+  // Return the name of this compressor, e.g. for logging.
+  virtual const char* Name() const = 0;
+
+  // Store the compressed form of "input" in *output and return true,
+  // or return false to store "input" uncompressed, e.g. because the
+  // compression library is not available.
+  virtual bool Compress(const Slice& input, std::string* output) const = 0;
+
+  // If "input" looks like the output of Compress(), store the length of
+  // its uncompressed form in *length and return true.  Else return
+  // false.
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const = 0;
+
+  // Uncompress "input" into output[0,length-1], where length is the
+  // result of GetUncompressedLength(input).  Return false if "input"
+  // is corrupt.
+  virtual bool Uncompress(const Slice& input, char* output) const = 0;
+
+  // Return true if this compressor can compress against a dictionary,
+  // i.e., data with content common to the blocks it compresses.  The
+  // default implementation returns false.
+  virtual bool SupportsDictionary() const;
+
+  // Like Compress(), but may draw on the contents of "dict".  The
+  // default implementation ignores "dict" and calls Compress().
+  virtual bool CompressWithDictionary(const Slice& dict, const Slice& input,
+                                      std::string* output) const;
+
+  // Like Uncompress(), for input that CompressWithDictionary() produced
+  // with the same "dict".  The default implementation ignores "dict"
+  // and calls Uncompress().
+  virtual bool UncompressWithDictionary(const Slice& dict, const Slice& input,
+                                        char* output) const;
+};
+
+// Make "compressor" the compressor for compressor->type(), replacing
+// any compressor registered for that type before.  Register
+// compressors before opening databases that use them; the compressor
+// must remain live for the rest of the process.
+extern void RegisterCompressor(const Compressor* compressor);
+
+// Return the compressor registered for "type", or NULL if there is
+// none.  Returns NULL for kNoCompression.
+extern const Compressor* GetCompressor(CompressionType type);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 
@@ -29,6 +31,36 @@ class Snapshot {
   virtual ~Snapshot();
 };
 
+// The name of the column family that every database has.
+extern const char kDefaultColumnFamilyName[];
+
+// Handle to a column family of a DB: a key space with its own
+// comparator, table options, memtables and table files, which shares
+// the log, background work and sequence numbers of the DB.  A handle
+// must not be used after its DB has been deleted; it may be deleted
+// before or after the DB.
+class ColumnFamilyHandle {
+ public:
+  virtual ~ColumnFamilyHandle();
+  virtual const std::string& GetName() const = 0;
+  virtual uint32_t GetID() const = 0;
+};
+
+// The name of a column family, and the options to open it with.  Only
+// the fields of "options" that describe a key space are used: the
+// comparator, the merge operator, the filter and block settings,
+// compression, the compaction style and its settings, and
+// write_buffer_size.  All other
+// options come from the options the DB is opened with.
+struct ColumnFamilyDescriptor {
+  std::string name;
+  Options options;
+
+  ColumnFamilyDescriptor() : name(kDefaultColumnFamilyName) { }
+  ColumnFamilyDescriptor(const std::string& n, const Options& o)
+      : name(n), options(o) { }
+};
+
 // A range of keys
 struct Range {
   Slice start;          // Included in the range
@@ -52,6 +84,29 @@ class DB {
                      const std::string& name,
                      DB** dbptr);
 
+  // Open the database with the specified "name" and the column families
+  // listed in "column_families", which must name every column family of
+  // the database; the default column family may be left out, in which
+  // case it is opened with "options".  Options::create_if_missing only
+  // creates the database: other column families are created with
+  // CreateColumnFamily().
+  //
+  // On success, stores in *handles one heap-allocated handle per element
+  // of "column_families", in the same order.  The caller should delete
+  // them when they are no longer needed.
+  static Status Open(
+      const Options& options,
+      const std::string& name,
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      std::vector<ColumnFamilyHandle*>* handles,
+      DB** dbptr);
+
+  // Store the names of the column families of the database "name" in
+  // *column_families.
+  static Status ListColumnFamilies(const Options& options,
+                                   const std::string& name,
+                                   std::vector<std::string>* column_families);
+
   DB() { }
   virtual ~DB();
 
@@ -68,6 +123,83 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Record "value" as a merge operand for "key", without reading the
+  // current value of "key".  Reads return the result of applying the
+  // operands to the value with Options::merge_operator, and compactions
+  // store it in their place.  Returns InvalidArgument if the column
+  // family has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key,
+                       const Slice& value);
+
+  // Remove the database entries (if any) for all the keys in
+  // ["begin_key", "end_key"), as ordered by the comparator.  This
+  // writes a single record however many keys the range holds: reads
+  // skip the keys it covers, and compactions drop them, along with the
+  // tables that hold nothing else, without reading those.  Returns OK
+  // on success, and a non-OK status on error.  It is not an error if
+  // the range is empty.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin_key,
+                             const Slice& end_key);
+
+  // Create a column family named "name", whose key space is described
+  // by "options" (see ColumnFamilyDescriptor).  Stores a heap-allocated
+  // handle to it in *handle.
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle) = 0;
+
+  // Drop the specified column family and delete its data.  Other handles
+  // to the family remain valid objects, but operations through them
+  // fail, and updates to the family in a WriteBatch are ignored.  The
+  // default column family cannot be dropped.
+  virtual Status DropColumnFamily(ColumnFamilyHandle* column_family) = 0;
+
+  // Return a handle to the default column family, which the operations
+  // that take no column family apply to.  The handle belongs to the DB.
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const = 0;
+
+  // Like Put(), Delete(), Merge(), DeleteRange(), Get(), MultiGet(),
+  // IngestExternalFile(), NewIterator(), GetProperty()
+  // and CompactRange() below, for the specified column family.  Snapshots
+  // cover all column families; a WriteBatch may hold updates to several
+  // of them, which are applied atomically.
+  virtual Status Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key,
+                     const Slice& value) = 0;
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const Slice& key) = 0;
+  virtual Status Merge(const WriteOptions& options,
+                       ColumnFamilyHandle* column_family,
+                       const Slice& key,
+                       const Slice& value);
+  virtual Status DeleteRange(const WriteOptions& options,
+                             ColumnFamilyHandle* column_family,
+                             const Slice& begin_key,
+                             const Slice& end_key);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, std::string* value) = 0;
+  virtual void MultiGet(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    ColumnFamilyHandle* column_family,
+                                    const std::string& fname);
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family) = 0;
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value) = 0;
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end) = 0;
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -83,6 +215,35 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Look up several keys at once.  Resizes *values and *statuses to
+  // keys.size(), and stores the result of looking up keys[i] in
+  // (*values)[i] and (*statuses)[i] as Get() would, except that
+  // (*values)[i] is cleared if keys[i] is not found.  All keys are read
+  // from the same snapshot of the database.
+  //
+  // Cheaper than one Get() per key: the database state is captured once,
+  // and keys that fall in the same table or block share the work of
+  // reading it.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
+  // Add the table file "fname" built by an SstFileWriter (see
+  // leveldb/sst_file_writer.h) to the default column family, as if its
+  // entries had been written in one batch.  Snapshots taken before the
+  // call do not see them.
+  //
+  // The file is placed in the deepest level at which it overlaps no
+  // newer data, or in level-0 as a new sorted run if the family uses
+  // kCompactionStyleUniversal, without being rewritten.  Writes wait
+  // while memtable data in the file's key range is flushed and while
+  // running compactions finish.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    const std::string& fname);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -115,6 +276,23 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.latency.get", "leveldb.latency.multiget",
+  //  "leveldb.latency.write" - return a histogram of the latencies of the
+  //     calls to Get(), MultiGet() or Write() (and so Put() and
+  //     Delete()), in microseconds.
+  //  "leveldb.perf-context" - returns the calling thread's PerfContext
+  //     (see leveldb/perf_context.h) as a string.
+  //  "leveldb.write-stalls" - returns the estimated compaction debt, the
+  //     rate at which writes are currently admitted (zero if they are
+  //     not being slowed down), and how often and for how long writes
+  //     were delayed and stopped.
+  //  "leveldb.write-amplification" - returns the bytes written to the
+  //     log and ingested, the bytes of the tables that memtable flushes
+  //     and compactions wrote, and the ratio of the latter to the
+  //     former.
+  //  "leveldb.rate-limiter" - returns the bytes that flushes and
+  //     compactions requested from Options::rate_limiter and the time
+  //     they were throttled for.  Not available without a rate limiter.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -154,8 +332,23 @@ Status DestroyDB(const std::string& name, const Options& options);
 // resurrect as much of the contents of the database as possible.
 // Some data may be lost, so be careful when calling this function
 // on a database that contains important information.
+//
+// The column families and the family of each table file are taken from
+// what can still be read of the old descriptors.  A table file whose
+// family is unknown is set aside like an unreadable one, unless the
+// database has no other family than the default one.
 Status RepairDB(const std::string& dbname, const Options& options);
 
+// Like RepairDB(dbname, options), for a database with column families:
+// the tables of each family are read and written with the options
+// given for it in "column_families" (see DB::Open()).  The default
+// column family may be left out, in which case it uses "options".
+// Returns InvalidArgument if a family of the database is missing, and
+// NotSupported if no old descriptor can be read to tell the families of
+// the tables.
+Status RepairDB(const std::string& dbname, const Options& options,
+                const std::vector<ColumnFamilyDescriptor>& column_families);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_DB_H_
@@ -69,6 +69,18 @@ class Env {
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) = 0;
 
+  // Rename the existing file "old_fname" to "fname" and create an object
+  // that writes to it from its start.  Unlike NewWritableFile(), this
+  // may overwrite the contents of the file in place instead of
+  // truncating it, so that space already allocated to the file is
+  // reused; data past the end of what is written may remain.  On
+  // failure stores NULL in *result and returns non-OK.
+  //
+  // The default implementation calls RenameFile() and NewWritableFile().
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -125,6 +137,32 @@ class Env {
       void (*function)(void* arg),
       void* arg) = 0;
 
+  // Background work is run by one of two thread pools.  Short, latency
+  // sensitive jobs (e.g., writing out a full memtable) should use
+  // kHighPriority so that they do not queue up behind long running
+  // kLowPriority jobs (e.g., large compactions).
+  enum Priority {
+    kLowPriority,
+    kHighPriority
+  };
+
+  // Like Schedule(), but runs "(*function)(arg)" in the thread pool
+  // associated with "pri".  Schedule(f, a) is equivalent to
+  // ScheduleWithPriority(f, a, kLowPriority).
+  //
+  // The default implementation ignores "pri" and calls Schedule().
+  virtual void ScheduleWithPriority(
+      void (*function)(void* arg),
+      void* arg,
+      Priority pri);
+
+  // Allow up to "number" threads to concurrently run work scheduled
+  // with priority "pri".  Pools never shrink: a "number" that is smaller
+  // than the current size of the pool is ignored.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -151,6 +189,39 @@ class Env {
   void operator=(const Env&);
 };
 
+// Options for an Env created by NewPosixEnv().
+struct PosixEnvOptions {
+  // If true, table files are written with O_DIRECT, from aligned
+  // buffers, so that writing out memtables and compactions does not
+  // fill the page cache and evict other data from it.
+  // Default: false
+  bool use_direct_writes;
+
+  // If true, table files are read with O_DIRECT rather than mapped into
+  // memory, so that only Options::block_cache caches their contents;
+  // consider making it larger than the default.
+  // Default: false
+  bool use_direct_reads;
+
+  // If non-zero, space for log files is allocated this many bytes at a
+  // time (with fallocate()) as they grow, so that syncing a log rarely
+  // has to update the size of the file as well as its contents.
+  // Logs written over recycled files (see
+  // Options::recycle_log_file_num) are not truncated when closed, so
+  // that the space stays allocated.
+  // Default: 0
+  size_t log_preallocation_bytes;
+
+  // Create a PosixEnvOptions object with default values for all fields.
+  PosixEnvOptions();
+};
+
+// Return a new Env for the local file system, configured by "options".
+// Files on file systems that do not support O_DIRECT are accessed
+// through the page cache.  Like Env::Default(), the result runs
+// background threads that are never stopped, and must never be deleted.
+extern Env* NewPosixEnv(const PosixEnvOptions& options);
+
 // A file abstraction for reading sequentially through a file
 class SequentialFile {
  public:
@@ -200,6 +271,19 @@ class RandomAccessFile {
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
 
+  // Hint that "n" bytes starting at "offset" will be read soon, so that
+  // the implementation may start fetching them.  The default
+  // implementation does nothing and returns NotSupported.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status Prefetch(uint64_t offset, size_t n) const;
+
+  // Return true if Read() never copies into "scratch" but sets "*result"
+  // to point into memory that stays live while the file is open (e.g.
+  // because the file is mmapped).  Callers may then pass a NULL scratch
+  // buffer.  The default implementation returns false.
+  virtual bool ServesFromMemory() const;
+
  private:
   // No copying allowed
   RandomAccessFile(const RandomAccessFile&);
@@ -289,6 +373,10 @@ class EnvWrapper : public Env {
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     return target_->NewWritableFile(f, r);
   }
+  Status ReuseWritableFile(const std::string& f, const std::string& old_f,
+                           WritableFile** r) {
+    return target_->ReuseWritableFile(f, old_f, r);
+  }
   bool FileExists(const std::string& f) { return target_->FileExists(f); }
   Status GetChildren(const std::string& dir, std::vector<std::string>* r) {
     return target_->GetChildren(dir, r);
@@ -309,6 +397,12 @@ class EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) {
     return target_->Schedule(f, a);
   }
+  void ScheduleWithPriority(void (*f)(void*), void* a, Priority pri) {
+    return target_->ScheduleWithPriority(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) {
+    return target_->SetBackgroundThreads(number, pri);
+  }
   void StartThread(void (*f)(void*), void* a) {
     return target_->StartThread(f, a);
   }
@@ -65,6 +65,21 @@ class FilterPolicy {
 // trailing spaces in keys.
 extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a blocked bloom filter with
+// approximately the specified number of bits per key.  All probes for
+// a key fall in one 32-byte block, so a negative lookup costs about
+// one cache miss instead of one per probe, and the probes are checked
+// with SIMD instructions where available.  Each key always sets 8 bits,
+// so the false positive rate for a given bits_per_key is about the same
+// as NewBloomFilterPolicy()'s: ~1% at 10 bits per key.
+//
+// The filters are not readable by NewBloomFilterPolicy() and vice
+// versa.  Tables record the name of the policy that built their
+// filters, so switching policies only disables the filters of existing
+// tables until they are compacted.  The note about custom comparators
+// above applies here too.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -0,0 +1,149 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom MemTableRepFactory object.
+// It creates the container that holds the entries of each in-memory
+// write buffer.  The default is a skiplist, which is a good fit for
+// mixed workloads.  Other representations trade generality for speed:
+//
+//   NewVectorRepFactory()      -- appends in O(1) and sorts once the
+//                                 memtable stops taking writes.  Good
+//                                 for bulk loads; reads of a memtable
+//                                 that is still being written are slow.
+//   NewHashSkipListRepFactory() -- hashes a fixed-length prefix of the
+//                                 user key into buckets of small
+//                                 skiplists.  Speeds up point lookups;
+//                                 full scans have to sort all entries.
+//
+// Entries are opaque byte strings owned by the memtable.  A
+// representation only stores pointers to them and orders them with the
+// KeyComparator it was created with.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+
+#include <stddef.h>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Arena;
+
+class MemTableRep {
+ public:
+  // Orders entries.  Lookup keys passed to FindGreaterOrEqual() and
+  // Iterator::Seek() use the same encoding as entries.
+  class KeyComparator {
+   public:
+    virtual ~KeyComparator();
+
+    // Three-way comparison of two entries.
+    virtual int operator()(const char* a, const char* b) const = 0;
+
+    // Return the user key portion of an entry.
+    virtual Slice UserKey(const char* entry) const = 0;
+  };
+
+  // Iteration over the entries of a representation, in KeyComparator
+  // order.  An iterator may or may not observe entries inserted after
+  // it was created.
+  class Iterator {
+   public:
+    virtual ~Iterator();
+    virtual bool Valid() const = 0;
+
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    // REQUIRES: Valid()
+    virtual void Next() = 0;
+
+    // REQUIRES: Valid()
+    virtual void Prev() = 0;
+
+    // Advance to the first entry at or after target
+    virtual void Seek(const char* target) = 0;
+
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+  };
+
+  virtual ~MemTableRep();
+
+  // Insert entry into the representation.
+  // REQUIRES: nothing that compares equal to entry is already present.
+  // REQUIRES: no other thread is inserting at the same time.
+  virtual void Insert(const char* entry) = 0;
+
+  // Like Insert(), but may be called from several threads at once.
+  // Only called if the factory's IsInsertConcurrentlySupported() is true.
+  virtual void InsertConcurrently(const char* entry);
+
+  // Return the first entry at or after key, or NULL if there is none.
+  // Representations that partition their entries may search only the
+  // partition that holds key's user key; callers only use the result
+  // if it has the same user key as key.
+  virtual const char* FindGreaterOrEqual(const char* key) const = 0;
+
+  // Called once no more entries will be inserted.
+  virtual void MarkReadOnly() { }
+
+  // Memory used outside of the arena passed to the factory, in bytes.
+  // May be called while another thread is inserting.
+  virtual size_t ApproximateMemoryUsage() = 0;
+
+  // Return a new iterator over the entries.  The caller must delete it
+  // before the representation is destroyed.
+  virtual Iterator* NewIterator() = 0;
+};
+
+class MemTableRepFactory {
+ public:
+  virtual ~MemTableRepFactory();
+
+  // Return the name of this kind of representation.
+  virtual const char* Name() const = 0;
+
+  // Return a new representation.  "cmp" and "arena" outlive the result,
+  // and entries are allocated from "arena".
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const = 0;
+
+  // Can the representations handle InsertConcurrently()?  If not,
+  // Options::allow_concurrent_memtable_write is ignored.
+  virtual bool IsInsertConcurrentlySupported() const { return false; }
+};
+
+// Return a factory for skiplist memtables, the default.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.  The same applies to the factories below.
+extern const MemTableRepFactory* NewSkipListRepFactory();
+
+// Return a factory for memtables that keep entries in an unsorted
+// array until they are flushed.  "reserve" is the number of entries to
+// make room for up front; 0 is fine.
+//
+// While the memtable takes writes, each Get() scans every entry, and
+// each iterator copies and sorts them, all under a lock that writers
+// also take.  The array is sorted once, by the first read after the
+// memtable is full; later reads of it are binary searches.  Use it for
+// bulk loads that do not read what they write.
+extern const MemTableRepFactory* NewVectorRepFactory(size_t reserve);
+
+// Return a factory for memtables that hash the first "prefix_length"
+// bytes of each user key (the whole key if it is shorter) into one of
+// "bucket_count" skiplists.  A bucket_count of a few times the number
+// of distinct prefixes in one memtable works well.
+//
+// Get() only searches one bucket, but each iterator copies and sorts
+// the entries of all buckets, so each scan pays O(n log n) up front.
+// Once the memtable is full, the sorted copy is made once and shared by
+// later iterators, including the one that flushes it.
+extern const MemTableRepFactory* NewHashSkipListRepFactory(
+    size_t prefix_length, size_t bucket_count);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <deque>
+#include <string>
+
+namespace leveldb {
+
+class Logger;
+class Slice;
+
+// A MergeOperator combines the operands written with DB::Merge() into
+// the value of a key.  Merge() records an operand without reading the
+// key, so an update such as an increment or an append costs a single
+// write; the operands are applied when the key is read and when
+// compactions meet them together with the value they apply to.
+//
+// A MergeOperator implementation must be thread-safe since leveldb may
+// invoke its methods concurrently from multiple threads.
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Applies "operands", oldest first, to "existing_value", the value
+  // the key had before the oldest operand, or NULL if it had none (it
+  // was never written or was deleted).  Stores the result in *new_value
+  // and returns true on success.  Returning false marks the key as
+  // corrupt: reads of it and compactions that meet it fail.
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::deque<std::string>& operands,
+                         std::string* new_value,
+                         Logger* logger) const = 0;
+
+  // If applying "left_operand" and then "right_operand", the newer of
+  // the two, to any value has the same effect as applying a single
+  // operand, stores that operand in *new_value and returns true.
+  // Compactions use this to combine operands whose value is not at hand.
+  //
+  // The default implementation returns false.
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value,
+                            Logger* logger) const;
+
+  // The name of the merge operator.
+  virtual const char* Name() const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,14 +6,22 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <vector>
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MemTableRepFactory;
+class MergeOperator;
+class RateLimiter;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -24,7 +32,46 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression     = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZlibCompression   = 0x2
+
+  // Types from 0x80 up are free for compressors registered with
+  // RegisterCompressor() (see compressor.h).
+};
+
+// How the filters built with Options::filter_policy are laid out in a
+// table.  Tables record their layout, so a database may hold a mix.
+enum FilterType {
+  // One filter per 2KB range of data block offsets.  A lookup consults
+  // the index block first.  Readable by all versions of leveldb.
+  kBlockFilter = 0x0,
+
+  // One filter over every key in the table.  A lookup for an absent
+  // key is answered with a single probe, before the index is searched.
+  kFullFilter = 0x1,
+
+  // A full filter split into partitions of options.filter_partition_keys
+  // keys each.  A small index locates the partition for a key; the
+  // partitions are read on demand and, unless ReadOptions::fill_cache
+  // is false, kept in the block cache.  Useful
+  // for very large tables, whose filters would otherwise all have to
+  // stay in memory.
+  kPartitionedFilter = 0x2
+};
+
+// How table files are organized and compacted.
+enum CompactionStyle {
+  // Files are kept in levels of exponentially growing size, each of
+  // which holds disjoint key ranges.  Reads touch few files, but each
+  // byte is rewritten roughly once per level on its way down.
+  kCompactionStyleLevel = 0x0,
+
+  // Every table file is a sorted run in level-0, and runs of similar
+  // size are merged into one.  Each byte is rewritten far fewer times,
+  // at the cost of more runs to search on reads and of up to
+  // universal_max_size_amplification_percent extra space.  Files that
+  // an existing database already has past level-0 stay where they are.
+  kCompactionStyleUniversal = 0x1
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -40,6 +87,20 @@ struct Options {
   // comparator provided to previous open calls on the same DB.
   const Comparator* comparator;
 
+  // If non-NULL, use the specified operator to apply the operands
+  // written with DB::Merge() (see merge_operator.h).  A database that
+  // holds merge operands must be opened with an operator that applies
+  // them the same way, or reads of the keys they belong to fail.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
+  // If non-NULL, compactions pass the values they copy to this filter,
+  // which may delete them or change them (see compaction_filter.h).
+  //
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
   // If true, the database will be created if it is missing.
   // Default: false
   bool create_if_missing;
@@ -82,6 +143,23 @@ struct Options {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // If non-NULL, use the specified factory to create the in-memory
+  // representation of each write buffer.  See memtablerep.h for the
+  // built-in choices.
+  //
+  // Default: NULL, which uses a skiplist
+  const MemTableRepFactory* memtable_factory;
+
+  // If non-zero, up to this many log files that are no longer needed
+  // are kept and written over by new logs (see Env::ReuseWritableFile)
+  // instead of being deleted.  Writing over a file whose space is
+  // already allocated spares the file system from updating the file's
+  // metadata whenever the log is synced.  Logs are then written in a
+  // format that versions of leveldb without this option cannot read.
+  //
+  // Default: 0
+  size_t recycle_log_file_num;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -89,6 +167,115 @@ struct Options {
   // Default: 1000
   int max_open_files;
 
+  // How table files are organized and compacted; see CompactionStyle.
+  //
+  // Default: kCompactionStyleLevel
+  CompactionStyle compaction_style;
+
+  // With kCompactionStyleUniversal, a compaction starts once there are
+  // as many runs as the level-0 compaction trigger.  Going from the
+  // newest run to older ones, a run is merged with the runs newer than
+  // it if it is at most universal_size_ratio percent larger than their
+  // combined size; merges of fewer than universal_min_merge_width runs
+  // are not done, and merges are cut off at universal_max_merge_width
+  // runs (zero for no limit).  If no such merge is found, the newest
+  // runs are merged.  All runs are merged into one once the runs but
+  // the oldest take up universal_max_size_amplification_percent of the
+  // size of the oldest one.
+  //
+  // Default: 1, 2, 0 and 200
+  int universal_size_ratio;
+  int universal_min_merge_width;
+  int universal_max_merge_width;
+  int universal_max_size_amplification_percent;
+
+  // If non-zero, table files written more than this many seconds ago are
+  // compacted even if no level needs it, so that compaction_filter, and
+  // the removal of deleted and overwritten data, reach every key at
+  // least this often.  Files past level-0 are rewritten by themselves.
+  // Files of unknown age (written by older versions, or recovered by
+  // RepairDB) are given ages spread over this period when the database
+  // is opened, so they are rewritten gradually rather than all at once.
+  //
+  // While some column family sets this, the database runs a thread that
+  // checks the ages of files once a second, so that files of a database
+  // that takes no writes are compacted too.
+  //
+  // Default: 0
+  uint64_t periodic_compaction_seconds;
+
+  // Maximum number of compactions that may run concurrently in the
+  // background.  Compactions only run in parallel if they touch disjoint
+  // sets of files.  Memtable flushes are scheduled separately at
+  // Env::kHighPriority and do not count against this limit.  The DB
+  // grows the low priority thread pool of "env" to this many threads.
+  //
+  // Default: 1
+  int max_background_compactions;
+
+  // Maximum number of threads that merge a single compaction.  Large
+  // compactions are split at input file boundaries into up to this many
+  // key ranges that are merged in parallel, each into its own output
+  // files; the results are installed together.  The ranges are merged
+  // by the low priority thread pool, and by the compacting thread
+  // itself when the pool is busy, so no threads are added for them.
+  //
+  // Default: 1
+  int max_subcompactions;
+
+  // If true, the log write for one group of concurrent writers may
+  // proceed while the previous group is still being inserted into the
+  // memtable.  Writes only become visible to readers in sequence order.
+  //
+  // Default: false
+  bool enable_pipelined_write;
+
+  // If true, each writer in a group inserts its own batch into the
+  // memtable in parallel with the others, instead of the group leader
+  // inserting all of them.  Ignored if memtable_factory does not
+  // support concurrent inserts.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write;
+
+  // Writes are slowed down once level-0 has this many files, and
+  // stopped once it has level0_stop_writes_trigger files, until
+  // compactions bring the count back down.  Values below the number of
+  // level-0 files that triggers a compaction are raised to it, and the
+  // stop trigger is raised to the slowdown trigger plus one.
+  //
+  // Default: 8 and 12
+  int level0_slowdown_writes_trigger;
+  int level0_stop_writes_trigger;
+
+  // Writes are slowed down once the estimated number of bytes that
+  // compactions need to rewrite to bring every level back within its
+  // size limit reaches the soft limit, and stopped once it reaches the
+  // hard limit.  Zero disables the corresponding limit.
+  //
+  // Default: 64MB and 256MB
+  uint64_t soft_pending_compaction_bytes_limit;
+  uint64_t hard_pending_compaction_bytes_limit;
+
+  // Rate, in bytes per second, at which writes are admitted when they
+  // start being slowed down.  The rate falls in proportion to how far
+  // the level-0 file count or the compaction debt has moved from its
+  // slowdown threshold towards its stop threshold, so that writers are
+  // held back gradually instead of all at once.
+  //
+  // Default: 16MB/s
+  uint64_t delayed_write_rate;
+
+  // If non-NULL, flushes and compactions request the bytes of the
+  // tables they write and compactions the bytes of the tables they
+  // read from this limiter, which bounds the rate of that I/O so that
+  // it does not starve foreground reads of disk bandwidth.  Flushes
+  // request at Env::kHighPriority and compactions at
+  // Env::kLowPriority.  The limiter may be shared by several databases
+  // and must outlive them.  See NewRateLimiter() in rate_limiter.h.
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -112,6 +299,20 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // If true, each data block of a new table ends with a small hash
+  // index from keys to restart points, which lets a point lookup skip
+  // the binary search over the restart points and, if the key is not
+  // in the block, the scan of the entries as well.  Range scans are
+  // unaffected.  Costs about one byte per key.  Blocks with more than
+  // 253 restart points, and blocks of tables whose comparator does not
+  // support Comparator::HashKey(), are written without an index.
+  //
+  // Tables written with the index cannot be read by versions of leveldb
+  // that do not know about it.
+  //
+  // Default: false
+  bool data_block_hash_index;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -126,8 +327,42 @@ struct Options {
   // worth switching to kNoCompression.  Even if the input data is
   // incompressible, the kSnappyCompression implementation will
   // efficiently detect that and will switch to uncompressed mode.
+  //
+  // kZlibCompression compresses about twice as well as snappy but is
+  // several times slower.  Blocks are stored uncompressed if leveldb
+  // was built without the library for the chosen compression.
   CompressionType compression;
 
+  // If non-empty, tables written to level L are compressed with
+  // compression_per_level[L] instead of "compression", and tables at
+  // deeper levels with the last element.  For example,
+  //   {kNoCompression, kNoCompression, kSnappyCompression, kZlibCompression}
+  // spends no CPU on the small, frequently read and rewritten upper
+  // levels and compresses the large bottom levels harder.  Memtables
+  // are compressed as level 0 even if their table is placed deeper.
+  //
+  // Default: empty
+  std::vector<CompressionType> compression_per_level;
+
+  // If non-zero and the compression of a table supports dictionaries
+  // (e.g. kZlibCompression), the table builder samples up to this many
+  // bytes of the first entries of the table into a dictionary, stores
+  // it in the table and compresses each data block against it.  Blocks
+  // of small, similar values (e.g. JSON records) share much more with
+  // a dictionary sampled from their neighbours than they find within
+  // themselves, so this improves their compression without enlarging
+  // blocks.  The builder buffers 16 times this many bytes of entries
+  // to sample from, and each open table keeps its dictionary in
+  // memory.  zlib uses at most 32KB of a dictionary.
+  //
+  // Tables whose compression does not support dictionaries are written
+  // as if this were zero.  DB::Open() and CreateColumnFamily() return
+  // InvalidArgument if none of "compression" (or, if it is non-empty,
+  // compression_per_level) supports them, e.g. for kSnappyCompression.
+  //
+  // Default: 0
+  size_t compression_dict_bytes;
+
   // If non-NULL, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
@@ -135,6 +370,32 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // Layout of the filters in newly written tables.  Ignored if
+  // filter_policy is NULL.
+  //
+  // Default: kBlockFilter
+  FilterType filter_type;
+
+  // Approximate number of keys summarized by each filter partition when
+  // filter_type is kPartitionedFilter.
+  //
+  // Default: 4096
+  int filter_partition_keys;
+
+  // If non-NULL, the filters of newly written tables also summarize the
+  // prefixes that this transform extracts from their keys (see
+  // slice_transform.h).  Iterators created with
+  // ReadOptions::prefix_same_as_start then skip the tables whose filter
+  // shows that they hold no key with the prefix they seek to.  Only
+  // tables with filter_type kFullFilter are skipped.
+  //
+  // Filters are built and used for a given pair of filter_policy and
+  // prefix_extractor, so changing the prefix_extractor disables the
+  // filters of existing tables until compactions rewrite them.
+  //
+  // Default: NULL
+  const SliceTransform* prefix_extractor;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -158,10 +419,46 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // If non-zero, iterators read table files ahead of their position, up
+  // to "readahead_size" bytes at a time, so that scans fetch many data
+  // blocks per read instead of one.  Iterators read ahead little just
+  // after a seek and more as they keep moving forward.  Has no effect
+  // on Get() or when the table files are mmapped.
+  // Default: 0
+  size_t readahead_size;
+
+  // If non-NULL, iterators request the bytes they read from table
+  // files from this limiter at Env::kLowPriority.  Compactions read
+  // their inputs with Options::rate_limiter.  Has no effect on Get().
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
+  // If true and the column family has a prefix_extractor, an iterator
+  // only yields the keys that have the same prefix as the target of the
+  // last Seek(), and skips the tables whose filter shows that they hold
+  // no such key without reading their index or data blocks.
+  // SeekToFirst() and SeekToLast() ignore prefixes.  Scans must not
+  // change direction (e.g. call Prev() after Seek()), which may miss
+  // keys.
+  // Default: false
+  bool prefix_same_as_start;
+
+  // If non-NULL, iterators treat the keys at or past *iterate_upper_bound
+  // as absent: they become invalid on reaching the first such key
+  // instead of reading on through entries that are hidden or deleted,
+  // and SeekToLast() positions them at the last key before the bound.
+  // *iterate_upper_bound must remain live while the iterator is used.
+  // Default: NULL
+  const Slice* iterate_upper_bound;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        readahead_size(0),
+        rate_limiter(NULL),
+        prefix_same_as_start(false),
+        iterate_upper_bound(NULL) {
   }
 };
 
@@ -190,6 +487,19 @@ struct WriteOptions {
   }
 };
 
+// Options that control DB::IngestExternalFile()
+struct IngestExternalFileOptions {
+  // If true, the file is renamed into the database directory, which must
+  // be on the same file system, instead of being copied there.
+  //
+  // Default: false
+  bool move_files;
+
+  IngestExternalFileOptions()
+      : move_files(false) {
+  }
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
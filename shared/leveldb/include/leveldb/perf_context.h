@@ -0,0 +1,70 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext counts the work done by the database operations of one
+// thread, e.g. to find out where a slow Get() spent its time:
+//
+//   leveldb::SetPerfLevel(leveldb::kPerfEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   fprintf(stderr, "%s\n", leveldb::GetPerfContext()->ToString().c_str());
+//
+// Counting is cheap and on by default.  Timings need two clock reads
+// each and are only collected at kPerfEnableTime.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum PerfLevel {
+  kPerfDisable = 0,       // Collect nothing
+  kPerfEnableCount = 1,   // Collect the counts (default)
+  kPerfEnableTime = 2     // Collect the counts and the timings
+};
+
+// Set or return the perf level of the calling thread.
+extern void SetPerfLevel(PerfLevel level);
+extern PerfLevel GetPerfLevel();
+
+// Number of levels that get_from_level_count tracks.
+static const int kPerfContextNumLevels = 7;
+
+// All times are in microseconds.
+struct PerfContext {
+  // Set all the counters to zero.
+  void Reset();
+
+  // Return the non-zero counters as "name = value" pairs.
+  std::string ToString() const;
+
+  uint64_t block_cache_hit_count;   // Blocks found in the block cache
+  uint64_t block_cache_miss_count;  // Blocks not found in the block cache
+  uint64_t block_read_count;        // Blocks read from table files
+  uint64_t block_read_byte;         // Bytes of the blocks read
+  uint64_t block_read_time;         // Time spent reading blocks
+
+  uint64_t bloom_useful_count;      // Filter probes that skipped a table
+  uint64_t bloom_useless_count;     // Filter probes that let a missing
+                                    // key through
+  uint64_t get_from_memtable_count;  // Lookups answered by a memtable
+  // Lookups answered by a table file at each level
+  uint64_t get_from_level_count[kPerfContextNumLevels];
+
+  uint64_t db_mutex_wait_time;      // Time spent acquiring the DB mutex
+  uint64_t wal_write_time;          // Time spent appending to the log
+  uint64_t wal_sync_time;           // Time spent syncing the log
+  uint64_t write_stall_time;        // Time writes were delayed or stopped
+                                    // to let compactions catch up
+};
+
+// Return the perf context of the calling thread.
+extern PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
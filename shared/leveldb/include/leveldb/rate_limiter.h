@@ -0,0 +1,50 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate of the background I/O of databases:
+// the writes of the tables that flushes and compactions build and the
+// reads of compaction inputs.  Flushes free up memtable space that
+// writers may be waiting for, so they run at Env::kHighPriority and
+// take precedence over compactions, which run at Env::kLowPriority.
+//
+// A RateLimiter has internal synchronization, so one limiter may be
+// shared by all the databases of a process to bound their total I/O.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+class RateLimiter {
+ public:
+  RateLimiter() { }
+  virtual ~RateLimiter();
+
+  // Block until "bytes" bytes of I/O at "priority" may proceed.
+  virtual void Request(size_t bytes, Env::Priority priority) = 0;
+
+  // Return the number of bytes per second that this limiter allows.
+  virtual uint64_t GetBytesPerSecond() const = 0;
+
+ private:
+  // No copying allowed
+  RateLimiter(const RateLimiter&);
+  void operator=(const RateLimiter&);
+};
+
+// Create a token bucket limiter that allows "bytes_per_second" bytes of
+// I/O per second.  The tokens are refilled every 100 milliseconds, and
+// tokens left unused at a refill are dropped, so bursts are limited to
+// a tenth of the rate.  Waiting kHighPriority requests are granted
+// before kLowPriority ones, except that every tenth refill goes to the
+// kLowPriority requests first so that compactions cannot starve.
+extern RateLimiter* NewRateLimiter(uint64_t bytes_per_second);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps keys to prefixes.  When Options::prefix_extractor
+// is set, the filters of newly written tables also summarize the prefixes
+// of their keys, so that iterators created with
+// ReadOptions::prefix_same_as_start can skip the tables that hold no key
+// with the prefix they seek to.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Slice;
+
+class SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  Tables record the name of the
+  // transform whose prefixes their filters hold, and only use the
+  // filters while the same name is configured, so the name must be
+  // changed if the prefixes the transform returns change.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  Keys that compare equal must have
+  // equal prefixes, and all the keys with a given prefix must be
+  // adjacent in the comparator's order.
+  //
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if "key" has a prefix.  Keys without one are not
+  // summarized by their prefix, and seeks to them are not limited.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix of a key is its first "prefix_len"
+// bytes.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,72 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any database, which
+// DB::IngestExternalFile() can then add to a database without writing
+// its entries through the log and memtable.
+//
+// Multiple threads can invoke const methods on an SstFileWriter without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same SstFileWriter must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class SstFileWriter {
+ public:
+  // "options" should be the options of the database that the file will
+  // be ingested into.  Its comparator and filter_policy must be the
+  // ones the database uses; its block and compression settings shape
+  // the file.
+  explicit SstFileWriter(const Options& options);
+
+  // Abandons the file unless Finish() has been called.
+  ~SstFileWriter();
+
+  // Create the file named "fname", replacing any existing file.
+  Status Open(const std::string& fname);
+
+  // Add an entry that sets "key" to "value".
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  // REQUIRES: key is after any previously added key according to the
+  // comparator; otherwise an InvalidArgument error is returned.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Add an entry that deletes "key" from the database that the file is
+  // ingested into.  Same requirements as Put().
+  Status Delete(const Slice& key);
+
+  // Finish writing the file, sync it and close it.  Returns an error if
+  // no entry was added.
+  Status Finish();
+
+  // Number of entries added so far.
+  uint64_t NumEntries() const;
+
+  // Size of the file generated so far.  If invoked after a successful
+  // Finish() call, returns the size of the final file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  // No copying allowed
+  SstFileWriter(const SstFileWriter&);
+  void operator=(const SstFileWriter&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
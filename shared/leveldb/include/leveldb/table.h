@@ -55,6 +55,11 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns false if the table's full filter (see Options::filter_type)
+  // shows that "key" was not among the keys it summarizes.  Returns true
+  // if it may have been, or if the table has no full filter.
+  bool FullFilterMayMatch(const Slice& key) const;
+
  private:
   struct Rep;
   Rep* rep_;
@@ -62,18 +67,56 @@ class Table {
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // BlockReader() for iterators that read through a file of their own
+  // (see ReadOptions::readahead_size and ReadOptions::rate_limiter).
+  struct IteratorFileState;
+  static Iterator* IteratorFileBlockReader(void*, const ReadOptions&,
+                                           const Slice&);
+  static void DeleteIteratorFileState(void* arg, void* ignored);
+
+  // Return an iterator over the data block that index_value points to,
+  // reading it from "file" if it is not cached.  If lookup_key is
+  // non-NULL, the iterator is positioned for a point lookup of
+  // *lookup_key (see Block::NewLookupIterator()).
+  Iterator* DataBlockIterator(const ReadOptions& options,
+                              RandomAccessFile* file,
+                              const Slice& index_value,
+                              const Slice* lookup_key);
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key).  May not make such a call if filter policy or the
+  // data block's hash index says that key is not present.  If no entry
+  // has key's hash key (see Comparator::HashKey()), the call may be
+  // made with a different entry than Seek(key) would find.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
-
-  void ReadMeta(const Footer& footer);
+  // Like InternalGet(keys[i], args[i], handle_result) for each i in
+  // [0,n-1], with the outcome stored in statuses[i].  Keys that share a
+  // data block are looked up in one pass, and blocks that are not cached
+  // are read together.  Keys should be sorted.
+  void InternalMultiGet(
+      const ReadOptions&, const Slice* keys, int n,
+      void* const* args,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v),
+      Status* statuses);
+
+  Status ReadMeta(const Footer& footer);
+  Status ReadCompressionDictionary(const Slice& dict_handle_value);
+  void ReadFilters(Iterator* meta_iter);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadFullFilter(const Slice& filter_handle_value);
+  void ReadFilterPartitionIndex(const Slice& index_handle_value);
+
+  // Return false if the table's filter partitions show that key is
+  // absent.
+  bool PartitionMayMatch(const ReadOptions& options, const Slice& key);
+
+  // Return true if lookups consult a filter of any type.
+  bool HasFilter() const;
 
   // No copying allowed
   Table(const Table&);
@@ -70,14 +70,21 @@ class TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
-  // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Size of the file generated so far, counting entries buffered to
+  // sample a compression dictionary from at their uncompressed size.
+  // If invoked after a successful Finish() call, returns the size of
+  // the final generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
+  void AddToBlock(const Slice& key, const Slice& value);
+  void WriteBuffered();
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void WriteCompressedBlock(const Slice& raw, const Slice& dict,
+                            BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void WriteFilterPartition(const Slice& index_key);
 
   struct Rep;
   Rep* rep_;
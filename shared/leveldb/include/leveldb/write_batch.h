@@ -21,11 +21,13 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 
+#include <stdint.h>
 #include <string>
 #include "leveldb/status.h"
 
 namespace leveldb {
 
+class ColumnFamilyHandle;
 class Slice;
 
 class WriteBatch {
@@ -39,6 +41,30 @@ class WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Store the mapping "key->value" in the specified column family.
+  void Put(ColumnFamilyHandle* column_family,
+           const Slice& key, const Slice& value);
+
+  // Erase the mapping for "key" from the specified column family.
+  void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+
+  // Record "value" as a merge operand for "key": the value of "key"
+  // becomes the result of applying the operand to its current value
+  // with Options::merge_operator.
+  void Merge(const Slice& key, const Slice& value);
+
+  // Like Merge() above, for the specified column family.
+  void Merge(ColumnFamilyHandle* column_family,
+             const Slice& key, const Slice& value);
+
+  // Erase the mappings of all the keys in ["begin_key", "end_key"),
+  // as a single record however many keys the range holds.
+  void DeleteRange(const Slice& begin_key, const Slice& end_key);
+
+  // Like DeleteRange() above, for the specified column family.
+  void DeleteRange(ColumnFamilyHandle* column_family,
+                   const Slice& begin_key, const Slice& end_key);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -48,6 +74,28 @@ class WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+
+    // Called for the entries of column families other than the default
+    // one, whose entries are passed to Put() and Delete().  The default
+    // implementations ignore them.
+    virtual void PutCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value);
+    virtual void DeleteCF(uint32_t column_family_id, const Slice& key);
+
+    // Called for merge operands, those of column families other than
+    // the default one going to MergeCF().  The default implementations
+    // ignore them.
+    virtual void Merge(const Slice& key, const Slice& value);
+    virtual void MergeCF(uint32_t column_family_id,
+                         const Slice& key, const Slice& value);
+
+    // Called for range deletions, those of column families other than
+    // the default one going to DeleteRangeCF().  The default
+    // implementations ignore them.
+    virtual void DeleteRange(const Slice& begin_key, const Slice& end_key);
+    virtual void DeleteRangeCF(uint32_t column_family_id,
+                               const Slice& begin_key,
+                               const Slice& end_key);
   };
   Status Iterate(Handler* handler) const;
 
@@ -123,6 +123,14 @@ class AtomicPointer {
     MemoryBarrier();
     rep_ = v;
   }
+  inline bool CompareAndSwap(void* expected, void* desired) {
+#if defined(OS_WIN) && defined(COMPILER_MSVC)
+    return InterlockedCompareExchangePointer(
+        &rep_, desired, expected) == expected;
+#else
+    return __sync_bool_compare_and_swap(&rep_, expected, desired);
+#endif
+  }
 };
 
 // AtomicPointer based on <cstdatomic>
@@ -145,6 +153,9 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     rep_.store(v, std::memory_order_relaxed);
   }
+  inline bool CompareAndSwap(void* expected, void* desired) {
+    return rep_.compare_exchange_strong(expected, desired);
+  }
 };
 
 // Atomic pointer based on sparc memory barriers
@@ -175,6 +186,9 @@ class AtomicPointer {
   }
   inline void* NoBarrier_Load() const { return rep_; }
   inline void NoBarrier_Store(void* v) { rep_ = v; }
+  inline bool CompareAndSwap(void* expected, void* desired) {
+    return __sync_bool_compare_and_swap(&rep_, expected, desired);
+  }
 };
 
 // Atomic pointer based on ia64 acq/rel
@@ -205,6 +219,9 @@ class AtomicPointer {
   }
   inline void* NoBarrier_Load() const { return rep_; }
   inline void NoBarrier_Store(void* v) { rep_ = v; }
+  inline bool CompareAndSwap(void* expected, void* desired) {
+    return __sync_bool_compare_and_swap(&rep_, expected, desired);
+  }
 };
 
 // We have neither MemoryBarrier(), nor <cstdatomic>
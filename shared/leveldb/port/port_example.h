@@ -42,6 +42,28 @@ class Mutex {
   void AssertHeld();
 };
 
+// A RWMutex is a lock that may be held by many readers at once, or by
+// a single writer.
+class RWMutex {
+ public:
+  RWMutex();
+  ~RWMutex();
+
+  // Acquire a shared lock.  Waits while a writer holds the lock.
+  void ReadLock();
+
+  // Acquire an exclusive lock.  Waits until all other holders exit.
+  void WriteLock();
+
+  // Release a lock acquired with ReadLock() or WriteLock() respectively.
+  // REQUIRES: This thread holds the corresponding lock.
+  void ReadUnlock();
+  void WriteUnlock();
+
+  // Optionally crash if this thread does not hold this lock.
+  void AssertHeld();
+};
+
 class CondVar {
  public:
   explicit CondVar(Mutex* mu);
@@ -53,6 +75,11 @@ class CondVar {
   // REQUIRES: this thread holds *mu
   void Wait();
 
+  // Like Wait(), but give up after about "micros" microseconds.
+  // Returns true iff the wait timed out.
+  // REQUIRES: this thread holds *mu
+  bool TimedWait(uint64_t micros);
+
   // If there are some threads waiting, wake up at least one of them.
   void Signal();
 
@@ -97,6 +124,11 @@ class AtomicPointer {
 
   // Set va as the stored pointer with no ordering guarantees.
   void NoBarrier_Store(void* v);
+
+  // If the stored pointer equals "expected", atomically replace it with
+  // "desired" and return true.  Otherwise leave it alone and return false.
+  // Acts as a full memory barrier.
+  bool CompareAndSwap(void* expected, void* desired);
 };
 
 // ------------------ Compression -------------------
@@ -122,6 +154,23 @@ extern bool Snappy_GetUncompressedLength(const char* input, size_t length,
 extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
                               char* output);
 
+// Store the zlib compression of "input[0,input_length-1]" in *output.
+// If dict_length is non-zero, store raw deflate data compressed against
+// the preset dictionary "dict[0,dict_length-1]" instead.  Returns false
+// if zlib is not supported by this port.
+extern bool Zlib_Compress(const char* input, size_t input_length,
+                          const char* dict, size_t dict_length,
+                          std::string* output);
+
+// Attempt to uncompress input[0,input_length-1], the output of
+// Zlib_Compress() with the same dictionary, into
+// output[0,output_length-1].  Returns true if successful, false if the
+// input is invalid or does not uncompress to exactly output_length
+// bytes, or if zlib is not supported by this port.
+extern bool Zlib_Uncompress(const char* input_data, size_t input_length,
+                            const char* dict, size_t dict_length,
+                            char* output, size_t output_length);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
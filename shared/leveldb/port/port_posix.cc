@@ -5,8 +5,10 @@
 #include "port/port_posix.h"
 
 #include <cstdlib>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 #include "util/logging.h"
 
 namespace leveldb {
@@ -27,6 +29,30 @@ void Mutex::Lock() { PthreadCall("lock", pthread_mutex_lock(&mu_)); }
 
 void Mutex::Unlock() { PthreadCall("unlock", pthread_mutex_unlock(&mu_)); }
 
+RWMutex::RWMutex() {
+  PthreadCall("init rwlock", pthread_rwlock_init(&mu_, NULL));
+}
+
+RWMutex::~RWMutex() {
+  PthreadCall("destroy rwlock", pthread_rwlock_destroy(&mu_));
+}
+
+void RWMutex::ReadLock() {
+  PthreadCall("read lock", pthread_rwlock_rdlock(&mu_));
+}
+
+void RWMutex::WriteLock() {
+  PthreadCall("write lock", pthread_rwlock_wrlock(&mu_));
+}
+
+void RWMutex::ReadUnlock() {
+  PthreadCall("read unlock", pthread_rwlock_unlock(&mu_));
+}
+
+void RWMutex::WriteUnlock() {
+  PthreadCall("write unlock", pthread_rwlock_unlock(&mu_));
+}
+
 CondVar::CondVar(Mutex* mu)
     : mu_(mu) {
     PthreadCall("init cv", pthread_cond_init(&cv_, NULL));
@@ -38,6 +64,21 @@ void CondVar::Wait() {
   PthreadCall("wait", pthread_cond_wait(&cv_, &mu_->mu_));
 }
 
+bool CondVar::TimedWait(uint64_t micros) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const uint64_t usecs = now.tv_usec + micros;
+  struct timespec deadline;
+  deadline.tv_sec = now.tv_sec + static_cast<time_t>(usecs / 1000000);
+  deadline.tv_nsec = static_cast<long>(usecs % 1000000) * 1000;
+  const int result = pthread_cond_timedwait(&cv_, &mu_->mu_, &deadline);
+  if (result == ETIMEDOUT) {
+    return true;
+  }
+  PthreadCall("timedwait", result);
+  return false;
+}
+
 void CondVar::Signal() {
   PthreadCall("signal", pthread_cond_signal(&cv_));
 }
@@ -45,7 +45,12 @@
 #ifdef SNAPPY
 #include <snappy.h>
 #endif
+
+#ifdef ZLIB
+#include <zlib.h>
+#endif
 #include <stdint.h>
+#include <string.h>
 #include <string>
 #include "port/atomic_pointer.h"
 
@@ -100,11 +105,31 @@ class Mutex {
   void operator=(const Mutex&);
 };
 
+class RWMutex {
+ public:
+  RWMutex();
+  ~RWMutex();
+
+  void ReadLock();
+  void WriteLock();
+  void ReadUnlock();
+  void WriteUnlock();
+  void AssertHeld() { }
+
+ private:
+  pthread_rwlock_t mu_;
+
+  // No copying
+  RWMutex(const RWMutex&);
+  void operator=(const RWMutex&);
+};
+
 class CondVar {
  public:
   explicit CondVar(Mutex* mu);
   ~CondVar();
   void Wait();
+  bool TimedWait(uint64_t micros);
   void Signal();
   void SignalAll();
  private:
@@ -147,6 +172,73 @@ inline bool Snappy_Uncompress(const char* input, size_t length,
 #endif
 }
 
+// The zlib functions compress against dict[0,dict_length-1] if
+// dict_length is non-zero.
+inline bool Zlib_Compress(const char* input, size_t length,
+                          const char* dict, size_t dict_length,
+                          ::std::string* output) {
+#ifdef ZLIB
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // Streams compressed against a dictionary are raw deflate data:
+  // they skip the zlib header and checksum, so that uncompressing
+  // them need not checksum the dictionary to check that it matches.
+  const int window_bits = (dict_length > 0) ? -MAX_WBITS : MAX_WBITS;
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits,
+                   8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  if (dict_length > 0 &&
+      deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dict),
+                           dict_length) != Z_OK) {
+    deflateEnd(&stream);
+    return false;
+  }
+  output->resize(deflateBound(&stream, length));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input));
+  stream.avail_in = length;
+  stream.next_out = reinterpret_cast<Bytef*>(&(*output)[0]);
+  stream.avail_out = output->size();
+  const int ret = deflate(&stream, Z_FINISH);
+  output->resize(stream.total_out);
+  deflateEnd(&stream);
+  return ret == Z_STREAM_END;
+#endif
+
+  return false;
+}
+
+inline bool Zlib_Uncompress(const char* input, size_t length,
+                            const char* dict, size_t dict_length,
+                            char* output, size_t output_length) {
+#ifdef ZLIB
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (dict_length == 0) {
+    if (inflateInit(&stream) != Z_OK) {
+      return false;
+    }
+  } else if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    return false;
+  } else if (inflateSetDictionary(&stream,
+                                  reinterpret_cast<const Bytef*>(dict),
+                                  dict_length) != Z_OK) {
+    inflateEnd(&stream);
+    return false;
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input));
+  stream.avail_in = length;
+  stream.next_out = reinterpret_cast<Bytef*>(output);
+  stream.avail_out = output_length;
+  const int ret = inflate(&stream, Z_FINISH);
+  const bool ok = (ret == Z_STREAM_END && stream.total_out == output_length);
+  inflateEnd(&stream);
+  return ok;
+#else
+  return false;
+#endif
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   return false;
 }
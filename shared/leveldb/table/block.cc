@@ -9,6 +9,7 @@
 #include <vector>
 #include <algorithm>
 #include "leveldb/comparator.h"
+#include "table/block_hash_index.h"
 #include "table/format.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -17,22 +18,42 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & ~kBlockHashIndexFlag;
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      hash_buckets_(NULL),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
   } else {
-    size_t max_restarts_allowed = (size_-sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    // Size of everything after the restart array
+    size_t trailer_size = sizeof(uint32_t);
+    bool ok = true;
+    if (DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & kBlockHashIndexFlag) {
+      trailer_size += sizeof(uint32_t);
+      ok = (size_ >= trailer_size);
+      if (ok) {
+        num_buckets_ = DecodeFixed32(data_ + size_ - trailer_size);
+        ok = (num_buckets_ > 0 && num_buckets_ <= size_ - trailer_size);
+      }
+      if (ok) {
+        trailer_size += num_buckets_;
+        hash_buckets_ = data_ + size_ - trailer_size;
+      }
+    }
+    if (ok) {
+      size_t max_restarts_allowed = (size_ - trailer_size) / sizeof(uint32_t);
+      ok = (NumRestarts() <= max_restarts_allowed);
+    }
+    if (!ok) {
+      // The size is too small for NumRestarts() or the hash index
       size_ = 0;
     } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      restart_offset_ = size_ - trailer_size - NumRestarts() * sizeof(uint32_t);
     }
   }
 }
@@ -202,6 +223,32 @@ class Block::Iter : public Iterator {
     }
   }
 
+  // See Block::NewLookupIterator().  "buckets" is the block's hash
+  // index, or NULL if it has none.
+  void Lookup(const Slice& target, const char* buckets, uint32_t num_buckets) {
+    Slice hash_key;
+    if (buckets == NULL || !comparator_->HashKey(target, &hash_key)) {
+      Seek(target);
+      return;
+    }
+    const uint8_t index = BlockHashIndexLookup(buckets, num_buckets, hash_key);
+    if (index == kBlockHashNoEntry) {
+      return;  // Leave the iterator !Valid()
+    }
+    if (index >= num_restarts_) {
+      // kBlockHashCollision, or a bad index that Seek() can sort out
+      Seek(target);
+      return;
+    }
+
+    // All entries with target's hash key are in restart interval
+    // "index", so the first entry >= target is in it or just after it.
+    SeekToRestartPoint(index);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+      // Keep skipping
+    }
+  }
+
   virtual void SeekToFirst() {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -265,4 +312,14 @@ Iterator* Block::NewIterator(const Comparator* cmp) {
   }
 }
 
+Iterator* Block::NewLookupIterator(const Comparator* cmp,
+                                   const Slice& target) {
+  if (size_ < sizeof(uint32_t) || NumRestarts() == 0) {
+    return NewIterator(cmp);
+  }
+  Iter* iter = new Iter(cmp, data_, restart_offset_, NumRestarts());
+  iter->Lookup(target, hash_buckets_, num_buckets_);
+  return iter;
+}
+
 }  // namespace leveldb
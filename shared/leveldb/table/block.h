@@ -22,14 +22,29 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
+
+  // Iterators refer to the contents of the block, not to the Block, so
+  // a Block that does not own its contents may be destroyed while its
+  // iterators are in use.
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Return an iterator for a point lookup of "target".  If the block
+  // holds entries with the same hash key as target (see
+  // Comparator::HashKey), the iterator is positioned as if by
+  // Seek(target).  Otherwise it is either !Valid() or positioned at an
+  // entry with a different hash key.  Faster than Seek() for blocks with
+  // a hash index.
+  Iterator* NewLookupIterator(const Comparator* comparator,
+                              const Slice& target);
+
  private:
   uint32_t NumRestarts() const;
 
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
+  const char* hash_buckets_;    // Hash index, or NULL if there is none
+  uint32_t num_buckets_;
   bool owned_;                  // Block owns data_[]
 
   // No copying allowed
@@ -25,6 +25,16 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If options.data_block_hash_index is set, the trailer may instead be:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// Each key's hash key is hashed to a bucket, which holds the index of
+// the restart interval in which the key occurs, kBlockHashNoEntry if no
+// key maps to the bucket, or kBlockHashCollision if keys in different
+// intervals do.
 
 #include "table/block_builder.h"
 
@@ -40,7 +50,8 @@ BlockBuilder::BlockBuilder(const Options* options)
     : options_(options),
       restarts_(),
       counter_(0),
-      finished_(false) {
+      finished_(false),
+      hash_index_(options->data_block_hash_index) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);       // First restart point is at offset 0
 }
@@ -52,12 +63,18 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_index_ = options_->data_block_hash_index;
+  hash_index_builder_.Reset();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                        // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +   // Restart array
-          sizeof(uint32_t));                      // Restart array length
+  size_t estimate = (buffer_.size() +                       // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));                     // Restart count
+  if (hash_index_) {
+    estimate += hash_index_builder_.EstimateSize();
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -65,7 +82,13 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (hash_index_ && !hash_index_builder_.empty() &&
+      num_restarts <= kBlockHashIndexMaxRestarts) {
+    hash_index_builder_.Finish(&buffer_);
+    num_restarts |= kBlockHashIndexFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
@@ -104,6 +127,16 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   last_key_.append(key.data() + shared, non_shared);
   assert(Slice(last_key_) == key);
   counter_++;
+
+  if (hash_index_) {
+    Slice hash_key;
+    if (restarts_.size() > kBlockHashIndexMaxRestarts ||
+        !options_->comparator->HashKey(key, &hash_key)) {
+      hash_index_ = false;
+    } else {
+      hash_index_builder_.Add(hash_key, restarts_.size() - 1);
+    }
+  }
 }
 
 }  // namespace leveldb
@@ -9,6 +9,7 @@
 
 #include <stdint.h>
 #include "leveldb/slice.h"
+#include "table/block_hash_index.h"
 
 namespace leveldb {
 
@@ -46,6 +47,8 @@ class BlockBuilder {
   int                   counter_;     // Number of entries emitted since restart
   bool                  finished_;    // Has Finish() been called?
   std::string           last_key_;
+  bool                  hash_index_;  // Build hash_index_builder_?
+  BlockHashIndexBuilder hash_index_builder_;
 
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
@@ -0,0 +1,62 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/block_hash_index.h"
+
+#include <assert.h>
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+static uint32_t HashIndexHash(const Slice& hash_key) {
+  return Hash(hash_key.data(), hash_key.size(), 0x2f6b7a13);
+}
+
+// Keep the buckets at most 75% full.
+static uint32_t NumBuckets(size_t num_entries) {
+  return static_cast<uint32_t>(num_entries + num_entries / 3 + 1);
+}
+
+void BlockHashIndexBuilder::Add(const Slice& hash_key, uint32_t restart_index) {
+  assert(restart_index < kBlockHashIndexMaxRestarts);
+  std::pair<uint32_t, uint32_t> entry(HashIndexHash(hash_key), restart_index);
+  // Consecutive versions of a key usually share a restart interval.
+  if (entries_.empty() || entries_.back() != entry) {
+    entries_.push_back(entry);
+  }
+}
+
+size_t BlockHashIndexBuilder::EstimateSize() const {
+  return NumBuckets(entries_.size()) + sizeof(uint32_t);
+}
+
+void BlockHashIndexBuilder::Finish(std::string* dst) const {
+  assert(!entries_.empty());
+  const uint32_t num_buckets = NumBuckets(entries_.size());
+  const size_t init_size = dst->size();
+  dst->resize(init_size + num_buckets, static_cast<char>(kBlockHashNoEntry));
+  char* buckets = &(*dst)[init_size];
+  for (size_t i = 0; i < entries_.size(); i++) {
+    char* bucket = &buckets[entries_[i].first % num_buckets];
+    const uint8_t restart_index = static_cast<uint8_t>(entries_[i].second);
+    if (static_cast<uint8_t>(*bucket) == kBlockHashNoEntry) {
+      *bucket = static_cast<char>(restart_index);
+    } else if (static_cast<uint8_t>(*bucket) != restart_index) {
+      // Keys in different restart intervals share the bucket, either
+      // because their hashes collide or because the versions of one key
+      // span several intervals.
+      *bucket = static_cast<char>(kBlockHashCollision);
+    }
+  }
+  PutFixed32(dst, num_buckets);
+}
+
+uint8_t BlockHashIndexLookup(const char* buckets, uint32_t num_buckets,
+                             const Slice& hash_key) {
+  assert(num_buckets > 0);
+  return static_cast<uint8_t>(buckets[HashIndexHash(hash_key) % num_buckets]);
+}
+
+}  // namespace leveldb
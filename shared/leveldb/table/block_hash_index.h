@@ -0,0 +1,63 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A block hash index maps the hash keys (see Comparator::HashKey) of the
+// entries in a data block to the restart interval that holds them.  It
+// is stored between the restart array and the restart count of the
+// block; see block_builder.cc for the format.
+
+#ifndef STORAGE_LEVELDB_TABLE_BLOCK_HASH_INDEX_H_
+#define STORAGE_LEVELDB_TABLE_BLOCK_HASH_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+// Set in the restart count of blocks that have a hash index.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+
+// Special bucket values.  Other values are restart indexes, so blocks
+// with more than kBlockHashIndexMaxRestarts restarts have no index.
+static const uint8_t kBlockHashNoEntry = 255;
+static const uint8_t kBlockHashCollision = 254;
+static const uint32_t kBlockHashIndexMaxRestarts = 253;
+
+class BlockHashIndexBuilder {
+ public:
+  BlockHashIndexBuilder() { }
+
+  void Reset() { entries_.clear(); }
+
+  bool empty() const { return entries_.empty(); }
+
+  // Record that an entry with the specified hash key starts in restart
+  // interval "restart_index".
+  void Add(const Slice& hash_key, uint32_t restart_index);
+
+  // Returns an estimate of the size of the encoded index.
+  size_t EstimateSize() const;
+
+  // Append the buckets and their count to *dst.
+  // REQUIRES: !empty()
+  void Finish(std::string* dst) const;
+
+ private:
+  // (hash, restart index) pairs, without adjacent duplicates
+  std::vector<std::pair<uint32_t, uint32_t> > entries_;
+};
+
+// Return the restart index recorded for hash_key in the "num_buckets"
+// buckets starting at "buckets", kBlockHashNoEntry if the block has no
+// entries with that hash key, or kBlockHashCollision if the index
+// cannot tell.
+extern uint8_t BlockHashIndexLookup(const char* buckets, uint32_t num_buckets,
+                                    const Slice& hash_key);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_BLOCK_HASH_INDEX_H_
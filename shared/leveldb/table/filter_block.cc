@@ -108,4 +108,89 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy)
+    : policy_(policy) {
+}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice FullFilterBlockBuilder::Finish() {
+  const size_t num_keys = start_.size();
+  result_.clear();
+  if (num_keys == 0) {
+    return Slice(result_);  // Empty filters do not match any keys
+  }
+
+  // Make list of keys from flattened key structure
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i+1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+  policy_->CreateFilter(&tmp_keys_[0], num_keys, &result_);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+  return Slice(result_);
+}
+
+void FullFilterBlockBuilder::Reset() {
+  keys_.clear();
+  start_.clear();
+  result_.clear();
+}
+
+FullFilterBlockReader::FullFilterBlockReader(const FilterPolicy* policy,
+                                             const Slice& contents)
+    : policy_(policy),
+      contents_(contents) {
+}
+
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) {
+  if (contents_.empty()) {
+    return false;  // Empty filters do not match any keys
+  }
+  return policy_->KeyMayMatch(key, contents_);
+}
+
+PartitionedFilterBlockBuilder::PartitionedFilterBlockBuilder(
+    const FilterPolicy* policy, int keys_per_partition)
+    : keys_per_partition_(keys_per_partition > 0 ? keys_per_partition : 1),
+      current_(policy),
+      num_partitions_(0) {
+}
+
+void PartitionedFilterBlockBuilder::AddKey(const Slice& key) {
+  current_.AddKey(key);
+}
+
+bool PartitionedFilterBlockBuilder::EndBlock() {
+  if (current_.NumKeys() < keys_per_partition_) {
+    return false;
+  }
+  CutPartition();
+  return true;
+}
+
+bool PartitionedFilterBlockBuilder::Finish() {
+  if (current_.NumKeys() == 0 && num_partitions_ > 0) {
+    return false;
+  }
+  CutPartition();
+  return true;
+}
+
+void PartitionedFilterBlockBuilder::CutPartition() {
+  Slice filter = current_.Finish();
+  filter_.assign(filter.data(), filter.size());
+  current_.Reset();
+  num_partitions_++;
+}
+
 }
@@ -5,6 +5,10 @@
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
 // into a single filter block.
+//
+// Tables may instead hold a single filter over all of their keys (a
+// "full" filter), optionally split into partitions that are found
+// through a small index.  See doc/table_format.txt.
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -63,6 +67,90 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+// A FullFilterBlockBuilder builds one filter over all keys added to it.
+//
+// The sequence of calls to FullFilterBlockBuilder must match the regexp:
+//      AddKey* Finish
+class FullFilterBlockBuilder {
+ public:
+  explicit FullFilterBlockBuilder(const FilterPolicy*);
+
+  void AddKey(const Slice& key);
+  size_t NumKeys() const { return start_.size(); }
+
+  // Return the filter over the keys added since construction or the
+  // last call to Reset().  The result stays valid until Reset().
+  Slice Finish();
+
+  // Forget all keys and the last filter so the builder can be reused.
+  void Reset();
+
+ private:
+  const FilterPolicy* policy_;
+  std::string keys_;              // Flattened key contents
+  std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::string result_;            // Filter data
+  std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
+
+  // No copying allowed
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&);
+  void operator=(const FullFilterBlockBuilder&);
+};
+
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  bool KeyMayMatch(const Slice& key);
+
+ private:
+  const FilterPolicy* policy_;
+  Slice contents_;
+};
+
+// A PartitionedFilterBlockBuilder builds a sequence of full filters,
+// each covering a contiguous range of keys.  Partitions are only cut at
+// data block boundaries, so the index key of the last block in a
+// partition separates it from the next one.  Only the partition being
+// built is kept in memory: the caller writes out each partition as soon
+// as it is cut.
+//
+// The sequence of calls must match the regexp:
+//      (AddKey* EndBlock)* Finish
+class PartitionedFilterBlockBuilder {
+ public:
+  // Partitions are cut once they hold at least keys_per_partition keys.
+  PartitionedFilterBlockBuilder(const FilterPolicy*, int keys_per_partition);
+
+  void AddKey(const Slice& key);
+
+  // Called after each data block.  Returns true iff the block ends a
+  // partition, whose keys are all <= the block's index key.
+  bool EndBlock();
+
+  // Cut the last partition, whose keys are all <= the index key of the
+  // last data block.  Returns true iff there is one; a table without
+  // keys still gets one, empty, partition.
+  bool Finish();
+
+  // Return the filter of the partition that the last call to EndBlock()
+  // or Finish() cut.  Valid until the next call to another method.
+  // REQUIRES: that call returned true
+  Slice PartitionFilter() const { return filter_; }
+
+ private:
+  void CutPartition();
+
+  const size_t keys_per_partition_;
+  FullFilterBlockBuilder current_;
+  size_t num_partitions_;
+  std::string filter_;
+
+  // No copying allowed
+  PartitionedFilterBlockBuilder(const PartitionedFilterBlockBuilder&);
+  void operator=(const PartitionedFilterBlockBuilder&);
+};
+
 }
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -121,6 +121,87 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, FullEmptyBuilder) {
+  FullFilterBlockBuilder builder(&policy_);
+  Slice block = builder.Finish();
+  ASSERT_EQ("", EscapeString(block));
+  FullFilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(! reader.KeyMayMatch("foo"));
+}
+
+TEST(FilterBlockTest, FullFilter) {
+  FullFilterBlockBuilder builder(&policy_);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  builder.AddKey("box");
+  builder.AddKey("box");
+  builder.AddKey("hello");
+  ASSERT_EQ(5, builder.NumKeys());
+  Slice block = builder.Finish();
+  FullFilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(reader.KeyMayMatch("bar"));
+  ASSERT_TRUE(reader.KeyMayMatch("box"));
+  ASSERT_TRUE(reader.KeyMayMatch("hello"));
+  ASSERT_TRUE(! reader.KeyMayMatch("missing"));
+  ASSERT_TRUE(! reader.KeyMayMatch("other"));
+
+  // A reset builder starts over
+  builder.Reset();
+  builder.AddKey("other");
+  Slice block2 = builder.Finish();
+  FullFilterBlockReader reader2(&policy_, block2);
+  ASSERT_TRUE(reader2.KeyMayMatch("other"));
+  ASSERT_TRUE(! reader2.KeyMayMatch("foo"));
+}
+
+TEST(FilterBlockTest, Partitions) {
+  PartitionedFilterBlockBuilder builder(&policy_, 3);
+
+  // First data block is not enough for a partition
+  builder.AddKey("a");
+  builder.AddKey("b");
+  ASSERT_TRUE(! builder.EndBlock());
+
+  // The second one fills the first partition, which is handed out at once
+  builder.AddKey("c");
+  builder.AddKey("d");
+  ASSERT_TRUE(builder.EndBlock());
+  const std::string first_filter = builder.PartitionFilter().ToString();
+
+  // The rest goes into the last partition
+  builder.AddKey("e");
+  ASSERT_TRUE(! builder.EndBlock());
+  builder.AddKey("f");
+  ASSERT_TRUE(builder.Finish());
+
+  FullFilterBlockReader first(&policy_, first_filter);
+  ASSERT_TRUE(first.KeyMayMatch("a"));
+  ASSERT_TRUE(first.KeyMayMatch("d"));
+  ASSERT_TRUE(! first.KeyMayMatch("e"));
+  ASSERT_TRUE(! first.KeyMayMatch("f"));
+
+  FullFilterBlockReader last(&policy_, builder.PartitionFilter());
+  ASSERT_TRUE(last.KeyMayMatch("e"));
+  ASSERT_TRUE(last.KeyMayMatch("f"));
+  ASSERT_TRUE(! last.KeyMayMatch("a"));
+}
+
+TEST(FilterBlockTest, PartitionsEndWithLastBlock) {
+  PartitionedFilterBlockBuilder builder(&policy_, 1);
+  builder.AddKey("a");
+  ASSERT_TRUE(builder.EndBlock());
+  // Nothing is left for Finish() to cut
+  ASSERT_TRUE(! builder.Finish());
+}
+
+TEST(FilterBlockTest, PartitionsOfEmptyTable) {
+  PartitionedFilterBlockBuilder builder(&policy_, 3);
+  ASSERT_TRUE(builder.Finish());
+  FullFilterBlockReader reader(&policy_, builder.PartitionFilter());
+  ASSERT_TRUE(! reader.KeyMayMatch("foo"));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,6 +4,8 @@
 
 #include "table/format.h"
 
+#include <string.h>
+#include "leveldb/compressor.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
@@ -63,38 +65,22 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file,
-                 const ReadOptions& options,
-                 const BlockHandle& handle,
-                 BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
-  size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
-  if (contents.size() != n + kBlockTrailerSize) {
-    delete[] buf;
-    return Status::Corruption("truncated block read");
-  }
-
+// Check the trailer of the n-byte block at "data" and decode the block
+// into *result.  "buf" is NULL or a new[]-allocated buffer that is
+// deleted here unless data points to it, in which case it is handed
+// over to *result.  If data does not point into buf, it is assumed to
+// stay live while the file is open.
+static Status DecodeBlock(const char* data, size_t n, char* buf,
+                          const ReadOptions& options,
+                          const Slice& compression_dict,
+                          BlockContents* result) {
   // Check the crc of the type and the block contents
-  const char* data = contents.data();    // Pointer to where Read put the data
   if (options.verify_checksums) {
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
@@ -116,14 +102,25 @@ Status ReadBlock(RandomAccessFile* file,
 
       // Ok
       break;
-    case kSnappyCompression: {
+    default: {
+      const Compressor* compressor = GetCompressor(
+          static_cast<CompressionType>(static_cast<unsigned char>(data[n])));
+      if (compressor == NULL) {
+        delete[] buf;
+        return Status::Corruption("bad block type");
+      }
+      const Slice compressed(data, n);
       size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+      if (!compressor->GetUncompressedLength(compressed, &ulength)) {
         delete[] buf;
         return Status::Corruption("corrupted compressed block contents");
       }
       char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+      const bool uncompressed = compression_dict.empty() ?
+          compressor->Uncompress(compressed, ubuf) :
+          compressor->UncompressWithDictionary(compression_dict, compressed,
+                                               ubuf);
+      if (!uncompressed) {
         delete[] buf;
         delete[] ubuf;
         return Status::Corruption("corrupted compressed block contents");
@@ -134,12 +131,103 @@ Status ReadBlock(RandomAccessFile* file,
       result->cachable = true;
       break;
     }
-    default:
-      delete[] buf;
-      return Status::Corruption("bad block type");
   }
 
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file,
+                 const ReadOptions& options,
+                 const BlockHandle& handle,
+                 const Slice& compression_dict,
+                 BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = NULL;
+  if (!file->ServesFromMemory()) {
+    buf = new char[n + kBlockTrailerSize];
+  }
+  Slice contents;
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  if (contents.size() != n + kBlockTrailerSize) {
+    delete[] buf;
+    return Status::Corruption("truncated block read");
+  }
+
+  return DecodeBlock(contents.data(), n, buf, options, compression_dict,
+                     result);
+}
+
+void ReadBlocks(RandomAccessFile* file,
+                const ReadOptions& options,
+                const BlockHandle* handles,
+                size_t n,
+                const Slice& compression_dict,
+                BlockContents* results,
+                Status* statuses) {
+  size_t i = 0;
+  while (i < n) {
+    // Extend the run [i, limit) while the gaps between blocks are small.
+    const uint64_t start = handles[i].offset();
+    uint64_t end = start + handles[i].size() + kBlockTrailerSize;
+    size_t limit = i + 1;
+    while (limit < n &&
+           handles[limit].offset() >= end &&
+           handles[limit].offset() - end <= kMaxReadGap &&
+           (handles[limit].offset() + handles[limit].size() +
+            kBlockTrailerSize - start) <= kMaxReadSize) {
+      end = handles[limit].offset() + handles[limit].size() + kBlockTrailerSize;
+      limit++;
+    }
+
+    if (limit == i + 1) {
+      statuses[i] = ReadBlock(file, options, handles[i], compression_dict,
+                              &results[i]);
+      i++;
+      continue;
+    }
+
+    const size_t span = static_cast<size_t>(end - start);
+    char* scratch = NULL;
+    if (!file->ServesFromMemory()) {
+      scratch = new char[span];
+    }
+    Slice contents;
+    Status s = file->Read(start, span, &contents, scratch);
+    if (s.ok() && contents.size() != span) {
+      s = Status::Corruption("truncated block read");
+    }
+    for (; i < limit; i++) {
+      results[i].data = Slice();
+      results[i].cachable = false;
+      results[i].heap_allocated = false;
+      if (!s.ok()) {
+        statuses[i] = s;
+        continue;
+      }
+      const size_t block_size = static_cast<size_t>(handles[i].size());
+      const char* data = contents.data() + (handles[i].offset() - start);
+      char* buf = NULL;
+      if (contents.data() == scratch) {
+        // Each block needs a buffer of its own.
+        buf = new char[block_size + kBlockTrailerSize];
+        memcpy(buf, data, block_size + kBlockTrailerSize);
+        data = buf;
+      }
+      statuses[i] = DecodeBlock(data, block_size, buf, options,
+                                compression_dict, &results[i]);
+    }
+    delete[] scratch;
+  }
+}
+
 }  // namespace leveldb
@@ -83,19 +83,47 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Name of the metaindex entry for the dictionary that the data blocks
+// of a table are compressed against, if any.
+static const char kCompressionDictionaryBlock[] = "compression.dictionary";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
-// Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// Read the block identified by "handle" from "file", uncompressing it
+// against "compression_dict" if non-empty.  On failure return non-OK.
+// On success fill *result and return OK.
+//
+// Only an uncompressed block of a file that ServesFromMemory() is
+// returned without copying.  Every other block is read or uncompressed
+// into a new heap buffer: a cached Block owns that buffer until it is
+// evicted, so there is no point at which it could go back to a pool.
 extern Status ReadBlock(RandomAccessFile* file,
                         const ReadOptions& options,
                         const BlockHandle& handle,
+                        const Slice& compression_dict,
                         BlockContents* result);
 
+// Blocks that are at most kMaxReadGap bytes apart are fetched by
+// ReadBlocks() with a single read of at most kMaxReadSize bytes.
+static const uint64_t kMaxReadGap = 4096;
+static const uint64_t kMaxReadSize = 256 * 1024;
+
+// Read the blocks identified by handles[0,n-1] from "file", storing each
+// block in results[i] and the outcome in statuses[i], as ReadBlock()
+// would.  Runs of handles in increasing offset order that lie close
+// together are read with one call to file->Read().
+extern void ReadBlocks(RandomAccessFile* file,
+                       const ReadOptions& options,
+                       const BlockHandle* handles,
+                       size_t n,
+                       const Slice& compression_dict,
+                       BlockContents* results,
+                       Status* statuses);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
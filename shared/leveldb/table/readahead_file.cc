@@ -0,0 +1,139 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/readahead_file.h"
+
+#include <string.h>
+#include <algorithm>
+#include "leveldb/env.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+namespace {
+
+// Bytes read ahead by the first read that misses the buffer
+static const size_t kInitialReadahead = 8 * 1024;
+
+class ReadaheadRandomAccessFile : public RandomAccessFile {
+ public:
+  ReadaheadRandomAccessFile(RandomAccessFile* file, size_t readahead_size)
+      : file_(file),
+        max_readahead_(readahead_size),
+        readahead_(std::min(kInitialReadahead, readahead_size)),
+        buf_(NULL),
+        capacity_(0),
+        window_start_(0),
+        window_end_(0),
+        in_memory_(file->ServesFromMemory()) {
+  }
+
+  virtual ~ReadaheadRandomAccessFile() {
+    delete[] buf_;
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    const bool in_window = (offset >= window_start_ &&
+                            offset + n <= window_end_);
+    if (in_window && in_memory_) {
+      return file_->Read(offset, n, result, scratch);
+    } else if (in_window) {
+      memcpy(scratch, buf_ + (offset - window_start_), n);
+      *result = Slice(scratch, n);
+      return Status::OK();
+    }
+
+    // Read further ahead while the reads stay sequential, i.e., start
+    // within or right after the previous window.
+    if (window_end_ > window_start_ && offset >= window_start_ &&
+        offset <= window_end_) {
+      readahead_ = std::min(readahead_ * 2, max_readahead_);
+    } else {
+      readahead_ = std::min(kInitialReadahead, max_readahead_);
+    }
+    const size_t len = n + readahead_;
+    window_start_ = offset;
+    window_end_ = offset;
+
+    if (in_memory_) {
+      // Ask the file to fetch the window, then read as usual.
+      file_->Prefetch(offset, len);
+      window_end_ = offset + len;
+      return file_->Read(offset, n, result, scratch);
+    }
+
+    if (len > capacity_) {
+      delete[] buf_;
+      buf_ = new char[len];
+      capacity_ = len;
+    }
+    Slice contents;
+    Status s = file_->Read(offset, len, &contents, buf_);
+    if (!s.ok()) {
+      // Some files (e.g. mmapped ones) fail reads that extend past
+      // their end, so read just the requested range.
+      s = file_->Read(offset, n, result, scratch);
+      if (s.ok() && result->data() != scratch) {
+        SwitchToPrefetching();
+      }
+      return s;
+    }
+    if (contents.data() != buf_) {
+      // The file serves reads from memory, so copying through the
+      // buffer would only slow reads down.  Read ahead by prefetching
+      // instead.
+      SwitchToPrefetching();
+      file_->Prefetch(offset, len);
+      window_end_ = offset + len;
+      *result = Slice(contents.data(), std::min(n, contents.size()));
+      return s;
+    }
+    window_end_ = offset + contents.size();
+    const size_t copied = std::min(n, contents.size());
+    memcpy(scratch, buf_, copied);
+    *result = Slice(scratch, copied);
+    return s;
+  }
+
+  virtual Status Prefetch(uint64_t offset, size_t n) const {
+    return file_->Prefetch(offset, n);
+  }
+
+  virtual bool ServesFromMemory() const {
+    return file_->ServesFromMemory();
+  }
+
+ private:
+  void SwitchToPrefetching() const {
+    in_memory_ = true;
+    delete[] buf_;
+    buf_ = NULL;
+    capacity_ = 0;
+  }
+
+  RandomAccessFile* const file_;
+  const size_t max_readahead_;
+
+  // Iterators read from one thread at a time, so Read() may update
+  // this state without locking.
+  mutable size_t readahead_;
+  mutable char* buf_;
+  mutable size_t capacity_;
+  // The file range [window_start_, window_end_) was last read ahead.
+  // Unless in_memory_, buf_ holds its contents.
+  mutable uint64_t window_start_;
+  mutable uint64_t window_end_;
+  mutable bool in_memory_;
+};
+
+}  // namespace
+
+RandomAccessFile* NewReadaheadRandomAccessFile(RandomAccessFile* file,
+                                               size_t readahead_size) {
+  return new ReadaheadRandomAccessFile(file, readahead_size);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,30 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+#define STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class RandomAccessFile;
+
+// Return a RandomAccessFile that reads "file" ahead of sequential reads.
+// A read that the buffer cannot serve fetches the requested range plus
+// the bytes that follow it in one larger read.  The amount read ahead
+// starts small and doubles, up to "readahead_size" bytes, while the
+// reads stay sequential, so that a few reads after a seek do not fetch
+// much more than they need.  Files that serve reads from memory (e.g.
+// mmapped ones) are not copied; RandomAccessFile::Prefetch() is called
+// on the range to read ahead instead.
+//
+// The result does not own "file", which must outlive it.  Unlike other
+// RandomAccessFiles, the result is not safe for concurrent use.
+extern RandomAccessFile* NewReadaheadRandomAccessFile(RandomAccessFile* file,
+                                                      size_t readahead_size);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
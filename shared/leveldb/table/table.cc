@@ -4,6 +4,7 @@
 
 #include "leveldb/table.h"
 
+#include <vector>
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -12,27 +13,40 @@
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/readahead_file.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
 struct Table::Rep {
   ~Rep() {
     delete filter;
+    delete full_filter;
     delete [] filter_data;
+    delete filter_index;
     delete index_block;
+    delete [] compression_dict_data;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  // At most one of filter, full_filter and filter_index is non-NULL.
   FilterBlockReader* filter;
-  const char* filter_data;
+  FullFilterBlockReader* full_filter;
+  const char* filter_data;       // Backing store of filter or full_filter
+  Block* filter_index;           // Maps keys to filter partitions
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+
+  // Data blocks are uncompressed against compression_dict if non-empty
+  Slice compression_dict;
+  const char* compression_dict_data;  // Owned backing store, if any
 };
 
 Status Table::Open(const Options& options,
@@ -58,7 +72,8 @@ Status Table::Open(const Options& options,
   BlockContents contents;
   Block* index_block = NULL;
   if (s.ok()) {
-    s = ReadBlock(file, ReadOptions(), footer.index_handle(), &contents);
+    s = ReadBlock(file, ReadOptions(), footer.index_handle(), Slice(),
+                  &contents);
     if (s.ok()) {
       index_block = new Block(contents);
     }
@@ -75,8 +90,15 @@ Status Table::Open(const Options& options,
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->full_filter = NULL;
+    rep->filter_index = NULL;
+    rep->compression_dict_data = NULL;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = NULL;
+    }
   } else {
     if (index_block) delete index_block;
   }
@@ -84,44 +106,103 @@ Status Table::Open(const Options& options,
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
+Status Table::ReadMeta(const Footer& footer) {
+  // An empty metaindex block holds just its restart array: one restart
+  // point and their count.
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return Status::OK();
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), Slice(),
+                 &contents).ok()) {
+    // Do not propagate errors since filters are not needed for
+    // operation.  Reads of blocks that need a compression dictionary
+    // will fail instead.
+    return Status::OK();
   }
   Block* meta = new Block(contents);
-
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+
+  // The dictionary is needed to read the data blocks compressed
+  // against it, so failing to read it fails the open.
+  Status s;
+  iter->Seek(kCompressionDictionaryBlock);
+  if (iter->Valid() && iter->key() == Slice(kCompressionDictionaryBlock)) {
+    s = ReadCompressionDictionary(iter->value());
+  }
+
+  if (s.ok() && rep_->options.filter_policy != NULL) {
+    ReadFilters(iter);
   }
   delete iter;
   delete meta;
+  return s;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+Status Table::ReadCompressionDictionary(const Slice& dict_handle_value) {
+  Slice v = dict_handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  BlockContents block;
+  if (s.ok()) {
+    ReadOptions opt;
+    s = ReadBlock(rep_->file, opt, handle, Slice(), &block);
+  }
+  if (s.ok()) {
+    if (block.heap_allocated) {
+      rep_->compression_dict_data = block.data.data();
+    }
+    rep_->compression_dict = block.data;
+  }
+  return s;
+}
+
+// Read the filter for options.filter_policy, if any, that the
+// metaindex block that "iter" iterates over points to.
+void Table::ReadFilters(Iterator* iter) {
+  // A table holds filters in at most one layout, whichever
+  // options.filter_type was when it was written.
+  static const char* kFilterPrefixes[] = {
+    "fullfilter.", "partitionedfilter.", "filter."
+  };
+  for (int i = 0; i < 3; i++) {
+    std::string key = kFilterPrefixes[i];
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      if (i == 0) {
+        ReadFullFilter(iter->value());
+      } else if (i == 1) {
+        ReadFilterPartitionIndex(iter->value());
+      } else {
+        ReadFilter(iter->value());
+      }
+      break;
+    }
+  }
+}
+
+// Read the block that filter_handle_value points to into *block.
+static bool ReadFilterBlock(RandomAccessFile* file,
+                            const Slice& filter_handle_value,
+                            BlockContents* block) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
-    return;
+    return false;
   }
 
   // We might want to unify with ReadBlock() if we start
   // requiring checksum verification in Table::Open.
   ReadOptions opt;
+  return ReadBlock(file, opt, filter_handle, Slice(), block).ok();
+}
+
+void Table::ReadFilter(const Slice& filter_handle_value) {
   BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  if (!ReadFilterBlock(rep_->file, filter_handle_value, &block)) {
     return;
   }
   if (block.heap_allocated) {
@@ -130,6 +211,26 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+void Table::ReadFullFilter(const Slice& filter_handle_value) {
+  BlockContents block;
+  if (!ReadFilterBlock(rep_->file, filter_handle_value, &block)) {
+    return;
+  }
+  if (block.heap_allocated) {
+    rep_->filter_data = block.data.data();     // Will need to delete later
+  }
+  rep_->full_filter = new FullFilterBlockReader(rep_->options.filter_policy,
+                                                block.data);
+}
+
+void Table::ReadFilterPartitionIndex(const Slice& index_handle_value) {
+  BlockContents block;
+  if (!ReadFilterBlock(rep_->file, index_handle_value, &block)) {
+    return;
+  }
+  rep_->filter_index = new Block(block);
+}
+
 Table::~Table() {
   delete rep_;
 }
@@ -149,13 +250,98 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  BlockContents* contents = reinterpret_cast<BlockContents*>(value);
+  if (contents->heap_allocated) {
+    delete[] contents->data.data();
+  }
+  delete contents;
+}
+
+// Store the block cache key of the block at "offset" in buf[0,15] and
+// return it.
+static Slice BlockCacheKey(uint64_t cache_id, uint64_t offset, char* buf) {
+  EncodeFixed64(buf, cache_id);
+  EncodeFixed64(buf+8, offset);
+  return Slice(buf, 16);
+}
+
+// Return an iterator over "block", or one for the point lookup of
+// *lookup_key if lookup_key is non-NULL.
+static Iterator* NewBlockIterator(Block* block, const Comparator* cmp,
+                                  const Slice* lookup_key) {
+  if (lookup_key != NULL) {
+    return block->NewLookupIterator(cmp, *lookup_key);
+  } else {
+    return block->NewIterator(cmp);
+  }
+}
+
+// ReadBlock() that records the read in the perf context.
+static Status ReadBlockCounted(RandomAccessFile* file, Env* env,
+                               const ReadOptions& options,
+                               const BlockHandle& handle,
+                               const Slice& compression_dict,
+                               BlockContents* contents) {
+  PerfTimer timer(env, &perf_context.block_read_time);
+  PERF_COUNTER_ADD(block_read_count, 1);
+  PERF_COUNTER_ADD(block_read_byte, handle.size());
+  return ReadBlock(file, options, handle, compression_dict, contents);
+}
+
+// Record a filter false positive if the entry that the lookup of k
+// found, if any, is for a different key.  Keys are told apart by their
+// hash keys (see Comparator::HashKey()), so nothing is recorded for
+// comparators that do not provide them.
+static void CountFilterPositive(const Comparator* cmp, const Slice& k,
+                                Iterator* iter) {
+  Slice target, found;
+  if (perf_level >= kPerfEnableCount &&
+      iter->status().ok() &&
+      cmp->HashKey(k, &target) &&
+      !(iter->Valid() && cmp->HashKey(iter->key(), &found) &&
+        found == target)) {
+    perf_context.bloom_useless_count++;
+  }
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->DataBlockIterator(options, table->rep_->file, index_value,
+                                  NULL);
+}
+
+struct Table::IteratorFileState {
+  Table* table;
+  RandomAccessFile* file;           // Reads table->rep_->file
+  RandomAccessFile* limited_file;   // Rate limited file, or NULL
+  RandomAccessFile* readahead_file; // Reads ahead, or NULL
+};
+
+Iterator* Table::IteratorFileBlockReader(void* arg,
+                                         const ReadOptions& options,
+                                         const Slice& index_value) {
+  IteratorFileState* state = reinterpret_cast<IteratorFileState*>(arg);
+  return state->table->DataBlockIterator(options, state->file, index_value,
+                                         NULL);
+}
+
+void Table::DeleteIteratorFileState(void* arg, void* ignored) {
+  IteratorFileState* state = reinterpret_cast<IteratorFileState*>(arg);
+  delete state->readahead_file;
+  delete state->limited_file;
+  delete state;
+}
+
+Iterator* Table::DataBlockIterator(const ReadOptions& options,
+                                   RandomAccessFile* file,
+                                   const Slice& index_value,
+                                   const Slice* lookup_key) {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = NULL;
   Cache::Handle* cache_handle = NULL;
 
@@ -165,58 +351,162 @@ Iterator* Table::BlockReader(void* arg,
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
 
+  BlockContents contents;
   if (s.ok()) {
-    BlockContents contents;
     if (block_cache != NULL) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer+8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Slice key = BlockCacheKey(rep_->cache_id, handle.offset(),
+                                cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
+        PERF_COUNTER_ADD(block_cache_hit_count, 1);
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        if (s.ok()) {
+        PERF_COUNTER_ADD(block_cache_miss_count, 1);
+        s = ReadBlockCounted(file, rep_->options.env, options, handle,
+                             rep_->compression_dict, &contents);
+        if (s.ok() && contents.cachable && options.fill_cache) {
           block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
-          }
+          cache_handle = block_cache->Insert(
+              key, block, block->size(), &DeleteCachedBlock);
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
-      }
+      s = ReadBlockCounted(file, rep_->options.env, options, handle,
+                           rep_->compression_dict, &contents);
     }
   }
 
+  const Comparator* cmp = rep_->options.comparator;
   Iterator* iter;
-  if (block != NULL) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == NULL) {
-      iter->RegisterCleanup(&DeleteBlock, block, NULL);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
-    }
-  } else {
+  if (!s.ok()) {
     iter = NewErrorIterator(s);
+  } else if (cache_handle != NULL) {
+    iter = NewBlockIterator(block, cmp, lookup_key);
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  } else if (contents.heap_allocated) {
+    block = new Block(contents);
+    iter = NewBlockIterator(block, cmp, lookup_key);
+    iter->RegisterCleanup(&DeleteBlock, block, NULL);
+  } else {
+    // The contents stay live while the file is open (e.g. they point
+    // into an mmapped file), and block iterators do not refer to their
+    // Block, so reading from memory takes no allocation for the Block.
+    Block transient(contents);
+    iter = NewBlockIterator(&transient, cmp, lookup_key);
   }
   return iter;
 }
 
+bool Table::HasFilter() const {
+  return (rep_->filter != NULL || rep_->full_filter != NULL ||
+          rep_->filter_index != NULL);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  Iterator* index_iter =
+      rep_->index_block->NewIterator(rep_->options.comparator);
+  if (options.readahead_size == 0 && options.rate_limiter == NULL) {
+    return NewTwoLevelIterator(index_iter, &Table::BlockReader,
+                               const_cast<Table*>(this), options);
+  }
+  // Each iterator gets a buffer of its own.  Reads ahead are requested
+  // from the rate limiter as a whole.
+  IteratorFileState* state = new IteratorFileState;
+  state->table = const_cast<Table*>(this);
+  state->file = rep_->file;
+  state->limited_file = NULL;
+  state->readahead_file = NULL;
+  if (options.rate_limiter != NULL) {
+    state->limited_file = NewRateLimitedRandomAccessFile(
+        state->file, options.rate_limiter, Env::kLowPriority);
+    state->file = state->limited_file;
+  }
+  if (options.readahead_size > 0) {
+    state->readahead_file = NewReadaheadRandomAccessFile(
+        state->file, options.readahead_size);
+    state->file = state->readahead_file;
+  }
+  Iterator* iter = NewTwoLevelIterator(index_iter,
+                                       &Table::IteratorFileBlockReader,
+                                       state, options);
+  iter->RegisterCleanup(&DeleteIteratorFileState, state, NULL);
+  return iter;
+}
+
+bool Table::FullFilterMayMatch(const Slice& key) const {
+  return rep_->full_filter == NULL || rep_->full_filter->KeyMayMatch(key);
+}
+
+bool Table::PartitionMayMatch(const ReadOptions& options, const Slice& k) {
+  Iterator* iter = rep_->filter_index->NewIterator(rep_->options.comparator);
+  iter->Seek(k);
+  if (!iter->Valid()) {
+    // k is past the last key of the table, unless the index is corrupt.
+    bool may_match = !iter->status().ok();
+    delete iter;
+    return may_match;
+  }
+  BlockHandle handle;
+  Slice input = iter->value();
+  Status s = handle.DecodeFrom(&input);
+  delete iter;
+  if (!s.ok()) {
+    return true;  // Errors are treated as potential matches
+  }
+
+  // Partitions go through the block cache like data blocks, and are
+  // only added to it if options.fill_cache.
+  Cache* block_cache = rep_->options.block_cache;
+  Cache::Handle* cache_handle = NULL;
+  BlockContents* contents = NULL;
+  char cache_key_buffer[16];
+  Slice key = BlockCacheKey(rep_->cache_id, handle.offset(), cache_key_buffer);
+  if (block_cache != NULL) {
+    cache_handle = block_cache->Lookup(key);
+  }
+  if (cache_handle != NULL) {
+    PERF_COUNTER_ADD(block_cache_hit_count, 1);
+    contents = reinterpret_cast<BlockContents*>(
+        block_cache->Value(cache_handle));
+  } else {
+    if (block_cache != NULL) {
+      PERF_COUNTER_ADD(block_cache_miss_count, 1);
+    }
+    contents = new BlockContents;
+    if (!ReadBlockCounted(rep_->file, rep_->options.env, options, handle,
+                          Slice(), contents).ok()) {
+      delete contents;
+      return true;
+    }
+    if (block_cache != NULL && options.fill_cache) {
+      cache_handle = block_cache->Insert(key, contents, contents->data.size(),
+                                         &DeleteCachedFilter);
+    }
+  }
+
+  FullFilterBlockReader reader(rep_->options.filter_policy, contents->data);
+  const bool may_match = reader.KeyMayMatch(k);
+  if (cache_handle != NULL) {
+    block_cache->Release(cache_handle);
+  } else {
+    DeleteCachedFilter(key, contents);
+  }
+  return may_match;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
                           void (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
+  if (rep_->full_filter != NULL && !rep_->full_filter->KeyMayMatch(k)) {
+    PERF_COUNTER_ADD(bloom_useful_count, 1);
+    return s;  // Not found, without searching the index
+  }
+  if (rep_->filter_index != NULL && !PartitionMayMatch(options, k)) {
+    PERF_COUNTER_ADD(bloom_useful_count, 1);
+    return s;  // Not found
+  }
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   iiter->Seek(k);
   if (iiter->Valid()) {
@@ -227,9 +517,13 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
         handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
+      PERF_COUNTER_ADD(bloom_useful_count, 1);
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
+      Iterator* block_iter = DataBlockIterator(options, rep_->file,
+                                               iiter->value(), &k);
+      if (HasFilter()) {
+        CountFilterPositive(rep_->options.comparator, k, block_iter);
+      }
       if (block_iter->Valid()) {
         (*saver)(arg, block_iter->key(), block_iter->value());
       }
@@ -244,6 +538,131 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
   return s;
 }
 
+void Table::InternalMultiGet(const ReadOptions& options,
+                             const Slice* keys, int n,
+                             void* const* args,
+                             void (*saver)(void*, const Slice&, const Slice&),
+                             Status* statuses) {
+  // Find the data block of each key that may be present.  Sorted keys
+  // that share a block are adjacent.
+  std::vector<int> lookups;              // Keys that need a data block
+  std::vector<size_t> lookup_block;      // Index in blocks of each lookup
+  std::vector<BlockHandle> blocks;       // Distinct data blocks
+  lookups.reserve(n);
+  lookup_block.reserve(n);
+  blocks.reserve(n);
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  for (int i = 0; i < n; i++) {
+    const Slice& k = keys[i];
+    statuses[i] = Status::OK();
+    if (rep_->full_filter != NULL && !rep_->full_filter->KeyMayMatch(k)) {
+      PERF_COUNTER_ADD(bloom_useful_count, 1);
+      continue;
+    }
+    if (rep_->filter_index != NULL && !PartitionMayMatch(options, k)) {
+      PERF_COUNTER_ADD(bloom_useful_count, 1);
+      continue;
+    }
+    iiter->Seek(k);
+    if (!iiter->Valid()) {
+      statuses[i] = iiter->status();
+      continue;
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    statuses[i] = handle.DecodeFrom(&handle_value);
+    if (!statuses[i].ok()) {
+      continue;
+    }
+    if (rep_->filter != NULL &&
+        !rep_->filter->KeyMayMatch(handle.offset(), k)) {
+      PERF_COUNTER_ADD(bloom_useful_count, 1);
+      continue;
+    }
+    if (blocks.empty() || blocks.back().offset() != handle.offset()) {
+      blocks.push_back(handle);
+    }
+    lookups.push_back(i);
+    lookup_block.push_back(blocks.size() - 1);
+  }
+  delete iiter;
+
+  // Pin the blocks that are cached, and read the rest together.
+  Cache* block_cache = rep_->options.block_cache;
+  std::vector<Block*> block(blocks.size(), NULL);
+  std::vector<Cache::Handle*> cache_handle(blocks.size(), NULL);
+  std::vector<Status> block_status(blocks.size());
+  std::vector<size_t> missing;
+  std::vector<BlockHandle> missing_handles;
+  for (size_t b = 0; b < blocks.size(); b++) {
+    if (block_cache != NULL) {
+      char cache_key_buffer[16];
+      cache_handle[b] = block_cache->Lookup(
+          BlockCacheKey(rep_->cache_id, blocks[b].offset(), cache_key_buffer));
+      if (cache_handle[b] != NULL) {
+        PERF_COUNTER_ADD(block_cache_hit_count, 1);
+        block[b] =
+            reinterpret_cast<Block*>(block_cache->Value(cache_handle[b]));
+        continue;
+      }
+      PERF_COUNTER_ADD(block_cache_miss_count, 1);
+    }
+    missing.push_back(b);
+    missing_handles.push_back(blocks[b]);
+    PERF_COUNTER_ADD(block_read_count, 1);
+    PERF_COUNTER_ADD(block_read_byte, blocks[b].size());
+  }
+  if (!missing.empty()) {
+    std::vector<BlockContents> contents(missing.size());
+    std::vector<Status> read_status(missing.size());
+    PerfTimer timer(rep_->options.env, &perf_context.block_read_time);
+    ReadBlocks(rep_->file, options, &missing_handles[0], missing.size(),
+               rep_->compression_dict, &contents[0], &read_status[0]);
+    timer.Stop();
+    for (size_t m = 0; m < missing.size(); m++) {
+      const size_t b = missing[m];
+      block_status[b] = read_status[m];
+      if (!read_status[m].ok()) {
+        continue;
+      }
+      block[b] = new Block(contents[m]);
+      if (block_cache != NULL && contents[m].cachable && options.fill_cache) {
+        char cache_key_buffer[16];
+        cache_handle[b] = block_cache->Insert(
+            BlockCacheKey(rep_->cache_id, blocks[b].offset(), cache_key_buffer),
+            block[b], block[b]->size(), &DeleteCachedBlock);
+      }
+    }
+  }
+
+  // Look up each key in its block.
+  for (size_t l = 0; l < lookups.size(); l++) {
+    const int i = lookups[l];
+    const size_t b = lookup_block[l];
+    if (block[b] == NULL) {
+      statuses[i] = block_status[b];
+      continue;
+    }
+    Iterator* block_iter = block[b]->NewLookupIterator(
+        rep_->options.comparator, keys[i]);
+    if (HasFilter()) {
+      CountFilterPositive(rep_->options.comparator, keys[i], block_iter);
+    }
+    if (block_iter->Valid()) {
+      (*saver)(args[i], block_iter->key(), block_iter->value());
+    }
+    statuses[i] = block_iter->status();
+    delete block_iter;
+  }
+
+  for (size_t b = 0; b < blocks.size(); b++) {
+    if (cache_handle[b] != NULL) {
+      block_cache->Release(cache_handle[b]);
+    } else {
+      delete block[b];
+    }
+  }
+}
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   Iterator* index_iter =
@@ -5,7 +5,10 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <vector>
 #include "leveldb/comparator.h"
+#include "leveldb/compressor.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
@@ -17,6 +20,15 @@
 
 namespace leveldb {
 
+// A builder that compresses against a dictionary buffers this many
+// times options.compression_dict_bytes of entries to sample the
+// dictionary from.
+static const size_t kDictionarySampleRatio = 16;
+
+// Tables with less data than this many times the dictionary size do
+// not gain enough from a dictionary to pay for storing it.
+static const size_t kMinDictionaryRatio = 4;
+
 struct TableBuilder::Rep {
   Options options;
   Options index_block_options;
@@ -28,7 +40,13 @@ struct TableBuilder::Rep {
   std::string last_key;
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
+
+  // At most one of these is non-NULL, depending on options.filter_type.
   FilterBlockBuilder* filter_block;
+  FullFilterBlockBuilder* full_filter_block;
+  PartitionedFilterBlockBuilder* partitioned_filter_block;
+  // Maps the last index key of each written filter partition to it
+  BlockBuilder filter_partition_index;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -44,6 +62,18 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // While buffering is true, Add() appends the length-prefixed key and
+  // value of each entry to buffer instead of adding it to a block, and
+  // Flush() records the number of entries buffered before it was
+  // called in buffered_flushes.
+  bool buffering;
+  std::string buffer;
+  uint64_t num_buffered;
+  std::vector<uint64_t> buffered_flushes;
+
+  // Data blocks are compressed against this dictionary if non-empty.
+  std::string compression_dict;
+
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
@@ -53,10 +83,40 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == NULL ? NULL
-                     : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        filter_block(NULL),
+        full_filter_block(NULL),
+        partitioned_filter_block(NULL),
+        filter_partition_index(&index_block_options),
+        pending_index_entry(false),
+        buffering(false),
+        num_buffered(0) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.data_block_hash_index = false;
+    if (opt.filter_policy != NULL) {
+      switch (opt.filter_type) {
+        case kBlockFilter:
+          filter_block = new FilterBlockBuilder(opt.filter_policy);
+          break;
+        case kFullFilter:
+          full_filter_block = new FullFilterBlockBuilder(opt.filter_policy);
+          break;
+        case kPartitionedFilter:
+          partitioned_filter_block = new PartitionedFilterBlockBuilder(
+              opt.filter_policy, opt.filter_partition_keys);
+          break;
+      }
+    }
+    if (opt.compression_dict_bytes > 0) {
+      const Compressor* compressor = GetCompressor(opt.compression);
+      buffering = (compressor != NULL && compressor->SupportsDictionary());
+    }
+  }
+
+  void AddIndexEntry() {
+    std::string handle_encoding;
+    pending_handle.EncodeTo(&handle_encoding);
+    index_block.Add(last_key, Slice(handle_encoding));
+    pending_index_entry = false;
   }
 };
 
@@ -70,6 +130,8 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
+  delete rep_->partitioned_filter_block;
   delete rep_;
 }
 
@@ -80,12 +142,22 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.filter_policy != rep_->options.filter_policy ||
+      options.filter_type != rep_->options.filter_type) {
+    return Status::InvalidArgument("changing filters while building table");
+  }
+  if (options.compression_dict_bytes !=
+      rep_->options.compression_dict_bytes) {
+    return Status::InvalidArgument(
+        "changing compression dictionary size while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.data_block_hash_index = false;
   return Status::OK();
 }
 
@@ -96,22 +168,43 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->num_entries > 0) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
+  r->num_entries++;
+
+  if (r->buffering) {
+    r->last_key.assign(key.data(), key.size());
+    PutLengthPrefixedSlice(&r->buffer, key);
+    PutLengthPrefixedSlice(&r->buffer, value);
+    r->num_buffered++;
+    if (r->buffer.size() >=
+        kDictionarySampleRatio * r->options.compression_dict_bytes) {
+      WriteBuffered();
+    }
+    return;
+  }
+  AddToBlock(key, value);
+}
 
+void TableBuilder::AddToBlock(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
-    r->pending_index_entry = false;
+    r->AddIndexEntry();
+    if (r->partitioned_filter_block != NULL &&
+        r->partitioned_filter_block->EndBlock()) {
+      WriteFilterPartition(r->last_key);
+    }
   }
 
   if (r->filter_block != NULL) {
     r->filter_block->AddKey(key);
+  } else if (r->full_filter_block != NULL) {
+    r->full_filter_block->AddKey(key);
+  } else if (r->partitioned_filter_block != NULL) {
+    r->partitioned_filter_block->AddKey(key);
   }
 
   r->last_key.assign(key.data(), key.size());
-  r->num_entries++;
   r->data_block.Add(key, value);
 
   const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
@@ -124,6 +217,14 @@ void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
+  if (r->buffering) {
+    if (r->num_buffered > 0 &&
+        (r->buffered_flushes.empty() ||
+         r->buffered_flushes.back() != r->num_buffered)) {
+      r->buffered_flushes.push_back(r->num_buffered);
+    }
+    return;
+  }
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
   WriteBlock(&r->data_block, &r->pending_handle);
@@ -136,40 +237,102 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::WriteBuffered() {
+  Rep* r = rep_;
+  r->buffering = false;
+
+  // Sample entries evenly from the buffer into the dictionary.
+  const size_t dict_bytes = r->options.compression_dict_bytes;
+  if (r->buffer.size() >= kMinDictionaryRatio * dict_bytes) {
+    const uint64_t stride = std::max<uint64_t>(
+        1, r->buffer.size() / dict_bytes);
+    Slice input(r->buffer);
+    Slice key, value;
+    for (uint64_t i = 0; r->compression_dict.size() < dict_bytes &&
+             GetLengthPrefixedSlice(&input, &key) &&
+             GetLengthPrefixedSlice(&input, &value); i++) {
+      if (i % stride == 0) {
+        r->compression_dict.append(key.data(), key.size());
+        r->compression_dict.append(value.data(), value.size());
+      }
+    }
+    if (r->compression_dict.size() > dict_bytes) {
+      r->compression_dict.resize(dict_bytes);
+    }
+  }
+
+  // Replay the buffered entries and flushes.
+  Slice input(r->buffer);
+  Slice key, value;
+  size_t next_flush = 0;
+  for (uint64_t i = 0; ok() && i < r->num_buffered; i++) {
+    GetLengthPrefixedSlice(&input, &key);
+    GetLengthPrefixedSlice(&input, &value);
+    AddToBlock(key, value);
+    if (next_flush < r->buffered_flushes.size() &&
+        r->buffered_flushes[next_flush] == i + 1) {
+      Flush();
+      next_flush++;
+    }
+  }
+  std::string().swap(r->buffer);
+  r->num_buffered = 0;
+  r->buffered_flushes.clear();
+}
+
+// Write the partition that the partitioned filter builder just cut,
+// which ends with the data block whose index key is "index_key".
+void TableBuilder::WriteFilterPartition(const Slice& index_key) {
+  Rep* r = rep_;
+  if (!ok()) return;
+  BlockHandle handle;
+  WriteRawBlock(r->partitioned_filter_block->PartitionFilter(),
+                kNoCompression, &handle);
+  std::string handle_encoding;
+  handle.EncodeTo(&handle_encoding);
+  r->filter_partition_index.Add(index_key, handle_encoding);
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  assert(ok());
+  Rep* r = rep_;
+  // Only data blocks are compressed against the dictionary.
+  Slice dict;
+  if (block == &r->data_block) {
+    dict = r->compression_dict;
+  }
+  WriteCompressedBlock(block->Finish(), dict, handle);
+  block->Reset();
+}
+
+void TableBuilder::WriteCompressedBlock(const Slice& raw, const Slice& dict,
+                                        BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
-  assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
-
   Slice block_contents;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
-
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
-      break;
-    }
+  const Compressor* compressor = GetCompressor(type);
+  std::string* compressed = &r->compressed_output;
+  bool compressed_ok = false;
+  if (compressor != NULL) {
+    compressed_ok = dict.empty() ?
+        compressor->Compress(raw, compressed) :
+        compressor->CompressWithDictionary(dict, raw, compressed);
+  }
+  if (compressed_ok &&
+      compressed->size() < raw.size() - (raw.size() / 8u)) {
+    block_contents = *compressed;
+  } else {
+    // No compression asked for or supported, or compressed less than
+    // 12.5%, so just store uncompressed form
+    block_contents = raw;
+    type = kNoCompression;
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -198,24 +361,63 @@ Status TableBuilder::status() const {
 
 Status TableBuilder::Finish() {
   Rep* r = rep_;
+  if (r->buffering && ok()) {
+    WriteBuffered();
+  }
   Flush();
   assert(!r->closed);
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle dict_block_handle;
+
+  // The last index entry is needed to bound the last filter partition.
+  if (r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    r->AddIndexEntry();
+  }
+
+  // Write compression dictionary block
+  if (ok() && !r->compression_dict.empty()) {
+    WriteCompressedBlock(r->compression_dict, Slice(), &dict_block_handle);
+  }
 
   // Write filter block
+  const char* filter_prefix = NULL;
   if (ok() && r->filter_block != NULL) {
+    filter_prefix = "filter.";
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+  } else if (ok() && r->full_filter_block != NULL) {
+    filter_prefix = "fullfilter.";
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  } else if (ok() && r->partitioned_filter_block != NULL) {
+    // Write the last partition, then an index over all of them that is
+    // formatted like the table's index block.
+    filter_prefix = "partitionedfilter.";
+    if (r->partitioned_filter_block->Finish()) {
+      WriteFilterPartition(r->last_key);
+    }
+    if (ok()) {
+      WriteBlock(&r->filter_partition_index, &filter_block_handle);
+    }
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != NULL) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    // Only data blocks get hash indexes.
+    Options meta_index_options = r->options;
+    meta_index_options.data_block_hash_index = false;
+    BlockBuilder meta_index_block(&meta_index_options);
+    if (!r->compression_dict.empty()) {
+      std::string handle_encoding;
+      dict_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kCompressionDictionaryBlock, handle_encoding);
+    }
+    if (filter_prefix != NULL) {
+      // Add mapping from "<prefix>Name" to location of filter data
+      std::string key = filter_prefix;
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
@@ -228,13 +430,6 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
     WriteBlock(&r->index_block, &index_block_handle);
   }
 
@@ -264,7 +459,7 @@ uint64_t TableBuilder::NumEntries() const {
 }
 
 uint64_t TableBuilder::FileSize() const {
-  return rep_->offset;
+  return rep_->offset + rep_->buffer.size();
 }
 
 }  // namespace leveldb
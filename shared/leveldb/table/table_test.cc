@@ -9,13 +9,17 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compressor.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/memtablerep.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
+#include "table/block_hash_index.h"
 #include "table/format.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -110,15 +114,36 @@ class StringSink: public WritableFile {
 class StringSource: public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {
+      : contents_(contents.data(), contents.size()),
+        in_memory_(false), reads_(0), prefetches_(0) {
   }
 
   virtual ~StringSource() { }
 
   uint64_t Size() const { return contents_.size(); }
 
+  // If in_memory, serve reads without copying, and fail the reads that
+  // extend past the end, like an mmapped file.
+  void SetInMemory(bool in_memory) { in_memory_ = in_memory; }
+
+  int reads() const { return reads_; }
+  int prefetches() const { return prefetches_; }
+
+  // Return true iff p points into the contents of the source.
+  bool Contains(const char* p) const {
+    return p >= contents_.data() && p < contents_.data() + contents_.size();
+  }
+
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                        char* scratch) const {
+    reads_++;
+    if (in_memory_) {
+      if (offset + n > contents_.size()) {
+        return Status::InvalidArgument("invalid Read range");
+      }
+      *result = Slice(contents_.data() + offset, n);
+      return Status::OK();
+    }
     if (offset > contents_.size()) {
       return Status::InvalidArgument("invalid Read offset");
     }
@@ -130,8 +155,20 @@ class StringSource: public RandomAccessFile {
     return Status::OK();
   }
 
+  virtual Status Prefetch(uint64_t offset, size_t n) const {
+    prefetches_++;
+    return Status::OK();
+  }
+
+  virtual bool ServesFromMemory() const {
+    return in_memory_;
+  }
+
  private:
   std::string contents_;
+  bool in_memory_;
+  mutable int reads_;
+  mutable int prefetches_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -254,10 +291,21 @@ class TableConstructor: public Constructor {
     return table_->NewIterator(ReadOptions());
   }
 
+  Iterator* NewIterator(const ReadOptions& options) const {
+    return table_->NewIterator(options);
+  }
+
   uint64_t ApproximateOffsetOf(const Slice& key) const {
     return table_->ApproximateOffsetOf(key);
   }
 
+  void SetInMemory(bool in_memory) { source_->SetInMemory(in_memory); }
+
+  // Number of reads and prefetches of the table file so far
+  int reads() const { return source_->reads(); }
+  int prefetches() const { return source_->prefetches(); }
+  bool InSource(const Slice& s) const { return source_->Contains(s.data()); }
+
  private:
   void Reset() {
     delete table_;
@@ -315,18 +363,22 @@ class KeyConvertingIterator: public Iterator {
 
 class MemTableConstructor: public Constructor {
  public:
-  explicit MemTableConstructor(const Comparator* cmp)
+  // Takes ownership of "factory", which may be NULL.
+  MemTableConstructor(const Comparator* cmp,
+                      const MemTableRepFactory* factory)
       : Constructor(cmp),
-        internal_comparator_(cmp) {
-    memtable_ = new MemTable(internal_comparator_);
+        internal_comparator_(cmp),
+        factory_(factory) {
+    memtable_ = new MemTable(internal_comparator_, factory_);
     memtable_->Ref();
   }
   ~MemTableConstructor() {
     memtable_->Unref();
+    delete factory_;
   }
   virtual Status FinishImpl(const Options& options, const KVMap& data) {
     memtable_->Unref();
-    memtable_ = new MemTable(internal_comparator_);
+    memtable_ = new MemTable(internal_comparator_, factory_);
     memtable_->Ref();
     int seq = 1;
     for (KVMap::const_iterator it = data.begin();
@@ -335,6 +387,7 @@ class MemTableConstructor: public Constructor {
       memtable_->Add(seq, kTypeValue, it->first, it->second);
       seq++;
     }
+    memtable_->MarkReadOnly();
     return Status::OK();
   }
   virtual Iterator* NewIterator() const {
@@ -343,6 +396,7 @@ class MemTableConstructor: public Constructor {
 
  private:
   InternalKeyComparator internal_comparator_;
+  const MemTableRepFactory* factory_;
   MemTable* memtable_;
 };
 
@@ -400,6 +454,8 @@ enum TestType {
   TABLE_TEST,
   BLOCK_TEST,
   MEMTABLE_TEST,
+  VECTOR_MEMTABLE_TEST,
+  HASH_SKIPLIST_MEMTABLE_TEST,
   DB_TEST
 };
 
@@ -407,6 +463,7 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool hash_index;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -416,6 +473,8 @@ static const TestArgs kTestArgList[] = {
   { TABLE_TEST, true, 16 },
   { TABLE_TEST, true, 1 },
   { TABLE_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, true },
+  { TABLE_TEST, false, 1, true },
 
   { BLOCK_TEST, false, 16 },
   { BLOCK_TEST, false, 1 },
@@ -423,10 +482,16 @@ static const TestArgs kTestArgList[] = {
   { BLOCK_TEST, true, 16 },
   { BLOCK_TEST, true, 1 },
   { BLOCK_TEST, true, 1024 },
+  { BLOCK_TEST, false, 16, true },
+  { BLOCK_TEST, false, 1, true },
 
   // Restart interval does not matter for memtables
   { MEMTABLE_TEST, false, 16 },
   { MEMTABLE_TEST, true, 16 },
+  { VECTOR_MEMTABLE_TEST, false, 16 },
+  { VECTOR_MEMTABLE_TEST, true, 16 },
+  { HASH_SKIPLIST_MEMTABLE_TEST, false, 16 },
+  { HASH_SKIPLIST_MEMTABLE_TEST, true, 16 },
 
   // Do not bother with restart interval variations for DB
   { DB_TEST, false, 16 },
@@ -444,6 +509,7 @@ class Harness {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.data_block_hash_index = args.hash_index;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -458,7 +524,15 @@ class Harness {
         constructor_ = new BlockConstructor(options_.comparator);
         break;
       case MEMTABLE_TEST:
-        constructor_ = new MemTableConstructor(options_.comparator);
+        constructor_ = new MemTableConstructor(options_.comparator, NULL);
+        break;
+      case VECTOR_MEMTABLE_TEST:
+        constructor_ = new MemTableConstructor(options_.comparator,
+                                               NewVectorRepFactory(0));
+        break;
+      case HASH_SKIPLIST_MEMTABLE_TEST:
+        constructor_ = new MemTableConstructor(
+            options_.comparator, NewHashSkipListRepFactory(1, 16));
         break;
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
@@ -784,6 +858,180 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+// Look up "key" as of sequence number "seq".  Merge operands found on
+// the way follow the result, oldest first.
+static std::string MemTableGet(MemTable* memtable, const std::string& key,
+                               SequenceNumber seq) {
+  std::string value;
+  Status s;
+  std::deque<std::string> operands;
+  SequenceNumber covering = 0;
+  std::string result;
+  if (!memtable->Get(LookupKey(key, seq), &value, &s, &operands, &covering)) {
+    result = "MISSING";
+  } else {
+    result = s.ok() ? value : "DELETED";
+  }
+  for (size_t i = 0; i < operands.size(); i++) {
+    result += "+" + operands[i];
+  }
+  return result;
+}
+
+TEST(MemTableTest, GetWithEachRep) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  const MemTableRepFactory* factories[] = {
+    NULL,
+    NewVectorRepFactory(0),
+    NewHashSkipListRepFactory(2, 4),
+  };
+  for (int f = 0; f < 3; f++) {
+    for (int read_only = 0; read_only < 2; read_only++) {
+      MemTable* memtable = new MemTable(cmp, factories[f]);
+      memtable->Ref();
+      memtable->Add(1, kTypeValue, "ab1", "v1");
+      memtable->Add(2, kTypeValue, "ab2", "v2");
+      memtable->Add(3, kTypeValue, "cd1", "v3");
+      memtable->Add(4, kTypeDeletion, "ab1", "");
+      memtable->Add(5, kTypeValue, "ab1", "v5");
+      memtable->Add(6, kTypeMerge, "ab2", "m6");
+      memtable->Add(7, kTypeMerge, "ab2", "m7");
+      memtable->Add(8, kTypeMerge, "ef1", "m8");
+      if (read_only) {
+        memtable->MarkReadOnly();
+      }
+
+      ASSERT_EQ("MISSING", MemTableGet(memtable, "ab1", 0));
+      ASSERT_EQ("v1", MemTableGet(memtable, "ab1", 3));
+      ASSERT_EQ("DELETED", MemTableGet(memtable, "ab1", 4));
+      ASSERT_EQ("v5", MemTableGet(memtable, "ab1", 100));
+      ASSERT_EQ("v2", MemTableGet(memtable, "ab2", 5));
+      ASSERT_EQ("v2+m6", MemTableGet(memtable, "ab2", 6));
+      ASSERT_EQ("v2+m6+m7", MemTableGet(memtable, "ab2", 100));
+      ASSERT_EQ("v3", MemTableGet(memtable, "cd1", 100));
+      ASSERT_EQ("MISSING+m8", MemTableGet(memtable, "ef1", 100));
+      ASSERT_EQ("MISSING", MemTableGet(memtable, "ab", 100));
+      ASSERT_EQ("MISSING", MemTableGet(memtable, "zz", 100));
+
+      Iterator* iter = memtable->NewIterator();
+      std::string order;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        order += ExtractUserKey(iter->key()).ToString() + ",";
+      }
+      ASSERT_EQ("ab1,ab1,ab1,ab2,ab2,ab2,cd1,ef1,", order);
+      delete iter;
+      memtable->Unref();
+    }
+    delete factories[f];
+  }
+}
+
+class BlockHashIndexTest {
+ public:
+  std::string data_;
+
+  static std::string Key(int i) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return std::string(buf);
+  }
+
+  // Build a block holding the even keys in [0, 2n) with a hash index.
+  Block* BuildBlock(int n, int restart_interval) {
+    Options options;
+    options.block_restart_interval = restart_interval;
+    options.data_block_hash_index = true;
+    BlockBuilder builder(&options);
+    for (int i = 0; i < 2 * n; i += 2) {
+      builder.Add(Key(i), "v" + Key(i));
+    }
+    data_ = builder.Finish().ToString();
+    BlockContents contents;
+    contents.data = data_;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    return new Block(contents);
+  }
+
+  bool HasHashIndex() const {
+    return (DecodeFixed32(data_.data() + data_.size() - sizeof(uint32_t)) &
+            kBlockHashIndexFlag) != 0;
+  }
+
+  // Look up every key in [0, 2n) and return how many of the absent
+  // (odd) ones the block rejected without finding an entry.
+  int CheckLookups(Block* block, int n) {
+    int rejected = 0;
+    for (int i = 0; i < 2 * n; i++) {
+      Iterator* iter = block->NewLookupIterator(BytewiseComparator(), Key(i));
+      if (i % 2 == 0) {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(Key(i), iter->key().ToString());
+        ASSERT_EQ("v" + Key(i), iter->value().ToString());
+      } else if (!iter->Valid()) {
+        rejected++;
+      } else {
+        ASSERT_NE(Key(i), iter->key().ToString());
+      }
+      ASSERT_OK(iter->status());
+      delete iter;
+    }
+    return rejected;
+  }
+};
+
+TEST(BlockHashIndexTest, Lookup) {
+  Block* block = BuildBlock(100, 4);
+  ASSERT_TRUE(HasHashIndex());
+  // About half of the buckets are empty.
+  ASSERT_GT(CheckLookups(block, 100), 25);
+
+  // Scans ignore the index.
+  Iterator* iter = block->NewIterator(BytewiseComparator());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(2 * count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(100, count);
+  iter->Seek(Key(51));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(52), iter->key().ToString());
+  delete iter;
+  delete block;
+}
+
+TEST(BlockHashIndexTest, TooManyRestarts) {
+  // Restart indexes must fit in a bucket, so this block has no index
+  // and lookups fall back to Seek().
+  Block* block = BuildBlock(kBlockHashIndexMaxRestarts + 1, 1);
+  ASSERT_TRUE(!HasHashIndex());
+  // Only the key past the end of the block is rejected.
+  ASSERT_EQ(1, CheckLookups(block, kBlockHashIndexMaxRestarts + 1));
+  delete block;
+
+  block = BuildBlock(kBlockHashIndexMaxRestarts, 1);
+  ASSERT_TRUE(HasHashIndex());
+  CheckLookups(block, kBlockHashIndexMaxRestarts);
+  delete block;
+}
+
+TEST(BlockHashIndexTest, Corruption) {
+  Block* block = BuildBlock(10, 4);
+  delete block;
+  // A bucket count larger than the block is detected.
+  EncodeFixed32(&data_[data_.size() - 2 * sizeof(uint32_t)], 1 << 20);
+  BlockContents contents;
+  contents.data = data_;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block bad(contents);
+  Iterator* iter = bad.NewLookupIterator(BytewiseComparator(), Key(0));
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsCorruption());
+  delete iter;
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -827,12 +1075,349 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
 
 }
 
+TEST(TableTest, InMemoryBlocksAreNotCopied) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  for (int i = 0; i < 500; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%05d", i);
+    std::string value;
+    c.Add(key, test::RandomString(&rnd, 100, &value));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  for (int in_memory = 0; in_memory < 2; in_memory++) {
+    c.SetInMemory(in_memory);
+    Iterator* iter = c.NewIterator();
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(kvmap[iter->key().ToString()], iter->value().ToString());
+      ASSERT_EQ(in_memory != 0, c.InSource(iter->value()));
+      count++;
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(500, count);
+    delete iter;
+  }
+}
+
+TEST(TableTest, Readahead) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  const int kNumKeys = 2000;
+  for (int i = 0; i < kNumKeys; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%05d", i);
+    std::string value;
+    c.Add(key, test::RandomString(&rnd, 100, &value));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  ReadOptions readahead_options;
+  readahead_options.readahead_size = 64 * 1024;
+  for (int in_memory = 0; in_memory < 2; in_memory++) {
+    c.SetInMemory(in_memory);
+    Iterator* plain = c.NewIterator(ReadOptions());
+    Iterator* readahead = c.NewIterator(readahead_options);
+
+    // A full scan sees the same entries with far fewer reads, or for
+    // files in memory, with few prefetches.
+    int start = c.reads();
+    int count = 0;
+    for (plain->SeekToFirst(); plain->Valid(); plain->Next()) {
+      count++;
+    }
+    ASSERT_EQ(kNumKeys, count);
+    const int plain_reads = c.reads() - start;
+    start = c.reads();
+    const int start_prefetches = c.prefetches();
+    KVMap::const_iterator model = kvmap.begin();
+    for (readahead->SeekToFirst(); readahead->Valid(); readahead->Next()) {
+      ASSERT_TRUE(model != kvmap.end());
+      ASSERT_EQ(model->first, readahead->key().ToString());
+      ASSERT_EQ(model->second, readahead->value().ToString());
+      ++model;
+    }
+    ASSERT_TRUE(model == kvmap.end());
+    ASSERT_OK(readahead->status());
+    const int readahead_reads = c.reads() - start;
+    const int prefetches = c.prefetches() - start_prefetches;
+    fprintf(stderr, "full scan: %d reads, %d with readahead (%d prefetches)\n",
+            plain_reads, readahead_reads, prefetches);
+    if (in_memory) {
+      ASSERT_GT(prefetches, 0);
+      ASSERT_LT(prefetches * 10, plain_reads);
+    } else {
+      ASSERT_EQ(0, prefetches);
+      ASSERT_LT(readahead_reads * 10, plain_reads);
+    }
+
+    // Seeks and backward steps in random places
+    for (int i = 0; i < 100; i++) {
+      const std::string& target = keys[rnd.Uniform(keys.size())];
+      plain->Seek(target);
+      readahead->Seek(target);
+      for (int j = 0; j < 20 && plain->Valid(); j++) {
+        ASSERT_TRUE(readahead->Valid());
+        ASSERT_EQ(plain->key().ToString(), readahead->key().ToString());
+        ASSERT_EQ(plain->value().ToString(), readahead->value().ToString());
+        if (i % 2 == 0) {
+          plain->Next();
+          readahead->Next();
+        } else {
+          plain->Prev();
+          readahead->Prev();
+        }
+      }
+    }
+    delete plain;
+    delete readahead;
+  }
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
   return port::Snappy_Compress(in.data(), in.size(), &out);
 }
 
+// Compresses runs of equal bytes into (length, byte) pairs.
+class RunLengthCompressor : public Compressor {
+ public:
+  RunLengthCompressor() : compressed_(0), uncompressed_(0) { }
+
+  virtual CompressionType type() const {
+    return static_cast<CompressionType>(0x80);
+  }
+
+  virtual const char* Name() const { return "leveldb.RunLengthTest"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    compressed_++;
+    output->clear();
+    PutVarint32(output, input.size());
+    for (size_t i = 0; i < input.size(); ) {
+      size_t n = 1;
+      while (n < 255 && i + n < input.size() && input[i + n] == input[i]) {
+        n++;
+      }
+      output->push_back(static_cast<char>(n));
+      output->push_back(input[i]);
+      i += n;
+    }
+    return true;
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    Slice in = input;
+    uint32_t n;
+    if (!GetVarint32(&in, &n)) {
+      return false;
+    }
+    *length = n;
+    return true;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    uncompressed_++;
+    Slice in = input;
+    uint32_t length;
+    if (!GetVarint32(&in, &length)) {
+      return false;
+    }
+    size_t pos = 0;
+    for (size_t i = 0; i + 1 < in.size(); i += 2) {
+      const size_t n = static_cast<unsigned char>(in[i]);
+      if (pos + n > length) {
+        return false;
+      }
+      memset(output + pos, in[i + 1], n);
+      pos += n;
+    }
+    return pos == length;
+  }
+
+  int compressed() const { return compressed_; }
+  int uncompressed() const { return uncompressed_; }
+
+ private:
+  mutable int compressed_;
+  mutable int uncompressed_;
+};
+
+// Build a table of compressible values with "type" and check that it
+// reads back correctly.  Return the size of the table.
+static uint64_t CompressedTableSize(CompressionType type) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  for (int i = 0; i < 200; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%05d", i);
+    c.Add(key, std::string(rnd.Uniform(1000), 'a' + rnd.Uniform(26)));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = type;
+  c.Finish(options, &keys, &kvmap);
+
+  Iterator* iter = c.NewIterator();
+  KVMap::const_iterator model = kvmap.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(model != kvmap.end());
+    ASSERT_EQ(model->first, iter->key().ToString());
+    ASSERT_EQ(model->second, iter->value().ToString());
+    ++model;
+  }
+  ASSERT_TRUE(model == kvmap.end());
+  ASSERT_OK(iter->status());
+  delete iter;
+  return c.ApproximateOffsetOf("xyz");
+}
+
+TEST(TableTest, RegisteredCompressor) {
+  ASSERT_TRUE(GetCompressor(static_cast<CompressionType>(0x80)) == NULL);
+  // Registered compressors must stay live
+  static RunLengthCompressor compressor;
+  RegisterCompressor(&compressor);
+  ASSERT_TRUE(GetCompressor(compressor.type()) == &compressor);
+
+  const uint64_t plain = CompressedTableSize(kNoCompression);
+  const uint64_t compressed = CompressedTableSize(compressor.type());
+  ASSERT_GT(compressor.compressed(), 0);
+  ASSERT_GT(compressor.uncompressed(), 0);
+  ASSERT_LT(compressed * 10, plain);
+}
+
+TEST(TableTest, ZlibCompression) {
+  std::string out;
+  if (!GetCompressor(kZlibCompression)->Compress("aaaaaaaaaaaa", &out)) {
+    fprintf(stderr, "skipping zlib compression test\n");
+    return;
+  }
+  ASSERT_LT(CompressedTableSize(kZlibCompression) * 10,
+            CompressedTableSize(kNoCompression));
+}
+
+// Build a zlib compressed table of small JSON-like records with a
+// compression dictionary of "dict_bytes", check that it reads back
+// correctly and return its size.
+static uint64_t DictionaryTableSize(size_t dict_bytes) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  for (int i = 0; i < 3000; i++) {
+    char key[20];
+    char value[200];
+    snprintf(key, sizeof(key), "user%06d", i);
+    snprintf(value, sizeof(value),
+             "{\"id\":%d,\"name\":\"user%d\",\"email\":\"user%d@example.com\","
+             "\"active\":%s,\"score\":%d,\"tags\":[\"%c\",\"%c\"]}",
+             i, rnd.Uniform(100000), rnd.Uniform(100000),
+             rnd.OneIn(2) ? "true" : "false", rnd.Uniform(1000),
+             'a' + rnd.Uniform(26), 'a' + rnd.Uniform(26));
+    c.Add(key, value);
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.compression = kZlibCompression;
+  options.compression_dict_bytes = dict_bytes;
+  c.Finish(options, &keys, &kvmap);
+
+  Iterator* iter = c.NewIterator();
+  KVMap::const_iterator model = kvmap.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(model != kvmap.end());
+    ASSERT_EQ(model->first, iter->key().ToString());
+    ASSERT_EQ(model->second, iter->value().ToString());
+    ++model;
+  }
+  ASSERT_TRUE(model == kvmap.end());
+  ASSERT_OK(iter->status());
+  for (int i = 0; i < 100; i++) {
+    const std::string& k = keys[rnd.Uniform(keys.size())];
+    iter->Seek(k);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(k, iter->key().ToString());
+    ASSERT_EQ(kvmap[k], iter->value().ToString());
+  }
+  delete iter;
+  return c.ApproximateOffsetOf("xyz");
+}
+
+TEST(TableTest, CompressionDictionary) {
+  std::string out;
+  if (!GetCompressor(kZlibCompression)->Compress("aaaaaaaaaaaa", &out)) {
+    fprintf(stderr, "skipping compression dictionary test\n");
+    return;
+  }
+  const uint64_t without_dict = DictionaryTableSize(0);
+  const uint64_t with_dict = DictionaryTableSize(8192);
+  ASSERT_LT(with_dict * 20, without_dict * 19);
+
+  // Tables too small for the dictionary to pay off are written without
+  ASSERT_EQ(DictionaryTableSize(1 << 20), without_dict);
+}
+
+TEST(TableTest, CompressionDictionaryFlush) {
+  std::string out;
+  if (!GetCompressor(kZlibCompression)->Compress("aaaaaaaaaaaa", &out)) {
+    fprintf(stderr, "skipping compression dictionary test\n");
+    return;
+  }
+  // Flushes while entries are buffered still end blocks where asked.
+  Options options;
+  options.compression = kZlibCompression;
+  options.compression_dict_bytes = 256;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  std::string value(100, 'v');
+  for (int i = 0; i < 100; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%04d", i);
+    builder.Add(key, value);
+    if (i % 10 == 9) {
+      builder.Flush();
+    }
+    ASSERT_OK(builder.status());
+  }
+  ASSERT_GT(builder.FileSize(), 0);
+  ASSERT_OK(builder.Finish());
+  ASSERT_EQ(sink.contents().size(), builder.FileSize());
+
+  StringSource source(sink.contents());
+  Table* table = NULL;
+  ASSERT_OK(Table::Open(Options(), &source, sink.contents().size(), &table));
+  // Each block holds ten entries, so the offsets of keys in the same
+  // block agree and those of keys in different blocks do not.
+  ASSERT_EQ(table->ApproximateOffsetOf("k0011"),
+            table->ApproximateOffsetOf("k0019"));
+  ASSERT_LT(table->ApproximateOffsetOf("k0019"),
+            table->ApproximateOffsetOf("k0020"));
+  Iterator* iter = table->NewIterator(ReadOptions());
+  int n = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(value, iter->value().ToString());
+    n++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(100, n);
+  delete iter;
+  delete table;
+}
+
 TEST(TableTest, ApproximateOffsetOfCompressed) {
   if (!SnappyCompressionSupported()) {
     fprintf(stderr, "skipping compression tests\n");
@@ -4,13 +4,20 @@
 
 #include "util/arena.h"
 #include <assert.h>
+#include <new>
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
 static const int kBlockSize = 4096;
 
-Arena::Arena() {
-  blocks_memory_ = 0;
+// Header at the start of each block handed out by AllocateConcurrently().
+struct Arena::SharedBlock {
+  port::AtomicPointer alloc_ptr;   // Next free byte; advanced with CAS
+  char* limit;                     // End of the block
+};
+
+Arena::Arena() : memory_usage_(NULL), shared_block_(NULL) {
   alloc_ptr_ = NULL;  // First allocation will allocate a block
   alloc_bytes_remaining_ = 0;
 }
@@ -58,10 +65,63 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+// Returns NULL if there is no shared block or not enough room left in it.
+char* Arena::AllocateFromSharedBlock(size_t bytes) {
+  SharedBlock* block =
+      reinterpret_cast<SharedBlock*>(shared_block_.Acquire_Load());
+  if (block == NULL) {
+    return NULL;
+  }
+  while (true) {
+    char* result = reinterpret_cast<char*>(block->alloc_ptr.NoBarrier_Load());
+    if (bytes > static_cast<size_t>(block->limit - result)) {
+      return NULL;
+    }
+    if (block->alloc_ptr.CompareAndSwap(result, result + bytes)) {
+      return result;
+    }
+  }
+}
+
+char* Arena::AllocateConcurrently(size_t bytes) {
+  assert(bytes > 0);
+  const size_t align = sizeof(void*);
+  bytes = (bytes + align - 1) & ~(align - 1);  // Keep alloc_ptr aligned
+
+  if (bytes <= kBlockSize / 4) {
+    char* result = AllocateFromSharedBlock(bytes);
+    if (result != NULL) {
+      return result;
+    }
+  }
+
+  MutexLock l(&mu_);
+  if (bytes > kBlockSize / 4) {
+    // Same policy as AllocateFallback(): big objects get their own block
+    return AllocateNewBlock(bytes);
+  }
+
+  // Another thread may have started a new block while we waited
+  char* result = AllocateFromSharedBlock(bytes);
+  if (result != NULL) {
+    return result;
+  }
+
+  // We waste the remaining space in the current shared block.
+  char* mem = AllocateNewBlock(kBlockSize);
+  SharedBlock* block = new (mem) SharedBlock;
+  result = mem + ((sizeof(SharedBlock) + align - 1) & ~(align - 1));
+  block->alloc_ptr.NoBarrier_Store(result + bytes);
+  block->limit = mem + kBlockSize;
+  shared_block_.Release_Store(block);
+  return result;
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
-  blocks_memory_ += block_bytes;
   blocks_.push_back(result);
+  memory_usage_.NoBarrier_Store(reinterpret_cast<void*>(
+      MemoryUsage() + block_bytes + sizeof(char*)));
   return result;
 }
 
@@ -9,6 +9,7 @@
 #include <vector>
 #include <assert.h>
 #include <stdint.h>
+#include "port/port.h"
 
 namespace leveldb {
 
@@ -23,16 +24,25 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc
   char* AllocateAligned(size_t bytes);
 
+  // Like AllocateAligned(), but safe to call from several threads at
+  // once.  Small requests are carved out of a shared block with
+  // compare-and-swap; only starting a new block takes a lock.  Must not
+  // be mixed with concurrent calls to the other allocation methods.
+  char* AllocateConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena (including space allocated but not yet used for user
-  // allocations).
+  // allocations).  Safe to call while another thread is allocating.
   size_t MemoryUsage() const {
-    return blocks_memory_ + blocks_.capacity() * sizeof(char*);
+    return reinterpret_cast<uintptr_t>(memory_usage_.NoBarrier_Load());
   }
 
  private:
+  struct SharedBlock;
+
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateFromSharedBlock(size_t bytes);
 
   // Allocation state
   char* alloc_ptr_;
@@ -41,8 +51,14 @@ class Arena {
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
 
-  // Bytes of memory in blocks allocated so far
-  size_t blocks_memory_;
+  // Bytes of memory in blocks allocated so far, plus the block index
+  port::AtomicPointer memory_usage_;
+
+  // Block that AllocateConcurrently() is currently carving up, or NULL
+  port::AtomicPointer shared_block_;
+
+  // Serializes the slow path of AllocateConcurrently()
+  port::Mutex mu_;
 
   // No copying allowed
   Arena(const Arena&);
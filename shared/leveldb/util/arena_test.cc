@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include "leveldb/env.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -61,6 +63,73 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+namespace {
+
+struct ConcurrentState {
+  Arena* arena;
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;
+  ConcurrentState() : cv(&mu) { }
+};
+
+struct ConcurrentThread {
+  ConcurrentState* state;
+  int id;
+  std::vector<std::pair<size_t, char*> > allocated;
+};
+
+static void ConcurrentAllocator(void* arg) {
+  ConcurrentThread* t = reinterpret_cast<ConcurrentThread*>(arg);
+  Random rnd(301 + t->id);
+  for (int i = 0; i < 20000; i++) {
+    size_t s = rnd.OneIn(1000) ? 1 + rnd.Uniform(6000) : 1 + rnd.Uniform(100);
+    char* r = t->state->arena->AllocateConcurrently(s);
+    ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
+    memset(r, t->id, s);
+    t->allocated.push_back(std::make_pair(s, r));
+  }
+  MutexLock l(&t->state->mu);
+  t->state->running--;
+  t->state->cv.Signal();
+}
+
+}  // namespace
+
+TEST(ArenaTest, Concurrent) {
+  const int kThreads = 4;
+  Arena arena;
+  ConcurrentState state;
+  state.arena = &arena;
+  state.running = kThreads;
+  ConcurrentThread threads[kThreads];
+  for (int i = 0; i < kThreads; i++) {
+    threads[i].state = &state;
+    threads[i].id = i;
+    Env::Default()->StartThread(ConcurrentAllocator, &threads[i]);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.running > 0) {
+      state.cv.Wait();
+    }
+  }
+
+  // Every allocation still holds its owner's pattern, so none overlap
+  size_t bytes = 0;
+  for (int i = 0; i < kThreads; i++) {
+    for (size_t j = 0; j < threads[i].allocated.size(); j++) {
+      size_t num_bytes = threads[i].allocated[j].first;
+      const char* p = threads[i].allocated[j].second;
+      for (size_t b = 0; b < num_bytes; b++) {
+        ASSERT_EQ(i, int(p[b]) & 0xff);
+      }
+      bytes += num_bytes;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -31,6 +31,13 @@ class BloomTest {
     delete policy_;
   }
 
+  // Switch to *policy, which this object will delete.
+  void UsePolicy(const FilterPolicy* policy) {
+    delete policy_;
+    policy_ = policy;
+    Reset();
+  }
+
   void Reset() {
     keys_.clear();
     filter_.clear();
@@ -83,6 +90,28 @@ class BloomTest {
     }
     return result / 10000.0;
   }
+
+  // Build a filter over keys [0,n) and return its false positive rate
+  // over many more keys than FalsePositiveRate() uses.
+  double LargeFalsePositiveRate(int n) {
+    char buffer[sizeof(int)];
+    Reset();
+    for (int i = 0; i < n; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+    for (int i = 0; i < n; i++) {
+      if (!Matches(Key(i, buffer))) return 1.0;
+    }
+    int result = 0;
+    const int kProbes = 200000;
+    for (int i = 0; i < kProbes; i++) {
+      if (Matches(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    return result / static_cast<double>(kProbes);
+  }
 };
 
 TEST(BloomTest, EmptyFilter) {
@@ -151,6 +180,100 @@ TEST(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters/5);
 }
 
+TEST(BloomTest, BlockedEmptyFilter) {
+  UsePolicy(NewBlockedBloomFilterPolicy(10));
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(BloomTest, BlockedSmall) {
+  UsePolicy(NewBlockedBloomFilterPolicy(10));
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(BloomTest, BlockedVaryingLengths) {
+  UsePolicy(NewBlockedBloomFilterPolicy(10));
+  char buffer[sizeof(int)];
+
+  // Count number of filters that significantly exceed the false positive rate
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Rounded up to a whole 32-byte block, plus the marker byte
+    ASSERT_LE(FilterSize(), (length * 10 / 8) + 33) << length;
+    ASSERT_EQ(1, FilterSize() % 32) << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+              rate*100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.03);   // Must not be over 3%
+    if (rate > 0.02) mediocre_filters++;  // Allowed, but not too often
+    else good_filters++;
+  }
+  if (kVerbose >= 1) {
+    fprintf(stderr, "Filters: %d good, %d mediocre\n",
+            good_filters, mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters/5);
+}
+
+TEST(BloomTest, BlockedFalsePositiveRate) {
+  // Expected rates for a blocked bloom filter with 8 probes per key,
+  // with some slack.
+  struct {
+    int bits_per_key;
+    double max_rate;
+  } cases[] = {
+    { 6, 0.100 },
+    { 10, 0.018 },
+    { 16, 0.004 },
+  };
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    UsePolicy(NewBlockedBloomFilterPolicy(cases[c].bits_per_key));
+    const double rate = LargeFalsePositiveRate(100000);
+    if (kVerbose >= 1) {
+      fprintf(stderr, "Blocked: %5.2f%% @ %d bits per key\n",
+              rate*100.0, cases[c].bits_per_key);
+    }
+    ASSERT_LE(rate, cases[c].max_rate);
+  }
+}
+
+TEST(BloomTest, ForeignFilters) {
+  // A policy must not reject keys based on a filter with another layout.
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  const FilterPolicy* blocked = NewBlockedBloomFilterPolicy(10);
+  Slice key("hello");
+  std::string bloom_filter, blocked_filter;
+  bloom->CreateFilter(&key, 1, &bloom_filter);
+  blocked->CreateFilter(&key, 1, &blocked_filter);
+  ASSERT_TRUE(blocked->KeyMayMatch("anything", bloom_filter));
+  ASSERT_TRUE(bloom->KeyMayMatch("anything", blocked_filter));
+  delete bloom;
+  delete blocked;
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "leveldb/cache.h"
 #include "port/port.h"
@@ -50,18 +51,21 @@ struct LRUHandle {
 // table implementations in some of the compiler/runtime combinations
 // we have tested.  E.g., readrandom speeds up by ~5% over the g++
 // 4.4.3's builtin hashtable.
+//
+// Handle must provide key(), hash and next_hash.
+template <class Handle>
 class HandleTable {
  public:
   HandleTable() : length_(0), elems_(0), list_(NULL) { Resize(); }
   ~HandleTable() { delete[] list_; }
 
-  LRUHandle* Lookup(const Slice& key, uint32_t hash) {
+  Handle* Lookup(const Slice& key, uint32_t hash) {
     return *FindPointer(key, hash);
   }
 
-  LRUHandle* Insert(LRUHandle* h) {
-    LRUHandle** ptr = FindPointer(h->key(), h->hash);
-    LRUHandle* old = *ptr;
+  Handle* Insert(Handle* h) {
+    Handle** ptr = FindPointer(h->key(), h->hash);
+    Handle* old = *ptr;
     h->next_hash = (old == NULL ? NULL : old->next_hash);
     *ptr = h;
     if (old == NULL) {
@@ -75,9 +79,9 @@ class HandleTable {
     return old;
   }
 
-  LRUHandle* Remove(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = FindPointer(key, hash);
-    LRUHandle* result = *ptr;
+  Handle* Remove(const Slice& key, uint32_t hash) {
+    Handle** ptr = FindPointer(key, hash);
+    Handle* result = *ptr;
     if (result != NULL) {
       *ptr = result->next_hash;
       --elems_;
@@ -90,13 +94,13 @@ class HandleTable {
   // a linked list of cache entries that hash into the bucket.
   uint32_t length_;
   uint32_t elems_;
-  LRUHandle** list_;
+  Handle** list_;
 
   // Return a pointer to slot that points to a cache entry that
   // matches key/hash.  If there is no such cache entry, return a
   // pointer to the trailing slot in the corresponding linked list.
-  LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = &list_[hash & (length_ - 1)];
+  Handle** FindPointer(const Slice& key, uint32_t hash) {
+    Handle** ptr = &list_[hash & (length_ - 1)];
     while (*ptr != NULL &&
            ((*ptr)->hash != hash || key != (*ptr)->key())) {
       ptr = &(*ptr)->next_hash;
@@ -109,15 +113,15 @@ class HandleTable {
     while (new_length < elems_) {
       new_length *= 2;
     }
-    LRUHandle** new_list = new LRUHandle*[new_length];
+    Handle** new_list = new Handle*[new_length];
     memset(new_list, 0, sizeof(new_list[0]) * new_length);
     uint32_t count = 0;
     for (uint32_t i = 0; i < length_; i++) {
-      LRUHandle* h = list_[i];
+      Handle* h = list_[i];
       while (h != NULL) {
-        LRUHandle* next = h->next_hash;
+        Handle* next = h->next_hash;
         uint32_t hash = h->hash;
-        LRUHandle** ptr = &new_list[hash & (new_length - 1)];
+        Handle** ptr = &new_list[hash & (new_length - 1)];
         h->next_hash = *ptr;
         *ptr = h;
         h = next;
@@ -164,7 +168,7 @@ class LRUCache {
   // lru.prev is newest entry, lru.next is oldest entry.
   LRUHandle lru_;
 
-  HandleTable table_;
+  HandleTable<LRUHandle> table_;
 };
 
 LRUCache::LRUCache()
@@ -264,12 +268,233 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+// CLOCK cache implementation
+//
+// Entries live in a ring that a clock hand sweeps when room is needed.
+// A lookup only bumps the entry's saturating usage count, so unlike the
+// LRU shard the hit path needs no list manipulation and runs under a
+// shared lock.  The hand decrements usage counts as it passes and evicts
+// the first unpinned entry whose count is already zero; a count rather
+// than a single bit keeps entries that are hit often from being swept
+// out by a burst of entries that are hit once.  Reference counts are
+// atomic, so Release() takes no lock at all.
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockHandle* next_hash;
+  size_t charge;
+  size_t key_length;
+  size_t ring_index;    // Position in ClockCache::ring_
+  // Reference count stored as an integer.  The cache holds one
+  // reference while the entry is in the table.
+  port::AtomicPointer refs;
+  // Number of lookups since the hand last passed, up to kMaxClockUsage.
+  // Updated without synchronization, so increments may be lost.
+  port::AtomicPointer usage;
+  uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  char key_data[1];   // Beginning of key
+
+  Slice key() const {
+    return Slice(key_data, key_length);
+  }
+
+  uintptr_t AddRefs(intptr_t delta) {
+    while (true) {
+      void* old = refs.Acquire_Load();
+      void* now = reinterpret_cast<void*>(
+          reinterpret_cast<uintptr_t>(old) + delta);
+      if (refs.CompareAndSwap(old, now)) {
+        return reinterpret_cast<uintptr_t>(now);
+      }
+    }
+  }
+
+  uintptr_t Refs() const {
+    return reinterpret_cast<uintptr_t>(refs.Acquire_Load());
+  }
+
+  uintptr_t Usage() const {
+    return reinterpret_cast<uintptr_t>(usage.NoBarrier_Load());
+  }
+
+  void SetUsage(uintptr_t u) {
+    usage.NoBarrier_Store(reinterpret_cast<void*>(u));
+  }
+};
+
+static const uintptr_t kMaxClockUsage = 3;
+
+// A single shard of sharded CLOCK cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCache.
+  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash,
+                        void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
 
-class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  // Remove e from the table and the ring.  The caller must drop the
+  // cache's reference to e, preferably after releasing mutex_.
+  void Remove(ClockHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RemoveFromRing(ClockHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void Unref(ClockHandle* e);
+
+  // Initialized before use.
+  size_t capacity_;
+
+  // Lookups hold mutex_ shared; everything that changes the table or
+  // the ring holds it exclusively.
+  port::RWMutex mutex_;
+  size_t usage_;
+  std::vector<ClockHandle*> ring_;
+  size_t hand_;
+
+  HandleTable<ClockHandle> table_;
+};
+
+ClockCache::ClockCache()
+    : usage_(0),
+      hand_(0) {
+}
+
+ClockCache::~ClockCache() {
+  for (size_t i = 0; i < ring_.size(); i++) {
+    assert(ring_[i]->Refs() == 1);  // Error if caller has unreleased handle
+    Unref(ring_[i]);
+  }
+}
+
+void ClockCache::Unref(ClockHandle* e) {
+  if (e->AddRefs(-1) == 0) {
+    (*e->deleter)(e->key(), e->value);
+    free(e);
+  }
+}
+
+void ClockCache::RemoveFromRing(ClockHandle* e) {
+  // Move the last entry into e's slot.  This perturbs the sweep order
+  // slightly, which CLOCK tolerates.
+  ClockHandle* last = ring_.back();
+  ring_[e->ring_index] = last;
+  last->ring_index = e->ring_index;
+  ring_.pop_back();
+}
+
+void ClockCache::Remove(ClockHandle* e) {
+  table_.Remove(e->key(), e->hash);
+  RemoveFromRing(e);
+  usage_ -= e->charge;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  ReadLock l(&mutex_);
+  ClockHandle* e = table_.Lookup(key, hash);
+  if (e != NULL) {
+    // Entries cannot leave the table while we hold mutex_, so the
+    // cache's reference keeps e alive until we have taken our own.
+    e->AddRefs(1);
+    const uintptr_t u = e->Usage();
+    if (u < kMaxClockUsage) {
+      e->SetUsage(u + 1);
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+Cache::Handle* ClockCache::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value)) {
+  ClockHandle* e = reinterpret_cast<ClockHandle*>(
+      malloc(sizeof(ClockHandle)-1 + key.size()));
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  // One from ClockCache, one for the returned handle
+  e->refs.NoBarrier_Store(reinterpret_cast<void*>(2));
+  e->SetUsage(0);
+  memcpy(e->key_data, key.data(), key.size());
+
+  std::vector<ClockHandle*> evicted;
+  {
+    WriteLock l(&mutex_);
+    ClockHandle* old = table_.Insert(e);
+    if (old != NULL) {
+      RemoveFromRing(old);
+      usage_ -= old->charge;
+      evicted.push_back(old);
+    }
+    e->ring_index = ring_.size();
+    ring_.push_back(e);
+    usage_ += charge;
+
+    // kMaxClockUsage + 1 full sweeps bring every usage count to zero, so
+    // if nothing can be evicted by then, everything left is pinned.
+    size_t budget = (kMaxClockUsage + 1) * ring_.size();
+    while (usage_ > capacity_ && budget > 0 && !ring_.empty()) {
+      budget--;
+      if (hand_ >= ring_.size()) {
+        hand_ = 0;
+      }
+      ClockHandle* c = ring_[hand_];
+      if (c->Refs() > 1) {
+        hand_++;                              // Pinned by a client
+      } else if (c->Usage() > 0) {
+        c->SetUsage(c->Usage() - 1);          // Another chance
+        hand_++;
+      } else {
+        Remove(c);  // Fills ring_[hand_] with another entry
+        evicted.push_back(c);
+      }
+    }
+  }
+
+  // Run deleters without holding the lock.
+  for (size_t i = 0; i < evicted.size(); i++) {
+    Unref(evicted[i]);
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  ClockHandle* e;
+  {
+    WriteLock l(&mutex_);
+    e = table_.Lookup(key, hash);
+    if (e != NULL) {
+      Remove(e);
+    }
+  }
+  if (e != NULL) {
+    Unref(e);
+  }
+}
+
+static const int kDefaultNumShardBits = 4;
+
+// Spreads keys over 2^num_shard_bits independently locked shards.
+// ShardType is LRUCache or ClockCache and HandleType the matching
+// entry type.
+template <class ShardType, class HandleType>
+class ShardedCache : public Cache {
+ private:
+  const int num_shard_bits_;
+  ShardType* shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -277,38 +502,42 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) {
-    return hash >> (32 - kNumShardBits);
+  uint32_t Shard(uint32_t hash) const {
+    return (num_shard_bits_ > 0) ? hash >> (32 - num_shard_bits_) : 0;
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
-      : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
+  ShardedCache(size_t capacity, int num_shard_bits)
+      : num_shard_bits_(num_shard_bits),
+        last_id_(0) {
+    const int num_shards = 1 << num_shard_bits_;
+    shard_ = new ShardType[num_shards];
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    for (int s = 0; s < num_shards; s++) {
       shard_[s].SetCapacity(per_shard);
     }
   }
-  virtual ~ShardedLRUCache() { }
-  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
-                         void (*deleter)(const Slice& key, void* value)) {
+  virtual ~ShardedCache() { delete[] shard_; }
+  virtual Cache::Handle* Insert(const Slice& key, void* value, size_t charge,
+                                void (*deleter)(const Slice& key,
+                                                void* value)) {
     const uint32_t hash = HashSlice(key);
     return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
   }
-  virtual Handle* Lookup(const Slice& key) {
+  virtual Cache::Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
     return shard_[Shard(hash)].Lookup(key, hash);
   }
-  virtual void Release(Handle* handle) {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
+  virtual void Release(Cache::Handle* handle) {
+    HandleType* h = reinterpret_cast<HandleType*>(handle);
     shard_[Shard(h->hash)].Release(handle);
   }
   virtual void Erase(const Slice& key) {
     const uint32_t hash = HashSlice(key);
     shard_[Shard(hash)].Erase(key, hash);
   }
-  virtual void* Value(Handle* handle) {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+  virtual void* Value(Cache::Handle* handle) {
+    return reinterpret_cast<HandleType*>(handle)->value;
   }
   virtual uint64_t NewId() {
     MutexLock l(&id_mutex_);
@@ -316,10 +545,33 @@ class ShardedLRUCache : public Cache {
   }
 };
 
+int SanitizeShardBits(int num_shard_bits) {
+  if (num_shard_bits < 0) {
+    return kDefaultNumShardBits;
+  } else if (num_shard_bits > 20) {
+    return 20;
+  }
+  return num_shard_bits;
+}
+
 }  // end anonymous namespace
 
 Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+  return NewLRUCache(capacity, -1);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<LRUCache, LRUHandle>(
+      capacity, SanitizeShardBits(num_shard_bits));
+}
+
+Cache* NewClockCache(size_t capacity) {
+  return NewClockCache(capacity, -1);
+}
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<ClockCache, ClockHandle>(
+      capacity, SanitizeShardBits(num_shard_bits));
 }
 
 }  // namespace leveldb
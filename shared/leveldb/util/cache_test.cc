@@ -5,7 +5,11 @@
 #include "leveldb/cache.h"
 
 #include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -32,12 +36,20 @@ class CacheTest {
     current_->deleted_values_.push_back(DecodeValue(v));
   }
 
+  // Sequence of cache implementations to try
+  enum CacheType {
+    kLRU,
+    kClock,
+    kEnd
+  };
+
   static const int kCacheSize = 1000;
   std::vector<int> deleted_keys_;
   std::vector<int> deleted_values_;
+  int cache_type_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) {
+  CacheTest() : cache_type_(kLRU), cache_(NewLRUCache(kCacheSize)) {
     current_ = this;
   }
 
@@ -45,6 +57,27 @@ class CacheTest {
     delete cache_;
   }
 
+  // Switch to a fresh cache of the next type.  Returns false once all
+  // types have been tried.
+  bool ChangeCache() {
+    cache_type_++;
+    if (cache_type_ >= kEnd) {
+      return false;
+    }
+    delete cache_;
+    cache_ = NewCache(kCacheSize, -1);
+    deleted_keys_.clear();
+    deleted_values_.clear();
+    return true;
+  }
+
+  Cache* NewCache(size_t capacity, int num_shard_bits) {
+    if (cache_type_ == kClock) {
+      return NewClockCache(capacity, num_shard_bits);
+    }
+    return NewLRUCache(capacity, num_shard_bits);
+  }
+
   int Lookup(int key) {
     Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
     const int r = (handle == NULL) ? -1 : DecodeValue(cache_->Value(handle));
@@ -66,111 +99,121 @@ class CacheTest {
 CacheTest* CacheTest::current_;
 
 TEST(CacheTest, HitAndMiss) {
-  ASSERT_EQ(-1, Lookup(100));
-
-  Insert(100, 101);
-  ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(-1,  Lookup(200));
-  ASSERT_EQ(-1,  Lookup(300));
-
-  Insert(200, 201);
-  ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(-1,  Lookup(300));
-
-  Insert(100, 102);
-  ASSERT_EQ(102, Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(-1,  Lookup(300));
-
-  ASSERT_EQ(1, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[0]);
-  ASSERT_EQ(101, deleted_values_[0]);
+  do {
+    ASSERT_EQ(-1, Lookup(100));
+
+    Insert(100, 101);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1,  Lookup(200));
+    ASSERT_EQ(-1,  Lookup(300));
+
+    Insert(200, 201);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1,  Lookup(300));
+
+    Insert(100, 102);
+    ASSERT_EQ(102, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1,  Lookup(300));
+
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+  } while (ChangeCache());
 }
 
 TEST(CacheTest, Erase) {
-  Erase(200);
-  ASSERT_EQ(0, deleted_keys_.size());
-
-  Insert(100, 101);
-  Insert(200, 201);
-  Erase(100);
-  ASSERT_EQ(-1,  Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(1, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[0]);
-  ASSERT_EQ(101, deleted_values_[0]);
-
-  Erase(100);
-  ASSERT_EQ(-1,  Lookup(100));
-  ASSERT_EQ(201, Lookup(200));
-  ASSERT_EQ(1, deleted_keys_.size());
+  do {
+    Erase(200);
+    ASSERT_EQ(0, deleted_keys_.size());
+
+    Insert(100, 101);
+    Insert(200, 201);
+    Erase(100);
+    ASSERT_EQ(-1,  Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1,  Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1, deleted_keys_.size());
+  } while (ChangeCache());
 }
 
 TEST(CacheTest, EntriesArePinned) {
-  Insert(100, 101);
-  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
-  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
-
-  Insert(100, 102);
-  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
-  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
-  ASSERT_EQ(0, deleted_keys_.size());
-
-  cache_->Release(h1);
-  ASSERT_EQ(1, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[0]);
-  ASSERT_EQ(101, deleted_values_[0]);
-
-  Erase(100);
-  ASSERT_EQ(-1, Lookup(100));
-  ASSERT_EQ(1, deleted_keys_.size());
-
-  cache_->Release(h2);
-  ASSERT_EQ(2, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[1]);
-  ASSERT_EQ(102, deleted_values_[1]);
+  do {
+    Insert(100, 101);
+    Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+    Insert(100, 102);
+    Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+    ASSERT_EQ(0, deleted_keys_.size());
+
+    cache_->Release(h1);
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(1, deleted_keys_.size());
+
+    cache_->Release(h2);
+    ASSERT_EQ(2, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[1]);
+    ASSERT_EQ(102, deleted_values_[1]);
+  } while (ChangeCache());
 }
 
 TEST(CacheTest, EvictionPolicy) {
-  Insert(100, 101);
-  Insert(200, 201);
-
-  // Frequently used entry must be kept around
-  for (int i = 0; i < kCacheSize + 100; i++) {
-    Insert(1000+i, 2000+i);
-    ASSERT_EQ(2000+i, Lookup(1000+i));
+  do {
+    Insert(100, 101);
+    Insert(200, 201);
+
+    // Frequently used entry must be kept around
+    for (int i = 0; i < kCacheSize + 100; i++) {
+      Insert(1000+i, 2000+i);
+      ASSERT_EQ(2000+i, Lookup(1000+i));
+      ASSERT_EQ(101, Lookup(100));
+    }
     ASSERT_EQ(101, Lookup(100));
-  }
-  ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(-1, Lookup(200));
+    ASSERT_EQ(-1, Lookup(200));
+  } while (ChangeCache());
 }
 
 TEST(CacheTest, HeavyEntries) {
-  // Add a bunch of light and heavy entries and then count the combined
-  // size of items still in the cache, which must be approximately the
-  // same as the total capacity.
-  const int kLight = 1;
-  const int kHeavy = 10;
-  int added = 0;
-  int index = 0;
-  while (added < 2*kCacheSize) {
-    const int weight = (index & 1) ? kLight : kHeavy;
-    Insert(index, 1000+index, weight);
-    added += weight;
-    index++;
-  }
+  do {
+    // Add a bunch of light and heavy entries and then count the combined
+    // size of items still in the cache, which must be approximately the
+    // same as the total capacity.
+    const int kLight = 1;
+    const int kHeavy = 10;
+    int added = 0;
+    int index = 0;
+    while (added < 2*kCacheSize) {
+      const int weight = (index & 1) ? kLight : kHeavy;
+      Insert(index, 1000+index, weight);
+      added += weight;
+      index++;
+    }
 
-  int cached_weight = 0;
-  for (int i = 0; i < index; i++) {
-    const int weight = (i & 1 ? kLight : kHeavy);
-    int r = Lookup(i);
-    if (r >= 0) {
-      cached_weight += weight;
-      ASSERT_EQ(1000+i, r);
+    int cached_weight = 0;
+    for (int i = 0; i < index; i++) {
+      const int weight = (i & 1 ? kLight : kHeavy);
+      int r = Lookup(i);
+      if (r >= 0) {
+        cached_weight += weight;
+        ASSERT_EQ(1000+i, r);
+      }
     }
-  }
-  ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
+    ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
+  } while (ChangeCache());
 }
 
 TEST(CacheTest, NewId) {
@@ -179,6 +222,155 @@ TEST(CacheTest, NewId) {
   ASSERT_NE(a, b);
 }
 
+TEST(CacheTest, NumShardBits) {
+  do {
+    // With a single shard the oldest unused entry goes first.
+    delete cache_;
+    cache_ = NewCache(kCacheSize, 0);
+    deleted_keys_.clear();
+    for (int i = 0; i < kCacheSize; i++) {
+      Insert(i, 1000+i);
+    }
+    ASSERT_EQ(0, deleted_keys_.size());
+    Insert(kCacheSize, 1000+kCacheSize);
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(0, deleted_keys_[0]);
+
+    // Many shards still hold roughly the full capacity.
+    delete cache_;
+    cache_ = NewCache(kCacheSize, 6);
+    for (int i = 0; i < 2*kCacheSize; i++) {
+      Insert(i, 1000+i);
+    }
+    int cached = 0;
+    for (int i = 0; i < 2*kCacheSize; i++) {
+      if (Lookup(i) >= 0) {
+        cached++;
+      }
+    }
+    ASSERT_LE(cached, kCacheSize + 64);
+    ASSERT_GE(cached, kCacheSize / 2);
+  } while (ChangeCache());
+}
+
+TEST(CacheTest, ClockPinnedEntriesAreNotEvicted) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 0);
+
+  std::vector<Cache::Handle*> handles;
+  for (int i = 0; i < kCacheSize; i++) {
+    handles.push_back(cache_->Insert(EncodeKey(i), EncodeValue(1000+i), 1,
+                                     &CacheTest::Deleter));
+  }
+  // The pinned entries fill the cache, so each unpinned entry only
+  // lasts until the next insertion.
+  for (int i = kCacheSize; i < kCacheSize + 10; i++) {
+    Insert(i, 1000+i);
+  }
+  for (int i = 0; i < kCacheSize; i++) {
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  ASSERT_EQ(9, deleted_keys_.size());
+  ASSERT_EQ(1000 + kCacheSize + 9, Lookup(kCacheSize + 9));
+
+  // Once released, the next insertion brings usage back to capacity.
+  for (size_t i = 0; i < handles.size(); i++) {
+    cache_->Release(handles[i]);
+  }
+  Insert(kCacheSize + 10, 1000 + kCacheSize + 10);
+  ASSERT_EQ(11, deleted_keys_.size());
+  ASSERT_EQ(1000 + kCacheSize + 10, Lookup(kCacheSize + 10));
+}
+
+namespace {
+
+struct ConcurrentState {
+  Cache* cache;
+  port::Mutex mu;
+  int inserted;                 // Protected by mu
+  int deleted;                  // Protected by mu
+  int running;                  // Protected by mu
+  port::CondVar cv;
+
+  explicit ConcurrentState(Cache* c)
+      : cache(c), inserted(0), deleted(0), running(0), cv(&mu) { }
+};
+
+struct ConcurrentThreadArg {
+  ConcurrentState* state;
+  int seed;
+};
+
+static ConcurrentState* concurrent_state;
+
+static void CountingDeleter(const Slice& key, void* v) {
+  ASSERT_EQ(DecodeKey(key), DecodeValue(v));
+  MutexLock l(&concurrent_state->mu);
+  concurrent_state->deleted++;
+}
+
+// Mix inserts, erases and lookups of a small key space.  Each value
+// equals its key, so lookups can verify what they find.
+static void ConcurrentThread(void* v) {
+  ConcurrentThreadArg* arg = reinterpret_cast<ConcurrentThreadArg*>(v);
+  ConcurrentState* state = arg->state;
+  Random rnd(arg->seed);
+  int inserted = 0;
+  for (int i = 0; i < 20000; i++) {
+    const int k = rnd.Uniform(400);
+    const std::string key = EncodeKey(k);
+    Cache::Handle* h = NULL;
+    switch (rnd.Uniform(10)) {
+      case 0:
+        h = state->cache->Insert(key, EncodeValue(k), 1, &CountingDeleter);
+        inserted++;
+        break;
+      case 1:
+        state->cache->Erase(key);
+        break;
+      default:
+        h = state->cache->Lookup(key);
+        break;
+    }
+    if (h != NULL) {
+      ASSERT_EQ(k, DecodeValue(state->cache->Value(h)));
+      state->cache->Release(h);
+    }
+  }
+  MutexLock l(&state->mu);
+  state->inserted += inserted;
+  state->running--;
+  state->cv.Signal();
+}
+
+}  // namespace
+
+TEST(CacheTest, Concurrent) {
+  const int kThreads = 8;
+  do {
+    ConcurrentState state(NewCache(100, 2));
+    concurrent_state = &state;
+    ConcurrentThreadArg args[kThreads];
+    state.running = kThreads;
+    for (int i = 0; i < kThreads; i++) {
+      args[i].state = &state;
+      args[i].seed = 301 + i;
+      Env::Default()->StartThread(&ConcurrentThread, &args[i]);
+    }
+    {
+      MutexLock l(&state.mu);
+      while (state.running > 0) {
+        state.cv.Wait();
+      }
+    }
+    delete state.cache;
+
+    // Every inserted value was passed to the deleter exactly once.
+    ASSERT_GT(state.inserted, 0);
+    ASSERT_EQ(state.inserted, state.deleted);
+  } while (ChangeCache());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
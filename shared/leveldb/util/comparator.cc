@@ -13,6 +13,10 @@ namespace leveldb {
 
 Comparator::~Comparator() { }
 
+bool Comparator::HashKey(const Slice& key, Slice* hash_key) const {
+  return false;
+}
+
 namespace {
 class BytewiseComparatorImpl : public Comparator {
  public:
@@ -63,6 +67,11 @@ class BytewiseComparatorImpl : public Comparator {
     }
     // *key is a run of 0xffs.  Leave it alone.
   }
+
+  virtual bool HashKey(const Slice& key, Slice* hash_key) const {
+    *hash_key = key;
+    return true;
+  }
 };
 }  // namespace
 
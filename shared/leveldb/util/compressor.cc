@@ -0,0 +1,141 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/compressor.h"
+
+#include <assert.h>
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+Compressor::~Compressor() { }
+
+bool Compressor::SupportsDictionary() const {
+  return false;
+}
+
+bool Compressor::CompressWithDictionary(const Slice& dict, const Slice& input,
+                                        std::string* output) const {
+  return Compress(input, output);
+}
+
+bool Compressor::UncompressWithDictionary(const Slice& dict,
+                                          const Slice& input,
+                                          char* output) const {
+  return Uncompress(input, output);
+}
+
+namespace {
+class SnappyCompressor : public Compressor {
+ public:
+  virtual CompressionType type() const { return kSnappyCompression; }
+
+  virtual const char* Name() const { return "leveldb.Snappy"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    return port::Snappy_Compress(input.data(), input.size(), output);
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    return port::Snappy_GetUncompressedLength(input.data(), input.size(),
+                                              length);
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    return port::Snappy_Uncompress(input.data(), input.size(), output);
+  }
+};
+
+// zlib data does not record its uncompressed length, so the blocks
+// hold the varint32 length of the uncompressed data followed by the
+// zlib data.
+class ZlibCompressor : public Compressor {
+ public:
+  virtual CompressionType type() const { return kZlibCompression; }
+
+  virtual const char* Name() const { return "leveldb.Zlib"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    return CompressWithDictionary(Slice(), input, output);
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    uint32_t n;
+    if (GetVarint32Ptr(input.data(), input.data() + input.size(), &n) ==
+        NULL) {
+      return false;
+    }
+    *length = n;
+    return true;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    return UncompressWithDictionary(Slice(), input, output);
+  }
+
+  // zlib only looks back 32KB, so it uses at most the last 32KB of a
+  // dictionary.
+  virtual bool SupportsDictionary() const { return true; }
+
+  virtual bool CompressWithDictionary(const Slice& dict, const Slice& input,
+                                      std::string* output) const {
+    std::string compressed;
+    if (!port::Zlib_Compress(input.data(), input.size(),
+                             dict.data(), dict.size(), &compressed)) {
+      return false;
+    }
+    output->clear();
+    PutVarint32(output, input.size());
+    output->append(compressed);
+    return true;
+  }
+
+  virtual bool UncompressWithDictionary(const Slice& dict, const Slice& input,
+                                        char* output) const {
+    const char* limit = input.data() + input.size();
+    uint32_t n;
+    const char* p = GetVarint32Ptr(input.data(), limit, &n);
+    return (p != NULL &&
+            port::Zlib_Uncompress(p, limit - p, dict.data(), dict.size(),
+                                  output, n));
+  }
+};
+}  // namespace
+
+// Compressors indexed by CompressionType.  Entries are stored and
+// loaded atomically so that block reads need no lock.
+static const int kNumCompressionTypes = 256;
+static port::OnceType once = LEVELDB_ONCE_INIT;
+static port::AtomicPointer* compressors;
+
+static void InitModule() {
+  compressors = new port::AtomicPointer[kNumCompressionTypes];
+  for (int i = 0; i < kNumCompressionTypes; i++) {
+    compressors[i].NoBarrier_Store(NULL);
+  }
+  compressors[kSnappyCompression].NoBarrier_Store(new SnappyCompressor);
+  compressors[kZlibCompression].NoBarrier_Store(new ZlibCompressor);
+}
+
+void RegisterCompressor(const Compressor* compressor) {
+  const int type = compressor->type();
+  assert(type != kNoCompression);
+  assert(type >= 0 && type < kNumCompressionTypes);
+  port::InitOnce(&once, InitModule);
+  compressors[type].Release_Store(const_cast<Compressor*>(compressor));
+}
+
+const Compressor* GetCompressor(CompressionType type) {
+  if (type <= kNoCompression || type >= kNumCompressionTypes) {
+    return NULL;
+  }
+  port::InitOnce(&once, InitModule);
+  return reinterpret_cast<const Compressor*>(compressors[type].Acquire_Load());
+}
+
+}  // namespace leveldb
@@ -9,12 +9,39 @@ namespace leveldb {
 Env::~Env() {
 }
 
+Status Env::ReuseWritableFile(const std::string& fname,
+                              const std::string& old_fname,
+                              WritableFile** result) {
+  Status s = RenameFile(old_fname, fname);
+  if (!s.ok()) {
+    *result = NULL;
+    return s;
+  }
+  return NewWritableFile(fname, result);
+}
+
+void Env::ScheduleWithPriority(void (*function)(void*), void* arg,
+                               Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number, Priority pri) {
+}
+
 SequentialFile::~SequentialFile() {
 }
 
 RandomAccessFile::~RandomAccessFile() {
 }
 
+Status RandomAccessFile::Prefetch(uint64_t offset, size_t n) const {
+  return Status::NotSupported("Prefetch");
+}
+
+bool RandomAccessFile::ServesFromMemory() const {
+  return false;
+}
+
 WritableFile::~WritableFile() {
 }
 
@@ -35,6 +35,71 @@ static Status IOError(const std::string& context, int err_number) {
   return Status::IOError(context, strerror(err_number));
 }
 
+// Alignment of the buffers, file offsets and sizes of O_DIRECT reads and
+// writes: a multiple of the logical block size of common devices.
+static const size_t kDirectIOAlignment = 4096;
+
+// Roundup x to a multiple of y
+static uint64_t AlignUp(uint64_t x, uint64_t y) {
+  return ((x + y - 1) / y) * y;
+}
+
+static bool HasSuffix(const std::string& fname, const char* suffix) {
+  const size_t n = strlen(suffix);
+  return fname.size() >= n && fname.compare(fname.size() - n, n, suffix) == 0;
+}
+
+static bool IsTableFile(const std::string& fname) {
+  return HasSuffix(fname, ".sst");
+}
+
+static bool IsLogFile(const std::string& fname) {
+  return HasSuffix(fname, ".log");
+}
+
+// Open "fname" with "flags", adding O_DIRECT if *direct is true.  Clears
+// *direct if the file system does not support O_DIRECT, in which case
+// the file is opened without it.
+static int OpenMaybeDirect(const std::string& fname, int flags, bool* direct) {
+#if defined(O_DIRECT)
+  if (*direct) {
+    int fd = open(fname.c_str(), flags | O_DIRECT, 0644);
+    if (fd >= 0 || errno != EINVAL) {
+      return fd;
+    }
+  }
+#endif
+  *direct = false;
+  return open(fname.c_str(), flags, 0644);
+}
+
+static Status SyncDirIfManifest(const std::string& fname) {
+  const char* f = fname.c_str();
+  const char* sep = strrchr(f, '/');
+  Slice basename;
+  std::string dir;
+  if (sep == NULL) {
+    dir = ".";
+    basename = f;
+  } else {
+    dir = std::string(f, sep - f);
+    basename = sep + 1;
+  }
+  Status s;
+  if (basename.starts_with("MANIFEST")) {
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+      s = IOError(dir, errno);
+    } else {
+      if (fsync(fd) < 0) {
+        s = IOError(dir, errno);
+      }
+      close(fd);
+    }
+  }
+  return s;
+}
+
 class PosixSequentialFile: public SequentialFile {
  private:
   std::string filename_;
@@ -90,6 +155,71 @@ class PosixRandomAccessFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual Status Prefetch(uint64_t offset, size_t n) const {
+#if defined(POSIX_FADV_WILLNEED)
+    int r = posix_fadvise(fd_, static_cast<off_t>(offset),
+                          static_cast<off_t>(n), POSIX_FADV_WILLNEED);
+    if (r != 0) {
+      return IOError(filename_, r);
+    }
+    return Status::OK();
+#else
+    return RandomAccessFile::Prefetch(offset, n);
+#endif
+  }
+};
+
+// pread() based random-access of a file opened with O_DIRECT.  Reads go
+// around the page cache, through an aligned buffer that covers the
+// requested range widened to aligned offsets.
+class PosixDirectRandomAccessFile: public RandomAccessFile {
+ private:
+  std::string filename_;
+  int fd_;
+
+ public:
+  PosixDirectRandomAccessFile(const std::string& fname, int fd)
+      : filename_(fname), fd_(fd) { }
+  virtual ~PosixDirectRandomAccessFile() { close(fd_); }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    const uint64_t start = offset - offset % kDirectIOAlignment;
+    const size_t skip = offset - start;
+    const size_t size = AlignUp(skip + n, kDirectIOAlignment);
+    void* buf;
+    if (posix_memalign(&buf, kDirectIOAlignment, size) != 0) {
+      *result = Slice();
+      return Status::IOError(filename_, "cannot allocate read buffer");
+    }
+    char* aligned = reinterpret_cast<char*>(buf);
+    Status s;
+    size_t done = 0;
+    while (done < size) {
+      ssize_t r = pread(fd_, aligned + done, size - done,
+                        static_cast<off_t>(start + done));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        s = IOError(filename_, errno);
+        break;
+      }
+      done += r;
+      if (r == 0 || done % kDirectIOAlignment != 0) {
+        break;  // End of file
+      }
+    }
+    size_t available = 0;
+    if (s.ok() && done > skip) {
+      available = std::min(done - skip, n);
+      memcpy(scratch, aligned + skip, available);
+    }
+    *result = Slice(scratch, available);
+    free(buf);
+    return s;
+  }
 };
 
 // Helper class to limit mmap file usage so that we do not end up
@@ -173,6 +303,27 @@ class PosixMmapReadableFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual Status Prefetch(uint64_t offset, size_t n) const {
+    if (offset >= length_) {
+      return Status::OK();
+    }
+    if (n > length_ - offset) {
+      n = length_ - offset;
+    }
+    // madvise() needs a page-aligned start
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t start = offset - offset % page_size;
+    if (madvise(reinterpret_cast<char*>(mmapped_region_) + start,
+                n + (offset - start), MADV_WILLNEED) != 0) {
+      return IOError(filename_, errno);
+    }
+    return Status::OK();
+  }
+
+  virtual bool ServesFromMemory() const {
+    return true;
+  }
 };
 
 // We preallocate up to an extra megabyte and use memcpy to append new
@@ -319,36 +470,9 @@ class PosixMmapFile : public WritableFile {
     return Status::OK();
   }
 
-  Status SyncDirIfManifest() {
-    const char* f = filename_.c_str();
-    const char* sep = strrchr(f, '/');
-    Slice basename;
-    std::string dir;
-    if (sep == NULL) {
-      dir = ".";
-      basename = f;
-    } else {
-      dir = std::string(f, sep - f);
-      basename = sep + 1;
-    }
-    Status s;
-    if (basename.starts_with("MANIFEST")) {
-      int fd = open(dir.c_str(), O_RDONLY);
-      if (fd < 0) {
-        s = IOError(dir, errno);
-      } else {
-        if (fsync(fd) < 0) {
-          s = IOError(dir, errno);
-        }
-        close(fd);
-      }
-    }
-    return s;
-  }
-
   virtual Status Sync() {
     // Ensure new files referred to by the manifest are in the filesystem.
-    Status s = SyncDirIfManifest();
+    Status s = SyncDirIfManifest(filename_);
     if (!s.ok()) {
       return s;
     }
@@ -376,6 +500,167 @@ class PosixMmapFile : public WritableFile {
   }
 };
 
+// write() based file that does its own buffering.
+//
+// If "direct" is set, the file was opened with O_DIRECT, so data is
+// written from the aligned buffer in multiples of kDirectIOAlignment.
+// A partial chunk at the end is padded with zeros when it has to be
+// written, kept in the buffer and written again once more data follows
+// it, and the file is cut to its actual size by Close().
+//
+// If "preallocation" is non-zero, space is allocated for the file that
+// many bytes at a time ahead of the data.  The zeros past the data are
+// cut off by Close() unless "keep_size" is set; the log reading code
+// skips them if the file is not closed.
+class PosixWritableFile : public WritableFile {
+ private:
+  std::string filename_;
+  int fd_;
+  bool direct_;
+  size_t preallocation_;
+  bool keep_size_;
+  char* buf_;
+  size_t capacity_;
+  size_t pos_;            // Bytes of data in buf_
+  uint64_t buf_offset_;   // Offset of buf_[0] in the file
+  uint64_t allocated_;    // Space is allocated up to this offset
+
+  Status WriteAt(const char* data, size_t n, uint64_t offset) {
+    while (n > 0) {
+      ssize_t r = pwrite(fd_, data, n, static_cast<off_t>(offset));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return IOError(filename_, errno);
+      }
+      data += r;
+      n -= r;
+      offset += r;
+    }
+    return Status::OK();
+  }
+
+  void Preallocate(uint64_t end) {
+#if defined(OS_LINUX)
+    if (preallocation_ > 0 && end > allocated_) {
+      const uint64_t limit = AlignUp(end, preallocation_);
+      if (fallocate(fd_, 0, allocated_, limit - allocated_) == 0) {
+        allocated_ = limit;
+      } else {
+        // Not supported by the file system: grow the file as we write
+        preallocation_ = 0;
+      }
+    }
+#endif
+  }
+
+  Status WriteBuffer() {
+    if (pos_ == 0) {
+      return Status::OK();
+    }
+    size_t n = pos_;
+    size_t tail = 0;
+    if (direct_) {
+      n = AlignUp(pos_, kDirectIOAlignment);
+      tail = pos_ % kDirectIOAlignment;
+      memset(buf_ + pos_, 0, n - pos_);
+    }
+    Preallocate(buf_offset_ + n);
+    Status s = WriteAt(buf_, n, buf_offset_);
+    if (s.ok()) {
+      memmove(buf_, buf_ + pos_ - tail, tail);
+      buf_offset_ += pos_ - tail;
+      pos_ = tail;
+    }
+    return s;
+  }
+
+ public:
+  PosixWritableFile(const std::string& fname, int fd, bool direct,
+                    size_t preallocation, bool keep_size, uint64_t size)
+      : filename_(fname),
+        fd_(fd),
+        direct_(direct),
+        preallocation_(preallocation),
+        keep_size_(keep_size),
+        buf_(NULL),
+        capacity_(direct ? (1 << 20) : 65536),
+        pos_(0),
+        buf_offset_(0),
+        allocated_(size) {
+    void* buf = NULL;
+    if (posix_memalign(&buf, kDirectIOAlignment, capacity_) != 0) {
+      fprintf(stderr, "cannot allocate write buffer\n");
+      abort();
+    }
+    buf_ = reinterpret_cast<char*>(buf);
+  }
+
+  ~PosixWritableFile() {
+    if (fd_ >= 0) {
+      PosixWritableFile::Close();
+    }
+    free(buf_);
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* src = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      const size_t n = std::min(left, capacity_ - pos_);
+      memcpy(buf_ + pos_, src, n);
+      pos_ += n;
+      src += n;
+      left -= n;
+      if (pos_ == capacity_) {
+        Status s = WriteBuffer();
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  virtual Status Close() {
+    Status s = WriteBuffer();
+    const uint64_t size = buf_offset_ + pos_;
+    if (s.ok() && (direct_ || (!keep_size_ && allocated_ > size))) {
+      if (ftruncate(fd_, size) < 0) {
+        s = IOError(filename_, errno);
+      }
+    }
+    if (close(fd_) < 0) {
+      if (s.ok()) {
+        s = IOError(filename_, errno);
+      }
+    }
+    fd_ = -1;
+    return s;
+  }
+
+  virtual Status Flush() {
+    if (direct_) {
+      // Leave partial chunks in the buffer until Sync() or Close()
+      return Status::OK();
+    }
+    return WriteBuffer();
+  }
+
+  virtual Status Sync() {
+    // Ensure new files referred to by the manifest are in the filesystem.
+    Status s = SyncDirIfManifest(filename_);
+    if (s.ok()) {
+      s = WriteBuffer();
+    }
+    if (s.ok() && fdatasync(fd_) < 0) {
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+};
+
 static int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct flock f;
@@ -413,7 +698,7 @@ class PosixLockTable {
 
 class PosixEnv : public Env {
  public:
-  PosixEnv();
+  explicit PosixEnv(const PosixEnvOptions& options);
   virtual ~PosixEnv() {
     fprintf(stderr, "Destroying Env::Default()\n");
     abort();
@@ -435,10 +720,16 @@ class PosixEnv : public Env {
                                      RandomAccessFile** result) {
     *result = NULL;
     Status s;
-    int fd = open(fname.c_str(), O_RDONLY);
+    // Tables to be read with O_DIRECT are never mmapped, even if the file
+    // system does not support O_DIRECT.
+    const bool use_direct = options_.use_direct_reads && IsTableFile(fname);
+    bool direct = use_direct;
+    int fd = OpenMaybeDirect(fname, O_RDONLY, &direct);
     if (fd < 0) {
       s = IOError(fname, errno);
-    } else if (mmap_limit_.Acquire()) {
+    } else if (direct) {
+      *result = new PosixDirectRandomAccessFile(fname, fd);
+    } else if (!use_direct && mmap_limit_.Acquire()) {
       uint64_t size;
       s = GetFileSize(fname, &size);
       if (s.ok()) {
@@ -462,16 +753,50 @@ class PosixEnv : public Env {
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) {
     Status s;
-    const int fd = open(fname.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    bool direct = options_.use_direct_writes && IsTableFile(fname);
+    const size_t preallocation =
+        IsLogFile(fname) ? options_.log_preallocation_bytes : 0;
+    const int fd = OpenMaybeDirect(fname, O_CREAT | O_RDWR | O_TRUNC,
+                                   &direct);
     if (fd < 0) {
       *result = NULL;
       s = IOError(fname, errno);
+    } else if (direct || preallocation > 0) {
+      *result = new PosixWritableFile(fname, fd, direct, preallocation,
+                                      false, 0);
     } else {
       *result = new PosixMmapFile(fname, fd, page_size_);
     }
     return s;
   }
 
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result) {
+    *result = NULL;
+    if (rename(old_fname.c_str(), fname.c_str()) != 0) {
+      return IOError(old_fname, errno);
+    }
+    bool direct = options_.use_direct_writes && IsTableFile(fname);
+    const size_t preallocation =
+        IsLogFile(fname) ? options_.log_preallocation_bytes : 0;
+    const int fd = OpenMaybeDirect(fname, O_RDWR, &direct);
+    if (fd < 0) {
+      return IOError(fname, errno);
+    }
+    struct stat sbuf;
+    if (fstat(fd, &sbuf) != 0) {
+      Status s = IOError(fname, errno);
+      close(fd);
+      return s;
+    }
+    // Write over the old contents without truncating the file, so that
+    // its blocks stay allocated.
+    *result = new PosixWritableFile(fname, fd, direct, preallocation,
+                                    true, sbuf.st_size);
+    return Status::OK();
+  }
+
   virtual bool FileExists(const std::string& fname) {
     return access(fname.c_str(), F_OK) == 0;
   }
@@ -569,7 +894,14 @@ class PosixEnv : public Env {
     return result;
   }
 
-  virtual void Schedule(void (*function)(void*), void* arg);
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    ScheduleWithPriority(function, arg, kLowPriority);
+  }
+
+  virtual void ScheduleWithPriority(void (*function)(void*), void* arg,
+                                    Priority pri);
+
+  virtual void SetBackgroundThreads(int number, Priority pri);
 
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
@@ -623,70 +955,96 @@ class PosixEnv : public Env {
     }
   }
 
-  // BGThread() is the body of the background thread
-  void BGThread();
+  // Entry per Schedule() call
+  struct BGItem { void* arg; void (*function)(void*); };
+  typedef std::deque<BGItem> BGQueue;
+
+  // Threads and pending work for one Priority.  Protected by mu_.
+  struct BGPool {
+    pthread_cond_t signal;
+    int max_threads;      // Number of threads allowed to run work
+    int started_threads;  // Number of threads started so far
+    BGQueue queue;
+  };
+
+  // BGThread() is the body of a background thread in "pool"
+  void BGThread(BGPool* pool);
+  struct BGThreadArg { PosixEnv* env; BGPool* pool; };
   static void* BGThreadWrapper(void* arg) {
-    reinterpret_cast<PosixEnv*>(arg)->BGThread();
+    BGThreadArg* state = reinterpret_cast<BGThreadArg*>(arg);
+    PosixEnv* env = state->env;
+    BGPool* pool = state->pool;
+    delete state;
+    env->BGThread(pool);
     return NULL;
   }
 
+  const PosixEnvOptions options_;
   size_t page_size_;
   pthread_mutex_t mu_;
-  pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
-
-  // Entry per Schedule() call
-  struct BGItem { void* arg; void (*function)(void*); };
-  typedef std::deque<BGItem> BGQueue;
-  BGQueue queue_;
+  BGPool pools_[2];  // Indexed by Priority
 
   PosixLockTable locks_;
   MmapLimiter mmap_limit_;
 };
 
-PosixEnv::PosixEnv() : page_size_(getpagesize()),
-                       started_bgthread_(false) {
+PosixEnv::PosixEnv(const PosixEnvOptions& options)
+    : options_(options),
+      page_size_(getpagesize()) {
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
-  PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
+  for (int i = 0; i < 2; i++) {
+    PthreadCall("cvar_init", pthread_cond_init(&pools_[i].signal, NULL));
+    pools_[i].max_threads = 1;
+    pools_[i].started_threads = 0;
+  }
 }
 
-void PosixEnv::Schedule(void (*function)(void*), void* arg) {
+void PosixEnv::ScheduleWithPriority(void (*function)(void*), void* arg,
+                                    Priority pri) {
+  BGPool* pool = &pools_[pri];
   PthreadCall("lock", pthread_mutex_lock(&mu_));
 
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
+  // Start background threads if necessary
+  while (pool->started_threads < pool->max_threads) {
+    pool->started_threads++;
+    BGThreadArg* state = new BGThreadArg;
+    state->env = this;
+    state->pool = pool;
+    pthread_t t;
     PthreadCall(
         "create thread",
-        pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
+        pthread_create(&t, NULL,  &PosixEnv::BGThreadWrapper, state));
   }
 
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
-  }
+  // Add to priority queue and wake up one idle thread, if any.
+  pool->queue.push_back(BGItem());
+  pool->queue.back().function = function;
+  pool->queue.back().arg = arg;
+  PthreadCall("signal", pthread_cond_signal(&pool->signal));
 
-  // Add to priority queue
-  queue_.push_back(BGItem());
-  queue_.back().function = function;
-  queue_.back().arg = arg;
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+}
 
+void PosixEnv::SetBackgroundThreads(int number, Priority pri) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  if (number > pools_[pri].max_threads) {
+    // Extra threads are started by the next ScheduleWithPriority() call
+    pools_[pri].max_threads = number;
+  }
   PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 }
 
-void PosixEnv::BGThread() {
+void PosixEnv::BGThread(BGPool* pool) {
   while (true) {
     // Wait until there is an item that is ready to run
     PthreadCall("lock", pthread_mutex_lock(&mu_));
-    while (queue_.empty()) {
-      PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
+    while (pool->queue.empty()) {
+      PthreadCall("wait", pthread_cond_wait(&pool->signal, &mu_));
     }
 
-    void (*function)(void*) = queue_.front().function;
-    void* arg = queue_.front().arg;
-    queue_.pop_front();
+    void (*function)(void*) = pool->queue.front().function;
+    void* arg = pool->queue.front().arg;
+    pool->queue.pop_front();
 
     PthreadCall("unlock", pthread_mutex_unlock(&mu_));
     (*function)(arg);
@@ -717,9 +1075,19 @@ void PosixEnv::StartThread(void (*function)(void* arg), void* arg) {
 
 }  // namespace
 
+PosixEnvOptions::PosixEnvOptions()
+    : use_direct_writes(false),
+      use_direct_reads(false),
+      log_preallocation_bytes(0) {
+}
+
+Env* NewPosixEnv(const PosixEnvOptions& options) {
+  return new PosixEnv(options);
+}
+
 static pthread_once_t once = PTHREAD_ONCE_INIT;
 static Env* default_env;
-static void InitDefaultEnv() { default_env = new PosixEnv; }
+static void InitDefaultEnv() { default_env = new PosixEnv(PosixEnvOptions()); }
 
 Env* Env::Default() {
   pthread_once(&once, InitDefaultEnv);
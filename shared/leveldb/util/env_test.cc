@@ -5,7 +5,9 @@
 #include "leveldb/env.h"
 
 #include "port/port.h"
+#include "util/random.h"
 #include "util/testharness.h"
+#include "util/testutil.h"
 
 namespace leveldb {
 
@@ -64,6 +66,25 @@ TEST(EnvPosixTest, RunMany) {
   ASSERT_EQ(4, reinterpret_cast<uintptr_t>(cur));
 }
 
+TEST(EnvPosixTest, HighPriorityDoesNotWaitForLowPriority) {
+  port::AtomicPointer high_done(NULL);
+
+  struct LowPriorityJob {
+    static void Run(void* v) {
+      // Occupy the low priority thread until the high priority job ran
+      port::AtomicPointer* done = reinterpret_cast<port::AtomicPointer*>(v);
+      for (int i = 0; i < 100 && done->Acquire_Load() == NULL; i++) {
+        Env::Default()->SleepForMicroseconds(kDelayMicros / 10);
+      }
+    }
+  };
+
+  env_->Schedule(&LowPriorityJob::Run, &high_done);
+  env_->ScheduleWithPriority(&SetBool, &high_done, Env::kHighPriority);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(high_done.Acquire_Load() != NULL);
+}
+
 struct State {
   port::Mutex mu;
   int val;
@@ -97,6 +118,130 @@ TEST(EnvPosixTest, StartThread) {
   ASSERT_EQ(state.val, 3);
 }
 
+// Env that uses O_DIRECT and preallocates logs.  Like Env::Default(),
+// it is never deleted.
+static Env* DirectEnv() {
+  static Env* env = NULL;
+  if (env == NULL) {
+    PosixEnvOptions options;
+    options.use_direct_writes = true;
+    options.use_direct_reads = true;
+    options.log_preallocation_bytes = 1 << 20;
+    env = NewPosixEnv(options);
+  }
+  return env;
+}
+
+// Write "contents" to "file" in pieces of varying sizes, flushing after
+// each and syncing now and then.
+static void WriteInPieces(WritableFile* file, const std::string& contents) {
+  size_t pos = 0;
+  for (int i = 0; pos < contents.size(); i++) {
+    const size_t n = std::min<size_t>((i * 7919) % 20000 + 1,
+                                      contents.size() - pos);
+    ASSERT_OK(file->Append(Slice(contents.data() + pos, n)));
+    ASSERT_OK(file->Flush());
+    if (i % 50 == 0) {
+      ASSERT_OK(file->Sync());
+    }
+    pos += n;
+  }
+}
+
+TEST(EnvPosixTest, DirectTableFile) {
+  Env* env = DirectEnv();
+  std::string fname;
+  ASSERT_OK(env->GetTestDirectory(&fname));
+  fname += "/direct_test.sst";
+
+  Random rnd(301);
+  std::string contents;
+  test::RandomString(&rnd, 3 * (1 << 20) + 12345, &contents);
+  WritableFile* wfile;
+  ASSERT_OK(env->NewWritableFile(fname, &wfile));
+  WriteInPieces(wfile, contents);
+  ASSERT_OK(wfile->Close());
+  delete wfile;
+
+  uint64_t size;
+  ASSERT_OK(env->GetFileSize(fname, &size));
+  ASSERT_EQ(contents.size(), size);
+  std::string data;
+  ASSERT_OK(ReadFileToString(env, fname, &data));
+  ASSERT_TRUE(data == contents);
+
+  RandomAccessFile* rfile;
+  ASSERT_OK(env->NewRandomAccessFile(fname, &rfile));
+  std::string scratch(10000, '\0');
+  for (int i = 0; i < 1000; i++) {
+    const uint64_t offset = rnd.Uniform(contents.size());
+    const size_t n = rnd.Uniform(scratch.size());
+    Slice result;
+    ASSERT_OK(rfile->Read(offset, n, &result, &scratch[0]));
+    ASSERT_EQ(contents.substr(offset, n), result.ToString());
+  }
+  delete rfile;
+  ASSERT_OK(env->DeleteFile(fname));
+}
+
+TEST(EnvPosixTest, PreallocatedLogFile) {
+  Env* env = DirectEnv();
+  std::string fname;
+  ASSERT_OK(env->GetTestDirectory(&fname));
+  fname += "/prealloc_test.log";
+
+  Random rnd(301);
+  std::string contents;
+  test::RandomString(&rnd, 100000, &contents);
+  WritableFile* wfile;
+  ASSERT_OK(env->NewWritableFile(fname, &wfile));
+  WriteInPieces(wfile, contents);
+  uint64_t size;
+  ASSERT_OK(env->GetFileSize(fname, &size));
+  ASSERT_GE(size, contents.size());
+  ASSERT_OK(wfile->Close());
+  delete wfile;
+
+  // The space allocated past the data is given back
+  ASSERT_OK(env->GetFileSize(fname, &size));
+  ASSERT_EQ(contents.size(), size);
+  std::string data;
+  ASSERT_OK(ReadFileToString(env, fname, &data));
+  ASSERT_TRUE(data == contents);
+  ASSERT_OK(env->DeleteFile(fname));
+}
+
+TEST(EnvPosixTest, ReuseWritableFile) {
+  Env* envs[] = { Env::Default(), DirectEnv() };
+  for (int i = 0; i < 2; i++) {
+    Env* env = envs[i];
+    std::string dir;
+    ASSERT_OK(env->GetTestDirectory(&dir));
+    const std::string old_fname = dir + "/reuse_test_old.log";
+    const std::string fname = dir + "/reuse_test_new.log";
+
+    WritableFile* file;
+    ASSERT_OK(env->NewWritableFile(old_fname, &file));
+    ASSERT_OK(file->Append(std::string(200000, 'a')));
+    ASSERT_OK(file->Close());
+    delete file;
+
+    ASSERT_OK(env->ReuseWritableFile(fname, old_fname, &file));
+    ASSERT_OK(file->Append("hello"));
+    ASSERT_OK(file->Sync());
+    ASSERT_OK(file->Close());
+    delete file;
+
+    // The new contents are written over the old ones, which remain
+    ASSERT_TRUE(!env->FileExists(old_fname));
+    std::string data;
+    ASSERT_OK(ReadFileToString(env, fname, &data));
+    ASSERT_EQ(200000, data.size());
+    ASSERT_EQ("hello" + std::string(200000 - 5, 'a'), data);
+    ASSERT_OK(env->DeleteFile(fname));
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
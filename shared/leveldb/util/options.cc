@@ -11,18 +11,43 @@ namespace leveldb {
 
 Options::Options()
     : comparator(BytewiseComparator()),
+      merge_operator(NULL),
+      compaction_filter(NULL),
       create_if_missing(false),
       error_if_exists(false),
       paranoid_checks(false),
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      memtable_factory(NULL),
+      recycle_log_file_num(0),
       max_open_files(1000),
+      compaction_style(kCompactionStyleLevel),
+      universal_size_ratio(1),
+      universal_min_merge_width(2),
+      universal_max_merge_width(0),
+      universal_max_size_amplification_percent(200),
+      periodic_compaction_seconds(0),
+      max_background_compactions(1),
+      max_subcompactions(1),
+      enable_pipelined_write(false),
+      allow_concurrent_memtable_write(false),
+      level0_slowdown_writes_trigger(8),
+      level0_stop_writes_trigger(12),
+      soft_pending_compaction_bytes_limit(64 << 20),
+      hard_pending_compaction_bytes_limit(256 << 20),
+      delayed_write_rate(16 << 20),
+      rate_limiter(NULL),
       block_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
+      data_block_hash_index(false),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      compression_dict_bytes(0),
+      filter_policy(NULL),
+      filter_type(kBlockFilter),
+      filter_partition_keys(4096),
+      prefix_extractor(NULL) {
 }
 
 
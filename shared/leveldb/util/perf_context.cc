@@ -0,0 +1,65 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+__thread PerfLevel perf_level = kPerfEnableCount;
+__thread PerfContext perf_context;
+
+void SetPerfLevel(PerfLevel level) {
+  perf_level = level;
+}
+
+PerfLevel GetPerfLevel() {
+  return perf_level;
+}
+
+PerfContext* GetPerfContext() {
+  return &perf_context;
+}
+
+void PerfContext::Reset() {
+  memset(this, 0, sizeof(*this));
+}
+
+static void AppendCounter(std::string* result, const char* name,
+                          uint64_t value) {
+  if (value != 0) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%s%s = %llu",
+             result->empty() ? "" : ", ", name,
+             static_cast<unsigned long long>(value));
+    result->append(buf);
+  }
+}
+
+std::string PerfContext::ToString() const {
+  std::string result;
+  AppendCounter(&result, "block_cache_hit_count", block_cache_hit_count);
+  AppendCounter(&result, "block_cache_miss_count", block_cache_miss_count);
+  AppendCounter(&result, "block_read_count", block_read_count);
+  AppendCounter(&result, "block_read_byte", block_read_byte);
+  AppendCounter(&result, "block_read_time", block_read_time);
+  AppendCounter(&result, "bloom_useful_count", bloom_useful_count);
+  AppendCounter(&result, "bloom_useless_count", bloom_useless_count);
+  AppendCounter(&result, "get_from_memtable_count", get_from_memtable_count);
+  for (int level = 0; level < kPerfContextNumLevels; level++) {
+    char name[50];
+    snprintf(name, sizeof(name), "get_from_level_count[%d]", level);
+    AppendCounter(&result, name, get_from_level_count[level]);
+  }
+  AppendCounter(&result, "db_mutex_wait_time", db_mutex_wait_time);
+  AppendCounter(&result, "wal_write_time", wal_write_time);
+  AppendCounter(&result, "wal_sync_time", wal_sync_time);
+  AppendCounter(&result, "write_stall_time", write_stall_time);
+  return result;
+}
+
+}  // namespace leveldb
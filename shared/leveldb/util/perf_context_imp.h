@@ -0,0 +1,58 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers to update the calling thread's PerfContext.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+
+namespace leveldb {
+
+// The thread-local state behind SetPerfLevel() and GetPerfContext(),
+// exposed so that updates are inlined.
+extern __thread PerfLevel perf_level;
+extern __thread PerfContext perf_context;
+
+#define PERF_COUNTER_ADD(metric, value)             \
+  do {                                              \
+    if (perf_level >= kPerfEnableCount) {           \
+      perf_context.metric += (value);               \
+    }                                               \
+  } while (0)
+
+// Adds the time between its construction and Stop() (or its
+// destruction) to *metric if the perf level is kPerfEnableTime.
+class PerfTimer {
+ public:
+  PerfTimer(Env* env, uint64_t* metric)
+      : env_(perf_level >= kPerfEnableTime ? env : NULL),
+        metric_(metric),
+        start_(env_ != NULL ? env_->NowMicros() : 0) {
+  }
+
+  ~PerfTimer() { Stop(); }
+
+  void Stop() {
+    if (env_ != NULL) {
+      *metric_ += env_->NowMicros() - start_;
+      env_ = NULL;
+    }
+  }
+
+ private:
+  Env* env_;
+  uint64_t* const metric_;
+  const uint64_t start_;
+
+  // No copying allowed
+  PerfTimer(const PerfTimer&);
+  void operator=(const PerfTimer&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
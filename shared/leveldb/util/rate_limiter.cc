@@ -0,0 +1,238 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <algorithm>
+#include <deque>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() { }
+
+namespace {
+
+// Tokens are refilled this often
+static const uint64_t kRefillPeriodMicros = 100 * 1000;
+
+// Every kFairness-th refill serves kLowPriority requests first
+static const int kFairness = 10;
+
+class TokenBucketRateLimiter : public RateLimiter {
+ public:
+  TokenBucketRateLimiter(uint64_t bytes_per_second, Env* env)
+      : env_(env),
+        bytes_per_second_(bytes_per_second),
+        refill_bytes_(std::max<uint64_t>(
+            1, bytes_per_second * kRefillPeriodMicros / 1000000)),
+        cv_(&mu_),
+        available_(refill_bytes_),
+        next_refill_micros_(env->NowMicros() + kRefillPeriodMicros),
+        refilling_(false),
+        refills_(0) {
+  }
+
+  virtual void Request(size_t bytes, Env::Priority priority) {
+    MutexLock l(&mu_);
+    // Requests for more than a refill are granted a refill at a time.
+    while (bytes > 0) {
+      const size_t n = std::min<uint64_t>(bytes, refill_bytes_);
+      Acquire(n, priority);
+      bytes -= n;
+    }
+  }
+
+  virtual uint64_t GetBytesPerSecond() const {
+    return bytes_per_second_;
+  }
+
+ private:
+  struct Waiter {
+    uint64_t bytes;
+    bool granted;
+  };
+
+  // REQUIRES: mu_ is held
+  void Acquire(uint64_t bytes, Env::Priority priority) {
+    if (waiters_[Env::kHighPriority].empty() &&
+        waiters_[Env::kLowPriority].empty() &&
+        available_ >= bytes) {
+      available_ -= bytes;
+      return;
+    }
+
+    Waiter w;
+    w.bytes = bytes;
+    w.granted = false;
+    waiters_[priority].push_back(&w);
+    while (!w.granted) {
+      if (refilling_) {
+        cv_.Wait();
+        continue;
+      }
+      // Sleep until the next refill without holding mu_, so that other
+      // requests can queue up meanwhile, then grant what it allows.
+      refilling_ = true;
+      const uint64_t now = env_->NowMicros();
+      if (now < next_refill_micros_) {
+        mu_.Unlock();
+        env_->SleepForMicroseconds(
+            static_cast<int>(next_refill_micros_ - now));
+        mu_.Lock();
+      }
+      Refill();
+      refilling_ = false;
+      cv_.SignalAll();
+    }
+  }
+
+  // REQUIRES: mu_ is held
+  void Refill() {
+    next_refill_micros_ = env_->NowMicros() + kRefillPeriodMicros;
+    available_ = refill_bytes_;
+    refills_++;
+    const bool low_first = (refills_ % kFairness == 0);
+    const Env::Priority order[2] = {
+      low_first ? Env::kLowPriority : Env::kHighPriority,
+      low_first ? Env::kHighPriority : Env::kLowPriority
+    };
+    for (int i = 0; i < 2; i++) {
+      std::deque<Waiter*>* queue = &waiters_[order[i]];
+      while (!queue->empty() && queue->front()->bytes <= available_) {
+        available_ -= queue->front()->bytes;
+        queue->front()->granted = true;
+        queue->pop_front();
+      }
+      if (!queue->empty()) {
+        // Requests queued behind this one wait for the next refill.
+        break;
+      }
+    }
+  }
+
+  Env* const env_;
+  const uint64_t bytes_per_second_;
+  const uint64_t refill_bytes_;
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  uint64_t available_;
+  uint64_t next_refill_micros_;
+  bool refilling_;            // Some waiter is sleeping until the refill
+  uint64_t refills_;
+  std::deque<Waiter*> waiters_[2];  // Indexed by Env::Priority
+};
+
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* file, RateLimiter* limiter,
+                          Env::Priority priority)
+      : file_(file), limiter_(limiter), priority_(priority) {
+  }
+
+  virtual ~RateLimitedWritableFile() {
+    delete file_;
+  }
+
+  virtual Status Append(const Slice& data) {
+    limiter_->Request(data.size(), priority_);
+    return file_->Append(data);
+  }
+
+  virtual Status Close() { return file_->Close(); }
+  virtual Status Flush() { return file_->Flush(); }
+  virtual Status Sync() { return file_->Sync(); }
+
+ private:
+  WritableFile* const file_;
+  RateLimiter* const limiter_;
+  const Env::Priority priority_;
+};
+
+class RateLimitedRandomAccessFile : public RandomAccessFile {
+ public:
+  RateLimitedRandomAccessFile(RandomAccessFile* file, RateLimiter* limiter,
+                              Env::Priority priority)
+      : file_(file), limiter_(limiter), priority_(priority) {
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    limiter_->Request(n, priority_);
+    return file_->Read(offset, n, result, scratch);
+  }
+
+  virtual Status Prefetch(uint64_t offset, size_t n) const {
+    return file_->Prefetch(offset, n);
+  }
+
+  virtual bool ServesFromMemory() const {
+    return file_->ServesFromMemory();
+  }
+
+ private:
+  RandomAccessFile* const file_;
+  RateLimiter* const limiter_;
+  const Env::Priority priority_;
+};
+
+}  // namespace
+
+RateLimiter* NewRateLimiter(uint64_t bytes_per_second) {
+  return new TokenBucketRateLimiter(bytes_per_second, Env::Default());
+}
+
+CountingRateLimiter::CountingRateLimiter(RateLimiter* target, Env* env)
+    : target_(target),
+      env_(env) {
+  for (int i = 0; i < 2; i++) {
+    bytes_[i] = 0;
+    wait_micros_[i] = 0;
+  }
+}
+
+CountingRateLimiter::~CountingRateLimiter() { }
+
+void CountingRateLimiter::Request(size_t bytes, Env::Priority priority) {
+  uint64_t waited = 0;
+  if (target_ != NULL) {
+    const uint64_t start = env_->NowMicros();
+    target_->Request(bytes, priority);
+    waited = env_->NowMicros() - start;
+  }
+  MutexLock l(&mu_);
+  bytes_[priority] += bytes;
+  wait_micros_[priority] += waited;
+}
+
+uint64_t CountingRateLimiter::GetBytesPerSecond() const {
+  return (target_ != NULL) ? target_->GetBytesPerSecond() : 0;
+}
+
+uint64_t CountingRateLimiter::Bytes(Env::Priority priority) const {
+  MutexLock l(&mu_);
+  return bytes_[priority];
+}
+
+uint64_t CountingRateLimiter::WaitMicros(Env::Priority priority) const {
+  MutexLock l(&mu_);
+  return wait_micros_[priority];
+}
+
+WritableFile* NewRateLimitedWritableFile(WritableFile* file,
+                                         RateLimiter* limiter,
+                                         Env::Priority priority) {
+  return new RateLimitedWritableFile(file, limiter, priority);
+}
+
+RandomAccessFile* NewRateLimitedRandomAccessFile(RandomAccessFile* file,
+                                                 RateLimiter* limiter,
+                                                 Env::Priority priority) {
+  return new RateLimitedRandomAccessFile(file, limiter, priority);
+}
+
+}  // namespace leveldb
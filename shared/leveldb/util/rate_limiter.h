@@ -0,0 +1,53 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+
+#include <stdint.h>
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+// A RateLimiter that passes requests on to another limiter, which may
+// be shared with other databases, and records the bytes requested and
+// the time spent waiting for them at each priority.
+class CountingRateLimiter : public RateLimiter {
+ public:
+  // "target" may be NULL, in which case requests do not wait.
+  CountingRateLimiter(RateLimiter* target, Env* env);
+  virtual ~CountingRateLimiter();
+
+  virtual void Request(size_t bytes, Env::Priority priority);
+  virtual uint64_t GetBytesPerSecond() const;
+
+  uint64_t Bytes(Env::Priority priority) const;
+  uint64_t WaitMicros(Env::Priority priority) const;
+
+ private:
+  RateLimiter* const target_;
+  Env* const env_;
+  mutable port::Mutex mu_;
+  uint64_t bytes_[2];
+  uint64_t wait_micros_[2];
+};
+
+// Return a file that requests the bytes of each Append() from "limiter"
+// at "priority" before appending them to "file".  The result owns
+// "file".
+extern WritableFile* NewRateLimitedWritableFile(WritableFile* file,
+                                                RateLimiter* limiter,
+                                                Env::Priority priority);
+
+// Return a file that requests the bytes of each Read() from "limiter"
+// at "priority" before reading them from "file".  The result does not
+// own "file", which must outlive it.
+extern RandomAccessFile* NewRateLimitedRandomAccessFile(
+    RandomAccessFile* file, RateLimiter* limiter, Env::Priority priority);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
@@ -0,0 +1,111 @@
+// Copyright (c) 2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static const uint64_t kBytesPerSecond = 1 << 20;
+
+class RateLimiterTest {
+ public:
+  Env* env_;
+  RateLimiter* limiter_;
+
+  RateLimiterTest()
+      : env_(Env::Default()),
+        limiter_(NewRateLimiter(kBytesPerSecond)) {
+  }
+
+  ~RateLimiterTest() {
+    delete limiter_;
+  }
+
+  // Return the micros that requests for "n" pieces of "bytes" took.
+  uint64_t TimeRequests(int n, size_t bytes) {
+    const uint64_t start = env_->NowMicros();
+    for (int i = 0; i < n; i++) {
+      limiter_->Request(bytes, Env::kLowPriority);
+    }
+    return env_->NowMicros() - start;
+  }
+};
+
+TEST(RateLimiterTest, BytesPerSecond) {
+  ASSERT_EQ(kBytesPerSecond, limiter_->GetBytesPerSecond());
+}
+
+TEST(RateLimiterTest, LimitsRate) {
+  // A tenth of a second of bytes is available up front, and each
+  // further tenth needs a refill.
+  const uint64_t micros = TimeRequests(25, 16 << 10);
+  ASSERT_GE(micros, 250000);
+  ASSERT_LT(micros, 5000000);
+}
+
+TEST(RateLimiterTest, LargeRequest) {
+  // Requests for more than a refill are granted in pieces.
+  const uint64_t micros = TimeRequests(1, 400 << 10);
+  ASSERT_GE(micros, 250000);
+  ASSERT_LT(micros, 5000000);
+}
+
+namespace {
+struct LowPriorityState {
+  RateLimiter* limiter;
+  port::AtomicPointer done;
+};
+
+static void RequestLowPriority(void* arg) {
+  LowPriorityState* state = reinterpret_cast<LowPriorityState*>(arg);
+  for (int i = 0; i < 20; i++) {
+    state->limiter->Request(50 << 10, Env::kLowPriority);
+  }
+  state->done.Release_Store(state);
+}
+}  // namespace
+
+TEST(RateLimiterTest, HighPriorityFirst) {
+  LowPriorityState state;
+  state.limiter = limiter_;
+  state.done.Release_Store(NULL);
+  env_->StartThread(&RequestLowPriority, &state);
+
+  // The low priority requests take a second.  High priority requests
+  // that queue up behind them are granted first.
+  env_->SleepForMicroseconds(150000);
+  for (int i = 0; i < 4; i++) {
+    limiter_->Request(50 << 10, Env::kHighPriority);
+  }
+  ASSERT_TRUE(state.done.Acquire_Load() == NULL);
+
+  while (state.done.Acquire_Load() == NULL) {
+    env_->SleepForMicroseconds(10000);
+  }
+}
+
+TEST(RateLimiterTest, Counting) {
+  CountingRateLimiter counter(limiter_, env_);
+  ASSERT_EQ(kBytesPerSecond, counter.GetBytesPerSecond());
+  counter.Request(1000, Env::kHighPriority);
+  counter.Request(2000, Env::kLowPriority);
+  counter.Request(3000, Env::kLowPriority);
+  ASSERT_EQ(1000, counter.Bytes(Env::kHighPriority));
+  ASSERT_EQ(5000, counter.Bytes(Env::kLowPriority));
+
+  // Requests past the available bytes wait for a refill.
+  counter.Request(200 << 10, Env::kLowPriority);
+  ASSERT_LT(counter.WaitMicros(Env::kHighPriority), 50000);
+  ASSERT_GE(counter.WaitMicros(Env::kLowPriority), 50000);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
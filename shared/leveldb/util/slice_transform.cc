@@ -0,0 +1,48 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/slice_transform.h"
+
+#include <stdio.h>
+#include <string>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+SliceTransform::~SliceTransform() { }
+
+namespace {
+class FixedPrefixTransform : public SliceTransform {
+ private:
+  size_t prefix_len_;
+  std::string name_;
+
+ public:
+  explicit FixedPrefixTransform(size_t prefix_len)
+      : prefix_len_(prefix_len) {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "leveldb.FixedPrefix.%llu",
+             static_cast<unsigned long long>(prefix_len));
+    name_ = buf;
+  }
+
+  virtual const char* Name() const {
+    return name_.c_str();
+  }
+
+  virtual Slice Transform(const Slice& key) const {
+    return Slice(key.data(), prefix_len_);
+  }
+
+  virtual bool InDomain(const Slice& key) const {
+    return key.size() >= prefix_len_;
+  }
+};
+}
+
+const SliceTransform* NewFixedPrefixTransform(size_t prefix_len) {
+  return new FixedPrefixTransform(prefix_len);
+}
+
+}  // namespace leveldb